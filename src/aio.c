@@ -0,0 +1,519 @@
+#define _GNU_SOURCE
+#include <avro.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(HAVE_LIBURING)
+#include <liburing.h>
+#endif
+
+#include "aio.h"
+
+#define AIO_MAX_THREADS 4
+
+enum slot_state { SLOT_IDLE, SLOT_PENDING, SLOT_DONE };
+
+// A chunk being read or written
+typedef struct {
+  char *data;
+  int64_t offset; // file offset, or -1 to write at the current file position
+  size_t length;
+  ssize_t result; // bytes transferred, or -errno
+  enum slot_state state;
+  int write;
+} aio_slot_t;
+
+typedef struct {
+  int fd;
+  aio_slot_t *slots;
+  size_t depth;
+#if defined(HAVE_LIBURING)
+  int uring;
+  struct io_uring ring;
+#endif
+  // Fallback to I/O threads doing blocking I/O
+  pthread_t threads[AIO_MAX_THREADS];
+  size_t threads_count;
+  pthread_mutex_t lock;
+  pthread_cond_t submitted;
+  pthread_cond_t completed;
+  aio_slot_t **queue; // submitted slots, in order of submission
+  size_t queue_head;
+  size_t queue_size;
+  int stopping;
+} aio_engine_t;
+
+// Transfers the whole slot using blocking I/O. Reads are short only at the
+// end of file.
+static ssize_t transfer(int fd, const aio_slot_t *slot) {
+  size_t done = 0;
+  while (done < slot->length) {
+    ssize_t n;
+    if (!slot->write) {
+      n = pread(fd, slot->data + done, slot->length - done, slot->offset + done);
+    } else if (slot->offset >= 0) {
+      n = pwrite(fd, slot->data + done, slot->length - done, slot->offset + done);
+    } else {
+      n = write(fd, slot->data + done, slot->length - done);
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+    if (n == 0) {
+      break;
+    }
+    done += (size_t)n;
+  }
+  return (ssize_t)done;
+}
+
+static void *io_thread(void *arg) {
+  aio_engine_t *engine = (aio_engine_t *)arg;
+  pthread_mutex_lock(&engine->lock);
+  for (;;) {
+    while (engine->queue_size == 0 && !engine->stopping) {
+      pthread_cond_wait(&engine->submitted, &engine->lock);
+    }
+    if (engine->queue_size == 0) {
+      break;
+    }
+    aio_slot_t *slot = engine->queue[engine->queue_head];
+    engine->queue_head = (engine->queue_head + 1) % engine->depth;
+    engine->queue_size--;
+
+    pthread_mutex_unlock(&engine->lock);
+    ssize_t result = transfer(engine->fd, slot);
+    pthread_mutex_lock(&engine->lock);
+
+    slot->result = result;
+    slot->state = SLOT_DONE;
+    pthread_cond_broadcast(&engine->completed);
+  }
+  pthread_mutex_unlock(&engine->lock);
+  return NULL;
+}
+
+#if defined(HAVE_LIBURING)
+// Sets up io_uring, if the kernel supports it along with read/write opcodes
+static int uring_init(aio_engine_t *engine) {
+  if (io_uring_queue_init((unsigned)engine->depth, &engine->ring, 0) < 0) {
+    return 0;
+  }
+  struct io_uring_probe *probe = io_uring_get_probe_ring(&engine->ring);
+  int supported = probe != NULL && io_uring_opcode_supported(probe, IORING_OP_READ) &&
+                  io_uring_opcode_supported(probe, IORING_OP_WRITE);
+  if (probe != NULL) {
+    io_uring_free_probe(probe);
+  }
+  if (!supported) {
+    io_uring_queue_exit(&engine->ring);
+  }
+  return supported;
+}
+#endif
+
+static void engine_free(aio_engine_t *engine);
+
+// Writes that must complete in order (e.g. to a pipe) use a single thread
+static int engine_init(aio_engine_t *engine, int fd, size_t depth, int ordered) {
+  memset(engine, 0, sizeof(aio_engine_t));
+  engine->fd = fd;
+  engine->depth = depth;
+  engine->slots = (aio_slot_t *)calloc(depth, sizeof(aio_slot_t));
+  if (engine->slots == NULL) {
+    return ENOMEM;
+  }
+  for (size_t i = 0; i < depth; ++i) {
+    if ((engine->slots[i].data = (char *)malloc(AIO_CHUNK_SIZE)) == NULL) {
+      engine_free(engine);
+      return ENOMEM;
+    }
+  }
+
+#if defined(HAVE_LIBURING)
+  if (!ordered && uring_init(engine)) {
+    engine->uring = 1;
+    return 0;
+  }
+#endif
+
+  engine->queue = (aio_slot_t **)calloc(depth, sizeof(aio_slot_t *));
+  if (engine->queue == NULL) {
+    engine_free(engine);
+    return ENOMEM;
+  }
+  pthread_mutex_init(&engine->lock, NULL);
+  pthread_cond_init(&engine->submitted, NULL);
+  pthread_cond_init(&engine->completed, NULL);
+  size_t threads = ordered ? 1 : depth < AIO_MAX_THREADS ? depth : AIO_MAX_THREADS;
+  for (size_t i = 0; i < threads; ++i) {
+    int rval = pthread_create(&engine->threads[i], NULL, io_thread, engine);
+    if (rval != 0) {
+      engine_free(engine);
+      return rval;
+    }
+    engine->threads_count++;
+  }
+  return 0;
+}
+
+static void engine_submit(aio_engine_t *engine, aio_slot_t *slot) {
+  slot->state = SLOT_PENDING;
+#if defined(HAVE_LIBURING)
+  if (engine->uring) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&engine->ring);
+    if (sqe != NULL) {
+      if (slot->write) {
+        io_uring_prep_write(sqe, engine->fd, slot->data, (unsigned)slot->length, slot->offset);
+      } else {
+        io_uring_prep_read(sqe, engine->fd, slot->data, (unsigned)slot->length, slot->offset);
+      }
+      io_uring_sqe_set_data(sqe, slot);
+      if (io_uring_submit(&engine->ring) >= 0) {
+        return;
+      }
+    }
+    // Submission queue is unusable, transfer synchronously
+    slot->result = transfer(engine->fd, slot);
+    slot->state = SLOT_DONE;
+    return;
+  }
+#endif
+  pthread_mutex_lock(&engine->lock);
+  engine->queue[(engine->queue_head + engine->queue_size) % engine->depth] = slot;
+  engine->queue_size++;
+  pthread_cond_signal(&engine->submitted);
+  pthread_mutex_unlock(&engine->lock);
+}
+
+// Waits for the slot to complete. Returns 0, or errno of the failed transfer.
+static int engine_wait(aio_engine_t *engine, aio_slot_t *slot) {
+#if defined(HAVE_LIBURING)
+  if (engine->uring) {
+    while (slot->state == SLOT_PENDING) {
+      struct io_uring_cqe *cqe;
+      int rval = io_uring_wait_cqe(&engine->ring, &cqe);
+      if (rval == -EINTR) {
+        continue;
+      }
+      if (rval < 0) {
+        return -rval;
+      }
+      aio_slot_t *done = (aio_slot_t *)io_uring_cqe_get_data(cqe);
+      done->result = cqe->res;
+      io_uring_cqe_seen(&engine->ring, cqe);
+
+      // Complete short transfers synchronously, so that only reads at the
+      // end of file are short
+      if (done->result >= 0 && (size_t)done->result < done->length) {
+        aio_slot_t rest = *done;
+        rest.data += done->result;
+        rest.offset += done->result;
+        rest.length -= (size_t)done->result;
+        ssize_t result = transfer(engine->fd, &rest);
+        done->result = result < 0 ? result : done->result + result;
+      }
+      done->state = SLOT_DONE;
+    }
+  } else
+#endif
+  {
+    pthread_mutex_lock(&engine->lock);
+    while (slot->state == SLOT_PENDING) {
+      pthread_cond_wait(&engine->completed, &engine->lock);
+    }
+    pthread_mutex_unlock(&engine->lock);
+  }
+  return slot->result < 0 ? (int)-slot->result : 0;
+}
+
+// Waits for all slots, returning the first error
+static int engine_drain(aio_engine_t *engine) {
+  int error = 0;
+  for (size_t i = 0; i < engine->depth; ++i) {
+    int rval = engine_wait(engine, &engine->slots[i]);
+    if (error == 0) {
+      error = rval;
+    }
+  }
+  return error;
+}
+
+static void engine_free(aio_engine_t *engine) {
+  if (engine->slots != NULL) {
+    engine_drain(engine);
+  }
+#if defined(HAVE_LIBURING)
+  if (engine->uring) {
+    io_uring_queue_exit(&engine->ring);
+  }
+#endif
+  if (engine->queue != NULL) {
+    pthread_mutex_lock(&engine->lock);
+    engine->stopping = 1;
+    pthread_cond_broadcast(&engine->submitted);
+    pthread_mutex_unlock(&engine->lock);
+    for (size_t i = 0; i < engine->threads_count; ++i) {
+      pthread_join(engine->threads[i], NULL);
+    }
+    pthread_cond_destroy(&engine->completed);
+    pthread_cond_destroy(&engine->submitted);
+    pthread_mutex_destroy(&engine->lock);
+    free(engine->queue);
+  }
+  if (engine->slots != NULL) {
+    for (size_t i = 0; i < engine->depth; ++i) {
+      free(engine->slots[i].data);
+    }
+    free(engine->slots);
+  }
+}
+
+/*
+ * Read-ahead
+ */
+
+typedef struct {
+  aio_engine_t engine;
+  int64_t pos;         // position of the stream
+  int64_t next_offset; // offset of the next chunk to read ahead
+  size_t head;         // slot of the chunk containing the position
+} aio_reader_t;
+
+static void reader_read_ahead(aio_reader_t *reader, aio_slot_t *slot) {
+  slot->offset = reader->next_offset;
+  slot->length = AIO_CHUNK_SIZE;
+  slot->write = 0;
+  reader->next_offset += AIO_CHUNK_SIZE;
+  engine_submit(&reader->engine, slot);
+}
+
+// Restarts reading ahead from the offset. All slots must be completed.
+static void reader_restart(aio_reader_t *reader, int64_t offset) {
+  reader->head = 0;
+  reader->next_offset = offset;
+  for (size_t i = 0; i < reader->engine.depth; ++i) {
+    reader_read_ahead(reader, &reader->engine.slots[i]);
+  }
+}
+
+// Moves to the next chunk, reusing the slot of the current one
+static int reader_next_chunk(aio_reader_t *reader) {
+  aio_slot_t *slot = &reader->engine.slots[reader->head];
+  int rval = engine_wait(&reader->engine, slot);
+  if (rval != 0) {
+    return rval;
+  }
+  reader_read_ahead(reader, slot);
+  reader->head = (reader->head + 1) % reader->engine.depth;
+  return 0;
+}
+
+static ssize_t reader_read(void *cookie, char *buf, size_t size) {
+  aio_reader_t *reader = (aio_reader_t *)cookie;
+  size_t total = 0;
+  while (total < size) {
+    aio_slot_t *slot = &reader->engine.slots[reader->head];
+    int rval = engine_wait(&reader->engine, slot);
+    if (rval != 0) {
+      errno = rval;
+      return total > 0 ? (ssize_t)total : -1;
+    }
+
+    int64_t available = slot->offset + slot->result - reader->pos;
+    if (available <= 0) {
+      if ((size_t)slot->result < slot->length) {
+        break; // end of file
+      }
+      if ((rval = reader_next_chunk(reader)) != 0) {
+        errno = rval;
+        return total > 0 ? (ssize_t)total : -1;
+      }
+      continue;
+    }
+
+    size_t n = (size_t)available < size - total ? (size_t)available : size - total;
+    memcpy(buf + total, slot->data + (reader->pos - slot->offset), n);
+    total += n;
+    reader->pos += n;
+  }
+  return (ssize_t)total;
+}
+
+static int reader_seek(void *cookie, off64_t *offset, int whence) {
+  aio_reader_t *reader = (aio_reader_t *)cookie;
+  int64_t pos = *offset;
+  if (whence == SEEK_CUR) {
+    pos += reader->pos;
+  } else if (whence == SEEK_END) {
+    struct stat st;
+    if (fstat(reader->engine.fd, &st) != 0) {
+      return -1;
+    }
+    pos += st.st_size;
+  }
+  if (pos < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  aio_slot_t *head = &reader->engine.slots[reader->head];
+  if (pos >= head->offset && pos < reader->next_offset) {
+    // Forward within the read-ahead window, keep the reads in flight
+    while (pos >= reader->engine.slots[reader->head].offset + AIO_CHUNK_SIZE) {
+      int rval = reader_next_chunk(reader);
+      if (rval != 0) {
+        errno = rval;
+        return -1;
+      }
+    }
+  } else {
+    engine_drain(&reader->engine);
+    reader_restart(reader, pos);
+  }
+
+  reader->pos = pos;
+  *offset = pos;
+  return 0;
+}
+
+static int reader_close(void *cookie) {
+  aio_reader_t *reader = (aio_reader_t *)cookie;
+  int fd = reader->engine.fd;
+  engine_free(&reader->engine);
+  free(reader);
+  return close(fd);
+}
+
+FILE *aio_open_read(const char *path, size_t depth) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    avro_set_error("Cannot open file: %s", strerror(errno));
+    return NULL;
+  }
+
+  aio_reader_t *reader = (aio_reader_t *)calloc(1, sizeof(aio_reader_t));
+  int rval = reader == NULL ? ENOMEM : engine_init(&reader->engine, fd, depth, 0);
+  if (rval != 0) {
+    avro_set_error("Cannot set up asynchronous reads: %s", strerror(rval));
+    free(reader);
+    close(fd);
+    return NULL;
+  }
+  reader_restart(reader, 0);
+
+  cookie_io_functions_t io = {
+      .read = reader_read, .write = NULL, .seek = reader_seek, .close = reader_close};
+  FILE *fp = fopencookie(reader, "rb", io);
+  if (fp == NULL) {
+    avro_set_error("Cannot open file: %s", strerror(errno));
+    reader_close(reader);
+  }
+  return fp;
+}
+
+/*
+ * Write-behind
+ */
+
+typedef struct {
+  aio_engine_t engine;
+  size_t current; // slot being filled
+  size_t fill;
+  int64_t offset; // file offset of the current slot, or -1 if not seekable
+} aio_writer_t;
+
+static void writer_submit(aio_writer_t *writer) {
+  aio_slot_t *slot = &writer->engine.slots[writer->current];
+  slot->offset = writer->offset;
+  slot->length = writer->fill;
+  slot->write = 1;
+  engine_submit(&writer->engine, slot);
+  if (writer->offset >= 0) {
+    writer->offset += writer->fill;
+  }
+  writer->current = (writer->current + 1) % writer->engine.depth;
+  writer->fill = 0;
+}
+
+static ssize_t writer_write(void *cookie, const char *buf, size_t size) {
+  aio_writer_t *writer = (aio_writer_t *)cookie;
+  size_t total = 0;
+  while (total < size) {
+    aio_slot_t *slot = &writer->engine.slots[writer->current];
+    if (writer->fill == 0) {
+      // The slot might still be written from its previous use
+      int rval = engine_wait(&writer->engine, slot);
+      if (rval != 0) {
+        errno = rval;
+        return -1;
+      }
+    }
+    size_t n = AIO_CHUNK_SIZE - writer->fill;
+    if (n > size - total) {
+      n = size - total;
+    }
+    memcpy(slot->data + writer->fill, buf + total, n);
+    writer->fill += n;
+    total += n;
+    if (writer->fill == AIO_CHUNK_SIZE) {
+      writer_submit(writer);
+    }
+  }
+  return (ssize_t)size;
+}
+
+static int writer_close(void *cookie) {
+  aio_writer_t *writer = (aio_writer_t *)cookie;
+  if (writer->fill > 0) {
+    writer_submit(writer);
+  }
+  int error = engine_drain(&writer->engine);
+  if (writer->offset >= 0) {
+    // Leave the descriptor positioned after the data, as write() would
+    lseek(writer->engine.fd, writer->offset, SEEK_SET);
+  }
+  engine_free(&writer->engine);
+  free(writer);
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+FILE *aio_open_write(int fd, size_t depth) {
+  // Positioned writes can complete in any order, others must be sequential
+  struct stat st;
+  int64_t offset = -1;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && !(fcntl(fd, F_GETFL) & O_APPEND)) {
+    offset = lseek(fd, 0, SEEK_CUR);
+  }
+
+  aio_writer_t *writer = (aio_writer_t *)calloc(1, sizeof(aio_writer_t));
+  int rval = writer == NULL ? ENOMEM : engine_init(&writer->engine, fd, depth, offset < 0);
+  if (rval != 0) {
+    avro_set_error("Cannot set up asynchronous writes: %s", strerror(rval));
+    free(writer);
+    return NULL;
+  }
+  writer->offset = offset;
+
+  cookie_io_functions_t io = {
+      .read = NULL, .write = writer_write, .seek = NULL, .close = writer_close};
+  FILE *fp = fopencookie(writer, "wb", io);
+  if (fp == NULL) {
+    avro_set_error("Cannot open output: %s", strerror(errno));
+    writer_close(writer);
+  }
+  return fp;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Asynchronous file I/O (--async-io), exposed as stdio streams so that the
+ * container reader and output functions don't need to know about it.
+ *
+ * Reads are issued in chunks ahead of the position being read, writes are
+ * queued and completed behind the writer. io_uring is used when available,
+ * with a fallback to I/O threads doing blocking reads and writes.
+ */
+
+#define AIO_DEFAULT_DEPTH 4
+#define AIO_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * Opens the file for reading, keeping up to 'depth' chunk reads in flight.
+ * Returns NULL (with Avro error set) on failure.
+ */
+FILE *aio_open_read(const char *path, size_t depth);
+
+/**
+ * Wraps the descriptor for writing, keeping up to 'depth' chunk writes in
+ * flight. The descriptor isn't closed by fclose(), but all pending writes are
+ * completed, and their errors are reported by it.
+ * Returns NULL (with Avro error set) on failure.
+ */
+FILE *aio_open_write(int fd, size_t depth);
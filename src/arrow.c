@@ -0,0 +1,911 @@
+#include <avro.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arrow.h"
+#include "avro_private.h"
+#include "binary.h"
+#include "config.h"
+#include "container.h"
+#include "stream.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+// Batches end early when their string and binary data grows larger than
+// this, so that 32-bit offsets can't overflow
+#define ARROW_MAX_BATCH_BYTES ((size_t)1024 * 1024 * 1024)
+// Largest precision of decimal128
+#define ARROW_MAX_DECIMAL_PRECISION 38
+
+#define ARROW_FORMAT_SIZE 32
+
+// How values of a column are decoded
+enum value_kind {
+  VK_NULL,
+  VK_BOOLEAN,
+  VK_INT,
+  VK_LONG,
+  VK_FLOAT,
+  VK_DOUBLE,
+  VK_BYTES, // string, bytes or decimal bytes that don't fit in decimal128
+  VK_ENUM,
+  VK_FIXED,
+  VK_DECIMAL, // bytes or fixed
+  VK_DURATION,
+  VK_JSON
+};
+
+/*
+ * Growable buffer, handed over to the consumer with the array it belongs
+ * to. Remembers allocation failures so that appends don't need to check
+ * every write.
+ */
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+  int failed;
+} buf_t;
+
+static char *buf_reserve(buf_t *buf, size_t size) {
+  if (buf->size + size > buf->capacity) {
+    size_t capacity = buf->capacity > 0 ? buf->capacity : 256;
+    while (capacity < buf->size + size) {
+      capacity *= 2;
+    }
+    char *data = buf->failed ? NULL : (char *)realloc(buf->data, capacity);
+    if (data == NULL) {
+      buf->failed = 1;
+      return NULL;
+    }
+    buf->data = data;
+    buf->capacity = capacity;
+  }
+  return buf->data + buf->size;
+}
+
+static void buf_append(buf_t *buf, const void *data, size_t size) {
+  char *dest = buf_reserve(buf, size);
+  if (dest != NULL) {
+    memcpy(dest, data, size);
+    buf->size += size;
+  }
+}
+
+static void buf_zeros(buf_t *buf, size_t size) {
+  char *dest = buf_reserve(buf, size);
+  if (dest != NULL) {
+    memset(dest, 0, size);
+    buf->size += size;
+  }
+}
+
+// Sets bit 'index' of a bitmap which has all bits before it set already
+static void buf_bit(buf_t *buf, size_t index, int bit) {
+  if (index % 8 == 0) {
+    buf_zeros(buf, 1);
+  }
+  if (bit && !buf->failed) {
+    buf->data[index / 8] |= (char)(1 << (index % 8));
+  }
+}
+
+static void buf_i32(buf_t *buf, int32_t value) {
+  buf_append(buf, &value, sizeof(value));
+}
+
+static void buf_i64(buf_t *buf, int64_t value) {
+  buf_append(buf, &value, sizeof(value));
+}
+
+// Hands the data over, leaving the buffer empty. Never returns NULL unless
+// out of memory, since consumers may not expect NULL data buffers.
+static void *buf_take(buf_t *buf) {
+  void *data = buf->data != NULL ? buf->data : malloc(1);
+  memset(buf, 0, sizeof(buf_t));
+  return data;
+}
+
+static void buf_free(buf_t *buf) {
+  free(buf->data);
+  memset(buf, 0, sizeof(buf_t));
+}
+
+typedef struct {
+  const char *name;
+  avro_schema_t schema; // of the field
+  avro_schema_t value;  // of non-null values
+  int null_branch;      // branch of null in a nullable union, or -1
+  enum value_kind kind;
+  char format[ARROW_FORMAT_SIZE]; // of indices for enums
+  int nullable;
+  size_t fixed_size;    // of fixed and decimal fixed values
+  // Symbols of enums, copied into the dictionary of every batch
+  buf_t symbol_offsets;
+  buf_t symbols;
+  // Batch being decoded
+  buf_t validity;
+  buf_t offsets; // of variable-length values
+  buf_t values;
+  int64_t null_count;
+} column_t;
+
+typedef struct {
+  container_reader_t *reader;
+  avro_schema_t record;
+  config_t conf; // of JSON columns
+  stream_t *json;
+  column_t *columns;
+  size_t columns_count;
+  size_t batch_size;
+  size_t rows;     // of the batch being decoded
+  size_t buffered; // variable-length bytes of the batch being decoded
+  // Records left of the current block
+  const char *p;
+  const char *end;
+  int64_t remaining;
+  int eof;
+  int failed; // error code once an error occurred
+  char error[1024];
+} exporter_t;
+
+/*
+ * Columns
+ */
+
+static void column_reset(column_t *col) {
+  col->validity.size = 0;
+  col->offsets.size = 0;
+  col->values.size = 0;
+  col->null_count = 0;
+  if (col->kind == VK_BYTES || col->kind == VK_JSON) {
+    buf_i32(&col->offsets, 0);
+  }
+}
+
+static void column_free(column_t *col) {
+  buf_free(&col->symbol_offsets);
+  buf_free(&col->symbols);
+  buf_free(&col->validity);
+  buf_free(&col->offsets);
+  buf_free(&col->values);
+}
+
+static int init_symbols(column_t *col) {
+  int count = avro_schema_enum_number_of_symbols(col->value);
+  buf_i32(&col->symbol_offsets, 0);
+  for (int i = 0; i < count; ++i) {
+    const char *symbol = avro_schema_enum_get(col->value, i);
+    buf_append(&col->symbols, symbol, strlen(symbol));
+    buf_i32(&col->symbol_offsets, (int32_t)col->symbols.size);
+  }
+  return col->symbols.failed || col->symbol_offsets.failed ? ENOMEM : 0;
+}
+
+// Maps the field schema to Arrow types
+static int column_init(column_t *col, const char *name, avro_schema_t schema) {
+  memset(col, 0, sizeof(column_t));
+  col->name = name;
+  col->schema = schema;
+  col->value = schema;
+  col->null_branch = -1;
+
+  if (is_avro_union(schema) && avro_schema_union_size(schema) == 2) {
+    for (int i = 0; i < 2; ++i) {
+      if (is_avro_null(avro_schema_union_branch(schema, i))) {
+        col->null_branch = i;
+        col->value = binary_resolve_schema(avro_schema_union_branch(schema, 1 - i));
+      }
+    }
+  }
+  col->nullable = col->null_branch >= 0 || is_avro_null(schema);
+
+  avro_schema_t value = col->value;
+  avro_logical_schema_t *logical = avro_logical_schema(value);
+  const char *format = NULL;
+  switch (avro_typeof(value)) {
+  case AVRO_NULL:
+    col->kind = VK_NULL;
+    format = "n";
+    break;
+  case AVRO_BOOLEAN:
+    col->kind = VK_BOOLEAN;
+    format = "b";
+    break;
+  case AVRO_INT32:
+    col->kind = VK_INT;
+    format = "i";
+    // Days and times of day, not instants as in --show-schema
+    if (logical != NULL && logical->type == AVRO_DATE) {
+      format = "tdD";
+    } else if (logical != NULL && logical->type == AVRO_TIME_MILLIS) {
+      format = "ttm";
+    }
+    break;
+  case AVRO_INT64:
+    col->kind = VK_LONG;
+    format = "l";
+    if (logical != NULL && logical->type == AVRO_TIME_MICROS) {
+      format = "ttu";
+    } else if (logical != NULL && logical->type == AVRO_TIMESTAMP_MILLIS) {
+      format = "tsm:UTC";
+    } else if (logical != NULL && logical->type == AVRO_TIMESTAMP_MICROS) {
+      format = "tsu:UTC";
+    }
+    break;
+  case AVRO_FLOAT:
+    col->kind = VK_FLOAT;
+    format = "f";
+    break;
+  case AVRO_DOUBLE:
+    col->kind = VK_DOUBLE;
+    format = "g";
+    break;
+  case AVRO_STRING:
+    col->kind = VK_BYTES;
+    format = "u";
+    break;
+  case AVRO_ENUM:
+    col->kind = VK_ENUM;
+    format = "i";
+    CHECKED_EV(init_symbols(col));
+    break;
+  case AVRO_BYTES:
+    // Binary value kept, rather than dynamic arrays of numbers
+    col->kind = VK_BYTES;
+    format = "z";
+    break;
+  case AVRO_FIXED:
+    // Binary value kept, rather than strings
+    col->kind = VK_FIXED;
+    col->fixed_size = (size_t)avro_schema_fixed_size(value);
+    snprintf(col->format, sizeof(col->format), "w:%zu", col->fixed_size);
+    if (logical != NULL && logical->type == AVRO_DURATION && col->fixed_size == 12) {
+      col->kind = VK_DURATION;
+      format = "tin";
+    }
+    break;
+  default:
+    // Anything else is JSON, and might be null in non-nullable unions too
+    col->kind = VK_JSON;
+    format = "u";
+    col->nullable = 1;
+    break;
+  }
+  // Two's complement big-endian unscaled values, in both formats
+  if (logical != NULL && logical->type == AVRO_DECIMAL &&
+      (col->kind == VK_BYTES || col->kind == VK_FIXED) &&
+      logical->precision <= ARROW_MAX_DECIMAL_PRECISION) {
+    col->kind = VK_DECIMAL;
+    snprintf(col->format, sizeof(col->format), "d:%d,%d", (int)logical->precision,
+             (int)logical->scale);
+    format = NULL;
+  }
+  if (format != NULL) {
+    snprintf(col->format, sizeof(col->format), "%s", format);
+  }
+
+  column_reset(col);
+  return 0;
+}
+
+// Appends a variable-length value and its end offset
+static int append_bytes(exporter_t *exporter, column_t *col, const char *data, size_t size) {
+  if (size > (size_t)INT32_MAX - col->values.size) {
+    avro_set_error("Value of column '%s' is too large for Arrow", col->name);
+    return EINVAL;
+  }
+  buf_append(&col->values, data, size);
+  buf_i32(&col->offsets, (int32_t)col->values.size);
+  exporter->buffered += size;
+  return 0;
+}
+
+// Converts a two's complement big-endian unscaled value to a little-endian
+// decimal128
+static int append_decimal(column_t *col, const char *bytes, size_t size) {
+  unsigned char sign = size > 0 && (bytes[0] & 0x80) ? 0xff : 0;
+  // Leading bytes beyond 128 bits may only extend the sign
+  for (; size > 16; ++bytes, --size) {
+    if ((unsigned char)bytes[0] != sign || ((unsigned char)bytes[1] & 0x80) != (sign & 0x80)) {
+      avro_set_error("Decimal of column '%s' doesn't fit in 128 bits", col->name);
+      return EINVAL;
+    }
+  }
+  unsigned char value[16];
+  memset(value, sign, sizeof(value));
+  for (size_t i = 0; i < size; ++i) {
+    value[i] = (unsigned char)bytes[size - 1 - i];
+  }
+  buf_append(&col->values, value, sizeof(value));
+  return 0;
+}
+
+// Appends the placeholder of a null value, so that values keep their slots
+static void append_null(column_t *col, size_t row) {
+  col->null_count++;
+  switch (col->kind) {
+  case VK_BOOLEAN:
+    buf_bit(&col->values, row, 0);
+    break;
+  case VK_INT:
+  case VK_FLOAT:
+  case VK_ENUM:
+    buf_zeros(&col->values, 4);
+    break;
+  case VK_LONG:
+  case VK_DOUBLE:
+    buf_zeros(&col->values, 8);
+    break;
+  case VK_DECIMAL:
+  case VK_DURATION:
+    buf_zeros(&col->values, 16);
+    break;
+  case VK_FIXED:
+    buf_zeros(&col->values, col->fixed_size);
+    break;
+  case VK_BYTES:
+  case VK_JSON:
+    buf_i32(&col->offsets, (int32_t)col->values.size);
+    break;
+  default:
+    break;
+  }
+}
+
+static int append_value(exporter_t *exporter, column_t *col, const char **p, const char *end) {
+  avro_schema_t schema = col->value;
+  size_t row = exporter->rows;
+  int valid = col->kind != VK_NULL;
+  if (col->null_branch >= 0 || (col->kind == VK_JSON && is_avro_union(col->schema))) {
+    const char *branch_start = *p;
+    int64_t branch;
+    CHECKED_EV(binary_read_long(p, end, &branch));
+    if (branch < 0 || (size_t)branch >= avro_schema_union_size(col->schema)) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    if (is_avro_null(avro_schema_union_branch(col->schema, (int)branch))) {
+      valid = 0;
+    } else if (col->kind == VK_JSON) {
+      // Whole union is converted
+      *p = branch_start;
+      schema = col->schema;
+    }
+  }
+  if (col->nullable) {
+    buf_bit(&col->validity, row, valid);
+  }
+  if (!valid) {
+    append_null(col, row);
+    return col->values.failed || col->offsets.failed || col->validity.failed ? ENOMEM : 0;
+  }
+
+  switch (col->kind) {
+  case VK_BOOLEAN:
+    if (*p >= end) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    buf_bit(&col->values, row, *(*p)++ ? 1 : 0);
+    break;
+
+  case VK_INT: {
+    int64_t value;
+    CHECKED_EV(binary_read_long(p, end, &value));
+    buf_i32(&col->values, (int32_t)value);
+    break;
+  }
+
+  case VK_LONG: {
+    int64_t value;
+    CHECKED_EV(binary_read_long(p, end, &value));
+    buf_i64(&col->values, value);
+    break;
+  }
+
+  case VK_FLOAT:
+  case VK_DOUBLE: {
+    // Both formats are little-endian IEEE 754
+    size_t size = col->kind == VK_FLOAT ? 4 : 8;
+    if ((size_t)(end - *p) < size) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    buf_append(&col->values, *p, size);
+    *p += size;
+    break;
+  }
+
+  case VK_BYTES: {
+    const char *bytes;
+    size_t size;
+    CHECKED_EV(binary_read_bytes(p, end, &bytes, &size));
+    CHECKED_EV(append_bytes(exporter, col, bytes, size));
+    break;
+  }
+
+  case VK_ENUM: {
+    int64_t index;
+    CHECKED_EV(binary_read_long(p, end, &index));
+    if (index < 0 || index >= avro_schema_enum_number_of_symbols(schema)) {
+      avro_set_error("Invalid enum index %lld", (long long)index);
+      return EILSEQ;
+    }
+    buf_i32(&col->values, (int32_t)index);
+    break;
+  }
+
+  case VK_FIXED:
+    if ((size_t)(end - *p) < col->fixed_size) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    buf_append(&col->values, *p, col->fixed_size);
+    *p += col->fixed_size;
+    break;
+
+  case VK_DECIMAL: {
+    const char *bytes = *p;
+    size_t size = col->fixed_size;
+    if (avro_typeof(schema) == AVRO_BYTES) {
+      CHECKED_EV(binary_read_bytes(p, end, &bytes, &size));
+    } else if ((size_t)(end - *p) < size) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    } else {
+      *p += size;
+    }
+    CHECKED_EV(append_decimal(col, bytes, size));
+    break;
+  }
+
+  case VK_DURATION: {
+    // Little-endian unsigned months, days and milliseconds
+    if (end - *p < 12) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    uint32_t parts[3];
+    for (int i = 0; i < 3; ++i) {
+      const unsigned char *bytes = (const unsigned char *)*p + 4 * i;
+      parts[i] = (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 |
+                 (uint32_t)bytes[3] << 24;
+    }
+    *p += 12;
+    if (parts[0] > INT32_MAX || parts[1] > INT32_MAX) {
+      avro_set_error("Duration of column '%s' is out of range", col->name);
+      return EINVAL;
+    }
+    buf_i32(&col->values, (int32_t)parts[0]);
+    buf_i32(&col->values, (int32_t)parts[1]);
+    buf_i64(&col->values, (int64_t)parts[2] * 1000000);
+    break;
+  }
+
+  case VK_JSON: {
+    const char *json;
+    size_t size;
+    CHECKED_EV(stream_json(exporter->json, schema, p, end, &json, &size));
+    CHECKED_EV(append_bytes(exporter, col, json, size));
+    break;
+  }
+
+  default:
+    break;
+  }
+  return col->values.failed || col->offsets.failed || col->validity.failed ? ENOMEM : 0;
+}
+
+/*
+ * Schemas
+ */
+
+static void release_schema(struct ArrowSchema *schema) {
+  free((void *)schema->format);
+  free((void *)schema->name);
+  free((void *)schema->metadata);
+  for (int64_t i = 0; i < schema->n_children; ++i) {
+    if (schema->children[i]->release != NULL) {
+      schema->children[i]->release(schema->children[i]);
+    }
+    free(schema->children[i]);
+  }
+  free(schema->children);
+  if (schema->dictionary != NULL) {
+    if (schema->dictionary->release != NULL) {
+      schema->dictionary->release(schema->dictionary);
+    }
+    free(schema->dictionary);
+  }
+  schema->release = NULL;
+}
+
+static char *copy_string(const char *str) {
+  size_t size = strlen(str) + 1;
+  char *copy = (char *)malloc(size);
+  if (copy != NULL) {
+    memcpy(copy, str, size);
+  }
+  return copy;
+}
+
+// Metadata of a single key, as int32 count, then length-prefixed key and
+// value in native byte order
+static char *single_metadata(const char *key, const char *value) {
+  int32_t count = 1;
+  int32_t key_size = (int32_t)strlen(key);
+  int32_t value_size = (int32_t)strlen(value);
+  char *metadata = (char *)malloc(12 + (size_t)key_size + (size_t)value_size);
+  if (metadata != NULL) {
+    char *p = metadata;
+    memcpy(p, &count, 4);
+    memcpy(p + 4, &key_size, 4);
+    memcpy(p + 8, key, (size_t)key_size);
+    p += 8 + key_size;
+    memcpy(p, &value_size, 4);
+    memcpy(p + 4, value, (size_t)value_size);
+  }
+  return metadata;
+}
+
+// Fills the schema, which is released on failure too
+static int init_schema(struct ArrowSchema *schema, const char *format, const char *name,
+                       int64_t flags) {
+  memset(schema, 0, sizeof(struct ArrowSchema));
+  schema->release = release_schema;
+  schema->format = copy_string(format);
+  schema->name = copy_string(name);
+  schema->flags = flags;
+  if (schema->format == NULL || schema->name == NULL) {
+    release_schema(schema);
+    return ENOMEM;
+  }
+  return 0;
+}
+
+static int export_field_schema(const column_t *col, struct ArrowSchema *schema) {
+  CHECKED_EV(init_schema(schema, col->format, col->name, col->nullable ? ARROW_FLAG_NULLABLE : 0));
+  if (col->kind == VK_JSON) {
+    schema->metadata = single_metadata("ARROW:extension:name", "arrow.json");
+    if (schema->metadata == NULL) {
+      release_schema(schema);
+      return ENOMEM;
+    }
+  } else if (col->kind == VK_ENUM) {
+    schema->dictionary = (struct ArrowSchema *)malloc(sizeof(struct ArrowSchema));
+    if (schema->dictionary == NULL || init_schema(schema->dictionary, "u", "", 0) != 0) {
+      free(schema->dictionary);
+      schema->dictionary = NULL;
+      release_schema(schema);
+      return ENOMEM;
+    }
+  }
+  return 0;
+}
+
+static int export_schema(const exporter_t *exporter, struct ArrowSchema *schema) {
+  CHECKED_EV(init_schema(schema, "+s", "", 0));
+  schema->children = (struct ArrowSchema **)calloc(exporter->columns_count + 1,
+                                                   sizeof(struct ArrowSchema *));
+  if (schema->children == NULL) {
+    release_schema(schema);
+    return ENOMEM;
+  }
+  for (size_t i = 0; i < exporter->columns_count; ++i) {
+    struct ArrowSchema *child = (struct ArrowSchema *)malloc(sizeof(struct ArrowSchema));
+    if (child == NULL || export_field_schema(&exporter->columns[i], child) != 0) {
+      free(child);
+      release_schema(schema);
+      return ENOMEM;
+    }
+    schema->children[schema->n_children++] = child;
+  }
+  return 0;
+}
+
+/*
+ * Arrays
+ */
+
+static void release_array(struct ArrowArray *array) {
+  for (int64_t i = 0; i < array->n_buffers; ++i) {
+    free((void *)array->buffers[i]);
+  }
+  free(array->buffers);
+  for (int64_t i = 0; i < array->n_children; ++i) {
+    if (array->children[i]->release != NULL) {
+      array->children[i]->release(array->children[i]);
+    }
+    free(array->children[i]);
+  }
+  free(array->children);
+  if (array->dictionary != NULL) {
+    if (array->dictionary->release != NULL) {
+      array->dictionary->release(array->dictionary);
+    }
+    free(array->dictionary);
+  }
+  array->release = NULL;
+}
+
+// Fills the array with room for 'n_buffers' buffers, all NULL
+static int init_array(struct ArrowArray *array, int64_t length, int64_t n_buffers) {
+  memset(array, 0, sizeof(struct ArrowArray));
+  array->release = release_array;
+  array->length = length;
+  array->buffers = (const void **)calloc((size_t)n_buffers + 1, sizeof(void *));
+  if (array->buffers == NULL) {
+    array->release = NULL;
+    return ENOMEM;
+  }
+  array->n_buffers = n_buffers;
+  return 0;
+}
+
+static void *copy_buffer(const buf_t *buf) {
+  void *copy = malloc(buf->size > 0 ? buf->size : 1);
+  if (copy != NULL && buf->size > 0) {
+    memcpy(copy, buf->data, buf->size);
+  }
+  return copy;
+}
+
+// Dictionary of an enum column, which every batch owns a copy of
+static int export_symbols(const column_t *col, struct ArrowArray *array) {
+  CHECKED_EV(init_array(array, (int64_t)(col->symbol_offsets.size / 4 - 1), 3));
+  array->buffers[1] = copy_buffer(&col->symbol_offsets);
+  array->buffers[2] = copy_buffer(&col->symbols);
+  if (array->buffers[1] == NULL || array->buffers[2] == NULL) {
+    release_array(array);
+    return ENOMEM;
+  }
+  return 0;
+}
+
+// Hands the buffers of the decoded batch over to the array
+static int export_column(column_t *col, size_t rows, struct ArrowArray *array) {
+  int64_t n_buffers;
+  switch (col->kind) {
+  case VK_NULL:
+    n_buffers = 0;
+    break;
+  case VK_BYTES:
+  case VK_JSON:
+    n_buffers = 3;
+    break;
+  default:
+    n_buffers = 2;
+    break;
+  }
+  CHECKED_EV(init_array(array, (int64_t)rows, n_buffers));
+  array->null_count = col->kind == VK_NULL ? (int64_t)rows : col->null_count;
+  if (col->kind == VK_NULL) {
+    return 0;
+  }
+
+  // Validity bitmap may be left out when there are no nulls, and is kept
+  // for the next batch then
+  if (col->null_count > 0) {
+    array->buffers[0] = buf_take(&col->validity);
+  }
+  if (n_buffers == 3) {
+    array->buffers[1] = buf_take(&col->offsets);
+    array->buffers[2] = buf_take(&col->values);
+  } else {
+    array->buffers[1] = buf_take(&col->values);
+  }
+  for (int64_t i = col->null_count > 0 ? 0 : 1; i < n_buffers; ++i) {
+    if (array->buffers[i] == NULL) {
+      release_array(array);
+      return ENOMEM;
+    }
+  }
+
+  if (col->kind == VK_ENUM) {
+    array->dictionary = (struct ArrowArray *)malloc(sizeof(struct ArrowArray));
+    if (array->dictionary == NULL || export_symbols(col, array->dictionary) != 0) {
+      free(array->dictionary);
+      array->dictionary = NULL;
+      release_array(array);
+      return ENOMEM;
+    }
+  }
+  return 0;
+}
+
+static int export_batch(exporter_t *exporter, struct ArrowArray *array) {
+  size_t rows = exporter->rows;
+  CHECKED_EV(init_array(array, (int64_t)rows, 1));
+  array->children = (struct ArrowArray **)calloc(exporter->columns_count + 1,
+                                                 sizeof(struct ArrowArray *));
+  if (array->children == NULL) {
+    release_array(array);
+    return ENOMEM;
+  }
+  for (size_t i = 0; i < exporter->columns_count; ++i) {
+    struct ArrowArray *child = (struct ArrowArray *)malloc(sizeof(struct ArrowArray));
+    if (child == NULL || export_column(&exporter->columns[i], rows, child) != 0) {
+      free(child);
+      release_array(array);
+      return ENOMEM;
+    }
+    array->children[array->n_children++] = child;
+  }
+
+  for (size_t i = 0; i < exporter->columns_count; ++i) {
+    column_reset(&exporter->columns[i]);
+  }
+  exporter->rows = 0;
+  exporter->buffered = 0;
+  return 0;
+}
+
+/*
+ * Stream
+ */
+
+static int fail(exporter_t *exporter, int rval) {
+  exporter->failed = rval;
+  snprintf(exporter->error, sizeof(exporter->error), "%s",
+           rval == ENOMEM ? "Out of memory" : avro_strerror());
+  return rval;
+}
+
+// Moves on to the next block when the current one has no records left
+static int next_records(exporter_t *exporter) {
+  while (exporter->remaining == 0 && !exporter->eof) {
+    if (exporter->p != exporter->end) {
+      avro_set_error("Block has %lld bytes after its last record",
+                     (long long)(exporter->end - exporter->p));
+      return EILSEQ;
+    }
+    block_header_t block;
+    int rval = container_next_block(exporter->reader, &block);
+    if (rval == CONTAINER_EOF) {
+      exporter->eof = 1;
+      break;
+    }
+    CHECKED_EV(rval);
+    const char *data;
+    size_t size;
+    CHECKED_EV(container_read_block(exporter->reader, &block, exporter->conf.memory_limit, &data,
+                                    &size));
+    exporter->p = data;
+    exporter->end = data + size;
+    exporter->remaining = block.count;
+  }
+  return 0;
+}
+
+static int append_record(exporter_t *exporter) {
+  for (size_t i = 0; i < exporter->columns_count; ++i) {
+    CHECKED_EV(append_value(exporter, &exporter->columns[i], &exporter->p, exporter->end));
+  }
+  exporter->remaining--;
+  exporter->rows++;
+  return 0;
+}
+
+static int get_schema(struct ArrowArrayStream *stream, struct ArrowSchema *out) {
+  exporter_t *exporter = (exporter_t *)stream->private_data;
+  int rval = export_schema(exporter, out);
+  return rval == 0 ? 0 : fail(exporter, rval);
+}
+
+static int get_next(struct ArrowArrayStream *stream, struct ArrowArray *out) {
+  exporter_t *exporter = (exporter_t *)stream->private_data;
+  if (exporter->failed) {
+    return exporter->failed;
+  }
+  while (exporter->rows < exporter->batch_size && exporter->buffered < ARROW_MAX_BATCH_BYTES) {
+    int rval = next_records(exporter);
+    if (rval == 0 && !exporter->eof) {
+      rval = append_record(exporter);
+    }
+    if (rval != 0) {
+      return fail(exporter, rval);
+    }
+    if (exporter->eof) {
+      break;
+    }
+  }
+  if (exporter->rows == 0) {
+    // End of stream
+    memset(out, 0, sizeof(struct ArrowArray));
+    return 0;
+  }
+  int rval = export_batch(exporter, out);
+  return rval == 0 ? 0 : fail(exporter, rval);
+}
+
+static const char *get_last_error(struct ArrowArrayStream *stream) {
+  exporter_t *exporter = (exporter_t *)stream->private_data;
+  return exporter->failed ? exporter->error : NULL;
+}
+
+static void exporter_free(exporter_t *exporter) {
+  if (exporter->columns != NULL) {
+    for (size_t i = 0; i < exporter->columns_count; ++i) {
+      column_free(&exporter->columns[i]);
+    }
+    free(exporter->columns);
+  }
+  if (exporter->json != NULL) {
+    stream_free(exporter->json);
+  }
+  if (exporter->record != NULL) {
+    avro_schema_decref(exporter->record);
+  }
+  if (exporter->reader != NULL) {
+    container_close(exporter->reader);
+  }
+  free(exporter);
+}
+
+static void release_stream(struct ArrowArrayStream *stream) {
+  exporter_free((exporter_t *)stream->private_data);
+  stream->release = NULL;
+}
+
+static int exporter_init(exporter_t *exporter) {
+  exporter->record = binary_resolve_schema(exporter->reader->schema);
+  if (!is_avro_record(exporter->record)) {
+    exporter->record = NULL;
+    avro_set_error("Can't find root record schema");
+    return EINVAL;
+  }
+  avro_schema_incref(exporter->record);
+
+  // Fields that become JSON text are converted with logical types
+  exporter->conf.logical_types = 1;
+  exporter->conf.memory_limit = DEFAULT_MEMORY_LIMIT;
+  CHECKED_EV(stream_new(exporter->record, &exporter->conf, NULL, &exporter->json));
+
+  size_t count = avro_schema_record_size(exporter->record);
+  exporter->columns = (column_t *)calloc(count > 0 ? count : 1, sizeof(column_t));
+  if (exporter->columns == NULL) {
+    return ENOMEM;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    CHECKED_EV(column_init(&exporter->columns[exporter->columns_count++],
+                           avro_schema_record_field_name(exporter->record, (int)i),
+                           binary_resolve_schema(avro_schema_record_field_get_by_index(exporter->record, (int)i))));
+  }
+  return 0;
+}
+
+int avro2arrow_open(const char *path, size_t batch_size, struct ArrowArrayStream *stream) {
+  memset(stream, 0, sizeof(struct ArrowArrayStream));
+  exporter_t *exporter = (exporter_t *)calloc(1, sizeof(exporter_t));
+  if (exporter == NULL) {
+    return ENOMEM;
+  }
+  exporter->batch_size = batch_size > 0 ? batch_size : AVRO2ARROW_DEFAULT_BATCH_SIZE;
+  int rval = container_open(path, &exporter->reader);
+  if (rval == 0) {
+    rval = exporter_init(exporter);
+  }
+  if (rval != 0) {
+    exporter_free(exporter);
+    return rval;
+  }
+
+  stream->get_schema = get_schema;
+  stream->get_next = get_next;
+  stream->get_last_error = get_last_error;
+  stream->release = release_stream;
+  stream->private_data = exporter;
+  return 0;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Export of Avro container files as Apache Arrow record batches, through
+ * the Arrow C data and stream interfaces, for consumers that link the
+ * avro2arrow library in process and want columns rather than JSON text. The
+ * Arrow library itself isn't needed: the interface is the plain structures
+ * below, as defined by the Arrow specification.
+ *
+ * Records are decoded straight from their binary encoding into Arrow
+ * buffers, which are then handed over to the consumer without copying. Every
+ * field of the root record is a child of a struct array, typed mostly the
+ * same way --show-schema maps fields to Kusto types: decimals are decimal128,
+ * timestamps are timestamps in UTC, durations are month_day_nano intervals,
+ * strings are utf8, enums are dictionary encoded utf8 with int32 indices,
+ * ints, longs, doubles and booleans are their Arrow counterparts, and
+ * anything else (records, arrays, maps and other unions) is utf8 JSON text,
+ * of the arrow.json extension type. Nullable unions are nullable fields.
+ *
+ * Where Arrow has a closer type than Kusto, it's used instead:
+ * - date is date32 rather than a timestamp, and time-millis and time-micros
+ *   are time32 and time64, since they are days and times of day and not
+ *   instants
+ * - bytes are binary rather than JSON arrays of numbers, and fixed are
+ *   fixed_size_binary rather than strings, keeping their binary value
+ * - decimals of more than 38 digits, which decimal128 can't hold, are binary
+ *   or fixed_size_binary too, holding their two's complement unscaled value
+ * - floats are float32 rather than doubles, and nulls are the null type
+ *   rather than strings, since their values fit them exactly
+ */
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  // Array type description
+  const char *format;
+  const char *name;
+  const char *metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema **children;
+  struct ArrowSchema *dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema *);
+  // Opaque producer-specific data
+  void *private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void **buffers;
+  struct ArrowArray **children;
+  struct ArrowArray *dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray *);
+  // Opaque producer-specific data
+  void *private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+  // Callbacks providing stream functionality
+  int (*get_schema)(struct ArrowArrayStream *, struct ArrowSchema *out);
+  int (*get_next)(struct ArrowArrayStream *, struct ArrowArray *out);
+  const char *(*get_last_error)(struct ArrowArrayStream *);
+
+  // Release callback
+  void (*release)(struct ArrowArrayStream *);
+
+  // Opaque producer-specific data
+  void *private_data;
+};
+
+#endif // ARROW_C_STREAM_INTERFACE
+
+// Only the entry point is exported from the library
+#if defined(_WIN32)
+#ifdef AVRO2ARROW_BUILD
+#define AVRO2ARROW_API __declspec(dllexport)
+#else
+#define AVRO2ARROW_API __declspec(dllimport)
+#endif
+#else
+#define AVRO2ARROW_API __attribute__((visibility("default")))
+#endif
+
+// Records of a batch when 0 is given
+#define AVRO2ARROW_DEFAULT_BATCH_SIZE 65536
+
+/**
+ * Opens the Avro container file as a stream of record batches of at most
+ * 'batch_size' records. Batches also end early when their string and binary
+ * data grows past 1 GiB, so that 32-bit offsets don't overflow.
+ *
+ * get_next() decodes the next batch, and marks the end of file by returning
+ * a released array. Errors are reported by get_last_error(), and the stream
+ * can't be read further once an error occurred. Schemas and arrays given
+ * out stay valid after the stream is released, until they are released
+ * themselves.
+ *
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+AVRO2ARROW_API int avro2arrow_open(const char *path, size_t batch_size,
+                                   struct ArrowArrayStream *stream);
@@ -1,6 +1,7 @@
 #include <avro.h>
 #include <avro/schema.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <jansson.h>
 #include <stdlib.h>
 #if defined(_WIN32)
@@ -9,48 +10,68 @@
 #include <jemalloc.h>
 #endif
 #include <string.h>
+#include <time.h>
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
+#if defined(__linux__)
+#include "aio.h"
+#endif
 #include "avro_private.h"
+#include "binary.h"
+#include "checkpoint.h"
+#include "codegen.h"
+#include "columnar.h"
+#include "config.h"
+#include "container.h"
+#include "datum.h"
+#include "filter.h"
+#include "fingerprint.h"
+#include "flatten.h"
+#include "follow.h"
+#include "format.h"
+#include "index.h"
 #include "logical.h"
+#include "memstats.h"
+#include "parquet.h"
+#include "partition.h"
+#include "path.h"
+#include "sample.h"
+#include "stream.h"
+#include "transform.h"
+#if !defined(_WIN32)
+#include "plugin.h"
+#include "ring.h"
+#include "server.h"
+#endif
 
 #if defined(_WIN32) || defined(_WIN64)
 #define strtok_r strtok_s
 #endif
 
-#define MILLIS_IN_SEC 1000UL
-#define NANOS_IN_SEC 1000000000UL
-
-#define TRANSFORM_TS_SECS_STR "ts-s"
-#define TRANSFORM_TS_MILLIS_STR "ts-ms"
-#define TRANSFORM_TS_NANOS_STR "ts-ns"
-
-enum TransformationType {
-    TRANSFORM_NONE,  // No transformation required
-    TRANSFORM_TS_SECS,
-    TRANSFORM_TS_MILLIS,
-    TRANSFORM_TS_NANOS
-};
-
-// Define a struct for column information
-typedef struct {
-    char *column_name;
-    enum TransformationType transformation; // Transformation for the column
-} column_info_t;
-
+// Conversion statistics, reported by --serve jobs
 typedef struct {
-  int prune;
-  int logical_types;
-  int ms_hadoop_logical_types;
-  int show_schema;
-  int output_csv;
-  column_info_t *columns;
-  size_t columns_size;
-} config_t;
+  size_t records;
+  // Corrupt blocks skipped with --on-error skip-block
+  size_t skipped_blocks;
+  size_t skipped_records;
+  int64_t skipped_bytes;
+  // Formatted dates, times, timestamps, decimals and GUIDs, and how many of
+  // them were memoized
+  uint64_t memo_lookups;
+  uint64_t memo_hits;
+} stats_t;
 
 typedef struct {
   decimal_t *dec;
   char *str;
   size_t str_size;
+  transform_t **transforms; // transformations of --columns, bound to fields
+  path_t **paths;           // nested columns of --columns, NULL for fields
+  size_t transforms_count;
 } cache_t;
 
 static cache_t *cache_new() {
@@ -61,6 +82,14 @@ static cache_t *cache_new() {
 }
 
 static void cache_free(cache_t *cache) {
+  for (size_t i = 0; i < cache->transforms_count; ++i) {
+    transform_free(cache->transforms[i]);
+    if (cache->paths[i] != NULL) {
+      path_free(cache->paths[i]);
+    }
+  }
+  free(cache->transforms);
+  free(cache->paths);
   decimal_free(cache->dec);
   free(cache->str);
   free(cache);
@@ -108,11 +137,6 @@ static int isinf(double x) { return !isnan(x) && isnan(x - x); }
     }                                                                          \
   } while (0)
 
-// Guid is formatted as 36 characters (32 nibbles plus 4 hyphens): xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx
-// The byte order is a bit tricky: https://stackoverflow.com/questions/10862171/convert-byte-or-object-to-guid
-#define GUID_FORMAT "%02hhX%02hhX%02hhX%02hhX-%02hhX%02hhX-%02hhX%02hhX-%02hhX%02hhX-%02hhX%02hhX%02hhX%02hhX%02hhX%02hhX"
-#define GUID_ARG(guid) (guid)[3], (guid)[2], (guid)[1], (guid)[0], (guid)[5], (guid)[4], (guid)[7], (guid)[6], (guid)[8], (guid)[9], (guid)[10], (guid)[11], (guid)[12], (guid)[13], (guid)[14], (guid)[15]
-
 static int is_ms_hadoop_logical_type_guid(const avro_value_t *value, size_t size) {
   if (size == 16) {
     avro_schema_t schema = avro_value_get_schema(value);
@@ -127,7 +151,9 @@ static int record_field_to_json_by_index(json_t *result, const avro_value_t *val
                                          size_t field_idx, const config_t *conf, cache_t *cache);
 
 static int record_field_to_json_by_name(json_t *result, const avro_value_t *value,
-                                        const char *field_name, const config_t *conf, cache_t *cache);
+                                        const column_info_t *column, const path_t *path,
+                                        transform_t *transform, const config_t *conf,
+                                        cache_t *cache);
 
 int avro_byte_array_to_json_t(json_t **json, const unsigned char *bytes, size_t element_count) {
   int rval = 0;
@@ -399,7 +425,7 @@ static int avro_value_to_json_t(const avro_value_t *value, json_t **json,
     CHECKED_EV(avro_value_get_enum(value, &symbol_value));
     enum_schema = avro_value_get_schema(value);
     symbol_name = avro_schema_enum_get(enum_schema, symbol_value);
-    CHECKED_ALLOC(*json, json_string(symbol_name));
+    CHECKED_ALLOC(*json, json_string_nocheck(symbol_name));
     return 0;
   }
 
@@ -443,8 +469,10 @@ static int avro_value_to_json_t(const avro_value_t *value, json_t **json,
 
     for (size_t field_idx = 0; field_idx < field_count; field_idx++) {
       if(filter_cols) {
-        const char *column_name = conf->columns[field_idx].column_name;
-        if(record_field_to_json_by_name(result, value, column_name, conf, cache)!= 0) {
+        const column_info_t *column = &conf->columns[field_idx];
+        transform_t *transform = cache->transforms != NULL ? cache->transforms[field_idx] : NULL;
+        const path_t *path = cache->paths != NULL ? cache->paths[field_idx] : NULL;
+        if(record_field_to_json_by_name(result, value, column, path, transform, conf, cache)!= 0) {
           // Unable to output field
           continue;
         }
@@ -471,13 +499,59 @@ static int avro_value_to_json_t(const avro_value_t *value, json_t **json,
   return 0;
 }
 
+// Converts value of a transformed column, null values aren't transformed
+static int transformed_value_to_json_t(const avro_value_t *value, json_t **json,
+                                       transform_t *transform) {
+  avro_value_t branch;
+  if (avro_value_get_type(value) == AVRO_UNION) {
+    CHECKED_EV(avro_value_get_current_branch(value, &branch));
+    value = &branch;
+  }
+  transform_value_t result = {.kind = TV_NULL};
+  if (avro_value_get_type(value) != AVRO_NULL) {
+    CHECKED_EV(transform_value(transform, value, &result));
+  }
+
+  switch (result.kind) {
+  case TV_NULL:
+    CHECKED_ALLOC(*json, json_null());
+    return 0;
+  case TV_INT:
+    CHECKED_ALLOC(*json, json_integer(result.integer));
+    return 0;
+  case TV_REAL:
+    if (isinf(result.real)) {
+      CHECKED_ALLOC(*json, json_string_nocheck("Infinity"));
+      return 0;
+    }
+    if (isnan(result.real)) {
+      CHECKED_ALLOC(*json, json_string_nocheck("NaN"));
+      return 0;
+    }
+    CHECKED_ALLOC(*json, json_real(result.real));
+    return 0;
+  case TV_TEXT:
+    CHECKED_ALLOC(*json, json_stringn_nocheck(result.str, result.size));
+    return 0;
+  case TV_STRING:
+    CHECKED_ALLOC(*json, json_stringn(result.str, result.size));
+    return 0;
+  }
+  return 0;
+}
+
 static int record_field_to_json(json_t *result, const avro_value_t *field_value,
-                              const char *field_name, const config_t *conf,
-                              cache_t *cache) {
+                              const char *field_name, transform_t *transform,
+                              const config_t *conf, cache_t *cache) {
   int rval = 0;
 
   json_t *field_json = NULL;
-  if ((rval = avro_value_to_json_t(field_value, &field_json, 0, conf, cache)) != 0) {
+  if (transform != NULL) {
+    rval = transformed_value_to_json_t(field_value, &field_json, transform);
+  } else {
+    rval = avro_value_to_json_t(field_value, &field_json, 0, conf, cache);
+  }
+  if (rval != 0) {
     return rval;
   }
 
@@ -508,56 +582,79 @@ static int record_field_to_json_by_index(json_t *result, const avro_value_t *val
     return rval;
   }
 
-  rval = record_field_to_json(result, &field, field_name, conf, cache);
+  rval = record_field_to_json(result, &field, field_name, NULL, conf, cache);
 
   return rval;
 }
 
+// Gets the value addressed by the path of a nested column. Sets 'found' to 0
+// when a nullable union on the way is null, or a map lacks the key.
+static int value_get_by_path(const avro_value_t *record, const path_t *path,
+                             avro_value_t *value, int *found) {
+  avro_value_t current = *record;
+  *found = 0;
+  for (size_t i = 0; i < path->steps_count; ++i) {
+    const path_step_t *step = &path->steps[i];
+    avro_value_t child;
+    if (step->branch >= 0) {
+      int discriminant;
+      CHECKED_EV(avro_value_get_discriminant(&current, &discriminant));
+      if (discriminant != step->branch) {
+        return 0;
+      }
+      CHECKED_EV(avro_value_get_current_branch(&current, &child));
+      current = child;
+    }
+    if (step->kind == PATH_FIELD) {
+      CHECKED_EV(avro_value_get_by_index(&current, step->field_index, &child, NULL));
+    } else if (avro_value_get_by_name(&current, step->key, &child, NULL) != 0 ||
+               child.self == NULL) {
+      return 0;
+    }
+    current = child;
+  }
+  *value = current;
+  *found = 1;
+  return 0;
+}
+
 static int record_field_to_json_by_name(json_t *result, const avro_value_t *value,
-                                        const char *field_name, const config_t *conf,
+                                        const column_info_t *column, const path_t *path,
+                                        transform_t *transform, const config_t *conf,
                                         cache_t *cache) {
   int rval = 0;
   avro_value_t field;
   size_t field_idx;
+  const char *field_name = column_output_name(column);
 
-  if ((rval = avro_value_get_by_name(value, field_name, &field, &field_idx)) != 0) {
+  if (path != NULL) {
+    int found;
+    CHECKED_EV(value_get_by_path(value, path, &field, &found));
+    if (!found) {
+      return conf->prune ? 0 : json_object_set_new_nocheck(result, field_name, json_null());
+    }
+  } else if ((rval = avro_value_get_by_name(value, column->column_name, &field, &field_idx)) != 0) {
     return rval;
   }
 
-  rval = record_field_to_json(result, &field, field_name, conf, cache);
+  rval = record_field_to_json(result, &field, field_name, transform, conf, cache);
 
   return rval;
 }
 
-static int avro_file_to_json(avro_file_reader_t reader, avro_schema_t wschema,
-                             const config_t *conf) {
-  avro_value_iface_t *iface = avro_generic_class_from_schema(wschema);
-  avro_value_t value;
-  avro_generic_value_new(iface, &value);
-  cache_t *cache = cache_new();
-  int rval = 0;
-  while (avro_file_reader_read_value(reader, &value) == 0) {
-    json_t *json = NULL;
-
-    if ((rval = avro_value_to_json_t(&value, &json, 1, conf, cache)) != 0) {
-      break;
-    }
-    rval = json_dumpf(json, stdout, JSON_ENCODE_FLAGS);
-    json_decref(json);
-    if (rval < 0) {
-      break;
-    }
-    if (fputc('\n', stdout) < 0) {
-      rval = ferror(stdout);
-      break;
-    }
-    avro_value_reset(&value);
+static int record_to_json(FILE *dest, const avro_value_t *value,
+                          const config_t *conf, cache_t *cache) {
+  json_t *json = NULL;
+  CHECKED_EV(avro_value_to_json_t(value, &json, 1, conf, cache));
+  int rval = json_dumpf(json, dest, JSON_ENCODE_FLAGS);
+  json_decref(json);
+  if (rval < 0) {
+    return rval;
   }
-
-  avro_value_decref(&value);
-  avro_value_iface_decref(iface);
-  cache_free(cache);
-  return rval;
+  if (fputc('\n', dest) < 0) {
+    return ferror(dest);
+  }
+  return 0;
 }
 
 static int write_escape_quotes(FILE *dest, const char *str, size_t size) {
@@ -653,9 +750,48 @@ static int avro_bytes_value_to_csv(FILE *dest, const avro_value_t *value,
   return write_byte_array_to_csv(dest, (const char *)bytes, size);
 }
 
+// Writes value of a transformed column, null values aren't transformed
+static int transformed_value_to_csv(FILE *dest, const avro_value_t *value,
+                                    transform_t *transform) {
+  avro_value_t branch;
+  if (avro_value_get_type(value) == AVRO_UNION) {
+    CHECKED_EV(avro_value_get_current_branch(value, &branch));
+    value = &branch;
+  }
+  if (avro_value_get_type(value) == AVRO_NULL) {
+    return 0;
+  }
+  transform_value_t result;
+  CHECKED_EV(transform_value(transform, value, &result));
+
+  switch (result.kind) {
+  case TV_NULL:
+    return 0;
+  case TV_INT:
+    CHECKED_PRINTF(dest, "%" JSON_INTEGER_FORMAT, (long long int)result.integer);
+    return 0;
+  case TV_REAL: {
+    char buf[MAX_REAL_SIZE];
+    size_t size = format_real(buf, result.real, 1);
+    if (fwrite(buf, 1, size, dest) < size) {
+      return ferror(dest);
+    }
+    return 0;
+  }
+  case TV_TEXT:
+    if (fwrite(result.str, 1, result.size, dest) < result.size) {
+      return ferror(dest);
+    }
+    return 0;
+  case TV_STRING:
+    return write_escaped_str_to_csv(dest, result.str, result.size);
+  }
+  return 0;
+}
+
 static int avro_value_to_csv(FILE *dest, const avro_value_t *value,
                              int top_level, const config_t *conf,
-                             cache_t *cache, enum TransformationType transformation) {
+                             cache_t *cache) {
   switch (avro_value_get_type(value)) {
   case AVRO_BOOLEAN: {
     int val;
@@ -730,20 +866,6 @@ static int avro_value_to_csv(FILE *dest, const avro_value_t *value,
     int64_t val;
     CHECKED_EV(avro_value_get_long(value, &val));
 
-    if (transformation != TRANSFORM_NONE) {
-      if(transformation == TRANSFORM_TS_SECS) {
-        CHECKED_PRINT(dest, epoch_nanos_to_utc_str(val * NANOS_IN_SEC));
-        return 0;
-      } else if(transformation == TRANSFORM_TS_MILLIS) {
-        CHECKED_PRINT(dest, epoch_nanos_to_utc_str(val * (NANOS_IN_SEC/MILLIS_IN_SEC)));
-        return 0;
-      } else if(transformation == TRANSFORM_TS_NANOS) {
-        CHECKED_PRINT(dest, epoch_nanos_to_utc_str(val));
-        return 0;
-      }
-      // else ignore
-    }
-
     avro_logical_schema_t *logical_type = NULL;
     if (conf->logical_types) {
       logical_type = avro_logical_schema(avro_value_get_schema(value));
@@ -877,7 +999,7 @@ static int avro_value_to_csv(FILE *dest, const avro_value_t *value,
   case AVRO_UNION: {
     avro_value_t branch;
     CHECKED_EV(avro_value_get_current_branch(value, &branch));
-    return avro_value_to_csv(dest, &branch, top_level, conf, cache, transformation);
+    return avro_value_to_csv(dest, &branch, top_level, conf, cache);
   }
   }
   return 0;
@@ -886,197 +1008,1839 @@ static int avro_value_to_csv(FILE *dest, const avro_value_t *value,
 static int record_field_to_csv(FILE *dest, const avro_value_t *value, int filter_cols, size_t field_idx, const config_t *conf, cache_t *cache) {
     avro_value_t field;
     const char *field_name = NULL;
-    enum TransformationType transformation = TRANSFORM_NONE;
+    transform_t *transform = NULL;
 
     if(filter_cols) {
       field_name = conf->columns[field_idx].column_name;
-      transformation = conf->columns[field_idx].transformation;
-      CHECKED_EV(avro_value_get_by_name(value, field_name, &field, NULL));
+      transform = cache->transforms != NULL ? cache->transforms[field_idx] : NULL;
+      const path_t *path = cache->paths != NULL ? cache->paths[field_idx] : NULL;
+      if (path != NULL) {
+        int found;
+        CHECKED_EV(value_get_by_path(value, path, &field, &found));
+        if (!found) {
+          // Null on the way to the nested column
+          return 0;
+        }
+      } else {
+        CHECKED_EV(avro_value_get_by_name(value, field_name, &field, NULL));
+      }
     } else {
       CHECKED_EV(avro_value_get_by_index(value, field_idx, &field, &field_name));
     }
-    CHECKED_EV(avro_value_to_csv(dest, &field, 0, conf, cache, transformation));
+    if (transform != NULL) {
+      return transformed_value_to_csv(dest, &field, transform);
+    }
+    CHECKED_EV(avro_value_to_csv(dest, &field, 0, conf, cache));
     return 0;
 }
 
-static int avro_file_to_csv(avro_file_reader_t reader, avro_schema_t wschema,
-                            const config_t *conf) {
-  avro_value_iface_t *iface = avro_generic_class_from_schema(wschema);
+static int record_to_csv(FILE *dest, const avro_value_t *value,
+                         const config_t *conf, cache_t *cache) {
+  CHECKED_EV(avro_value_to_csv(dest, value, 1, conf, cache));
+  if (fputc('\n', dest) < 0) {
+    return ferror(dest);
+  }
+  return 0;
+}
+
+// Binary encoded record within a decompressed block
+typedef struct {
+  const char *data;
+  size_t size;
+} record_ref_t;
+
+// State of a single file conversion, or of one of its --outputs or
+// --format-threads
+typedef struct converter_t {
+  const config_t *conf;
+  filter_t *filter;
+  avro_schema_t schema;
+  reservoir_t *reservoir;
+  columnar_t *columnar;
+  stream_t *stream;
+  parquet_t *parquet;
+  partitioner_t *partitioner; // with --partition-by only
+  follow_t *follow;            // with --follow only
+  struct converter_t *outputs; // with --outputs only
+  size_t outputs_count;
+  struct converter_t *formatters; // with --format-threads only
+  size_t formatters_count;
+  record_ref_t *records; // of the block being formatted in parallel
+  size_t records_capacity;
+  stats_t own_stats; // of outputs and formatters, added up by the file converter
+  const converter_plugin_t *plugin; // --converter generated for the file schema
+  FILE *dest;
+  cache_t *cache;
   avro_value_t value;
-  avro_generic_value_new(iface, &value);
-  cache_t *cache = cache_new();
-  int rval = 0;
-  while (avro_file_reader_read_value(reader, &value) == 0) {
-    if ((rval = avro_value_to_csv(stdout, &value, 1, conf, cache, TRANSFORM_NONE)) != 0) {
-      break;
+  avro_reader_t record_reader;
+  stats_t *stats;
+} converter_t;
+
+static int converter_init(converter_t *converter, avro_value_iface_t *iface,
+                          const config_t *conf, FILE *dest, stats_t *stats) {
+  memset(converter, 0, sizeof(converter_t));
+  converter->conf = conf;
+  converter->dest = dest;
+  converter->stats = stats;
+  CHECKED_EV(avro_generic_value_new(iface, &converter->value));
+  converter->cache = cache_new();
+  converter->record_reader = avro_reader_memory("", 0);
+  return 0;
+}
+
+// Binds transformations and nested paths of --columns to fields of the
+// record, for row conversion
+static int converter_bind_transforms(converter_t *converter) {
+  const config_t *conf = converter->conf;
+  cache_t *cache = converter->cache;
+  if (conf->columns_size == 0 || !is_avro_record(converter->schema)) {
+    return 0;
+  }
+  CHECKED_ALLOC(cache->transforms,
+                (transform_t **)calloc(conf->columns_size, sizeof(transform_t *)));
+  CHECKED_ALLOC(cache->paths, (path_t **)calloc(conf->columns_size, sizeof(path_t *)));
+  cache->transforms_count = conf->columns_size;
+  for (size_t i = 0; i < conf->columns_size; ++i) {
+    const char *name = conf->columns[i].column_name;
+    avro_schema_t field = NULL;
+    if (path_is_nested(name)) {
+      CHECKED_EV(path_new(name, converter->schema, &cache->paths[i]));
+      field = cache->paths[i] != NULL ? cache->paths[i]->leaf : NULL;
+    } else {
+      field = avro_schema_record_field_get(converter->schema, name);
     }
-    if (fputc('\n', stdout) < 0) {
-      rval = ferror(stdout);
-      break;
+    // Missing columns are skipped by row conversion
+    if (field != NULL) {
+      CHECKED_EV(transform_new(&conf->columns[i], field, &cache->transforms[i]));
     }
-    avro_value_reset(&value);
   }
-
-  avro_value_decref(&value);
-  avro_value_iface_decref(iface);
-  cache_free(cache);
-  return rval;
+  return 0;
 }
 
-// Nullable types are represented as UNION of NULL and target schema.
-// This function extracts the target schema from such a UNION.
-static avro_schema_t get_nullable_schema(avro_schema_t schema) {
-  if (is_avro_union(schema)) {
-    const struct avro_union_schema_t *uschema = avro_schema_to_union(schema);
-    if (uschema->branches->num_entries == 2) {
-      union {
-        st_data_t data;
-        avro_schema_t schema;
-      } val1;
-      st_lookup(uschema->branches, 0, &val1.data);
+static int close_outputs(converter_t *converter);
 
-      union {
-        st_data_t data;
-        avro_schema_t schema;
-      } val2;
-      st_lookup(uschema->branches, 1, &val2.data);
+// Adds up memoization counters of the converter, its outputs and formatters
+static void add_memo_stats(const converter_t *converter, stats_t *stats) {
+  for (size_t i = 0; converter->outputs != NULL && i < converter->outputs_count; ++i) {
+    add_memo_stats(&converter->outputs[i], stats);
+  }
+  for (size_t i = 0; converter->formatters != NULL && i < converter->formatters_count; ++i) {
+    add_memo_stats(&converter->formatters[i], stats);
+  }
+  if (converter->columnar != NULL) {
+    columnar_memo_stats(converter->columnar, &stats->memo_lookups, &stats->memo_hits);
+  }
+  if (converter->stream != NULL) {
+    stream_memo_stats(converter->stream, &stats->memo_lookups, &stats->memo_hits);
+  }
+}
 
-      if (val2.schema->type == AVRO_NULL) {
-        schema = val1.schema;
-      } else if (val1.schema->type == AVRO_NULL) {
-        schema = val2.schema;
-      }
+static void converter_free(converter_t *converter) {
+  if (converter->outputs != NULL) {
+    close_outputs(converter);
+    for (size_t i = 0; i < converter->outputs_count; ++i) {
+      converter_free(&converter->outputs[i]);
     }
+    free(converter->outputs);
   }
-  return schema;
+  if (converter->formatters != NULL) {
+    for (size_t i = 0; i < converter->formatters_count; ++i) {
+      converter_free(&converter->formatters[i]);
+    }
+    free(converter->formatters);
+  }
+  free(converter->records);
+  if (converter->record_reader != NULL) {
+    avro_reader_free(converter->record_reader);
+  }
+  if (converter->cache != NULL) {
+    cache_free(converter->cache);
+  }
+  if (converter->value.iface != NULL) {
+    avro_value_decref(&converter->value);
+  }
+  if (converter->filter != NULL) {
+    filter_free(converter->filter);
+  }
+  if (converter->reservoir != NULL) {
+    reservoir_free(converter->reservoir);
+    free(converter->reservoir);
+  }
+  if (converter->columnar != NULL) {
+    columnar_free(converter->columnar);
+  }
+  if (converter->stream != NULL) {
+    stream_free(converter->stream);
+  }
+  if (converter->parquet != NULL) {
+    parquet_free(converter->parquet);
+  }
+  if (converter->partitioner != NULL) {
+    partitioner_free(converter->partitioner);
+  }
+#if !defined(_WIN32)
+  if (converter->follow != NULL) {
+    follow_free(converter->follow);
+  }
+#endif
 }
 
-static int print_schema(avro_schema_t schema) {
-  schema = get_nullable_schema(schema);
-
-  if (!is_avro_record(schema)) {
-    avro_set_error("Can't find root record schema");
-    return EINVAL;
+static int convert_record(converter_t *converter, const avro_value_t *value) {
+  if (converter->conf->output_csv) {
+    return record_to_csv(converter->dest, value, converter->conf, converter->cache);
   }
+  return record_to_json(converter->dest, value, converter->conf, converter->cache);
+}
 
-  struct avro_record_schema_t *record_schema = avro_schema_to_record(schema);
-  json_t *result = json_array();
-  if (result == NULL) {
-    avro_set_error("Cannot allocate JSON array");
-    return ENOMEM;
+// Converts a binary encoded record starting at '*p' without decoding it into
+// a generic value: it's either added to the column batch, or streamed.
+static int convert_binary_record(converter_t *converter, const char **p, const char *end) {
+  if (converter->columnar != NULL) {
+    return columnar_append(converter->columnar, p, end);
   }
+  if (converter->parquet != NULL) {
+    CHECKED_EV(parquet_append(converter->parquet, p, end));
+  } else {
+    CHECKED_EV(stream_record(converter->stream, p, end));
+  }
+  converter->stats->records++;
+  return 0;
+}
 
-  for (int i = 0; i < record_schema->fields->num_entries; i++) {
-    union {
-      st_data_t data;
-      struct avro_record_field_t *field;
-    } val;
-    st_lookup(record_schema->fields, i, &val.data);
-
-    avro_schema_t field_schema = get_nullable_schema(val.field->type);
-    avro_logical_schema_t *logical_type = avro_logical_schema(field_schema);
+// Switches output to the partition of the record, with --partition-by
+static int route_record(converter_t *converter, const char *record, size_t size) {
+  // Output buffered for the previous record goes to its partition, which
+  // might be closed by routing this one
+  if (converter->stream != NULL) {
+    CHECKED_EV(stream_flush(converter->stream));
+  }
+  CHECKED_EV(partitioner_route(converter->partitioner, record, record + size, &converter->dest));
+  if (converter->stream != NULL) {
+    stream_set_dest(converter->stream, converter->dest);
+  }
+  return 0;
+}
 
-    json_t *obj;
-    CHECKED_ALLOC(obj, json_object());
-    json_object_set_new(obj, "name", json_string(val.field->name));
+static int decode_record(converter_t *converter, const char *record, size_t size) {
+  avro_reader_memory_set_source(converter->record_reader, record, size);
+  avro_value_reset(&converter->value);
+  CHECKED_EV(avro_value_read(converter->record_reader, &converter->value));
+  return 0;
+}
 
-    int found_logical_type = 0;
-    if (logical_type != NULL) {
-      switch (logical_type->type) {
-      case AVRO_DECIMAL:
-        json_object_set_new(obj, "type", json_string_nocheck("decimal"));
-        found_logical_type = 1;
-        break;
-      case AVRO_DATE:
-      case AVRO_TIME_MILLIS:
-      case AVRO_TIME_MICROS:
-      case AVRO_TIMESTAMP_MILLIS:
-      case AVRO_TIMESTAMP_MICROS:
-        json_object_set_new(obj, "type", json_string_nocheck("datetime"));
-        found_logical_type = 1;
-        break;
-      case AVRO_DURATION:
-        json_object_set_new(obj, "type", json_string_nocheck("timespan"));
-        found_logical_type = 1;
-        break;
-      }
+// Converts the record with each of --outputs. Outputs converting binary
+// records don't need it decoded, and the rest share one generic value.
+static int fan_out_record(converter_t *converter, const char *record, size_t size) {
+  int decoded = 0;
+  for (size_t i = 0; i < converter->outputs_count; ++i) {
+    converter_t *output = &converter->outputs[i];
+    if (output->columnar != NULL || output->stream != NULL) {
+      const char *p = record;
+      CHECKED_EV(convert_binary_record(output, &p, record + size));
+      continue;
     }
-
-    if (!found_logical_type) {
-      switch (field_schema->type) {
-      case AVRO_FIXED:
-      case AVRO_NULL:
-      case AVRO_STRING:
-      case AVRO_ENUM:
-        json_object_set_new(obj, "type", json_string_nocheck("string"));
-        break;
-      case AVRO_INT32:
-        json_object_set_new(obj, "type", json_string_nocheck("int"));
-        break;
-      case AVRO_INT64:
-        json_object_set_new(obj, "type", json_string_nocheck("long"));
-        break;
-      case AVRO_FLOAT:
-      case AVRO_DOUBLE:
-        json_object_set_new(obj, "type", json_string_nocheck("real"));
-        break;
-      case AVRO_BOOLEAN:
-        json_object_set_new(obj, "type", json_string_nocheck("bool"));
-        break;
-      case AVRO_BYTES:
-      default:
-        json_object_set_new(obj, "type", json_string_nocheck("dynamic"));
-        break;
-      }
+    if (!decoded) {
+      CHECKED_EV(decode_record(converter, record, size));
+      decoded = 1;
     }
-    json_array_append_new(result, obj);
+    CHECKED_EV(convert_record(output, &converter->value));
   }
+  converter->stats->records++;
+  return 0;
+}
 
-  int rval = json_dumpf(result, stdout, JSON_ENCODE_FLAGS);
-  json_decref(result);
-  return rval;
+static int decode_and_convert(converter_t *converter, const char *record, size_t size) {
+  if (converter->outputs != NULL) {
+    return fan_out_record(converter, record, size);
+  }
+  if (converter->partitioner != NULL) {
+    CHECKED_EV(route_record(converter, record, size));
+  }
+  if (converter->columnar != NULL || converter->stream != NULL || converter->parquet != NULL) {
+    return convert_binary_record(converter, &record, record + size);
+  }
+  CHECKED_EV(decode_record(converter, record, size));
+  CHECKED_EV(convert_record(converter, &converter->value));
+  converter->stats->records++;
+  return 0;
 }
 
-static int process_file(const char *filename, const config_t *conf) {
-  avro_file_reader_t reader;
-  if (avro_file_reader(filename, &reader)) {
-    fprintf(stderr, "Error opening file '%s': %s\n", filename, avro_strerror());
-    exit(1);
+static int flush_batch(converter_t *converter) {
+  for (size_t i = 0; i < converter->outputs_count; ++i) {
+    CHECKED_EV(flush_batch(&converter->outputs[i]));
   }
+  if (converter->columnar != NULL) {
+    size_t records;
+    CHECKED_EV(columnar_flush(converter->columnar, converter->dest, &records));
+    converter->stats->records += records;
+  }
+  if (converter->stream != NULL) {
+    CHECKED_EV(stream_flush(converter->stream));
+  }
+  return 0;
+}
 
-  avro_schema_t wschema = avro_file_reader_get_writer_schema(reader);
+#if !defined(_WIN32)
+// Blocks smaller than this are formatted by a single thread, since starting
+// threads would take a good part of the time saved
+#define FORMAT_THREADS_MIN_BLOCK_SIZE (1024 * 1024)
+
+// Range of records of a block, formatted by one of --format-threads
+typedef struct {
+  converter_t *formatter;
+  const record_ref_t *records;
+  size_t count;
+  char *data; // formatted output
+  size_t size;
   int rval;
-  if (conf->show_schema) {
-    rval = print_schema(wschema);
-  } else {
-    if (conf->output_csv) {
-      rval = avro_file_to_csv(reader, wschema, conf);
+  char message[256];
+} format_task_t;
+
+static void *format_records(void *arg) {
+  format_task_t *task = (format_task_t *)arg;
+  converter_t *formatter = task->formatter;
+  FILE *mem = open_memstream(&task->data, &task->size);
+  if (mem == NULL) {
+    task->rval = errno;
+    avro_set_error("Cannot allocate output buffer: %s", strerror(errno));
+    snprintf(task->message, sizeof(task->message), "%s", avro_strerror());
+    return NULL;
+  }
+  formatter->dest = mem;
+  if (formatter->stream != NULL) {
+    stream_set_dest(formatter->stream, mem);
+  }
+  int rval = 0;
+  for (size_t i = 0; rval == 0 && i < task->count; ++i) {
+    rval = decode_and_convert(formatter, task->records[i].data, task->records[i].size);
+  }
+  if (rval == 0) {
+    rval = flush_batch(formatter);
+  }
+  if (fclose(mem) != 0 && rval == 0) {
+    rval = errno;
+    avro_set_error("Cannot write output buffer: %s", strerror(errno));
+  }
+  formatter->dest = NULL;
+  if ((task->rval = rval) != 0) {
+    snprintf(task->message, sizeof(task->message), "%s", avro_strerror());
+  }
+  return NULL;
+}
+
+// Formats records of a large block with --format-threads. Boundaries of the
+// records are found by a sequential pass skipping over them (or evaluating
+// --where), and then consecutive ranges of records are formatted by separate
+// threads into memory, and written in order.
+static int convert_block_parallel(converter_t *converter, const char *data, size_t size,
+                                  int64_t count) {
+  const char *p = data, *end = data + size;
+  if ((size_t)count > converter->records_capacity) {
+    record_ref_t *records = (record_ref_t *)realloc(converter->records, count * sizeof(record_ref_t));
+    if (records == NULL) {
+      avro_set_error("Cannot allocate boundaries of %lld records", (long long)count);
+      return ENOMEM;
+    }
+    converter->records = records;
+    converter->records_capacity = (size_t)count;
+  }
+  size_t records_count = 0;
+  for (int64_t i = 0; i < count; ++i) {
+    const char *record = p;
+    if (converter->filter != NULL) {
+      int matches;
+      CHECKED_EV(filter_eval(converter->filter, &p, end, &matches));
+      if (!matches) {
+        continue;
+      }
+    } else {
+      CHECKED_EV(binary_skip(converter->schema, &p, end));
+    }
+    converter->records[records_count].data = record;
+    converter->records[records_count].size = p - record;
+    records_count++;
+  }
+
+  size_t tasks_count = converter->formatters_count;
+  size_t per_task = (records_count + tasks_count - 1) / tasks_count;
+  format_task_t tasks[FORMAT_THREADS_MAX];
+  pthread_t threads[FORMAT_THREADS_MAX];
+  int started[FORMAT_THREADS_MAX];
+  memset(tasks, 0, sizeof(tasks));
+  for (size_t i = 0; i < tasks_count; ++i) {
+    size_t first = i * per_task < records_count ? i * per_task : records_count;
+    size_t last = first + per_task < records_count ? first + per_task : records_count;
+    tasks[i].formatter = &converter->formatters[i];
+    tasks[i].formatter->own_stats.records = 0;
+    tasks[i].records = converter->records + first;
+    tasks[i].count = last - first;
+  }
+  // The first range is formatted by the calling thread, and others by new
+  // threads, or also by the calling thread when a thread can't be started
+  for (size_t i = 1; i < tasks_count; ++i) {
+    started[i] = pthread_create(&threads[i], NULL, format_records, &tasks[i]) == 0;
+  }
+  format_records(&tasks[0]);
+  for (size_t i = 1; i < tasks_count; ++i) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
     } else {
-      rval = avro_file_to_json(reader, wschema, conf);
+      format_records(&tasks[i]);
+    }
+  }
+
+  int rval = 0;
+  for (size_t i = 0; i < tasks_count; ++i) {
+    if (rval == 0 && tasks[i].rval != 0) {
+      avro_set_error("%s", tasks[i].message);
+      rval = tasks[i].rval;
+    }
+    if (rval == 0 && tasks[i].size > 0 &&
+        fwrite(tasks[i].data, 1, tasks[i].size, converter->dest) != tasks[i].size) {
+      avro_set_error("Cannot write output: %s", strerror(errno));
+      rval = EIO;
     }
+    if (rval == 0) {
+      converter->stats->records += tasks[i].formatter->own_stats.records;
+    }
+    free(tasks[i].data);
   }
-  avro_schema_decref(wschema);
-  avro_file_reader_close(reader);
   return rval;
 }
+#endif
 
-static void print_usage(const char *exe) {
-  fprintf(stderr,
+// Decodes and converts records of a decompressed block. Records rejected by
+// --where filter are skipped without being decoded into a generic value, and
+// with --sample-rows only records kept in the sample are copied for later.
+static int convert_block(converter_t *converter, const char *data, size_t size,
+                         int64_t count) {
+  const char *p = data, *end = data + size;
+#if !defined(_WIN32)
+  if (converter->formatters != NULL && size >= FORMAT_THREADS_MIN_BLOCK_SIZE) {
+    return convert_block_parallel(converter, data, size, count);
+  }
+#endif
+  int by_record = converter->filter != NULL || converter->reservoir != NULL ||
+                  converter->partitioner != NULL || converter->outputs != NULL;
+
+  if (!by_record) {
+    if (converter->columnar != NULL || converter->stream != NULL || converter->parquet != NULL) {
+      for (int64_t i = 0; i < count; ++i) {
+        CHECKED_EV(convert_binary_record(converter, &p, end));
+      }
+      return flush_batch(converter);
+    }
+    avro_reader_memory_set_source(converter->record_reader, data, size);
+    for (int64_t i = 0; i < count; ++i) {
+      avro_value_reset(&converter->value);
+      CHECKED_EV(avro_value_read(converter->record_reader, &converter->value));
+      CHECKED_EV(convert_record(converter, &converter->value));
+      converter->stats->records++;
+    }
+    return 0;
+  }
+
+  for (int64_t i = 0; i < count; ++i) {
+    const char *record = p;
+    if (converter->filter != NULL) {
+      int matches;
+      CHECKED_EV(filter_eval(converter->filter, &p, end, &matches));
+      if (!matches) {
+        continue;
+      }
+    } else {
+      CHECKED_EV(binary_skip(converter->schema, &p, end));
+    }
+
+    if (converter->reservoir != NULL) {
+      CHECKED_EV(reservoir_offer(converter->reservoir, record, p - record));
+    } else {
+      CHECKED_EV(decode_and_convert(converter, record, p - record));
+    }
+  }
+  return flush_batch(converter);
+}
+
+// Converts records kept by --sample-rows, in their input order
+static int convert_reservoir(converter_t *converter) {
+  reservoir_t *reservoir = converter->reservoir;
+  reservoir_finish(reservoir);
+  for (size_t i = 0; i < reservoir->size; ++i) {
+    CHECKED_EV(decode_and_convert(converter, reservoir->slots[i].data,
+                                  reservoir->slots[i].size));
+  }
+  return flush_batch(converter);
+}
+
+// Verifies that the block consists of exactly 'count' well-formed records,
+// so that a corrupt block is detected before any of its records is written
+static int check_block(avro_schema_t schema, const char *data, size_t size, int64_t count) {
+  const char *p = data, *end = data + size;
+  for (int64_t i = 0; i < count; ++i) {
+    CHECKED_EV(binary_skip(schema, &p, end));
+  }
+  if (p != end) {
+    avro_set_error("Block has %lld bytes after its last record", (long long)(end - p));
+    return EILSEQ;
+  }
+  return 0;
+}
+
+// Skips the corrupt block starting at the offset, resuming at the next sync
+// marker. Number of records is negative when block header isn't readable.
+static int skip_corrupt_block(container_reader_t *reader, converter_t *converter,
+                              int64_t offset, int64_t records) {
+  char reason[256];
+  snprintf(reason, sizeof(reason), "%s", avro_strerror());
+
+  int64_t next;
+  int rval = container_resync(reader, offset, &next);
+  if (rval != 0 && rval != CONTAINER_EOF) {
+    return rval;
+  }
+
+  stats_t *stats = converter->stats;
+  stats->skipped_blocks++;
+  stats->skipped_records += records > 0 ? (size_t)records : 0;
+  stats->skipped_bytes += next - offset;
+  if (records >= 0) {
+    fprintf(stderr, "Warning: skipped corrupt block at bytes %lld-%lld (%lld records): %s\n",
+            (long long)offset, (long long)next, (long long)records, reason);
+  } else {
+    fprintf(stderr, "Warning: skipped corrupt data at bytes %lld-%lld: %s\n",
+            (long long)offset, (long long)next, reason);
+  }
+  return 0;
+}
+
+// Reads, decompresses and verifies the next block, or skips it
+static int read_block(container_reader_t *reader, converter_t *converter,
+                      const block_header_t *block, int64_t block_index,
+                      const char **data, size_t *size) {
+  const config_t *conf = converter->conf;
+  // Blocks outside of --sample-blocks are skipped using their size, so
+  // they are neither read nor decompressed
+  if (conf->sample_blocks > 0 &&
+      !sample_block_selected(conf->seed, block_index, conf->sample_blocks)) {
+    *data = NULL;
+    return container_skip_block(reader, block);
+  }
+  size_t memory_limit = conf->memory_limit > 0 ? conf->memory_limit : DEFAULT_MEMORY_LIMIT;
+  if ((uint64_t)block->size > memory_limit) {
+    avro_set_error("Block of %lld bytes at offset %lld exceeds memory limit of %zu bytes "
+                   "(see --memory-limit)",
+                   (long long)block->size, (long long)block->offset, memory_limit);
+    return EFBIG;
+  }
+  CHECKED_EV(container_read_block(reader, block, memory_limit, data, size));
+  if (conf->skip_corrupt_blocks) {
+    CHECKED_EV(check_block(converter->schema, *data, *size, block->count));
+  }
+  return 0;
+}
+
+#if !defined(_WIN32)
+// Reads header of the next block once the whole block, up to its sync marker,
+// has been written to the followed file, waiting for it as long as needed
+static int follow_next_block(container_reader_t *reader, follow_t *follow,
+                             block_header_t *block) {
+  int64_t offset = ftello(reader->fp);
+  for (;;) {
+    int64_t size;
+    CHECKED_EV(follow_size(follow, &size));
+    if (size > offset) {
+      int rval = container_next_block(reader, block);
+      if (rval == 0 && block->data_offset + block->size + CONTAINER_SYNC_SIZE <= size) {
+        return 0;
+      }
+      // Header of the block being written may be incomplete, but not when
+      // the longest possible header is already there
+      if (rval != 0 && rval != CONTAINER_EOF &&
+          size - offset >= CONTAINER_BLOCK_HEADER_MAX_SIZE) {
+        return rval;
+      }
+      CHECKED_EV(container_seek(reader, offset));
+    }
+    CHECKED_EV(follow_wait(follow, size));
+  }
+}
+#endif
+
+// Gets the next block header, waiting for it with --follow
+static int next_block(container_reader_t *reader, converter_t *converter,
+                      block_header_t *block) {
+#if !defined(_WIN32)
+  if (converter->follow != NULL) {
+    return follow_next_block(reader, converter->follow, block);
+  }
+#else
+  (void)converter;
+#endif
+  return container_next_block(reader, block);
+}
+
+// Flushes buffered output to the destination file(s)
+static int flush_output(converter_t *converter) {
+  if (converter->partitioner != NULL) {
+    return partitioner_flush(converter->partitioner);
+  }
+  for (size_t i = 0; i < converter->outputs_count; ++i) {
+    CHECKED_EV(flush_output(&converter->outputs[i]));
+  }
+  if (fflush(converter->dest) != 0) {
+    avro_set_error("Cannot write output: %s", strerror(errno));
+    return EIO;
+  }
+  return 0;
+}
+
+// Interval of --checkpoint saves
+#define CHECKPOINT_INTERVAL_SECONDS 10
+
+// Truncates the output to the position saved in the checkpoint, discarding
+// records written after it, so that they aren't duplicated when resuming
+static int truncate_output(FILE *dest, int64_t offset) {
+  int64_t size = ftello(dest);
+  if (size < offset) {
+    avro_set_error("Output has %lld bytes, but checkpoint expects at least %lld "
+                   "(output must be appended to, not overwritten)",
+                   (long long)size, (long long)offset);
+    return EINVAL;
+  }
+#if defined(_WIN32)
+  int failed = _chsize_s(_fileno(dest), offset) != 0;
+#else
+  int failed = ftruncate(fileno(dest), (off_t)offset) != 0;
+#endif
+  if (failed || fseeko(dest, offset, SEEK_SET) != 0) {
+    avro_set_error("Cannot truncate output: %s", strerror(errno));
+    return EIO;
+  }
+  return 0;
+}
+
+// Fingerprint of the options which the output depends on, saved with
+// --checkpoint so that output written with other ones isn't resumed
+static int options_fingerprint(const config_t *conf, uint64_t *fingerprint) {
+  json_t *columns = json_array();
+  for (size_t i = 0; columns != NULL && i < conf->columns_size; ++i) {
+    const column_info_t *column = &conf->columns[i];
+    if (json_array_append_new(columns, json_pack("[s,i,f,s?]", column->column_name,
+                                                 (int)column->transformation,
+                                                 column->transformation_arg,
+                                                 column->output_name)) != 0) {
+      json_decref(columns);
+      columns = NULL;
+    }
+  }
+  json_t *options =
+      json_pack("{s:b,s:b,s:b,s:b,s:s?,s:s?,s:f,s:I,s:b,s:o?}", "prune", conf->prune,
+                "logical_types", conf->logical_types, "ms_hadoop_logical_types",
+                conf->ms_hadoop_logical_types, "csv", conf->output_csv, "flatten", conf->flatten,
+                "where", conf->where, "sample_blocks", conf->sample_blocks, "seed",
+                (json_int_t)conf->seed, "skip_corrupt_blocks", conf->skip_corrupt_blocks,
+                "columns", columns);
+  char *content = options != NULL ? json_dumps(options, JSON_COMPACT | JSON_SORT_KEYS) : NULL;
+  json_decref(options);
+  if (columns == NULL || content == NULL) {
+    free(content);
+    avro_set_error("Cannot allocate JSON options");
+    return ENOMEM;
+  }
+  *fingerprint = rabin_fingerprint(content, strlen(content));
+  free(content);
+  return 0;
+}
+
+// Resumes from the --checkpoint saved by a previous run, if any: positions
+// the reader at the next block to convert, and the output right after the
+// records written for the blocks before it
+static int resume_checkpoint(container_reader_t *reader, converter_t *converter,
+                             uint64_t options, int64_t *block_index) {
+  const config_t *conf = converter->conf;
+  // Output position is only known for files, which are positioned at their
+  // end in case they are appended to
+  if (fflush(converter->dest) != 0) {
+    avro_set_error("Cannot write output: %s", strerror(errno));
+    return EIO;
+  }
+  fseeko(converter->dest, 0, SEEK_END);
+
+  checkpoint_t checkpoint;
+  int rval = checkpoint_load(conf->checkpoint, &checkpoint);
+  if (rval == ENOENT) {
+    return 0;
+  }
+  CHECKED_EV(rval);
+  if (memcmp(checkpoint.sync, reader->sync, CONTAINER_SYNC_SIZE)) {
+    avro_set_error("Checkpoint '%s' was saved for another input file", conf->checkpoint);
+    return EINVAL;
+  }
+  if (checkpoint.options != options) {
+    avro_set_error("Checkpoint '%s' was saved with other output options, like --columns, "
+                   "--csv or --where",
+                   conf->checkpoint);
+    return EINVAL;
+  }
+  if (checkpoint.output_offset >= 0) {
+    CHECKED_EV(truncate_output(converter->dest, checkpoint.output_offset));
+  }
+  CHECKED_EV(container_seek(reader, checkpoint.offset));
+  *block_index = checkpoint.blocks;
+  converter->stats->records = (size_t)checkpoint.records;
+  return 0;
+}
+
+// Moves the checkpoint to the current position of the reader, once all
+// blocks before it are converted
+static void mark_checkpoint(container_reader_t *reader, converter_t *converter,
+                            int64_t block_index, checkpoint_t *checkpoint) {
+  memcpy(checkpoint->sync, reader->sync, CONTAINER_SYNC_SIZE);
+  checkpoint->offset = ftello(reader->fp);
+  checkpoint->blocks = block_index;
+  checkpoint->records = (int64_t)converter->stats->records;
+  checkpoint->output_offset = ftello(converter->dest);
+}
+
+// Saves --checkpoint after the output of all blocks before it is flushed to
+// disk
+static int save_checkpoint(converter_t *converter, const checkpoint_t *checkpoint) {
+  FILE *dest = converter->dest;
+  if (fflush(dest) != 0) {
+    avro_set_error("Cannot write output: %s", strerror(errno));
+    return EIO;
+  }
+#if !defined(_WIN32)
+  // Pipes and terminals can't be synced, nor resumed at a position
+  fsync(fileno(dest));
+#endif
+  return checkpoint_save(converter->conf->checkpoint, checkpoint);
+}
+
+#if !defined(_WIN32)
+// Number of blocks, and of their converted outputs, in flight with --pipeline
+#define PIPELINE_DEPTH 4
+
+// Decompressed block, passed from the reader to the converter thread
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+  int64_t count;
+} pipeline_block_t;
+
+// Converted block, passed from the converter to the writer thread
+typedef struct {
+  char *data;
+  size_t size;
+} pipeline_output_t;
+
+// State of --pipeline conversion, where a reader thread reads and decompresses
+// blocks, the calling thread converts them, and a writer thread writes their
+// output. Block and output handles go around a pair of rings between each two
+// stages, so that a stage waits when the next one falls behind.
+typedef struct {
+  container_reader_t *reader;
+  converter_t *converter;
+  FILE *dest;
+  ring_t blocks;       // read, to be converted
+  ring_t free_blocks;  // converted, to be reused by the reader
+  ring_t outputs;      // converted, to be written
+  ring_t free_outputs; // written, to be reused by the converter
+  pipeline_block_t block_slots[PIPELINE_DEPTH];
+  pipeline_output_t output_slots[PIPELINE_DEPTH];
+  int read_error;
+  int write_error;
+  char message[256]; // of the read or write error
+} pipeline_t;
+
+static void pipeline_failed(pipeline_t *pipeline, int *error, int rval) {
+  *error = rval;
+  snprintf(pipeline->message, sizeof(pipeline->message), "%s", avro_strerror());
+}
+
+static void *pipeline_read(void *arg) {
+  pipeline_t *pipeline = (pipeline_t *)arg;
+  container_reader_t *reader = pipeline->reader;
+  converter_t *converter = pipeline->converter;
+  block_header_t header;
+  int64_t block_index = 0;
+  int rval;
+  for (;;) {
+    const char *data = NULL;
+    size_t size;
+    if ((rval = container_next_block(reader, &header)) == CONTAINER_EOF) {
+      rval = 0;
+      break;
+    }
+    int header_read = rval == 0;
+    if (header_read) {
+      rval = read_block(reader, converter, &header, block_index++, &data, &size);
+    }
+    if (rval != 0) {
+      if (!converter->conf->skip_corrupt_blocks || rval != EILSEQ ||
+          (rval = skip_corrupt_block(reader, converter, header.offset,
+                                     header_read ? header.count : -1)) != 0) {
+        break;
+      }
+      continue;
+    }
+    if (data == NULL) {
+      continue;
+    }
+
+    // Converter stopped, when there's no block to reuse
+    pipeline_block_t *block = (pipeline_block_t *)ring_pop(&pipeline->free_blocks);
+    if (block == NULL) {
+      break;
+    }
+    if (size > block->capacity) {
+      char *buf = (char *)realloc(block->data, size);
+      if (buf == NULL) {
+        avro_set_error("Cannot allocate %zu bytes for a block", size);
+        rval = ENOMEM;
+        break;
+      }
+      block->data = buf;
+      block->capacity = size;
+    }
+    memcpy(block->data, data, size);
+    block->size = size;
+    block->count = header.count;
+    if (ring_push(&pipeline->blocks, block) != 0) {
+      break;
+    }
+  }
+  if (rval != 0) {
+    pipeline_failed(pipeline, &pipeline->read_error, rval);
+  }
+  ring_close(&pipeline->blocks);
+  return NULL;
+}
+
+static void *pipeline_write(void *arg) {
+  pipeline_t *pipeline = (pipeline_t *)arg;
+  pipeline_output_t *output;
+  while ((output = (pipeline_output_t *)ring_pop(&pipeline->outputs)) != NULL) {
+    if (pipeline->write_error == 0 && output->size > 0 &&
+        fwrite(output->data, 1, output->size, pipeline->dest) != output->size) {
+      avro_set_error("Cannot write output: %s", strerror(errno));
+      pipeline_failed(pipeline, &pipeline->write_error, EIO);
+      // Stops the converter, while outputs already converted are discarded
+      ring_close(&pipeline->free_outputs);
+    }
+    free(output->data);
+    output->data = NULL;
+    ring_push(&pipeline->free_outputs, output);
+  }
+  return NULL;
+}
+
+// Converts the block into a memory buffer, passed on to the writer thread
+static int pipeline_convert(converter_t *converter, const pipeline_block_t *block,
+                            pipeline_output_t *output) {
+  FILE *mem = open_memstream(&output->data, &output->size);
+  if (mem == NULL) {
+    return errno;
+  }
+  converter->dest = mem;
+  if (converter->stream != NULL) {
+    stream_set_dest(converter->stream, mem);
+  }
+  int rval = convert_block(converter, block->data, block->size, block->count);
+  if (fclose(mem) != 0 && rval == 0) {
+    rval = errno;
+  }
+  return rval;
+}
+
+static void pipeline_destroy(pipeline_t *pipeline) {
+  ring_t *rings[] = {&pipeline->blocks, &pipeline->free_blocks, &pipeline->outputs,
+                     &pipeline->free_outputs};
+  for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); ++i) {
+    if (rings[i]->slots != NULL) {
+      ring_destroy(rings[i]);
+    }
+  }
+  for (size_t i = 0; i < PIPELINE_DEPTH; ++i) {
+    free(pipeline->block_slots[i].data);
+  }
+}
+
+// Converts all blocks of the file with --pipeline, overlapping reading and
+// decompression, conversion, and writing of consecutive blocks. Blocks go
+// through whole, so options which trim, sample, checkpoint, follow or report
+// between blocks are rejected.
+static int convert_file_pipelined(container_reader_t *reader, converter_t *converter) {
+  const config_t *conf = converter->conf;
+  if (conf->rows || conf->sample_rows > 0 || conf->checkpoint != NULL || conf->follow ||
+      conf->mem_stats) {
+    avro_set_error("Option --pipeline can't be combined with --rows, --sample-rows, --checkpoint, --follow or --mem-stats");
+    return EINVAL;
+  }
+  pipeline_t pipeline;
+  memset(&pipeline, 0, sizeof(pipeline_t));
+  pipeline.reader = reader;
+  pipeline.converter = converter;
+  pipeline.dest = converter->dest;
+  int rval;
+  if ((rval = ring_init(&pipeline.blocks, PIPELINE_DEPTH)) != 0 ||
+      (rval = ring_init(&pipeline.free_blocks, PIPELINE_DEPTH)) != 0 ||
+      (rval = ring_init(&pipeline.outputs, PIPELINE_DEPTH)) != 0 ||
+      (rval = ring_init(&pipeline.free_outputs, PIPELINE_DEPTH)) != 0) {
+    pipeline_destroy(&pipeline);
+    return rval;
+  }
+  for (size_t i = 0; i < PIPELINE_DEPTH; ++i) {
+    ring_push(&pipeline.free_blocks, &pipeline.block_slots[i]);
+    ring_push(&pipeline.free_outputs, &pipeline.output_slots[i]);
+  }
+
+  pthread_t reader_thread, writer_thread;
+  if ((rval = pthread_create(&reader_thread, NULL, pipeline_read, &pipeline)) != 0) {
+    avro_set_error("Cannot start reader thread: %s", strerror(rval));
+    pipeline_destroy(&pipeline);
+    return rval;
+  }
+  if ((rval = pthread_create(&writer_thread, NULL, pipeline_write, &pipeline)) != 0) {
+    avro_set_error("Cannot start writer thread: %s", strerror(rval));
+    ring_close(&pipeline.free_blocks);
+    ring_close(&pipeline.blocks);
+    pthread_join(reader_thread, NULL);
+    pipeline_destroy(&pipeline);
+    return rval;
+  }
+
+  pipeline_block_t *block;
+  while ((block = (pipeline_block_t *)ring_pop(&pipeline.blocks)) != NULL) {
+    pipeline_output_t *output = (pipeline_output_t *)ring_pop(&pipeline.free_outputs);
+    if (output == NULL) {
+      break; // writer failed
+    }
+    rval = pipeline_convert(converter, block, output);
+    ring_push(&pipeline.free_blocks, block);
+    if (rval != 0 || ring_push(&pipeline.outputs, output) != 0) {
+      free(output->data);
+      output->data = NULL;
+      break;
+    }
+  }
+  // Stops the reader if the converter stopped early, and lets the writer
+  // finish the outputs already converted
+  ring_close(&pipeline.free_blocks);
+  ring_close(&pipeline.blocks);
+  ring_close(&pipeline.outputs);
+  pthread_join(reader_thread, NULL);
+  pthread_join(writer_thread, NULL);
+  converter->dest = pipeline.dest;
+  if (converter->stream != NULL) {
+    stream_set_dest(converter->stream, pipeline.dest);
+  }
+
+  if (rval == 0 && (pipeline.read_error != 0 || pipeline.write_error != 0)) {
+    avro_set_error("%s", pipeline.message);
+    rval = pipeline.read_error != 0 ? pipeline.read_error : pipeline.write_error;
+  }
+  pipeline_destroy(&pipeline);
+  return rval;
+}
+#endif
+
+// Returns path of the index next to the Avro file, to be freed by the caller
+static char *index_path(const char *path) {
+  size_t size = strlen(path) + sizeof(INDEX_SUFFIX);
+  char *result = (char *)malloc(size);
+  if (result != NULL) {
+    snprintf(result, size, "%s%s", path, INDEX_SUFFIX);
+  }
+  return result;
+}
+
+// Positions the reader at the block holding the first record of --rows. It
+// starts from the closest block in the index of the file when there's one,
+// and walks block headers from there, so that a stale index still works.
+// Sets index and first record ordinal of that block.
+static int seek_rows(container_reader_t *reader, const config_t *conf, int64_t *block_index,
+                     int64_t *first_record) {
+  int64_t offset = reader->header_size;
+  *block_index = 0;
+  *first_record = 0;
+
+  char *path;
+  CHECKED_ALLOC(path, index_path(reader->path));
+  record_index_t index;
+  index_entry_t found = {0};
+  int rval = index_load(path, &index);
+  if (rval == 0) {
+    const index_entry_t *entry = index_find(&index, conf->rows_begin);
+    if (memcmp(index.sync, reader->sync, CONTAINER_SYNC_SIZE)) {
+      avro_set_error("Index '%s' was built for another file", path);
+      rval = EINVAL;
+    } else if (entry != NULL) {
+      found = *entry;
+      offset = entry->offset;
+      *block_index = entry - index.entries;
+      *first_record = entry->first_record;
+    }
+    index_free(&index);
+  } else if (rval == ENOENT) {
+    rval = 0;
+  }
+
+  // Files written by the same writer may share their sync marker, so the
+  // block found in the index must also be there in the file
+  block_header_t block;
+  if (rval == 0 && found.count > 0 && (rval = container_seek(reader, offset)) == 0 &&
+      (container_next_block(reader, &block) != 0 || block.count != found.count ||
+       block.size != found.size)) {
+    avro_set_error("Index '%s' doesn't match the file", path);
+    rval = EINVAL;
+  }
+  free(path);
+  CHECKED_EV(rval);
+
+  CHECKED_EV(container_seek(reader, offset));
+  while ((rval = container_next_block(reader, &block)) == 0) {
+    if (*first_record + block.count > conf->rows_begin) {
+      return container_seek(reader, block.offset);
+    }
+    CHECKED_EV(container_skip_block(reader, &block));
+    *first_record += block.count;
+    (*block_index)++;
+  }
+  return rval == CONTAINER_EOF ? 0 : rval;
+}
+
+// Narrows the block, whose first record has the given ordinal, to records of
+// --rows. Records before them are skipped without being decoded.
+static int trim_block(avro_schema_t schema, const config_t *conf, int64_t first_record,
+                      const char **data, size_t *size, int64_t *count) {
+  const char *p = *data, *end = *data + *size;
+  int64_t skip = conf->rows_begin > first_record ? conf->rows_begin - first_record : 0;
+  int64_t keep = conf->rows_end - first_record < *count ? conf->rows_end - first_record : *count;
+  keep = keep > skip ? keep - skip : 0;
+  for (int64_t i = 0; i < skip && i < *count; ++i) {
+    CHECKED_EV(binary_skip(schema, &p, end));
+  }
+  const char *start = p;
+  if (skip + keep < *count) {
+    for (int64_t i = 0; i < keep; ++i) {
+      CHECKED_EV(binary_skip(schema, &p, end));
+    }
+    end = p;
+  }
+  *data = start;
+  *size = end - start;
+  *count = keep;
+  return 0;
+}
+
+// Converts blocks from the current position of the reader to the end of the
+// file. With --checkpoint, 'progress' follows the last converted block.
+static int convert_blocks(container_reader_t *reader, converter_t *converter,
+                          int64_t block_index, int64_t first_record, checkpoint_t *progress) {
+  const config_t *conf = converter->conf;
+  block_header_t block;
+  time_t checkpoint_saved = time(NULL);
+  int rval;
+  for (;;) {
+    const char *data = NULL;
+    size_t size;
+#if defined(__linux__)
+    mem_snapshot_t block_mem;
+    if (conf->mem_stats) {
+      memstats_begin(MEM_SCOPE_BLOCK, &block_mem);
+    }
+#endif
+    if ((rval = next_block(reader, converter, &block)) == CONTAINER_EOF) {
+      break;
+    }
+    int header_read = rval == 0;
+    if (header_read) {
+      rval = read_block(reader, converter, &block, block_index++, &data, &size);
+    }
+    if (rval != 0) {
+      // Only malformed data is skipped, failing to read or allocate isn't
+      // a corrupt block
+      if (!conf->skip_corrupt_blocks || rval != EILSEQ) {
+        return rval;
+      }
+      CHECKED_EV(skip_corrupt_block(reader, converter, block.offset, header_read ? block.count : -1));
+      first_record += header_read ? block.count : 0;
+      continue;
+    }
+    int64_t count = block.count;
+    if (data != NULL && conf->rows) {
+      CHECKED_EV(trim_block(converter->schema, conf, first_record, &data, &size, &count));
+    }
+    if (data != NULL) {
+      CHECKED_EV(convert_block(converter, data, size, count));
+    }
+#if defined(__linux__)
+    if (conf->mem_stats) {
+      CHECKED_EV(memstats_report(stderr, MEM_SCOPE_BLOCK, reader->path, block_index - 1, &block_mem));
+    }
+#endif
+    if (converter->follow != NULL) {
+      CHECKED_EV(flush_output(converter));
+    }
+    if (conf->checkpoint != NULL) {
+      mark_checkpoint(reader, converter, block_index, progress);
+      if (time(NULL) - checkpoint_saved >= CHECKPOINT_INTERVAL_SECONDS) {
+        CHECKED_EV(save_checkpoint(converter, progress));
+        checkpoint_saved = time(NULL);
+      }
+    }
+    // Blocks after the last record of --rows aren't read
+    first_record += block.count;
+    if (conf->rows && first_record >= conf->rows_end) {
+      break;
+    }
+  }
+  if (conf->checkpoint != NULL) {
+    mark_checkpoint(reader, converter, block_index, progress);
+    CHECKED_EV(save_checkpoint(converter, progress));
+  }
+  return converter->reservoir != NULL ? convert_reservoir(converter) : 0;
+}
+
+// Converts all blocks of the file. With --follow, it converts blocks appended
+// to the file as they are completed, flushing output after each, and never
+// reaches the end. With --checkpoint, a failing block leaves the checkpoint
+// after the blocks before it, where the next run resumes.
+static int convert_file(container_reader_t *reader, converter_t *converter) {
+  const config_t *conf = converter->conf;
+  int64_t block_index = 0;
+  int64_t first_record = 0; // of the block, with --rows
+  checkpoint_t progress = {0};
+#if !defined(_WIN32)
+  if (conf->pipeline) {
+    return convert_file_pipelined(reader, converter);
+  }
+#endif
+  if (conf->checkpoint != NULL) {
+    CHECKED_EV(options_fingerprint(conf, &progress.options));
+    CHECKED_EV(resume_checkpoint(reader, converter, progress.options, &block_index));
+  }
+  if (conf->rows) {
+    CHECKED_EV(seek_rows(reader, conf, &block_index, &first_record));
+  }
+#if !defined(_WIN32)
+  if (conf->follow) {
+    CHECKED_EV(follow_new(reader->path, fileno(reader->fp), &converter->follow));
+  }
+#endif
+  int rval = convert_blocks(reader, converter, block_index, first_record, &progress);
+  if (rval != 0 && progress.offset > 0) {
+    // Output of the failing block, if any, is truncated when resuming
+    save_checkpoint(converter, &progress);
+  }
+  return rval;
+}
+
+// Nullable types are represented as UNION of NULL and target schema.
+// This function extracts the target schema from such a UNION.
+static avro_schema_t get_nullable_schema(avro_schema_t schema) {
+  if (is_avro_union(schema)) {
+    const struct avro_union_schema_t *uschema = avro_schema_to_union(schema);
+    if (uschema->branches->num_entries == 2) {
+      union {
+        st_data_t data;
+        avro_schema_t schema;
+      } val1;
+      st_lookup(uschema->branches, 0, &val1.data);
+
+      union {
+        st_data_t data;
+        avro_schema_t schema;
+      } val2;
+      st_lookup(uschema->branches, 1, &val2.data);
+
+      if (val2.schema->type == AVRO_NULL) {
+        schema = val1.schema;
+      } else if (val1.schema->type == AVRO_NULL) {
+        schema = val2.schema;
+      }
+    }
+  }
+  return schema;
+}
+
+// Prints columns of the record schema, or of its --flatten layout
+static int print_schema(avro_schema_t schema, const config_t *conf, FILE *dest) {
+  schema = get_nullable_schema(schema);
+
+  if (!is_avro_record(schema)) {
+    avro_set_error("Can't find root record schema");
+    return EINVAL;
+  }
+
+  flatten_t *flatten = NULL;
+  if (conf->flatten != NULL) {
+    CHECKED_EV(flatten_new(schema, conf->flatten, &flatten));
+  }
+  struct avro_record_schema_t *record_schema = avro_schema_to_record(schema);
+  size_t columns_count = flatten != NULL ? flatten->columns_size : record_schema->fields->num_entries;
+  json_t *result = json_array();
+  if (result == NULL) {
+    if (flatten != NULL) {
+      flatten_free(flatten);
+    }
+    avro_set_error("Cannot allocate JSON array");
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < columns_count; i++) {
+    const char *name;
+    avro_schema_t field_schema;
+    if (flatten != NULL) {
+      name = flatten->columns[i].output_name;
+      field_schema = get_nullable_schema(flatten->leaves[i]);
+    } else {
+      union {
+        st_data_t data;
+        struct avro_record_field_t *field;
+      } val;
+      st_lookup(record_schema->fields, i, &val.data);
+      name = val.field->name;
+      field_schema = get_nullable_schema(val.field->type);
+    }
+    avro_logical_schema_t *logical_type = avro_logical_schema(field_schema);
+
+    json_t *obj = json_object();
+    if (obj == NULL) {
+      break;
+    }
+    json_object_set_new(obj, "name", json_string(name));
+
+    int found_logical_type = 0;
+    if (logical_type != NULL) {
+      switch (logical_type->type) {
+      case AVRO_DECIMAL:
+        json_object_set_new(obj, "type", json_string_nocheck("decimal"));
+        found_logical_type = 1;
+        break;
+      case AVRO_DATE:
+      case AVRO_TIME_MILLIS:
+      case AVRO_TIME_MICROS:
+      case AVRO_TIMESTAMP_MILLIS:
+      case AVRO_TIMESTAMP_MICROS:
+        json_object_set_new(obj, "type", json_string_nocheck("datetime"));
+        found_logical_type = 1;
+        break;
+      case AVRO_DURATION:
+        json_object_set_new(obj, "type", json_string_nocheck("timespan"));
+        found_logical_type = 1;
+        break;
+      }
+    }
+
+    if (!found_logical_type) {
+      switch (field_schema->type) {
+      case AVRO_FIXED:
+      case AVRO_NULL:
+      case AVRO_STRING:
+      case AVRO_ENUM:
+        json_object_set_new(obj, "type", json_string_nocheck("string"));
+        break;
+      case AVRO_INT32:
+        json_object_set_new(obj, "type", json_string_nocheck("int"));
+        break;
+      case AVRO_INT64:
+        json_object_set_new(obj, "type", json_string_nocheck("long"));
+        break;
+      case AVRO_FLOAT:
+      case AVRO_DOUBLE:
+        json_object_set_new(obj, "type", json_string_nocheck("real"));
+        break;
+      case AVRO_BOOLEAN:
+        json_object_set_new(obj, "type", json_string_nocheck("bool"));
+        break;
+      case AVRO_BYTES:
+      default:
+        json_object_set_new(obj, "type", json_string_nocheck("dynamic"));
+        break;
+      }
+    }
+    json_array_append_new(result, obj);
+  }
+
+  int rval = json_array_size(result) == columns_count ? json_dumpf(result, dest, JSON_ENCODE_FLAGS)
+                                                      : ENOMEM;
+  json_decref(result);
+  if (flatten != NULL) {
+    flatten_free(flatten);
+  }
+  return rval;
+}
+
+#define SCAN_HISTOGRAM_BUCKETS 64
+
+// Walks block headers only, seeking past the payloads, and prints per-file
+// statistics: records, blocks, and distribution of (compressed) block sizes.
+static int scan_file(container_reader_t *reader, const char *filename, FILE *dest,
+                     stats_t *stats) {
+  uint64_t fingerprint;
+  CHECKED_EV(schema_fingerprint(reader->schema, &fingerprint));
+
+  size_t histogram[SCAN_HISTOGRAM_BUCKETS] = {0};
+  int64_t records = 0, blocks = 0, total_size = 0;
+  int64_t min_records = 0, max_records = 0, min_size = 0, max_size = 0;
+  block_header_t block;
+  int rval;
+
+  while ((rval = container_next_block(reader, &block)) == 0) {
+    CHECKED_EV(container_skip_block(reader, &block));
+
+    if (blocks == 0 || block.count < min_records) {
+      min_records = block.count;
+    }
+    if (blocks == 0 || block.count > max_records) {
+      max_records = block.count;
+    }
+    if (blocks == 0 || block.size < min_size) {
+      min_size = block.size;
+    }
+    if (blocks == 0 || block.size > max_size) {
+      max_size = block.size;
+    }
+    // Bucket is the smallest power of two that isn't less than block size
+    int bucket = 0;
+    while (bucket < SCAN_HISTOGRAM_BUCKETS - 1 && (INT64_C(1) << bucket) < block.size) {
+      bucket++;
+    }
+    histogram[bucket]++;
+
+    blocks++;
+    records += block.count;
+    total_size += block.size;
+  }
+  if (rval != CONTAINER_EOF) {
+    return rval;
+  }
+  stats->records = records;
+
+  json_t *result, *block_records, *block_size, *size_histogram;
+  CHECKED_ALLOC(result, json_object());
+  CHECKED_ALLOC(block_records, json_object());
+  CHECKED_ALLOC(block_size, json_object());
+  CHECKED_ALLOC(size_histogram, json_object());
+
+  char fingerprint_str[17];
+  snprintf(fingerprint_str, sizeof(fingerprint_str), "%016" PRIx64, fingerprint);
+
+  json_object_set_new(result, "file", json_string(filename));
+  json_object_set_new(result, "codec", json_string(reader->codec));
+  json_object_set_new(result, "fingerprint", json_string_nocheck(fingerprint_str));
+  json_object_set_new(result, "bytes", json_integer(block.offset));
+  json_object_set_new(result, "records", json_integer(records));
+  json_object_set_new(result, "blocks", json_integer(blocks));
+
+  json_object_set_new(block_records, "min", json_integer(min_records));
+  json_object_set_new(block_records, "max", json_integer(max_records));
+  json_object_set_new(block_records, "avg", json_integer(blocks ? records / blocks : 0));
+  json_object_set_new(result, "block_records", block_records);
+
+  for (int bucket = 0; bucket < SCAN_HISTOGRAM_BUCKETS; ++bucket) {
+    if (histogram[bucket] > 0) {
+      char bucket_str[24];
+      snprintf(bucket_str, sizeof(bucket_str), "%" PRIu64, (uint64_t)1 << bucket);
+      json_object_set_new(size_histogram, bucket_str, json_integer(histogram[bucket]));
+    }
+  }
+  json_object_set_new(block_size, "min", json_integer(min_size));
+  json_object_set_new(block_size, "max", json_integer(max_size));
+  json_object_set_new(block_size, "avg", json_integer(blocks ? total_size / blocks : 0));
+  json_object_set_new(block_size, "histogram", size_histogram);
+  json_object_set_new(result, "block_size", block_size);
+
+  rval = json_dumpf(result, dest, JSON_ENCODE_FLAGS);
+  json_decref(result);
+  if (rval == 0 && fputc('\n', dest) < 0) {
+    rval = ferror(dest);
+  }
+  return rval;
+}
+
+// Walks block headers only, like --scan, and saves the record index of the
+// file next to it (--build-index)
+static int build_index(container_reader_t *reader, stats_t *stats) {
+  record_index_t index;
+  memset(&index, 0, sizeof(record_index_t));
+  memcpy(index.sync, reader->sync, CONTAINER_SYNC_SIZE);
+  block_header_t block;
+  int rval;
+  while ((rval = container_next_block(reader, &block)) == 0) {
+    if ((rval = container_skip_block(reader, &block)) != 0 ||
+        (rval = index_add(&index, &block)) != 0) {
+      break;
+    }
+    stats->records += block.count;
+  }
+  if (rval == CONTAINER_EOF) {
+    char *path = index_path(reader->path);
+    rval = path != NULL ? index_save(path, &index) : ENOMEM;
+    free(path);
+  }
+  index_free(&index);
+  return rval;
+}
+
+// Sets up converters of --outputs, which convert records decoded by the file
+// converter, each with its own format options and destination file
+static int converter_add_outputs(converter_t *converter) {
+  const config_t *conf = converter->conf;
+  CHECKED_ALLOC(converter->outputs, (converter_t *)calloc(conf->outputs_size, sizeof(converter_t)));
+  for (size_t i = 0; i < conf->outputs_size; ++i) {
+    converter_t *output = &converter->outputs[converter->outputs_count++];
+    output->conf = &conf->outputs[i];
+    output->schema = converter->schema;
+    output->stats = &output->own_stats;
+    CHECKED_ALLOC(output->cache, cache_new());
+    if (!strcmp(output->conf->output_path, "-")) {
+      output->dest = converter->dest;
+    } else if ((output->dest = fopen(output->conf->output_path, "wb")) == NULL) {
+      int rval = errno;
+      avro_set_error("Cannot open output file '%s': %s", output->conf->output_path, strerror(rval));
+      return rval;
+    }
+
+    CHECKED_EV(columnar_new(output->schema, output->conf, &output->columnar));
+    if (output->columnar == NULL) {
+      CHECKED_EV(stream_new(output->schema, output->conf, output->dest, &output->stream));
+    }
+    if (output->columnar == NULL && output->stream == NULL) {
+      CHECKED_EV(converter_bind_transforms(output));
+    }
+  }
+  return 0;
+}
+
+// Sets up converters of --format-threads, each formatting a range of records
+// of large blocks with its own engine, from the same writer schema
+static int converter_add_formatters(converter_t *converter, avro_value_iface_t *iface) {
+  const config_t *conf = converter->conf;
+  CHECKED_ALLOC(converter->formatters,
+                (converter_t *)calloc(conf->format_threads, sizeof(converter_t)));
+  for (size_t i = 0; i < conf->format_threads; ++i) {
+    converter_t *formatter = &converter->formatters[converter->formatters_count++];
+    CHECKED_EV(converter_init(formatter, iface, conf, converter->dest, &formatter->own_stats));
+    formatter->schema = converter->schema;
+    formatter->plugin = converter->plugin;
+    if (formatter->plugin == NULL) {
+      CHECKED_EV(columnar_new(formatter->schema, conf, &formatter->columnar));
+    }
+    if (formatter->columnar == NULL) {
+      CHECKED_EV(stream_new(formatter->schema, conf, formatter->dest, &formatter->stream));
+    }
+    if (formatter->stream != NULL && formatter->plugin != NULL) {
+      stream_set_plugin(formatter->stream, formatter->plugin);
+    }
+    if (formatter->columnar == NULL && formatter->stream == NULL) {
+      CHECKED_EV(converter_bind_transforms(formatter));
+    }
+  }
+  return 0;
+}
+
+// Closes files of --outputs, returning the first error
+static int close_outputs(converter_t *converter) {
+  int rval = 0;
+  for (size_t i = 0; i < converter->outputs_count; ++i) {
+    converter_t *output = &converter->outputs[i];
+    if (output->dest == NULL || output->dest == converter->dest) {
+      continue;
+    }
+    if (fclose(output->dest) != 0 && rval == 0) {
+      rval = errno;
+      avro_set_error("Cannot write output file '%s': %s", output->conf->output_path, strerror(rval));
+    }
+    output->dest = NULL;
+  }
+  return rval;
+}
+
+// Gets the --converter when it was generated for the writer schema and the
+// format options, and records are converted to JSON as a whole
+static int matching_plugin(const config_t *conf, avro_schema_t schema,
+                           const converter_plugin_t **plugin) {
+  *plugin = NULL;
+  if (conf->converter == NULL || conf->output_csv || conf->prune || conf->columns_size > 0 ||
+      conf->converter->options != codegen_options(conf)) {
+    return 0;
+  }
+  uint64_t fingerprint;
+  CHECKED_EV(schema_logical_fingerprint(schema, &fingerprint));
+  if (fingerprint == conf->converter->fingerprint) {
+    *plugin = conf->converter;
+  }
+  return 0;
+}
+
+// Conversion of the records of one writer schema, with everything its
+// converter is set up with
+typedef struct {
+  converter_t converter;
+  avro_value_iface_t *iface;
+  flatten_t *flatten;
+  config_t flat_conf; // options of the converter with --flatten
+} conversion_t;
+
+// Sets up conversion of records of the writer schema, using the generic value
+// interface provided by the caller, or one that is created for the schema
+// when 'iface' is NULL. The conversion must be ended by conversion_end(),
+// even when this fails.
+static int conversion_begin(conversion_t *conversion, avro_schema_t wschema,
+                            const config_t *conf, FILE *dest, avro_value_iface_t *iface,
+                            stats_t *stats) {
+  memset(conversion, 0, sizeof(conversion_t));
+  converter_t *converter = &conversion->converter;
+
+  // Flattened layout is converted as --columns of nested paths
+  if (conf->flatten != NULL) {
+    CHECKED_EV(flatten_new(wschema, conf->flatten, &conversion->flatten));
+    conversion->flat_conf = *conf;
+    conversion->flat_conf.columns = conversion->flatten->columns;
+    conversion->flat_conf.columns_size = conversion->flatten->columns_size;
+    conf = &conversion->flat_conf;
+  }
+
+  if (iface == NULL) {
+    iface = avro_generic_class_from_schema(wschema);
+  } else {
+    avro_value_iface_incref(iface);
+  }
+  if (iface == NULL) {
+    return ENOMEM;
+  }
+  conversion->iface = iface;
+
+  CHECKED_EV(converter_init(converter, iface, conf, dest, stats));
+  converter->schema = wschema;
+  CHECKED_EV(matching_plugin(conf, wschema, &converter->plugin));
+  if (conf->where != NULL) {
+    CHECKED_EV(filter_compile(conf->where, wschema, &converter->filter));
+  }
+  if (conf->partition_by != NULL) {
+    CHECKED_EV(partitioner_new(wschema, conf, &converter->partitioner));
+  }
+  if (conf->parquet_path != NULL) {
+    CHECKED_EV(parquet_new(wschema, conf, dest, &converter->parquet));
+  }
+  if (conf->outputs_size > 0) {
+    CHECKED_EV(converter_add_outputs(converter));
+  }
+  if (conf->format_threads > 1) {
+    CHECKED_EV(converter_add_formatters(converter, iface));
+  }
+  int single_output = converter->parquet == NULL && converter->outputs == NULL;
+  // Columnar conversion writes whole batches, so records can't be routed
+  if (single_output && converter->partitioner == NULL && converter->plugin == NULL) {
+    CHECKED_EV(columnar_new(wschema, conf, &converter->columnar));
+  }
+  if (single_output && converter->columnar == NULL) {
+    CHECKED_EV(stream_new(wschema, conf, dest, &converter->stream));
+  }
+  if (converter->stream != NULL && converter->plugin != NULL) {
+    stream_set_plugin(converter->stream, converter->plugin);
+  }
+  if (single_output && converter->columnar == NULL && converter->stream == NULL) {
+    CHECKED_EV(converter_bind_transforms(converter));
+  }
+  if (conf->sample_rows > 0) {
+    CHECKED_ALLOC(converter->reservoir, (reservoir_t *)calloc(1, sizeof(reservoir_t)));
+    CHECKED_EV(reservoir_init(converter->reservoir, conf->sample_rows, conf->seed));
+  }
+  return 0;
+}
+
+// Finishes the outputs of the conversion, unless it already failed with
+// 'rval', and releases it. Returns the first error.
+static int conversion_end(conversion_t *conversion, int rval) {
+  converter_t *converter = &conversion->converter;
+  if (rval == 0 && converter->partitioner != NULL) {
+    rval = partitioner_close(converter->partitioner);
+  }
+  if (rval == 0 && converter->parquet != NULL) {
+    rval = parquet_finish(converter->parquet);
+  }
+  if (rval == 0 && converter->outputs != NULL) {
+    rval = close_outputs(converter);
+  }
+  if (converter->stats != NULL) {
+    add_memo_stats(converter, converter->stats);
+  }
+  converter_free(converter);
+  if (conversion->iface != NULL) {
+    avro_value_iface_decref(conversion->iface);
+  }
+  if (conversion->flatten != NULL) {
+    flatten_free(conversion->flatten);
+  }
+  return rval;
+}
+
+#if defined(__linux__)
+// Writes a JSON line with lookups of memoized formatted values made while
+// converting the file, with --mem-stats, since memos trade memory for time
+static int report_memo_stats(FILE *dest, const char *path, const stats_t *start,
+                             const stats_t *now) {
+  uint64_t lookups = now->memo_lookups - start->memo_lookups;
+  uint64_t hits = now->memo_hits - start->memo_hits;
+  json_t *line;
+  CHECKED_ALLOC(line, json_object());
+  json_object_set_new(line, "memo_stats", json_string_nocheck("file"));
+  json_object_set_new(line, "file", json_string(path));
+  json_object_set_new(line, "lookups", json_integer((json_int_t)lookups));
+  json_object_set_new(line, "hits", json_integer((json_int_t)hits));
+  if (lookups > 0) {
+    json_object_set_new(line, "hit_rate", json_real((double)hits / (double)lookups));
+  }
+  int rval = json_dumpf(line, dest, JSON_ENCODE_FLAGS);
+  json_decref(line);
+  if (rval == 0 && fputc('\n', dest) < 0) {
+    rval = ferror(dest);
+  }
+  return rval;
+}
+#endif
+
+// Converts the file, using the generic value interface provided by the caller,
+// or one that is created for the writer schema when 'iface' is NULL.
+static int process_file(container_reader_t *reader, const config_t *conf,
+                        FILE *dest, avro_value_iface_t *iface, stats_t *stats) {
+  avro_schema_t wschema = reader->schema;
+  if (conf->show_schema) {
+    return print_schema(wschema, conf, dest);
+  }
+#if defined(__linux__)
+  mem_snapshot_t file_mem;
+  stats_t file_start = *stats;
+  if (conf->mem_stats) {
+    memstats_begin(MEM_SCOPE_FILE, &file_mem);
+  }
+#endif
+
+  conversion_t conversion;
+  int rval = conversion_begin(&conversion, wschema, conf, dest, iface, stats);
+  if (rval == 0) {
+    rval = convert_file(reader, &conversion.converter);
+  }
+  rval = conversion_end(&conversion, rval);
+#if defined(__linux__)
+  if (rval == 0 && conf->mem_stats) {
+    rval = memstats_report(stderr, MEM_SCOPE_FILE, reader->path, -1, &file_mem);
+  }
+  if (rval == 0 && conf->mem_stats) {
+    rval = report_memo_stats(stderr, reader->path, &file_start, stats);
+  }
+#endif
+  return rval;
+}
+
+// Converts datums of --datums block by block. Every schema has its own
+// conversion, set up when its first datum is read. Output is flushed whenever
+// the reader waits for more input, so that a stream is converted as it comes.
+static int convert_datums(datum_reader_t *reader, const config_t *conf, FILE *dest,
+                          stats_t *stats) {
+  // Outputs that are written as a whole can't interleave schemas
+  if (reader->schemas_count > 1 && (conf->sample_rows > 0 || conf->partition_by != NULL ||
+                                    conf->parquet_path != NULL || conf->outputs_size > 0)) {
+    avro_set_error("Options --sample-rows, --partition-by, --parquet and --outputs need a single schema file");
+    return EINVAL;
+  }
+  conversion_t **conversions = NULL;
+  size_t conversions_count = 0;
+  int rval;
+  for (;;) {
+    avro_schema_t schema;
+    const char *data;
+    size_t size;
+    int64_t count;
+    if ((rval = datum_next_block(reader, &schema, &data, &size, &count)) != 0) {
+      if (rval == DATUM_EOF) {
+        rval = 0;
+      }
+      break;
+    }
+
+    conversion_t *conversion = NULL;
+    for (size_t i = 0; i < conversions_count && conversion == NULL; ++i) {
+      if (conversions[i]->converter.schema == schema) {
+        conversion = conversions[i];
+      }
+    }
+    if (conversion == NULL) {
+      conversion_t **grown = (conversion_t **)realloc(
+          conversions, (conversions_count + 1) * sizeof(conversion_t *));
+      if (grown != NULL) {
+        conversions = grown;
+        conversion = (conversion_t *)malloc(sizeof(conversion_t));
+      }
+      if (conversion == NULL) {
+        rval = ENOMEM;
+        break;
+      }
+      // Ended below, whether it's set up or not
+      conversions[conversions_count++] = conversion;
+      if ((rval = conversion_begin(conversion, schema, conf, dest, NULL, stats)) != 0) {
+        break;
+      }
+    }
+
+    if ((rval = convert_block(&conversion->converter, data, size, count)) != 0) {
+      break;
+    }
+    if (reader->drained && (rval = flush_output(&conversion->converter)) != 0) {
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < conversions_count; ++i) {
+    converter_t *converter = &conversions[i]->converter;
+    if (rval == 0 && converter->reservoir != NULL) {
+      rval = convert_reservoir(converter);
+    }
+    rval = conversion_end(conversions[i], rval);
+    free(conversions[i]);
+  }
+  free(conversions);
+  return rval;
+}
+
+// Opens the input file, reading it ahead asynchronously with --async-io
+static int open_input(const char *path, const config_t *conf, container_reader_t **reader) {
+#if !defined(_WIN32)
+  // Corrupt blocks are skipped by seeking back to look for a sync marker
+  struct stat st;
+  if (conf->skip_corrupt_blocks && stat(path, &st) == 0 &&
+      (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode) || S_ISCHR(st.st_mode))) {
+    avro_set_error("Option --on-error skip-block needs a seekable input");
+    return ESPIPE;
+  }
+#endif
+#if defined(__linux__)
+  if (conf->async_io) {
+    FILE *fp = aio_open_read(path, conf->io_depth > 0 ? conf->io_depth : AIO_DEFAULT_DEPTH);
+    if (fp == NULL) {
+      return EIO;
+    }
+    CHECKED_EV(container_open_fp(fp, reader));
+    // Named in reports of --mem-stats
+    CHECKED_ALLOC((*reader)->path, strdup(path));
+    return 0;
+  }
+#endif
+  return container_open(path, reader);
+}
+
+// Returns the stream to write output to, which writes behind asynchronously
+// to 'dest' with --async-io, and must be closed before it
+static FILE *open_output(FILE *dest, const config_t *conf) {
+#if defined(__linux__)
+  if (conf->async_io) {
+    fflush(dest);
+    return aio_open_write(fileno(dest), conf->io_depth > 0 ? conf->io_depth : AIO_DEFAULT_DEPTH);
+  }
+#endif
+  return dest;
+}
+
+// Writes converter source for --emit-converter, specialized to the schema of
+// an Avro file, or of a JSON schema file
+static int emit_converter(const char *path, const config_t *conf) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    int rval = errno;
+    avro_set_error("Cannot open '%s': %s", path, strerror(rval));
+    return rval;
+  }
+  char magic[4];
+  if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && !memcmp(magic, "Obj\x01", 4)) {
+    fclose(fp);
+    container_reader_t *reader;
+    CHECKED_EV(open_input(path, conf, &reader));
+    int rval = codegen_emit(reader->schema, conf, stdout);
+    container_close(reader);
+    return rval;
+  }
+
+  fclose(fp);
+  avro_schema_t schema;
+  CHECKED_EV(datum_read_schema(path, &schema));
+  int rval = codegen_emit(schema, conf, stdout);
+  avro_schema_decref(schema);
+  return rval;
+}
+
+static void print_usage(const char *exe) {
+  fprintf(stderr,
           "Usage: %s [OPTIONS] FILE\n"
+          "       %s --serve SOCKET [--workers N]\n"
           "\n"
           "Where options are:\n"
           " --show-schema                                                         Only show Avro file schema, and exit\n"
+          " --scan                                                                Only show record counts and block statistics, without decoding blocks\n"
           " --prune                                                               Omit null values as well as empty lists and objects\n"
           " --logical-types                                                       Convert logical types automatically\n"
           " --csv                                                                 Produce output in CSV format\n"
           " --ms-hadoop-logical-types                                             Convert non-standard logical types of Microsoft.Hadoop.Avro (System.Guid) automatically\n"
+          " --flatten[=SEPARATOR]                                                 Output fields of nested records as separate columns, named e.g. a_b_c (default separator _)\n"
           " --columns '[[\"<column>\",\"<transformation>\"],\"<column>\"...]',...       Only output specified columns (with optional transformations)\n"
-          "                                                                       Supported transformations (only with --csv) are: \n"
-          "                                                                       For 'long' values representing time units since Unix epoch (1970-01-01) to ISO 8601 'yyyy-mm-ddThh::mm:ss.0000000Z': \n"
+          "                                                                       Nested values are addressed by paths, e.g. body.user.id or props[\\\"key\\\"]\n"
+          "                                                                       Supported transformations are: \n"
+          "                                                                       For numbers representing time units since Unix epoch (1970-01-01) to ISO 8601 'yyyy-mm-ddThh::mm:ss.0000000Z': \n"
           "                                                                       ts-s: converts seconds\n"
           "                                                                       ts-ms: converts milliseconds\n"
-          "                                                                       ts-ns: converts nanoseconds\n",
-          exe);
+          "                                                                       ts-us: converts microseconds\n"
+          "                                                                       ts-ns: converts nanoseconds\n"
+          "                                                                       real: converts numbers and decimals to reals\n"
+          "                                                                       scale: multiplies numbers by a factor, e.g. [\"Amount\",\"scale\",0.01]\n"
+          "                                                                       truncate: keeps at most N characters of strings, e.g. [\"Message\",\"truncate\",1000]\n"
+          "                                                                       base64: converts bytes to base64 strings\n"
+          " --where EXPRESSION                                                    Only output records matching the expression, e.g. 'Level == \"Error\" and Region in [\"eu\",\"us\"]'\n"
+          "                                                                       Top-level fields can be compared using ==, !=, <, <=, >, >=, in [...], is null, is not null,\n"
+          "                                                                       and combined using and, or, not. Comparisons with null values are false.\n"
+          " --sample-blocks FRACTION                                              Only convert a random sample of blocks (0 < FRACTION <= 1), unselected blocks are skipped without reading\n"
+          " --sample-rows N                                                       Only output a uniform random sample of N records (of the selected blocks), in their original order\n"
+          " --seed N                                                              Seed of --sample-blocks and --sample-rows, the same seed selects the same sample (default: 0)\n"
+          " --memory-limit SIZE[K|M|G]                                            Maximum size of a block, or of a single string, bytes or fixed value (default: 256M)\n"
+          "                                                                       Arrays and maps are converted element by element, using bounded memory regardless of their size\n"
+          " --on-error abort|skip-block                                          Abort on a corrupt block (default), or skip it resuming at the next sync marker, reporting skipped bytes on stderr\n"
+          " --partition-by COLUMN                                                Write records to files <prefix><partition>.json (or .csv) by hash or value of the column\n"
+          " --partitions N                                                       Number of hash partitions (default 16)\n"
+          " --by-value                                                           Write a file per distinct value of the column instead\n"
+          " --max-open-partitions N                                              Maximum number of partition files kept open (default 64)\n"
+          " --partition-prefix PREFIX                                            Path prefix of partition files (default part-)\n"
+          " --parquet OUTFILE                                                    Write Parquet file instead of JSON to stdout\n"
+          " --row-group-size N                                                   Rows per Parquet row group (default 131072)\n"
+          " --parquet-codec snappy|gzip|none                                     Compression of Parquet pages (default snappy)\n"
+          " --outputs '[{\"output\":\"<file>\",\"options\":[...]},...]'        Write several outputs from one decoding pass, each with its own file (- for stdout)\n"
+          "                                                                       and format options (--csv, --columns, --prune, --logical-types, --ms-hadoop-logical-types)\n"
+          " --follow                                                             Keep converting blocks appended to the file, as soon as each is complete, until interrupted\n"
+          " --format-threads N                                                   Format records of blocks larger than 1 MiB in N threads (default 1)\n"
+          " --pipeline                                                           Read and decompress, convert, and write consecutive blocks concurrently, in three threads\n"
+          " --build-index                                                         Only write record index of the file to FILE.avroidx, without decoding blocks\n"
+          " --rows N:M                                                            Only output records N (counted from 0) to M, excluding M, or to the end with N:\n"
+          "                                                                       Reading starts at the block holding record N, found by the index when there's one\n"
+          " --checkpoint FILE                                                    Save progress to FILE periodically, and resume from it when it exists (append output with >>)\n"
+          " --emit-converter                                                      Only write C source of a converter specialized to the schema of FILE (Avro or JSON schema file)\n"
+          "                                                                       for the given --logical-types and --ms-hadoop-logical-types, see its header for building it\n"
+          " --converter LIBRARY                                                   Convert files whose schema matches the generated converter with it, and other files as usual\n"
+          " --datums length-prefixed|single-object                                Read a stream of Avro datums from FILE (- for standard input) instead of a container file,\n"
+          "                                                                       each preceded by its size as an Avro long, or in single-object encoding\n"
+          " --schema FILE|DIRECTORY                                               Schema of --datums, or for single-object encoding a directory of .avsc and .json schema files\n"
+          "                                                                       whose fingerprints identify the schema of every datum\n"
+          " --mem-stats                                                           Report allocations, bytes and peak live bytes by subsystem (Avro, JSON, decimals, output buffers)\n"
+          "                                                                       for every block and file, as JSON lines on stderr\n"
+          "                                                                       and lookups of memoized dates, times, timestamps, decimals and GUIDs for every file\n"
+          " --async-io                                                            Read input ahead and write output behind asynchronously (io_uring, or I/O threads when unavailable)\n"
+          " --io-depth N                                                          Number of 1 MiB chunks in flight with --async-io (default: 4)\n"
+          " --serve SOCKET                                                        Run as a daemon, serving conversion jobs on a Unix domain socket\n"
+          "                                                                       Every job is a JSON line: {\"input\":\"<file>\",\"output\":\"<file>\",\"options\":[\"--csv\",...]}\n"
+          "                                                                       When \"output\" is omitted, output goes to a descriptor passed with the job (SCM_RIGHTS)\n"
+          " --workers N                                                           Number of worker threads in --serve mode (default: number of CPUs)\n",
+          exe, exe);
   exit(1);
 }
 
@@ -1096,95 +2860,780 @@ char *alloc_and_copy_string(const char *source) {
   return duplicate;
 }
 
-enum TransformationType transformStringToEnum(const char* transformation) {
-    if (!strcmp(transformation, TRANSFORM_TS_SECS_STR)) {
-        return TRANSFORM_TS_SECS;
-    } else if (!strcmp(transformation, TRANSFORM_TS_MILLIS_STR)) {
-        return TRANSFORM_TS_MILLIS;
-    } else if (!strcmp(transformation, TRANSFORM_TS_NANOS_STR)) {
-        return TRANSFORM_TS_NANOS;
-    } else {
-        return TRANSFORM_NONE; // Invalid or unsupported transformation
+static void config_free(config_t *conf) {
+  if (conf->columns) {
+    for(size_t i = 0; i < conf->columns_size; i++) {
+      free(conf->columns[i].column_name);
     }
+    free(conf->columns);
+  }
+  for (size_t i = 0; i < conf->outputs_size; ++i) {
+    config_free(&conf->outputs[i]);
+  }
+  free(conf->outputs);
+  free(conf->output_path);
 }
 
-static const char *parse_args(int argc, char **argv, config_t *conf) {
-  int arg_idx;
-  for (arg_idx = 1; arg_idx < argc - 1; ++arg_idx) {
-    if (!strcmp(argv[arg_idx], "--prune")) {
-      conf->prune = 1;
-    } else if (!strcmp(argv[arg_idx], "--logical-types")) {
-      conf->logical_types = 1;
-    } else if (!strcmp(argv[arg_idx], "--ms-hadoop-logical-types")) {
-      conf->ms_hadoop_logical_types = 1;
-    } else if (!strcmp(argv[arg_idx], "--show-schema")) {
-      conf->show_schema = 1;
-    } else if (!strcmp(argv[arg_idx], "--csv")) {
-      conf->output_csv = 1;
-    } else if (!strcmp(argv[arg_idx], "--columns") && arg_idx < argc - 1) {
-      // Treat the next argument as a JSON array string
-      const char *columns_json_string = argv[++arg_idx];
-      
-      // Parse the JSON array string to extract column information
-      json_t *columns_json_array = json_loads(columns_json_string, 0, NULL);
-      
-      if (!columns_json_array) {
-        fprintf(stderr, "Error: Failed to parse JSON array for columns. %s\n", columns_json_string);
-        exit(1);
-      }
-      
-      // Extract and store column information from the JSON array
-      size_t columns_json_array_size = json_array_size(columns_json_array);
-      conf->columns_size = columns_json_array_size;
-      conf->columns = (column_info_t *)malloc(sizeof(column_info_t) * columns_json_array_size);
-      
-      for (size_t i = 0; i < columns_json_array_size; i++) {
-        json_t *item = json_array_get(columns_json_array, i);
-
-        if (json_is_array(item) && json_array_size(item) >= 2) {
-          json_t *column_name_item = json_array_get(item, 0);
-          json_t *transformation_item = json_array_get(item, 1);
-
-          if (json_is_string(column_name_item)) {
-            conf->columns[i].column_name = alloc_and_copy_string(json_string_value(column_name_item));
-
-            if (json_is_string(transformation_item)) {
-              const char* transformation = json_string_value(transformation_item);
-              conf->columns[i].transformation = transformStringToEnum(transformation);
-
-              if (conf->columns[i].transformation == TRANSFORM_NONE) {
-                  fprintf(stderr, "Error: Invalid or unsupported transformation in JSON array for columns.\n");
-                  exit(1);
-              }
-            } else {
-              conf->columns[i].transformation = TRANSFORM_NONE; // No transformation specified
-            }
-          } else {
-            fprintf(stderr, "Error: Invalid item in JSON array for columns.\n");
-            exit(1);
+static int parse_columns(const char *columns_json_string, config_t *conf) {
+  // Parse the JSON array string to extract column information
+  json_t *columns_json_array = json_loads(columns_json_string, 0, NULL);
+
+  if (!columns_json_array) {
+    avro_set_error("Failed to parse JSON array for columns. %s", columns_json_string);
+    return EINVAL;
+  }
+
+  // Extract and store column information from the JSON array
+  size_t columns_json_array_size = json_array_size(columns_json_array);
+  conf->columns_size = columns_json_array_size;
+  conf->columns = (column_info_t *)calloc(columns_json_array_size, sizeof(column_info_t));
+
+  for (size_t i = 0; i < columns_json_array_size; i++) {
+    json_t *item = json_array_get(columns_json_array, i);
+
+    if (json_is_array(item) && json_array_size(item) >= 2) {
+      json_t *column_name_item = json_array_get(item, 0);
+      json_t *transformation_item = json_array_get(item, 1);
+
+      if (json_is_string(column_name_item)) {
+        conf->columns[i].column_name = alloc_and_copy_string(json_string_value(column_name_item));
+
+        if (json_is_string(transformation_item)) {
+          const char* transformation = json_string_value(transformation_item);
+          // Optional argument, e.g. ["Amount","scale",0.01]
+          if (transform_parse(transformation, json_array_get(item, 2), &conf->columns[i]) != 0) {
+              json_decref(columns_json_array);
+              return EINVAL;
           }
-        } else if (json_is_string(item)) {
-          // When only a column name is provided without transformation
-          conf->columns[i].column_name = alloc_and_copy_string(json_string_value(item));
-          conf->columns[i].transformation = TRANSFORM_NONE;
         } else {
-          fprintf(stderr, "Error: Invalid item in JSON array for columns.\n");
-          exit(1);
+          conf->columns[i].transformation = TRANSFORM_NONE; // No transformation specified
         }
+      } else {
+        avro_set_error("Invalid item in JSON array for columns.");
+        json_decref(columns_json_array);
+        return EINVAL;
       }
-      
+    } else if (json_is_string(item)) {
+      // When only a column name is provided without transformation
+      conf->columns[i].column_name = alloc_and_copy_string(json_string_value(item));
+      conf->columns[i].transformation = TRANSFORM_NONE;
+    } else {
+      avro_set_error("Invalid item in JSON array for columns.");
       json_decref(columns_json_array);
+      return EINVAL;
+    }
+  }
+
+  json_decref(columns_json_array);
+  return 0;
+}
+
+/*
+ * Parses option at argv[*arg_idx], advancing the index past option's value.
+ * Returns 0 on success, EINVAL if option's value is invalid, or -1 if the
+ * option is unknown or lacks a value.
+ */
+static int parse_option(int argc, char **argv, int *arg_idx, config_t *conf) {
+  const char *arg = argv[*arg_idx];
+  int has_value = *arg_idx < argc - 1;
+
+  if (!strcmp(arg, "--prune")) {
+    conf->prune = 1;
+  } else if (!strcmp(arg, "--logical-types")) {
+    conf->logical_types = 1;
+  } else if (!strcmp(arg, "--ms-hadoop-logical-types")) {
+    conf->ms_hadoop_logical_types = 1;
+  } else if (!strcmp(arg, "--show-schema")) {
+    conf->show_schema = 1;
+  } else if (!strcmp(arg, "--scan")) {
+    conf->scan = 1;
+  } else if (!strcmp(arg, "--csv")) {
+    conf->output_csv = 1;
+  } else if (!strcmp(arg, "--flatten") || !strncmp(arg, "--flatten=", 10)) {
+    conf->flatten = arg[9] == '=' ? arg + 10 : DEFAULT_FLATTEN_SEPARATOR;
+  } else if (!strcmp(arg, "--columns") && has_value) {
+    // Treat the next argument as a JSON array string
+    return parse_columns(argv[++*arg_idx], conf);
+  } else if (!strcmp(arg, "--where") && has_value) {
+    conf->where = argv[++*arg_idx];
+  } else if (!strcmp(arg, "--sample-blocks") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    double fraction = strtod(value, &end);
+    if (*end != '\0' || !(fraction > 0 && fraction <= 1)) {
+      avro_set_error("Invalid fraction of blocks: %s", value);
+      return EINVAL;
+    }
+    conf->sample_blocks = fraction;
+  } else if (!strcmp(arg, "--sample-rows") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    long long rows = strtoll(value, &end, 10);
+    if (*end != '\0' || rows <= 0) {
+      avro_set_error("Invalid number of rows: %s", value);
+      return EINVAL;
+    }
+    conf->sample_rows = (size_t)rows;
+  } else if (!strcmp(arg, "--seed") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    conf->seed = strtoull(value, &end, 10);
+    if (*end != '\0' || *value == '-') {
+      avro_set_error("Invalid seed: %s", value);
+      return EINVAL;
+    }
+  } else if (!strcmp(arg, "--memory-limit") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    unsigned long long limit = strtoull(value, &end, 10);
+    size_t multiplier = 1;
+    if (*end == 'K' || *end == 'k') {
+      multiplier = 1024;
+    } else if (*end == 'M' || *end == 'm') {
+      multiplier = 1024 * 1024;
+    } else if (*end == 'G' || *end == 'g') {
+      multiplier = 1024 * 1024 * 1024;
+    }
+    if (multiplier > 1) {
+      end++;
+    }
+    if (*end != '\0' || *value == '-' || limit == 0) {
+      avro_set_error("Invalid memory limit: %s", value);
+      return EINVAL;
+    }
+    conf->memory_limit = (size_t)limit * multiplier;
+  } else if ((!strcmp(arg, "--on-error") && has_value) || !strncmp(arg, "--on-error=", 11)) {
+    const char *value = arg[10] == '=' ? arg + 11 : argv[++*arg_idx];
+    if (!strcmp(value, "skip-block")) {
+      conf->skip_corrupt_blocks = 1;
+    } else if (!strcmp(value, "abort")) {
+      conf->skip_corrupt_blocks = 0;
+    } else {
+      avro_set_error("Invalid error handling: %s", value);
+      return EINVAL;
+    }
+  } else if (!strcmp(arg, "--partition-by") && has_value) {
+    conf->partition_by = argv[++*arg_idx];
+  } else if (!strcmp(arg, "--partitions") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    long partitions = strtol(value, &end, 10);
+    if (*end != '\0' || partitions <= 0) {
+      avro_set_error("Invalid number of partitions: %s", value);
+      return EINVAL;
+    }
+    conf->partitions = (size_t)partitions;
+  } else if (!strcmp(arg, "--by-value")) {
+    conf->partition_by_value = 1;
+  } else if (!strcmp(arg, "--max-open-partitions") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    long max_open = strtol(value, &end, 10);
+    if (*end != '\0' || max_open <= 0) {
+      avro_set_error("Invalid number of open partitions: %s", value);
+      return EINVAL;
+    }
+    conf->max_open_partitions = (size_t)max_open;
+  } else if (!strcmp(arg, "--partition-prefix") && has_value) {
+    conf->partition_prefix = argv[++*arg_idx];
+  } else if (!strcmp(arg, "--parquet") && has_value) {
+    conf->parquet_path = argv[++*arg_idx];
+  } else if (!strcmp(arg, "--row-group-size") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    long rows = strtol(value, &end, 10);
+    if (*end != '\0' || rows <= 0) {
+      avro_set_error("Invalid row group size: %s", value);
+      return EINVAL;
+    }
+    conf->row_group_size = (size_t)rows;
+  } else if (!strcmp(arg, "--parquet-codec") && has_value) {
+    const char *value = argv[++*arg_idx];
+    if (!strcmp(value, "snappy")) {
+      conf->parquet_codec = PARQUET_CODEC_SNAPPY;
+    } else if (!strcmp(value, "gzip")) {
+      conf->parquet_codec = PARQUET_CODEC_GZIP;
+    } else if (!strcmp(value, "none")) {
+      conf->parquet_codec = PARQUET_CODEC_NONE;
+    } else {
+      avro_set_error("Invalid Parquet codec: %s", value);
+      return EINVAL;
+    }
+  } else if (!strcmp(arg, "--follow")) {
+#if !defined(_WIN32)
+    conf->follow = 1;
+#else
+    avro_set_error("Option --follow is not supported on this platform");
+    return EINVAL;
+#endif
+  } else if (!strcmp(arg, "--format-threads") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    long threads = strtol(value, &end, 10);
+    if (*end != '\0' || threads <= 0 || threads > FORMAT_THREADS_MAX) {
+      avro_set_error("Invalid number of format threads: %s", value);
+      return EINVAL;
+    }
+#if !defined(_WIN32)
+    conf->format_threads = (size_t)threads;
+#else
+    avro_set_error("Option --format-threads is not supported on this platform");
+    return EINVAL;
+#endif
+  } else if (!strcmp(arg, "--pipeline")) {
+#if !defined(_WIN32)
+    conf->pipeline = 1;
+#else
+    avro_set_error("Option --pipeline is not supported on this platform");
+    return EINVAL;
+#endif
+  } else if (!strcmp(arg, "--build-index")) {
+    conf->build_index = 1;
+  } else if (!strcmp(arg, "--rows") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    long long begin = strtoll(value, &end, 10), last = INT64_MAX;
+    if (*end == ':' && end[1] != '\0') {
+      last = strtoll(end + 1, &end, 10);
+    } else if (*end == ':') {
+      end++;
+    }
+    if (*end != '\0' || *value == '-' || begin < 0 || last <= begin) {
+      avro_set_error("Invalid range of rows: %s", value);
+      return EINVAL;
+    }
+    conf->rows = 1;
+    conf->rows_begin = begin;
+    conf->rows_end = last;
+  } else if (!strcmp(arg, "--checkpoint") && has_value) {
+    conf->checkpoint = argv[++*arg_idx];
+  } else if (!strcmp(arg, "--outputs") && has_value) {
+    conf->outputs_json = argv[++*arg_idx];
+  } else if (!strcmp(arg, "--emit-converter")) {
+    conf->emit_converter = 1;
+  } else if (!strcmp(arg, "--converter") && has_value) {
+#if !defined(_WIN32)
+    conf->converter_path = argv[++*arg_idx];
+#else
+    avro_set_error("Option --converter is not supported on this platform");
+    return EINVAL;
+#endif
+  } else if (!strcmp(arg, "--datums") && has_value) {
+    const char *value = argv[++*arg_idx];
+    if (!strcmp(value, "length-prefixed")) {
+      conf->datums = DATUMS_LENGTH_PREFIXED;
+    } else if (!strcmp(value, "single-object")) {
+      conf->datums = DATUMS_SINGLE_OBJECT;
     } else {
+      avro_set_error("Invalid datum framing: %s", value);
+      return EINVAL;
+    }
+  } else if (!strcmp(arg, "--schema") && has_value) {
+    conf->schema_path = argv[++*arg_idx];
+  } else if (!strcmp(arg, "--mem-stats")) {
+#if defined(__linux__)
+    conf->mem_stats = 1;
+#else
+    avro_set_error("Option --mem-stats is not supported on this platform");
+    return EINVAL;
+#endif
+  } else if (!strcmp(arg, "--async-io")) {
+#if defined(__linux__)
+    conf->async_io = 1;
+#else
+    avro_set_error("Option --async-io is not supported on this platform");
+    return EINVAL;
+#endif
+  } else if (!strcmp(arg, "--io-depth") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    long depth = strtol(value, &end, 10);
+    if (*end != '\0' || depth <= 0 || depth > 256) {
+      avro_set_error("Invalid I/O depth: %s", value);
+      return EINVAL;
+    }
+    conf->io_depth = (size_t)depth;
+  } else if (!strcmp(arg, "--serve") && has_value) {
+    conf->serve_socket = argv[++*arg_idx];
+  } else if (!strcmp(arg, "--workers") && has_value) {
+    const char *value = argv[++*arg_idx];
+    char *end;
+    long workers = strtol(value, &end, 10);
+    if (*end != '\0' || workers <= 0) {
+      avro_set_error("Invalid number of workers: %s", value);
+      return EINVAL;
+    }
+    conf->serve_workers = (size_t)workers;
+  } else {
+    avro_set_error("Unknown option: %s", arg);
+    return -1;
+  }
+  return 0;
+}
+
+#define OPTIONS_ARRAY_MAX_SIZE 64
+
+// Parses options given as JSON array of strings, by a --serve job or an
+// output of --outputs. Returns 0 on success, or EINVAL with Avro error set.
+static int parse_options_array(const json_t *options, config_t *conf) {
+  char *argv[OPTIONS_ARRAY_MAX_SIZE + 1];
+  int argc = 0;
+
+  argv[argc++] = "avro2json";
+  for (size_t i = 0; i < json_array_size(options); ++i) {
+    const char *option = json_string_value(json_array_get(options, i));
+    if (option == NULL || argc > OPTIONS_ARRAY_MAX_SIZE) {
+      avro_set_error("Options must be an array of at most %d strings", OPTIONS_ARRAY_MAX_SIZE);
+      return EINVAL;
+    }
+    argv[argc++] = (char *)option;
+  }
+
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+    if (parse_option(argc, argv, &arg_idx, conf) != 0) {
+      return EINVAL;
+    }
+  }
+  return 0;
+}
+
+// Options which can be given separately for each output of --outputs
+static const char *const OUTPUT_OPTIONS[] = {
+    "--prune", "--logical-types", "--ms-hadoop-logical-types", "--csv", "--columns", NULL};
+
+static int is_output_option(const char *option) {
+  for (const char *const *name = OUTPUT_OPTIONS; *name != NULL; ++name) {
+    if (!strcmp(option, *name)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Parses --outputs, e.g.
+ * '[{"output":"all.json"},{"output":"hot.csv","options":["--csv","--columns","[\"a\"]"]}]'.
+ * Each output inherits the options of the conversion, and adds its own
+ * format options to them.
+ */
+static int parse_outputs(config_t *conf) {
+  json_t *outputs = json_loads(conf->outputs_json, 0, NULL);
+  if (!json_is_array(outputs) || json_array_size(outputs) == 0) {
+    avro_set_error("Option --outputs must be a non-empty JSON array of objects: %s", conf->outputs_json);
+    json_decref(outputs);
+    return EINVAL;
+  }
+
+  int rval = 0;
+  conf->outputs = (config_t *)calloc(json_array_size(outputs), sizeof(config_t));
+  if (conf->outputs == NULL) {
+    rval = ENOMEM;
+  }
+  for (size_t i = 0; rval == 0 && i < json_array_size(outputs); ++i) {
+    const json_t *item = json_array_get(outputs, i);
+    const char *path = json_string_value(json_object_get(item, "output"));
+    const json_t *options = json_object_get(item, "options");
+
+    config_t *output = &conf->outputs[conf->outputs_size++];
+    *output = *conf;
+    output->columns = NULL;
+    output->columns_size = 0;
+    output->outputs_json = NULL;
+    output->outputs = NULL;
+    output->outputs_size = 0;
+    output->output_path = NULL;
+    if (path == NULL) {
+      avro_set_error("Output %zu of --outputs has no 'output' file", i + 1);
+      rval = EINVAL;
+      break;
+    }
+    // Outputs sharing a file would overwrite each other
+    for (size_t j = 0; j < i; ++j) {
+      if (!strcmp(conf->outputs[j].output_path, path)) {
+        if (!strcmp(path, "-")) {
+          avro_set_error("Only one output of --outputs can be '-' (standard output)");
+        } else {
+          avro_set_error("Outputs %zu and %zu of --outputs both write to '%s'", j + 1, i + 1, path);
+        }
+        rval = EINVAL;
+        break;
+      }
+    }
+    if (rval != 0) {
+      break;
+    }
+    if ((output->output_path = alloc_and_copy_string(path)) == NULL) {
+      rval = ENOMEM;
+      break;
+    }
+    for (size_t j = 0; j < json_array_size(options); ++j) {
+      const char *option = json_string_value(json_array_get(options, j));
+      if (option != NULL && !strncmp(option, "--", 2) && !is_output_option(option)) {
+        avro_set_error("Option %s is not allowed in an output of --outputs", option);
+        rval = EINVAL;
+        break;
+      }
+    }
+    if (rval == 0) {
+      rval = parse_options_array(options, output);
+    }
+  }
+  json_decref(outputs);
+  return rval;
+}
+
+// Message of a failed conversion, from the Avro error which is set for all
+// but allocation failures
+static const char *error_message(int rval) {
+  const char *message = avro_strerror();
+  return rval == ENOMEM || message == NULL || *message == '\0' ? strerror(rval) : message;
+}
+
+// Checks combinations of options, which are rejected the same way from the
+// command line and in --serve jobs. Returns 0 if they are valid, or EINVAL
+// with Avro error set.
+static int validate_config(const config_t *conf) {
+  if (conf->follow && (conf->scan || conf->sample_rows > 0 || conf->async_io)) {
+    avro_set_error("Option --follow can't be combined with --scan, --sample-rows or --async-io");
+    return EINVAL;
+  }
+  if (conf->checkpoint != NULL && (conf->scan || conf->sample_rows > 0 || conf->async_io ||
+                                   conf->partition_by != NULL)) {
+    avro_set_error("Option --checkpoint can't be combined with --scan, --sample-rows, --async-io or --partition-by");
+    return EINVAL;
+  }
+  if (conf->partition_by == NULL && (conf->partitions > 0 || conf->partition_by_value ||
+                                     conf->max_open_partitions > 0 || conf->partition_prefix != NULL)) {
+    avro_set_error("Partitioning options require --partition-by");
+    return EINVAL;
+  }
+  if (conf->parquet_path != NULL &&
+      (conf->output_csv || conf->scan || conf->show_schema || conf->partition_by != NULL ||
+       conf->follow || conf->checkpoint != NULL)) {
+    avro_set_error("Option --parquet can't be combined with --csv, --scan, --show-schema, --partition-by, --follow or --checkpoint");
+    return EINVAL;
+  }
+  if (conf->parquet_path == NULL && conf->row_group_size > 0) {
+    avro_set_error("Option --row-group-size requires --parquet");
+    return EINVAL;
+  }
+  if (conf->partitions > 0 && conf->partition_by_value) {
+    avro_set_error("Options --partitions and --by-value are mutually exclusive");
+    return EINVAL;
+  }
+  if (conf->pipeline && (conf->sample_rows > 0 || conf->partition_by != NULL ||
+                         conf->parquet_path != NULL || conf->follow ||
+                         conf->checkpoint != NULL || conf->outputs_json != NULL)) {
+    avro_set_error("Option --pipeline can't be combined with --sample-rows, --partition-by, --parquet, --follow, --checkpoint or --outputs");
+    return EINVAL;
+  }
+  if (conf->format_threads > 1 && (conf->sample_rows > 0 || conf->partition_by != NULL ||
+                                   conf->parquet_path != NULL || conf->outputs_json != NULL)) {
+    avro_set_error("Option --format-threads can't be combined with --sample-rows, --partition-by, --parquet or --outputs");
+    return EINVAL;
+  }
+  if (conf->rows && (conf->pipeline || conf->follow || conf->checkpoint != NULL)) {
+    avro_set_error("Option --rows can't be combined with --pipeline, --follow or --checkpoint");
+    return EINVAL;
+  }
+  if (conf->mem_stats && (conf->pipeline || conf->serve_socket != NULL)) {
+    avro_set_error("Option --mem-stats can't be combined with --pipeline or --serve");
+    return EINVAL;
+  }
+  if (conf->flatten != NULL && (conf->columns_size > 0 || conf->parquet_path != NULL ||
+                                conf->outputs_json != NULL)) {
+    avro_set_error("Option --flatten can't be combined with --columns, --parquet or --outputs");
+    return EINVAL;
+  }
+  if (conf->emit_converter &&
+      (conf->output_csv || conf->columns_size > 0 || conf->flatten != NULL || conf->prune ||
+       conf->scan || conf->show_schema || conf->parquet_path != NULL ||
+       conf->outputs_json != NULL || conf->converter_path != NULL)) {
+    avro_set_error("Option --emit-converter can't be combined with --csv, --columns, --flatten, --prune, --scan, --show-schema, --parquet, --outputs or --converter");
+    return EINVAL;
+  }
+  if (conf->converter_path != NULL && conf->serve_socket != NULL) {
+    avro_set_error("Option --converter can't be combined with --serve");
+    return EINVAL;
+  }
+  if ((conf->datums != DATUMS_NONE) != (conf->schema_path != NULL)) {
+    avro_set_error("Options --datums and --schema must be given together");
+    return EINVAL;
+  }
+  if (conf->datums != DATUMS_NONE &&
+      (conf->scan || conf->show_schema || conf->build_index || conf->rows ||
+       conf->sample_blocks > 0 || conf->skip_corrupt_blocks || conf->follow ||
+       conf->checkpoint != NULL || conf->pipeline || conf->async_io || conf->mem_stats ||
+       conf->emit_converter || conf->serve_socket != NULL)) {
+    avro_set_error("Option --datums can't be combined with --scan, --show-schema, --build-index, --rows, --sample-blocks, --on-error skip-block, --follow, --checkpoint, --pipeline, --async-io, --mem-stats, --emit-converter or --serve");
+    return EINVAL;
+  }
+  if (conf->outputs_json != NULL &&
+      (conf->output_csv || conf->columns_size > 0 || conf->scan || conf->show_schema ||
+       conf->parquet_path != NULL || conf->partition_by != NULL || conf->checkpoint != NULL)) {
+    avro_set_error("Option --outputs can't be combined with --csv, --columns, --scan, --show-schema, --parquet, --partition-by or --checkpoint");
+    return EINVAL;
+  }
+  return 0;
+}
+
+static const char *parse_args(int argc, char **argv, config_t *conf) {
+  const char *file = NULL;
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+    // Last argument which isn't an option is the input file
+    if (arg_idx == argc - 1 && strncmp(argv[arg_idx], "--", 2)) {
+      file = argv[arg_idx];
+      break;
+    }
+    int rval = parse_option(argc, argv, &arg_idx, conf);
+    if (rval == -1) {
       print_usage(argv[0]);
     }
+    if (rval != 0) {
+      fprintf(stderr, "Error: %s\n", error_message(rval));
+      exit(1);
+    }
   }
-  
-  if (arg_idx != argc - 1) {
+
+  if ((file == NULL) == (conf->serve_socket == NULL)) {
     print_usage(argv[0]);
   }
-  
-  return argv[arg_idx];
+  if (validate_config(conf) != 0) {
+    fprintf(stderr, "Error: %s\n", avro_strerror());
+    exit(1);
+  }
+#if !defined(_WIN32)
+  if (conf->converter_path != NULL && plugin_load(conf->converter_path, &conf->converter) != 0) {
+    fprintf(stderr, "Error: %s\n", avro_strerror());
+    exit(1);
+  }
+#endif
+  if (conf->outputs_json != NULL && parse_outputs(conf) != 0) {
+    fprintf(stderr, "Error: %s\n", avro_strerror());
+    exit(1);
+  }
+
+  return file;
+}
+
+#if !defined(_WIN32)
+#define IFACE_CACHE_MAX_ENTRIES 256
+
+// Generic value interfaces shared between --serve jobs, keyed by writer schema
+// fingerprint, so that files with the same schema skip the class setup. The
+// fingerprint covers logical types, which converters read from the schema of
+// the interface, and hits are confirmed by comparing the schemas.
+typedef struct iface_cache_entry_t {
+  uint64_t fingerprint;
+  avro_schema_t schema;
+  avro_value_iface_t *iface;
+  struct iface_cache_entry_t *next;
+} iface_cache_entry_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  iface_cache_entry_t *entries;
+  size_t size;
+} iface_cache_t;
+
+// Returns a new reference to the interface for given schema
+static avro_value_iface_t *iface_cache_get(iface_cache_t *cache, avro_schema_t schema) {
+  uint64_t fingerprint;
+  if (schema_logical_fingerprint(schema, &fingerprint) != 0) {
+    return avro_generic_class_from_schema(schema);
+  }
+
+  avro_value_iface_t *iface = NULL;
+  pthread_mutex_lock(&cache->lock);
+  for (iface_cache_entry_t *entry = cache->entries; entry != NULL; entry = entry->next) {
+    if (entry->fingerprint == fingerprint && avro_schema_equal(entry->schema, schema)) {
+      iface = avro_value_iface_incref(entry->iface);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+  if (iface != NULL) {
+    return iface;
+  }
+
+  if ((iface = avro_generic_class_from_schema(schema)) == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  if (cache->size < IFACE_CACHE_MAX_ENTRIES) {
+    iface_cache_entry_t *entry = (iface_cache_entry_t *)malloc(sizeof(iface_cache_entry_t));
+    if (entry != NULL) {
+      entry->fingerprint = fingerprint;
+      entry->schema = avro_schema_incref(schema);
+      entry->iface = avro_value_iface_incref(iface);
+      entry->next = cache->entries;
+      cache->entries = entry;
+      cache->size++;
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return iface;
+}
+
+static void iface_cache_clear(iface_cache_t *cache) {
+  while (cache->entries != NULL) {
+    iface_cache_entry_t *entry = cache->entries;
+    cache->entries = entry->next;
+    avro_value_iface_decref(entry->iface);
+    avro_schema_decref(entry->schema);
+    free(entry);
+  }
+  cache->size = 0;
+}
+
+static void job_failed(json_t *response, const char *message) {
+  json_object_set_new(response, "status", json_string("error"));
+  json_object_set_new(response, "error", json_string(message));
+}
+
+static int job_parse_options(const json_t *options, config_t *conf) {
+  CHECKED_EV(parse_options_array(options, conf));
+  if (conf->serve_socket != NULL || conf->follow || conf->checkpoint != NULL ||
+      conf->partition_by != NULL || conf->parquet_path != NULL || conf->outputs_json != NULL ||
+      conf->mem_stats || conf->emit_converter || conf->converter_path != NULL ||
+      conf->datums != DATUMS_NONE || conf->schema_path != NULL) {
+    avro_set_error("Options --serve, --follow, --checkpoint, --partition-by, --parquet, --outputs, --mem-stats, --emit-converter, --converter, --datums and --schema are not allowed in a job");
+    return EINVAL;
+  }
+  return validate_config(conf);
+}
+
+static void run_job(const json_t *request, int out_fd, json_t *response, void *ctx) {
+  iface_cache_t *ifaces = (iface_cache_t *)ctx;
+  char message[1024];
+  struct timespec started, finished;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+
+  const char *input = json_string_value(json_object_get(request, "input"));
+  const char *output = json_string_value(json_object_get(request, "output"));
+  if (input == NULL) {
+    job_failed(response, "Job request has no 'input' file");
+    return;
+  }
+
+  config_t conf = {0};
+  if (job_parse_options(json_object_get(request, "options"), &conf) != 0) {
+    job_failed(response, avro_strerror());
+    config_free(&conf);
+    return;
+  }
+
+  FILE *dest = NULL;
+  if (output != NULL) {
+    dest = fopen(output, "wb");
+  } else if (out_fd >= 0) {
+    int fd = dup(out_fd);
+    if (fd >= 0 && (dest = fdopen(fd, "wb")) == NULL) {
+      close(fd);
+    }
+  } else {
+    job_failed(response, "Job request has neither 'output' file nor a passed descriptor");
+    config_free(&conf);
+    return;
+  }
+  if (dest == NULL) {
+    snprintf(message, sizeof(message), "Error opening output: %s", strerror(errno));
+    job_failed(response, message);
+    config_free(&conf);
+    return;
+  }
+
+  container_reader_t *reader;
+  if (open_input(input, &conf, &reader) != 0) {
+    snprintf(message, sizeof(message), "Error opening file '%s': %s", input, avro_strerror());
+    job_failed(response, message);
+    fclose(dest);
+    config_free(&conf);
+    return;
+  }
+  FILE *out = open_output(dest, &conf);
+  if (out == NULL) {
+    job_failed(response, avro_strerror());
+    container_close(reader);
+    fclose(dest);
+    config_free(&conf);
+    return;
+  }
+
+  stats_t stats = {0};
+  uint64_t fingerprint = 0;
+  int rval = schema_fingerprint(reader->schema, &fingerprint);
+  if (rval == 0 && conf.scan) {
+    rval = scan_file(reader, input, out, &stats);
+  } else if (rval == 0 && conf.build_index) {
+    rval = build_index(reader, &stats);
+  } else if (rval == 0) {
+    avro_value_iface_t *iface = iface_cache_get(ifaces, reader->schema);
+    if (iface == NULL) {
+      rval = ENOMEM;
+    } else {
+      rval = process_file(reader, &conf, out, iface, &stats);
+      avro_value_iface_decref(iface);
+    }
+  }
+  int write_failed = ferror(out);
+  if (out != dest && fclose(out) != 0) {
+    write_failed = 1;
+  }
+  if (fclose(dest) != 0) {
+    write_failed = 1;
+  }
+  container_close(reader);
+  config_free(&conf);
+
+  if (write_failed) {
+    job_failed(response, "Error writing output");
+    return;
+  }
+  if (rval != 0) {
+    job_failed(response, avro_strerror());
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &finished);
+  snprintf(message, sizeof(message), "%016" PRIx64, fingerprint);
+  json_object_set_new(response, "status", json_string("ok"));
+  json_object_set_new(response, "records", json_integer(stats.records));
+  if (stats.skipped_blocks > 0) {
+    json_object_set_new(response, "skipped_blocks", json_integer(stats.skipped_blocks));
+    json_object_set_new(response, "skipped_records", json_integer(stats.skipped_records));
+    json_object_set_new(response, "skipped_bytes", json_integer(stats.skipped_bytes));
+  }
+  if (stats.memo_lookups > 0) {
+    json_object_set_new(response, "memo_lookups", json_integer((json_int_t)stats.memo_lookups));
+    json_object_set_new(response, "memo_hits", json_integer((json_int_t)stats.memo_hits));
+    json_object_set_new(response, "memo_hit_rate",
+                        json_real((double)stats.memo_hits / (double)stats.memo_lookups));
+  }
+  json_object_set_new(response, "fingerprint", json_string(message));
+  json_object_set_new(response, "elapsed_ms",
+                      json_integer((finished.tv_sec - started.tv_sec) * 1000 +
+                                   (finished.tv_nsec - started.tv_nsec) / 1000000));
+}
+
+static int serve_jobs(const config_t *conf) {
+  iface_cache_t ifaces = {.entries = NULL, .size = 0};
+  pthread_mutex_init(&ifaces.lock, NULL);
+
+  size_t workers = conf->serve_workers;
+  if (workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cpus > 0 ? (size_t)cpus : 1;
+  }
+
+  int rval = serve(conf->serve_socket, workers, run_job, &ifaces);
+
+  iface_cache_clear(&ifaces);
+  pthread_mutex_destroy(&ifaces.lock);
+  return rval;
 }
+#endif
 
 #if defined(_WIN32)
 /*
@@ -1239,17 +3688,123 @@ int main(int argc, char **argv) {
   config_t conf = {.prune = 0,
                    .logical_types = 0,
                    .show_schema = 0,
+                   .scan = 0,
                    .output_csv = 0,
+                   .flatten = NULL,
                    .columns = NULL,
-                   .columns_size = 0};
+                   .columns_size = 0,
+                   .where = NULL,
+                   .sample_blocks = 0,
+                   .sample_rows = 0,
+                   .seed = 0,
+                   .memory_limit = DEFAULT_MEMORY_LIMIT,
+                   .skip_corrupt_blocks = 0,
+                   .partition_by = NULL,
+                   .partitions = 0,
+                   .partition_by_value = 0,
+                   .max_open_partitions = 0,
+                   .partition_prefix = NULL,
+                   .parquet_path = NULL,
+                   .row_group_size = 0,
+                   .parquet_codec = PARQUET_CODEC_SNAPPY,
+                   .follow = 0,
+                   .format_threads = 0,
+                   .pipeline = 0,
+                   .checkpoint = NULL,
+                   .build_index = 0,
+                   .rows = 0,
+                   .rows_begin = 0,
+                   .rows_end = 0,
+                   .outputs_json = NULL,
+                   .outputs = NULL,
+                   .outputs_size = 0,
+                   .output_path = NULL,
+                   .mem_stats = 0,
+                   .async_io = 0,
+                   .io_depth = 0,
+                   .serve_socket = NULL,
+                   .serve_workers = 0,
+                   .emit_converter = 0,
+                   .converter_path = NULL,
+                   .converter = NULL,
+                   .datums = DATUMS_NONE,
+                   .schema_path = NULL};
 
   const char *file = parse_args(argc, argv, &conf);
-  int rval = process_file(file, &conf);
-  if (conf.columns) {
-    for(size_t i = 0; i < conf.columns_size; i++) {
-      free(conf.columns[i].column_name);
+#if defined(__linux__)
+  if (conf.mem_stats) {
+    memstats_install();
+  }
+#endif
+
+  int rval;
+  if (conf.serve_socket != NULL) {
+#if !defined(_WIN32)
+    rval = serve_jobs(&conf);
+#else
+    fprintf(stderr, "Error: --serve is not supported on this platform\n");
+    rval = 1;
+#endif
+  } else if (conf.emit_converter) {
+    rval = emit_converter(file, &conf);
+    if (rval != 0) {
+      fprintf(stderr, "Error: %s\n", avro_strerror());
+    }
+  } else {
+    container_reader_t *reader = NULL;
+    datum_reader_t *datums = NULL;
+    if (conf.datums != DATUMS_NONE) {
+#if defined(_WIN32)
+      if (!strcmp(file, "-")) {
+        _setmode(_fileno(stdin), _O_BINARY);
+      }
+#endif
+      if (datum_open(file, conf.datums, conf.schema_path, conf.memory_limit, &datums)) {
+        fprintf(stderr, "Error opening datums '%s': %s\n", file, avro_strerror());
+        exit(1);
+      }
+    } else if (open_input(file, &conf, &reader)) {
+      fprintf(stderr, "Error opening file '%s': %s\n", file, avro_strerror());
+      exit(1);
+    }
+    FILE *out = stdout;
+    if (conf.parquet_path != NULL && (out = fopen(conf.parquet_path, "wb")) == NULL) {
+      fprintf(stderr, "Error opening file '%s': %s\n", conf.parquet_path, strerror(errno));
+      exit(1);
+    }
+    FILE *dest = open_output(out, &conf);
+    if (dest == NULL) {
+      fprintf(stderr, "Error: %s\n", avro_strerror());
+      exit(1);
+    }
+    stats_t stats = {0};
+    if (datums != NULL) {
+      rval = convert_datums(datums, &conf, dest, &stats);
+    } else if (conf.scan) {
+      rval = scan_file(reader, file, dest, &stats);
+    } else if (conf.build_index) {
+      rval = build_index(reader, &stats);
+    } else {
+      rval = process_file(reader, &conf, dest, NULL, &stats);
+    }
+    if (rval != 0) {
+      fprintf(stderr, "Error: %s\n", error_message(rval));
+    }
+    if (dest != out && fclose(dest) != 0) {
+      fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+      rval = rval != 0 ? rval : EIO;
+    }
+    if (out != stdout && fclose(out) != 0) {
+      fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+      rval = rval != 0 ? rval : EIO;
+    }
+    if (datums != NULL) {
+      datum_close(datums);
+    } else {
+      container_close(reader);
     }
-    free(conf.columns);
   }
+
+  config_free(&conf);
   return rval;
 }
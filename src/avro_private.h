@@ -27,6 +27,33 @@ struct avro_union_schema_t {
 	st_table *branches_byname;
 };
 
+/*
+ * Block codecs, as defined in lang/c/src/codec.h.
+ */
+
+enum avro_codec_type_t {
+  AVRO_CODEC_NULL,
+  AVRO_CODEC_DEFLATE,
+  AVRO_CODEC_LZMA,
+  AVRO_CODEC_SNAPPY
+};
+typedef enum avro_codec_type_t avro_codec_type_t;
+
+struct avro_codec_t_ {
+  const char *name;
+  avro_codec_type_t type;
+  int64_t block_size;
+  int64_t used_size;
+  void *block_data;
+  void *codec_data;
+};
+typedef struct avro_codec_t_ *avro_codec_t;
+
+int avro_codec(avro_codec_t c, const char *type);
+int avro_codec_reset(avro_codec_t c);
+int avro_codec_encode(avro_codec_t c, void *data, int64_t len);
+int avro_codec_decode(avro_codec_t c, void *data, int64_t len);
+
 #define container_of(ptr_, type_, member_)                                     \
   ((type_ *)((char *)ptr_ - (size_t) & ((type_ *)0)->member_))
 
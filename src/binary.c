@@ -0,0 +1,246 @@
+#include <avro.h>
+#include <errno.h>
+#include <string.h>
+
+#include "binary.h"
+
+// Data ends before the value does. Functions below return it as
+// BINARY_INCOMPLETE, which the public ones other than
+// binary_skip_available() report as EILSEQ.
+static int truncated(void) {
+  avro_set_error("Truncated or malformed Avro data");
+  return BINARY_INCOMPLETE;
+}
+
+static int malformed(void) {
+  avro_set_error("Truncated or malformed Avro data");
+  return EILSEQ;
+}
+
+static int public_result(int rval) {
+  return rval == BINARY_INCOMPLETE ? EILSEQ : rval;
+}
+
+static int read_long(const char **p, const char *end, int64_t *value) {
+  const unsigned char *cur = (const unsigned char *)*p;
+  uint64_t result = 0;
+  int shift = 0;
+  unsigned char b;
+  do {
+    if (shift >= 64) {
+      return malformed();
+    }
+    if (cur >= (const unsigned char *)end) {
+      return truncated();
+    }
+    b = *cur++;
+    result |= (uint64_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+
+  *value = (int64_t)((result >> 1) ^ -(result & 1));
+  *p = (const char *)cur;
+  return 0;
+}
+
+int binary_read_long(const char **p, const char *end, int64_t *value) {
+  return public_result(read_long(p, end, value));
+}
+
+int binary_read_float(const char **p, const char *end, float *value) {
+  if (end - *p < 4) {
+    return public_result(truncated());
+  }
+  // Avro floats are little-endian, as is every platform we build for
+  memcpy(value, *p, 4);
+  *p += 4;
+  return 0;
+}
+
+int binary_read_double(const char **p, const char *end, double *value) {
+  if (end - *p < 8) {
+    return public_result(truncated());
+  }
+  memcpy(value, *p, 8);
+  *p += 8;
+  return 0;
+}
+
+static int read_bytes(const char **p, const char *end, const char **bytes, size_t *size) {
+  int64_t len;
+  int rval = read_long(p, end, &len);
+  if (rval != 0) {
+    return rval;
+  }
+  if (len < 0) {
+    return malformed();
+  }
+  if (len > end - *p) {
+    return truncated();
+  }
+  *bytes = *p;
+  *size = (size_t)len;
+  *p += len;
+  return 0;
+}
+
+int binary_read_bytes(const char **p, const char *end, const char **bytes,
+                      size_t *size) {
+  return public_result(read_bytes(p, end, bytes, size));
+}
+
+avro_schema_t binary_resolve_schema(avro_schema_t schema) {
+  while (is_avro_link(schema)) {
+    schema = avro_schema_link_target(schema);
+  }
+  return schema;
+}
+
+static int skip(avro_schema_t schema, const char **p, const char *end);
+
+// Skips array or map blocks, calling skip() for every item.
+static int skip_blocks(avro_schema_t items, int is_map, const char **p,
+                       const char *end) {
+  for (;;) {
+    int64_t count;
+    int rval = read_long(p, end, &count);
+    if (rval != 0) {
+      return rval;
+    }
+    if (count == 0) {
+      return 0;
+    }
+    if (count < 0) {
+      // Block size in bytes follows negative count, so it can be skipped at once
+      int64_t size;
+      if ((rval = read_long(p, end, &size)) != 0) {
+        return rval;
+      }
+      if (size < 0) {
+        return malformed();
+      }
+      if (size > end - *p) {
+        return truncated();
+      }
+      *p += size;
+      continue;
+    }
+    for (int64_t i = 0; i < count; ++i) {
+      if (is_map) {
+        const char *key;
+        size_t key_size;
+        if ((rval = read_bytes(p, end, &key, &key_size)) != 0) {
+          return rval;
+        }
+      }
+      if ((rval = skip(items, p, end)) != 0) {
+        return rval;
+      }
+    }
+  }
+}
+
+static int skip(avro_schema_t schema, const char **p, const char *end) {
+  schema = binary_resolve_schema(schema);
+
+  switch (avro_typeof(schema)) {
+  case AVRO_NULL:
+    return 0;
+
+  case AVRO_BOOLEAN:
+    if (end - *p < 1) {
+      return truncated();
+    }
+    *p += 1;
+    return 0;
+
+  case AVRO_INT32:
+  case AVRO_INT64: {
+    int64_t value;
+    return read_long(p, end, &value);
+  }
+
+  case AVRO_ENUM: {
+    int64_t index;
+    int rval = read_long(p, end, &index);
+    if (rval != 0) {
+      return rval;
+    }
+    if (index < 0 || index >= avro_schema_enum_number_of_symbols(schema)) {
+      return malformed();
+    }
+    return 0;
+  }
+
+  case AVRO_FLOAT:
+    if (end - *p < 4) {
+      return truncated();
+    }
+    *p += 4;
+    return 0;
+
+  case AVRO_DOUBLE:
+    if (end - *p < 8) {
+      return truncated();
+    }
+    *p += 8;
+    return 0;
+
+  case AVRO_STRING:
+  case AVRO_BYTES: {
+    const char *bytes;
+    size_t size;
+    return read_bytes(p, end, &bytes, &size);
+  }
+
+  case AVRO_FIXED: {
+    int64_t size = avro_schema_fixed_size(schema);
+    if (end - *p < size) {
+      return truncated();
+    }
+    *p += size;
+    return 0;
+  }
+
+  case AVRO_ARRAY:
+    return skip_blocks(avro_schema_array_items(schema), 0, p, end);
+
+  case AVRO_MAP:
+    return skip_blocks(avro_schema_map_values(schema), 1, p, end);
+
+  case AVRO_UNION: {
+    int64_t branch;
+    int rval = read_long(p, end, &branch);
+    if (rval != 0) {
+      return rval;
+    }
+    if (branch < 0 || (size_t)branch >= avro_schema_union_size(schema)) {
+      return malformed();
+    }
+    return skip(avro_schema_union_branch(schema, (int)branch), p, end);
+  }
+
+  case AVRO_RECORD: {
+    size_t field_count = avro_schema_record_size(schema);
+    for (size_t i = 0; i < field_count; ++i) {
+      int rval = skip(avro_schema_record_field_get_by_index(schema, (int)i), p, end);
+      if (rval != 0) {
+        return rval;
+      }
+    }
+    return 0;
+  }
+
+  default:
+    avro_set_error("Unsupported schema type");
+    return EINVAL;
+  }
+}
+
+int binary_skip(avro_schema_t schema, const char **p, const char *end) {
+  return public_result(skip(schema, p, end));
+}
+
+int binary_skip_available(avro_schema_t schema, const char **p, const char *end) {
+  return skip(schema, p, end);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <avro.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Helpers for reading Avro binary encoded data directly from a buffer.
+ * All functions advance '*p' past the value read, and return 0 on success,
+ * or EILSEQ (with Avro error set) when data is truncated or malformed.
+ */
+
+int binary_read_long(const char **p, const char *end, int64_t *value);
+
+int binary_read_float(const char **p, const char *end, float *value);
+
+int binary_read_double(const char **p, const char *end, double *value);
+
+int binary_read_bytes(const char **p, const char *end, const char **bytes,
+                      size_t *size);
+
+/**
+ * Skips a single datum of the given schema without decoding it.
+ */
+int binary_skip(avro_schema_t schema, const char **p, const char *end);
+
+// Returned by binary_skip_available() when data ends before the datum does
+#define BINARY_INCOMPLETE -2
+
+/**
+ * Same as binary_skip(), but returns BINARY_INCOMPLETE rather than EILSEQ
+ * when data ends before the datum does, so that readers of streams can tell
+ * a datum they haven't read whole yet from a malformed one.
+ */
+int binary_skip_available(avro_schema_t schema, const char **p, const char *end);
+
+/**
+ * Resolves named schema references (links) to their target schemas.
+ */
+avro_schema_t binary_resolve_schema(avro_schema_t schema);
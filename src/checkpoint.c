@@ -0,0 +1,151 @@
+#include <avro.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "checkpoint.h"
+
+#define CHECKPOINT_VERSION 2
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+  const char *digit = c != '\0' ? strchr(HEX_DIGITS, c) : NULL;
+  return digit != NULL ? (int)(digit - HEX_DIGITS) : -1;
+}
+
+static int invalid(const char *path) {
+  avro_set_error("Invalid checkpoint file '%s'", path);
+  return EINVAL;
+}
+
+int checkpoint_load(const char *path, checkpoint_t *checkpoint) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    if (errno == ENOENT) {
+      return ENOENT;
+    }
+    int rval = errno;
+    avro_set_error("Cannot open checkpoint file '%s': %s", path, strerror(rval));
+    return rval;
+  }
+  json_error_t error;
+  json_t *json = json_loadf(fp, 0, &error);
+  fclose(fp);
+  if (json == NULL) {
+    return invalid(path);
+  }
+
+  const char *sync = json_string_value(json_object_get(json, "sync"));
+  json_t *offset = json_object_get(json, "offset");
+  json_t *blocks = json_object_get(json, "blocks");
+  json_t *records = json_object_get(json, "records");
+  json_t *output_offset = json_object_get(json, "output_offset");
+  const char *options = json_string_value(json_object_get(json, "options"));
+  int rval = 0;
+  if (json_integer_value(json_object_get(json, "version")) != CHECKPOINT_VERSION ||
+      sync == NULL || strlen(sync) != 2 * CONTAINER_SYNC_SIZE ||
+      !json_is_integer(offset) || !json_is_integer(blocks) ||
+      !json_is_integer(records) || !json_is_integer(output_offset) ||
+      options == NULL || strlen(options) != 16) {
+    rval = invalid(path);
+  }
+  checkpoint->options = 0;
+  for (size_t i = 0; rval == 0 && i < 16; ++i) {
+    int digit = hex_value(options[i]);
+    if (digit < 0) {
+      rval = invalid(path);
+    }
+    checkpoint->options = checkpoint->options << 4 | (uint64_t)digit;
+  }
+  for (size_t i = 0; rval == 0 && i < CONTAINER_SYNC_SIZE; ++i) {
+    int high = hex_value(sync[2 * i]), low = hex_value(sync[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      rval = invalid(path);
+    }
+    checkpoint->sync[i] = (char)(high << 4 | low);
+  }
+  if (rval == 0) {
+    checkpoint->offset = json_integer_value(offset);
+    checkpoint->blocks = json_integer_value(blocks);
+    checkpoint->records = json_integer_value(records);
+    checkpoint->output_offset = json_integer_value(output_offset);
+  }
+  json_decref(json);
+  return rval;
+}
+
+// Writes the checkpoint to a temporary file, and makes sure it's on disk
+// before it replaces the previous one
+static int write_file(const char *path, const char *content) {
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) {
+    return errno;
+  }
+  int rval = fputs(content, fp) < 0 || fflush(fp) != 0 ? errno : 0;
+#if !defined(_WIN32)
+  if (rval == 0 && fsync(fileno(fp)) != 0) {
+    rval = errno;
+  }
+#endif
+  if (fclose(fp) != 0 && rval == 0) {
+    rval = errno;
+  }
+  return rval;
+}
+
+int checkpoint_save(const char *path, const checkpoint_t *checkpoint) {
+  char sync[2 * CONTAINER_SYNC_SIZE + 1];
+  for (size_t i = 0; i < CONTAINER_SYNC_SIZE; ++i) {
+    unsigned char byte = (unsigned char)checkpoint->sync[i];
+    sync[2 * i] = HEX_DIGITS[byte >> 4];
+    sync[2 * i + 1] = HEX_DIGITS[byte & 0xf];
+  }
+  sync[2 * CONTAINER_SYNC_SIZE] = '\0';
+  char options[17];
+  snprintf(options, sizeof(options), "%016" PRIx64, checkpoint->options);
+
+  json_t *json = json_object();
+  json_object_set_new(json, "version", json_integer(CHECKPOINT_VERSION));
+  json_object_set_new(json, "sync", json_string(sync));
+  json_object_set_new(json, "offset", json_integer(checkpoint->offset));
+  json_object_set_new(json, "blocks", json_integer(checkpoint->blocks));
+  json_object_set_new(json, "records", json_integer(checkpoint->records));
+  json_object_set_new(json, "output_offset", json_integer(checkpoint->output_offset));
+  json_object_set_new(json, "options", json_string(options));
+  char *content = json_dumps(json, JSON_COMPACT);
+  json_decref(json);
+
+  size_t tmp_size = strlen(path) + 5;
+  char *tmp_path = (char *)malloc(tmp_size);
+  if (content == NULL || tmp_path == NULL) {
+    free(content);
+    free(tmp_path);
+    return ENOMEM;
+  }
+  snprintf(tmp_path, tmp_size, "%s.tmp", path);
+
+  int rval = write_file(tmp_path, content);
+#if defined(_WIN32)
+  // rename() doesn't replace an existing file on Windows
+  if (rval == 0) {
+    remove(path);
+  }
+#endif
+  if (rval == 0 && rename(tmp_path, path) != 0) {
+    rval = errno;
+  }
+  if (rval != 0) {
+    avro_set_error("Cannot save checkpoint file '%s': %s", path, strerror(rval));
+    remove(tmp_path);
+  }
+  free(content);
+  free(tmp_path);
+  return rval;
+}
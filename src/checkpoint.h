@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "container.h"
+
+/*
+ * Progress of a conversion, saved with --checkpoint so that a killed run can
+ * be resumed at block granularity. The checkpoint is kept as a small JSON
+ * file, replaced atomically on every save.
+ */
+
+typedef struct {
+  char sync[CONTAINER_SYNC_SIZE]; // sync marker identifying the input file
+  int64_t offset;                 // file offset of the next block to convert
+  int64_t blocks;                 // number of blocks before that offset
+  int64_t records;                // number of records written so far
+  int64_t output_offset;          // output position after them, -1 if unknown
+  uint64_t options;               // fingerprint of the options the output depends on
+} checkpoint_t;
+
+/**
+ * Loads the checkpoint saved at 'path'.
+ * Returns 0 on success, ENOENT if there's no checkpoint yet, or error code
+ * (with Avro error set) otherwise.
+ */
+int checkpoint_load(const char *path, checkpoint_t *checkpoint);
+
+/**
+ * Saves the checkpoint to 'path', replacing the previous one.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int checkpoint_save(const char *path, const checkpoint_t *checkpoint);
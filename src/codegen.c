@@ -0,0 +1,546 @@
+#include <avro.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary.h"
+#include "codegen.h"
+#include "fingerprint.h"
+#include "format.h"
+#include "plugin_abi.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+typedef struct {
+  FILE *dest;
+  const config_t *conf;
+  avro_schema_t *records; // every record type gets function record_<index>
+  size_t records_count;
+  size_t capacity;
+} codegen_t;
+
+// Helpers of the generated code, besides those of plugin_abi.h
+static const char PRELUDE[] =
+    "#include <avro.h>\n"
+    "#include <errno.h>\n"
+    "#include <stdio.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "#include \"binary.h\"\n"
+    "#include \"format.h\"\n"
+    "#include \"logical.h\"\n"
+    "#include \"plugin_abi.h\"\n"
+    "\n"
+    "#define CHECKED(call)                                                          \\\n"
+    "  do {                                                                         \\\n"
+    "    int rval_ = (call);                                                        \\\n"
+    "    if (rval_ != 0) {                                                          \\\n"
+    "      return rval_;                                                            \\\n"
+    "    }                                                                          \\\n"
+    "  } while (0)\n"
+    "\n"
+    "static inline int invalid(const char *message) {\n"
+    "  avro_set_error(\"%s\", message);\n"
+    "  return EILSEQ;\n"
+    "}\n"
+    "\n"
+    "static inline int write_text(plugin_buffer_t *out, const char *text) {\n"
+    "  size_t size = strlen(text);\n"
+    "  CHECKED(plugin_reserve(out, size + 2));\n"
+    "  out->data[out->size] = '\"';\n"
+    "  memcpy(out->data + out->size + 1, text, size);\n"
+    "  out->data[out->size + size + 1] = '\"';\n"
+    "  out->size += size + 2;\n"
+    "  return 0;\n"
+    "}\n"
+    "\n"
+    "static inline int write_int(plugin_buffer_t *out, int64_t value) {\n"
+    "  CHECKED(plugin_reserve(out, MAX_INT_SIZE));\n"
+    "  out->size += format_int64(out->data + out->size, value);\n"
+    "  return 0;\n"
+    "}\n"
+    "\n"
+    "static inline int write_real(plugin_buffer_t *out, double value) {\n"
+    "  CHECKED(plugin_reserve(out, MAX_REAL_SIZE));\n"
+    "  out->size += format_real(out->data + out->size, value, 0);\n"
+    "  return 0;\n"
+    "}\n"
+    "\n"
+    "static inline int write_string(plugin_buffer_t *out, const char *str, size_t size) {\n"
+    "  size_t written;\n"
+    "  CHECKED(plugin_reserve(out, 6 * size + 2));\n"
+    "  CHECKED(format_json_string(out->data + out->size, str, size, &written));\n"
+    "  out->size += written;\n"
+    "  return 0;\n"
+    "}\n"
+    "\n"
+    "static inline int write_byte_array(plugin_buffer_t *out, const char *bytes, size_t size) {\n"
+    "  CHECKED(plugin_write(out, \"[\", 1));\n"
+    "  for (size_t i = 0; i < size; ++i) {\n"
+    "    if (i > 0) {\n"
+    "      CHECKED(plugin_write(out, \",\", 1));\n"
+    "    }\n"
+    "    CHECKED(write_int(out, (unsigned char)bytes[i]));\n"
+    "  }\n"
+    "  return plugin_write(out, \"]\", 1);\n"
+    "}\n"
+    "\n"
+    "static inline int write_guid(plugin_buffer_t *out, const char *bytes) {\n"
+    "  char guid[37];\n"
+    "  snprintf(guid, sizeof(guid), GUID_FORMAT, GUID_ARG(bytes));\n"
+    "  return write_text(out, guid);\n"
+    "}\n"
+    "\n"
+    "static inline int read_fixed(const char **p, const char *end, size_t size, const char **bytes) {\n"
+    "  if ((size_t)(end - *p) < size) {\n"
+    "    return invalid(\"Truncated or malformed Avro data\");\n"
+    "  }\n"
+    "  *bytes = *p;\n"
+    "  *p += size;\n"
+    "  return 0;\n"
+    "}\n";
+
+int codegen_options(const config_t *conf) {
+  return (conf->logical_types ? PLUGIN_LOGICAL_TYPES : 0) |
+         (conf->ms_hadoop_logical_types ? PLUGIN_MS_HADOOP_LOGICAL_TYPES : 0);
+}
+
+static avro_logical_schema_t *logical_type(const codegen_t *gen, avro_schema_t schema) {
+  return gen->conf->logical_types ? avro_logical_schema(schema) : NULL;
+}
+
+static int is_ms_hadoop_guid(const codegen_t *gen, avro_schema_t schema) {
+  const char *ns = avro_schema_namespace(schema);
+  return gen->conf->ms_hadoop_logical_types && avro_schema_fixed_size(schema) == 16 &&
+         ns != NULL && !strcmp(ns, "System") && !strcmp(avro_schema_name(schema), "Guid");
+}
+
+static int unsupported(const char *message) {
+  avro_set_error("%s", message);
+  return EINVAL;
+}
+
+/*
+ * Collection of record types, and of unsupported types
+ */
+
+static int find_record(const codegen_t *gen, avro_schema_t record) {
+  for (size_t i = 0; i < gen->records_count; ++i) {
+    if (gen->records[i] == record) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static int collect(codegen_t *gen, avro_schema_t schema) {
+  schema = binary_resolve_schema(schema);
+  switch (avro_typeof(schema)) {
+  case AVRO_INT32: {
+    avro_logical_schema_t *logical = logical_type(gen, schema);
+    if (logical != NULL && logical->type != AVRO_DATE && logical->type != AVRO_TIME_MILLIS) {
+      return unsupported("INT type is annotated by an unsupported logical type");
+    }
+    return 0;
+  }
+
+  case AVRO_INT64: {
+    avro_logical_schema_t *logical = logical_type(gen, schema);
+    if (logical != NULL && logical->type != AVRO_TIME_MICROS &&
+        logical->type != AVRO_TIMESTAMP_MILLIS && logical->type != AVRO_TIMESTAMP_MICROS) {
+      return unsupported("LONG type is annotated by an unsupported logical type");
+    }
+    return 0;
+  }
+
+  case AVRO_FIXED:
+    if (is_ms_hadoop_guid(gen, schema)) {
+      return 0;
+    }
+    // fall through
+  case AVRO_BYTES:
+    if (logical_type(gen, schema) != NULL) {
+      return unsupported("Decimals aren't supported by generated converters");
+    }
+    return 0;
+
+  case AVRO_ARRAY:
+    return collect(gen, avro_schema_array_items(schema));
+
+  case AVRO_MAP:
+    return collect(gen, avro_schema_map_values(schema));
+
+  case AVRO_UNION:
+    for (size_t i = 0; i < avro_schema_union_size(schema); ++i) {
+      CHECKED_EV(collect(gen, avro_schema_union_branch(schema, (int)i)));
+    }
+    return 0;
+
+  case AVRO_RECORD: {
+    if (find_record(gen, schema) >= 0) {
+      return 0;
+    }
+    if (gen->records_count == gen->capacity) {
+      size_t capacity = gen->capacity > 0 ? gen->capacity * 2 : 16;
+      avro_schema_t *records =
+          (avro_schema_t *)realloc(gen->records, capacity * sizeof(avro_schema_t));
+      if (records == NULL) {
+        return ENOMEM;
+      }
+      gen->records = records;
+      gen->capacity = capacity;
+    }
+    gen->records[gen->records_count++] = schema;
+    size_t fields_count = avro_schema_record_size(schema);
+    for (size_t i = 0; i < fields_count; ++i) {
+      CHECKED_EV(collect(gen, avro_schema_record_field_get_by_index(schema, (int)i)));
+    }
+    return 0;
+  }
+
+  case AVRO_NULL:
+  case AVRO_BOOLEAN:
+  case AVRO_FLOAT:
+  case AVRO_DOUBLE:
+  case AVRO_STRING:
+  case AVRO_ENUM:
+    return 0;
+
+  default:
+    return unsupported("Unsupported schema type");
+  }
+}
+
+/*
+ * Code
+ */
+
+// Writes the bytes as a C string literal
+static void emit_literal(FILE *dest, const char *data, size_t size) {
+  fputc('"', dest);
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char c = (unsigned char)data[i];
+    if (c == '"' || c == '\\' || c == '?') {
+      fprintf(dest, "\\%c", c);
+    } else if (c < 0x20 || c > 0x7e) {
+      fprintf(dest, "\\%03o", c);
+    } else {
+      fputc(c, dest);
+    }
+  }
+  fputc('"', dest);
+}
+
+// Writes a line of code indented by 'indent' spaces
+static void emit_line(codegen_t *gen, int indent, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  fprintf(gen->dest, "%*s", indent, "");
+  vfprintf(gen->dest, format, args);
+  fputc('\n', gen->dest);
+  va_end(args);
+}
+
+// Writes a statement appending the constant text to the output
+static void emit_write(codegen_t *gen, int indent, const char *text, size_t size) {
+  fprintf(gen->dest, "%*sCHECKED(plugin_write(out, ", indent, "");
+  emit_literal(gen->dest, text, size);
+  fprintf(gen->dest, ", %zu));\n", size);
+}
+
+// Formats the name as a quoted JSON string, preceded by 'prefix' and followed
+// by 'suffix'. The returned string must be released with free().
+static char *json_name(const char *prefix, const char *name, const char *suffix, size_t *size) {
+  size_t prefix_size = strlen(prefix), name_size = strlen(name);
+  char *result = (char *)malloc(prefix_size + 6 * name_size + 2 + strlen(suffix) + 1);
+  if (result == NULL) {
+    return NULL;
+  }
+  size_t written;
+  memcpy(result, prefix, prefix_size);
+  if (format_json_string(result + prefix_size, name, name_size, &written) != 0) {
+    free(result);
+    return NULL;
+  }
+  *size = prefix_size + written;
+  strcpy(result + *size, suffix);
+  *size += strlen(suffix);
+  return result;
+}
+
+static const char *logical_formatter(avro_logical_schema_t *logical) {
+  switch (logical->type) {
+  case AVRO_DATE:
+    return "epoch_days_to_str((int32_t)";
+  case AVRO_TIME_MILLIS:
+    return "time_millis_to_str((int32_t)";
+  case AVRO_TIME_MICROS:
+    return "time_micros_to_str(";
+  case AVRO_TIMESTAMP_MILLIS:
+    return "timestamp_millis_to_str(";
+  default:
+    return "timestamp_micros_to_str(";
+  }
+}
+
+// Writes statements converting a value of the schema, indented by 2 * depth
+// spaces. Local variables are suffixed by the depth, so that they are unique
+// among enclosing blocks.
+static int emit_value(codegen_t *gen, avro_schema_t schema, int depth) {
+  int in = 2 * depth, d = depth;
+  schema = binary_resolve_schema(schema);
+  switch (avro_typeof(schema)) {
+  case AVRO_NULL:
+    emit_write(gen, in, "null", 4);
+    return 0;
+
+  case AVRO_BOOLEAN:
+    emit_line(gen, in, "if (*p >= end) {");
+    emit_line(gen, in, "  return invalid(\"Truncated or malformed Avro data\");");
+    emit_line(gen, in, "}");
+    emit_line(gen, in,
+              "CHECKED(*(*p)++ ? plugin_write(out, \"true\", 4) : plugin_write(out, \"false\", 5));");
+    return 0;
+
+  case AVRO_INT32:
+  case AVRO_INT64: {
+    avro_logical_schema_t *logical = logical_type(gen, schema);
+    emit_line(gen, in, "{");
+    emit_line(gen, in, "  int64_t v%d;", d);
+    emit_line(gen, in, "  CHECKED(binary_read_long(p, end, &v%d));", d);
+    if (logical != NULL) {
+      emit_line(gen, in, "  CHECKED(write_text(out, %sv%d)));", logical_formatter(logical), d);
+    } else if (avro_typeof(schema) == AVRO_INT32) {
+      emit_line(gen, in, "  CHECKED(write_int(out, (int32_t)v%d));", d);
+    } else {
+      emit_line(gen, in, "  CHECKED(write_int(out, v%d));", d);
+    }
+    emit_line(gen, in, "}");
+    return 0;
+  }
+
+  case AVRO_FLOAT:
+  case AVRO_DOUBLE: {
+    const char *type = avro_typeof(schema) == AVRO_FLOAT ? "float" : "double";
+    emit_line(gen, in, "{");
+    emit_line(gen, in, "  %s v%d;", type, d);
+    emit_line(gen, in, "  CHECKED(binary_read_%s(p, end, &v%d));", type, d);
+    emit_line(gen, in, "  CHECKED(write_real(out, v%d));", d);
+    emit_line(gen, in, "}");
+    return 0;
+  }
+
+  case AVRO_STRING:
+  case AVRO_BYTES:
+    emit_line(gen, in, "{");
+    emit_line(gen, in, "  const char *v%d;", d);
+    emit_line(gen, in, "  size_t size%d;", d);
+    emit_line(gen, in, "  CHECKED(binary_read_bytes(p, end, &v%d, &size%d));", d, d);
+    emit_line(gen, in, "  CHECKED(write_%s(out, v%d, size%d));",
+              avro_typeof(schema) == AVRO_STRING ? "string" : "byte_array", d, d);
+    emit_line(gen, in, "}");
+    return 0;
+
+  case AVRO_FIXED: {
+    int64_t size = avro_schema_fixed_size(schema);
+    emit_line(gen, in, "{");
+    emit_line(gen, in, "  const char *v%d;", d);
+    emit_line(gen, in, "  CHECKED(read_fixed(p, end, %" PRId64 ", &v%d));", size, d);
+    if (is_ms_hadoop_guid(gen, schema)) {
+      emit_line(gen, in, "  CHECKED(write_guid(out, v%d));", d);
+    } else {
+      emit_line(gen, in, "  CHECKED(write_byte_array(out, v%d, %" PRId64 "));", d, size);
+    }
+    emit_line(gen, in, "}");
+    return 0;
+  }
+
+  case AVRO_ENUM: {
+    emit_line(gen, in, "{");
+    emit_line(gen, in, "  int64_t v%d;", d);
+    emit_line(gen, in, "  CHECKED(binary_read_long(p, end, &v%d));", d);
+    emit_line(gen, in, "  switch (v%d) {", d);
+    int symbols = avro_schema_enum_number_of_symbols(schema);
+    for (int i = 0; i < symbols; ++i) {
+      size_t size;
+      char *symbol = json_name("", avro_schema_enum_get(schema, i), "", &size);
+      if (symbol == NULL) {
+        return ENOMEM;
+      }
+      emit_line(gen, in, "  case %d:", i);
+      emit_write(gen, in + 4, symbol, size);
+      emit_line(gen, in, "    break;");
+      free(symbol);
+    }
+    emit_line(gen, in, "  default:");
+    emit_line(gen, in, "    return invalid(\"Invalid enum symbol index\");");
+    emit_line(gen, in, "  }");
+    emit_line(gen, in, "}");
+    return 0;
+  }
+
+  case AVRO_ARRAY:
+  case AVRO_MAP: {
+    int is_map = avro_typeof(schema) == AVRO_MAP;
+    emit_line(gen, in, "{");
+    emit_write(gen, in + 2, is_map ? "{" : "[", 1);
+    emit_line(gen, in, "  int first%d = 1;", d);
+    emit_line(gen, in, "  for (;;) {");
+    emit_line(gen, in, "    int64_t count%d;", d);
+    emit_line(gen, in, "    CHECKED(binary_read_long(p, end, &count%d));", d);
+    emit_line(gen, in, "    if (count%d == 0) {", d);
+    emit_line(gen, in, "      break;");
+    emit_line(gen, in, "    }");
+    emit_line(gen, in, "    if (count%d < 0) {", d);
+    emit_line(gen, in, "      // Negative count is followed by block size in bytes");
+    emit_line(gen, in, "      int64_t size%d;", d);
+    emit_line(gen, in, "      CHECKED(binary_read_long(p, end, &size%d));", d);
+    emit_line(gen, in, "      count%d = -count%d;", d, d);
+    emit_line(gen, in, "    }");
+    emit_line(gen, in, "    for (int64_t i%d = 0; i%d < count%d; ++i%d) {", d, d, d, d);
+    emit_line(gen, in, "      if (!first%d) {", d);
+    emit_line(gen, in, "        CHECKED(plugin_write(out, \",\", 1));");
+    emit_line(gen, in, "      }");
+    emit_line(gen, in, "      first%d = 0;", d);
+    if (is_map) {
+      emit_line(gen, in, "      const char *key%d;", d);
+      emit_line(gen, in, "      size_t key_size%d;", d);
+      emit_line(gen, in, "      CHECKED(binary_read_bytes(p, end, &key%d, &key_size%d));", d, d);
+      emit_line(gen, in, "      CHECKED(write_string(out, key%d, key_size%d));", d, d);
+      emit_line(gen, in, "      CHECKED(plugin_write(out, \":\", 1));");
+    }
+    CHECKED_EV(emit_value(
+        gen, is_map ? avro_schema_map_values(schema) : avro_schema_array_items(schema), d + 3));
+    emit_line(gen, in, "    }");
+    emit_line(gen, in, "  }");
+    emit_write(gen, in + 2, is_map ? "}" : "]", 1);
+    emit_line(gen, in, "}");
+    return 0;
+  }
+
+  case AVRO_UNION:
+    emit_line(gen, in, "{");
+    emit_line(gen, in, "  int64_t branch%d;", d);
+    emit_line(gen, in, "  CHECKED(binary_read_long(p, end, &branch%d));", d);
+    emit_line(gen, in, "  switch (branch%d) {", d);
+    for (size_t i = 0; i < avro_schema_union_size(schema); ++i) {
+      emit_line(gen, in, "  case %zu:", i);
+      CHECKED_EV(emit_value(gen, avro_schema_union_branch(schema, (int)i), d + 2));
+      emit_line(gen, in, "    break;");
+    }
+    emit_line(gen, in, "  default:");
+    emit_line(gen, in, "    return invalid(\"Invalid union branch index\");");
+    emit_line(gen, in, "  }");
+    emit_line(gen, in, "}");
+    return 0;
+
+  case AVRO_RECORD:
+    emit_line(gen, in, "CHECKED(record_%d(p, end, out));", find_record(gen, schema));
+    return 0;
+
+  default:
+    return unsupported("Unsupported schema type");
+  }
+}
+
+static int emit_record(codegen_t *gen, size_t index) {
+  avro_schema_t record = gen->records[index];
+  FILE *dest = gen->dest;
+  const char *ns = avro_schema_namespace(record);
+  fprintf(dest, "\n// %s%s%s\n", ns != NULL ? ns : "", ns != NULL ? "." : "",
+          avro_schema_name(record));
+  fprintf(dest, "static int record_%zu(const char **p, const char *end, plugin_buffer_t *out) {\n",
+          index);
+  size_t fields_count = avro_schema_record_size(record);
+  if (fields_count == 0) {
+    emit_write(gen, 2, "{}", 2);
+  }
+  for (size_t i = 0; i < fields_count; ++i) {
+    size_t size;
+    char *prefix = json_name(i == 0 ? "{" : ",", avro_schema_record_field_name(record, (int)i),
+                             ":", &size);
+    if (prefix == NULL) {
+      return ENOMEM;
+    }
+    emit_write(gen, 2, prefix, size);
+    free(prefix);
+    CHECKED_EV(emit_value(gen, avro_schema_record_field_get_by_index(record, (int)i), 1));
+  }
+  if (fields_count > 0) {
+    emit_write(gen, 2, "}", 1);
+  }
+  fputs("  return 0;\n}\n", dest);
+  return 0;
+}
+
+static int emit(codegen_t *gen, avro_schema_t schema) {
+  FILE *dest = gen->dest;
+  uint64_t fingerprint;
+  CHECKED_EV(schema_logical_fingerprint(schema, &fingerprint));
+  CHECKED_EV(collect(gen, schema));
+
+  fprintf(dest,
+          "/*\n"
+          " * Converter generated by avro2json --emit-converter%s%s for schema\n"
+          " * %016" PRIx64 ", loaded with --converter. Build it as a shared library, from\n"
+          " * the src directory of avro2json:\n"
+          " *\n"
+          " *   cc -O2 -shared -fPIC -I. -o libconverter.so converter.c binary.c format.c \\\n"
+          " *      logical.c -lavro -lgmp\n"
+          " */\n\n",
+          gen->conf->logical_types ? " --logical-types" : "",
+          gen->conf->ms_hadoop_logical_types ? " --ms-hadoop-logical-types" : "", fingerprint);
+  fputs(PRELUDE, dest);
+  fputc('\n', dest);
+  for (size_t i = 0; i < gen->records_count; ++i) {
+    fprintf(dest, "static int record_%zu(const char **p, const char *end, plugin_buffer_t *out);\n",
+            i);
+  }
+  for (size_t i = 0; i < gen->records_count; ++i) {
+    CHECKED_EV(emit_record(gen, i));
+  }
+  fprintf(dest,
+          "\n"
+          "static int convert_record(const char **p, const char *end, plugin_buffer_t *out) {\n"
+          "  int rval = record_0(p, end, out);\n"
+          "  if (rval == 0) {\n"
+          "    rval = plugin_write(out, \"\\n\", 1);\n"
+          "  }\n"
+          "  // Errors set in this library's copy of Avro are handed over to avro2json\n"
+          "  if (rval != 0 && out->error[0] == '\\0') {\n"
+          "    snprintf(out->error, sizeof(out->error), \"%%s\", avro_strerror());\n"
+          "  }\n"
+          "  return rval;\n"
+          "}\n"
+          "\n"
+          "const converter_plugin_t avro2json_converter = {PLUGIN_ABI_VERSION, UINT64_C(0x%016" PRIx64
+          "), %d,\n"
+          "                                                convert_record};\n",
+          fingerprint, codegen_options(gen->conf));
+  return ferror(dest) ? EIO : 0;
+}
+
+int codegen_emit(avro_schema_t schema, const config_t *conf, FILE *dest) {
+  schema = binary_resolve_schema(schema);
+  if (!is_avro_record(schema)) {
+    avro_set_error("Can't find root record schema");
+    return EINVAL;
+  }
+  codegen_t gen;
+  memset(&gen, 0, sizeof(codegen_t));
+  gen.dest = dest;
+  gen.conf = conf;
+  int rval = emit(&gen, schema);
+  free(gen.records);
+  return rval;
+}
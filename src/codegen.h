@@ -0,0 +1,30 @@
+#pragma once
+
+#include <avro.h>
+#include <stdio.h>
+
+#include "config.h"
+
+/*
+ * Generation of C source of a converter specialized to a writer schema, for
+ * --emit-converter. Every record type becomes a function decoding its fields
+ * in order and writing constant field name prefixes, and every other value is
+ * decoded and formatted by code of its exact type, without looking at the
+ * schema at run time. The converter writes the same JSON as the streaming
+ * conversion with the same --logical-types and --ms-hadoop-logical-types
+ * options. See plugin_abi.h for how it's built and loaded.
+ *
+ * Decimals aren't supported, since their formatting needs state per thread.
+ */
+
+/**
+ * Format options of the configuration that converters are specialized to,
+ * as PLUGIN_* flags.
+ */
+int codegen_options(const config_t *conf);
+
+/**
+ * Writes converter source for the record schema to 'dest'.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int codegen_emit(avro_schema_t schema, const config_t *conf, FILE *dest);
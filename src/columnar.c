@@ -0,0 +1,769 @@
+#include <avro.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avro_private.h"
+#include "binary.h"
+#include "columnar.h"
+#include "format.h"
+#include "logical.h"
+#include "memo.h"
+#include "memstats.h"
+#include "names.h"
+#include "transform.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+#define INITIAL_ROWS 64
+
+enum column_kind {
+  COL_NULL,
+  COL_BOOLEAN,
+  COL_INT,
+  COL_LONG,
+  COL_FLOAT,
+  COL_DOUBLE,
+  COL_STRING,
+  COL_ENUM
+};
+
+// How integer values are rendered
+enum column_format {
+  FMT_PLAIN,
+  FMT_DATE,
+  FMT_TIME_MILLIS,
+  FMT_TIME_MICROS,
+  FMT_TIMESTAMP_MILLIS,
+  FMT_TIMESTAMP_MICROS
+};
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+} buffer_t;
+
+typedef struct {
+  const char *name;
+  char *key;               // '"name":' prefix of JSON output
+  size_t key_size;
+  avro_schema_t schema;    // schema of non-null values
+  enum column_kind kind;
+  enum column_format format;
+  memo_t *memo;            // formatted values, unless the format is plain
+  name_text_t *symbols;    // quoted symbols of JSON enums
+  transform_t *transform;  // transformation of --columns, or NULL
+  int null_branch;         // union branch of null values, or -1
+  int value_branch;        // union branch of non-null values
+
+  // Decoded values of the batch
+  unsigned char *validity; // bit set for non-null values
+  int64_t *ints;           // booleans, ints, longs and enums
+  double *reals;           // floats and doubles
+  size_t *offsets;         // string i is [offsets[i], offsets[i + 1]) in data
+  buffer_t data;
+
+  // Formatted values of the batch, cell i ends at cell_ends[i] in text
+  size_t *cell_ends;
+  buffer_t text;
+} column_t;
+
+struct columnar_t {
+  int csv;
+  int prune;
+  size_t fields_count;
+  avro_schema_t *field_schemas;
+  int *field_columns; // output column of every field, or -1 to skip the field
+  column_t *columns;
+  size_t columns_count;
+  size_t rows;
+  size_t capacity;
+  buffer_t out;
+};
+
+static int out_of_memory(void) {
+  avro_set_error("Cannot allocate column batch");
+  return ENOMEM;
+}
+
+static int buffer_reserve(buffer_t *buffer, size_t size) {
+  if (buffer->capacity - buffer->size >= size) {
+    return 0;
+  }
+  size_t capacity = buffer->capacity ? buffer->capacity : 256;
+  while (capacity - buffer->size < size) {
+    capacity *= 2;
+  }
+  char *data = (char *)memstats_realloc(MEM_OUTPUT, buffer->data, capacity);
+  if (data == NULL) {
+    return out_of_memory();
+  }
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return 0;
+}
+
+static int buffer_append(buffer_t *buffer, const char *data, size_t size) {
+  CHECKED_EV(buffer_reserve(buffer, size));
+  memcpy(buffer->data + buffer->size, data, size);
+  buffer->size += size;
+  return 0;
+}
+
+static int is_valid(const column_t *col, size_t row) {
+  return (col->validity[row >> 3] >> (row & 7)) & 1;
+}
+
+static const char *format_time(const column_t *col, int64_t value) {
+  switch (col->format) {
+  case FMT_DATE:
+    return epoch_days_to_str((int32_t)value);
+  case FMT_TIME_MILLIS:
+    return time_millis_to_str((int32_t)value);
+  case FMT_TIME_MICROS:
+    return time_micros_to_str(value);
+  case FMT_TIMESTAMP_MILLIS:
+    return timestamp_millis_to_str(value);
+  default:
+    return timestamp_micros_to_str(value);
+  }
+}
+
+/*
+ * Per-column loops, formatting all values of the batch into cells.
+ */
+
+static void format_null(column_t *col, size_t rows, int csv) {
+  for (size_t row = 0; row < rows; ++row) {
+    if (!csv) {
+      memcpy(col->text.data + col->text.size, "null", 4);
+      col->text.size += 4;
+    }
+    col->cell_ends[row] = col->text.size;
+  }
+}
+
+// Formats values of a transformed column. Values without representation
+// are marked null, so that --prune omits them.
+static int format_transformed(columnar_t *columnar, column_t *col) {
+  int csv = columnar->csv;
+  for (size_t row = 0; row < columnar->rows; ++row) {
+    transform_value_t value = {.kind = TV_NULL};
+    if (is_valid(col, row)) {
+      switch (col->kind) {
+      case COL_FLOAT:
+      case COL_DOUBLE:
+        CHECKED_EV(transform_double(col->transform, col->reals[row], &value));
+        break;
+      case COL_STRING:
+        CHECKED_EV(transform_bytes(col->transform, col->data.data + col->offsets[row],
+                                   col->offsets[row + 1] - col->offsets[row], &value));
+        break;
+      default:
+        CHECKED_EV(transform_long(col->transform, col->ints[row], &value));
+      }
+    }
+
+    char *out;
+    switch (value.kind) {
+    case TV_NULL:
+      col->validity[row >> 3] &= (unsigned char)~(1 << (row & 7));
+      if (!csv) {
+        CHECKED_EV(buffer_append(&col->text, "null", 4));
+      }
+      break;
+    case TV_INT:
+      CHECKED_EV(buffer_reserve(&col->text, MAX_INT_SIZE));
+      col->text.size += format_int64(col->text.data + col->text.size, value.integer);
+      break;
+    case TV_REAL:
+      CHECKED_EV(buffer_reserve(&col->text, MAX_REAL_SIZE));
+      col->text.size += format_real(col->text.data + col->text.size, value.real, csv);
+      break;
+    case TV_TEXT:
+      CHECKED_EV(buffer_reserve(&col->text, value.size + 2));
+      out = col->text.data + col->text.size;
+      if (!csv) {
+        *out++ = '"';
+      }
+      memcpy(out, value.str, value.size);
+      col->text.size += csv ? value.size : value.size + 2;
+      if (!csv) {
+        out[value.size] = '"';
+      }
+      break;
+    case TV_STRING:
+      CHECKED_EV(buffer_reserve(&col->text, 6 * value.size + 2));
+      out = col->text.data + col->text.size;
+      if (csv) {
+        col->text.size += format_csv_string(out, value.str, value.size);
+      } else {
+        size_t written;
+        CHECKED_EV(format_json_string(out, value.str, value.size, &written));
+        col->text.size += written;
+      }
+      break;
+    }
+    col->cell_ends[row] = col->text.size;
+  }
+  return 0;
+}
+
+static int format_column(columnar_t *columnar, column_t *col) {
+  int csv = columnar->csv;
+  size_t rows = columnar->rows;
+  col->text.size = 0;
+
+  if (col->transform != NULL) {
+    return format_transformed(columnar, col);
+  }
+
+  if (col->kind == COL_NULL) {
+    CHECKED_EV(buffer_reserve(&col->text, 4 * rows));
+    format_null(col, rows, csv);
+    return 0;
+  }
+
+  switch (col->kind) {
+  case COL_BOOLEAN:
+    CHECKED_EV(buffer_reserve(&col->text, 5 * rows));
+    for (size_t row = 0; row < rows; ++row) {
+      char *out = col->text.data + col->text.size;
+      if (!is_valid(col, row)) {
+        if (!csv) {
+          memcpy(out, "null", 4);
+          col->text.size += 4;
+        }
+      } else if (col->ints[row]) {
+        memcpy(out, "true", 4);
+        col->text.size += 4;
+      } else {
+        memcpy(out, "false", 5);
+        col->text.size += 5;
+      }
+      col->cell_ends[row] = col->text.size;
+    }
+    return 0;
+
+  case COL_INT:
+  case COL_LONG:
+    if (col->format == FMT_PLAIN) {
+      CHECKED_EV(buffer_reserve(&col->text, MAX_INT_SIZE * rows));
+      for (size_t row = 0; row < rows; ++row) {
+        char *out = col->text.data + col->text.size;
+        if (is_valid(col, row)) {
+          col->text.size += format_int64(out, col->ints[row]);
+        } else if (!csv) {
+          memcpy(out, "null", 4);
+          col->text.size += 4;
+        }
+        col->cell_ends[row] = col->text.size;
+      }
+      return 0;
+    }
+    for (size_t row = 0; row < rows; ++row) {
+      if (is_valid(col, row)) {
+        int64_t value = col->ints[row];
+        const char *str = memo_get(col->memo, NULL, &value, sizeof(value));
+        if (str == NULL) {
+          str = format_time(col, value);
+          memo_put(col->memo, NULL, &value, sizeof(value), str);
+        }
+        size_t size = strlen(str);
+        CHECKED_EV(buffer_reserve(&col->text, size + 2));
+        char *out = col->text.data + col->text.size;
+        if (!csv) {
+          *out++ = '"';
+        }
+        memcpy(out, str, size);
+        col->text.size += csv ? size : size + 2;
+        if (!csv) {
+          out[size] = '"';
+        }
+      } else if (!csv) {
+        CHECKED_EV(buffer_append(&col->text, "null", 4));
+      }
+      col->cell_ends[row] = col->text.size;
+    }
+    return 0;
+
+  case COL_FLOAT:
+  case COL_DOUBLE:
+    CHECKED_EV(buffer_reserve(&col->text, MAX_REAL_SIZE * rows));
+    for (size_t row = 0; row < rows; ++row) {
+      char *out = col->text.data + col->text.size;
+      if (is_valid(col, row)) {
+        col->text.size += format_real(out, col->reals[row], csv);
+      } else if (!csv) {
+        memcpy(out, "null", 4);
+        col->text.size += 4;
+      }
+      col->cell_ends[row] = col->text.size;
+    }
+    return 0;
+
+  case COL_STRING:
+    // Escaped strings are at most 6 times larger than the raw data
+    CHECKED_EV(buffer_reserve(&col->text, 6 * col->data.size + 6 * rows));
+    for (size_t row = 0; row < rows; ++row) {
+      char *out = col->text.data + col->text.size;
+      if (is_valid(col, row)) {
+        const char *str = col->data.data + col->offsets[row];
+        size_t size = col->offsets[row + 1] - col->offsets[row];
+        if (csv) {
+          col->text.size += format_csv_string(out, str, size);
+        } else {
+          size_t written;
+          CHECKED_EV(format_json_string(out, str, size, &written));
+          col->text.size += written;
+        }
+      } else if (!csv) {
+        memcpy(out, "null", 4);
+        col->text.size += 4;
+      }
+      col->cell_ends[row] = col->text.size;
+    }
+    return 0;
+
+  case COL_ENUM:
+    for (size_t row = 0; row < rows; ++row) {
+      if (is_valid(col, row) && col->symbols != NULL) {
+        const name_text_t *text = &col->symbols[col->ints[row]];
+        CHECKED_EV(buffer_append(&col->text, text->data, text->size));
+      } else if (is_valid(col, row)) {
+        const char *symbol = avro_schema_enum_get(col->schema, (int)col->ints[row]);
+        size_t size = strlen(symbol);
+        CHECKED_EV(buffer_reserve(&col->text, 6 * size + 2));
+        char *out = col->text.data + col->text.size;
+        if (csv) {
+          memcpy(out, symbol, size);
+          col->text.size += size;
+        } else {
+          size_t written;
+          CHECKED_EV(format_json_string(out, symbol, size, &written));
+          col->text.size += written;
+        }
+      } else if (!csv) {
+        CHECKED_EV(buffer_append(&col->text, "null", 4));
+      }
+      col->cell_ends[row] = col->text.size;
+    }
+    return 0;
+
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Decoding
+ */
+
+static int grow_array(void **array, size_t count, size_t item_size) {
+  void *grown = realloc(*array, count * item_size);
+  if (grown == NULL) {
+    return out_of_memory();
+  }
+  *array = grown;
+  return 0;
+}
+
+static int grow_batch(columnar_t *columnar) {
+  size_t capacity = columnar->capacity ? 2 * columnar->capacity : INITIAL_ROWS;
+  for (size_t i = 0; i < columnar->columns_count; ++i) {
+    column_t *col = &columnar->columns[i];
+    size_t bitmap_size = (capacity + 7) / 8, old_bitmap_size = (columnar->capacity + 7) / 8;
+    CHECKED_EV(grow_array((void **)&col->validity, bitmap_size, 1));
+    memset(col->validity + old_bitmap_size, 0, bitmap_size - old_bitmap_size);
+    CHECKED_EV(grow_array((void **)&col->cell_ends, capacity, sizeof(size_t)));
+    switch (col->kind) {
+    case COL_FLOAT:
+    case COL_DOUBLE:
+      CHECKED_EV(grow_array((void **)&col->reals, capacity, sizeof(double)));
+      break;
+    case COL_STRING:
+      CHECKED_EV(grow_array((void **)&col->offsets, capacity + 1, sizeof(size_t)));
+      if (columnar->capacity == 0) {
+        col->offsets[0] = 0;
+      }
+      break;
+    case COL_NULL:
+      break;
+    default:
+      CHECKED_EV(grow_array((void **)&col->ints, capacity, sizeof(int64_t)));
+    }
+  }
+  columnar->capacity = capacity;
+  return 0;
+}
+
+static int invalid_data(const char *message) {
+  avro_set_error("%s", message);
+  return EILSEQ;
+}
+
+static int decode_value(column_t *col, size_t row, const char **p, const char *end) {
+  if (col->null_branch >= 0) {
+    int64_t branch;
+    CHECKED_EV(binary_read_long(p, end, &branch));
+    if (branch == col->null_branch) {
+      if (col->kind == COL_STRING) {
+        col->offsets[row + 1] = col->offsets[row];
+      }
+      return 0;
+    }
+    if (branch != col->value_branch) {
+      return invalid_data("Invalid union branch index");
+    }
+  }
+
+  switch (col->kind) {
+  case COL_NULL:
+    return 0;
+
+  case COL_BOOLEAN:
+    if (*p >= end) {
+      return invalid_data("Truncated or malformed Avro data");
+    }
+    col->ints[row] = **p != 0;
+    *p += 1;
+    break;
+
+  case COL_INT:
+  case COL_LONG:
+    CHECKED_EV(binary_read_long(p, end, &col->ints[row]));
+    break;
+
+  case COL_ENUM:
+    CHECKED_EV(binary_read_long(p, end, &col->ints[row]));
+    if (col->ints[row] < 0 ||
+        col->ints[row] >= avro_schema_enum_number_of_symbols(col->schema)) {
+      return invalid_data("Invalid enum symbol index");
+    }
+    break;
+
+  case COL_FLOAT: {
+    float value;
+    CHECKED_EV(binary_read_float(p, end, &value));
+    col->reals[row] = value;
+    break;
+  }
+
+  case COL_DOUBLE:
+    CHECKED_EV(binary_read_double(p, end, &col->reals[row]));
+    break;
+
+  case COL_STRING: {
+    const char *str;
+    size_t size;
+    CHECKED_EV(binary_read_bytes(p, end, &str, &size));
+    CHECKED_EV(buffer_append(&col->data, str, size));
+    col->offsets[row + 1] = col->data.size;
+    break;
+  }
+  }
+
+  col->validity[row >> 3] |= (unsigned char)(1 << (row & 7));
+  return 0;
+}
+
+int columnar_append(columnar_t *columnar, const char **p, const char *end) {
+  if (columnar->rows == columnar->capacity) {
+    CHECKED_EV(grow_batch(columnar));
+  }
+  size_t row = columnar->rows;
+  for (size_t i = 0; i < columnar->fields_count; ++i) {
+    int col = columnar->field_columns[i];
+    if (col < 0) {
+      CHECKED_EV(binary_skip(columnar->field_schemas[i], p, end));
+    } else {
+      CHECKED_EV(decode_value(&columnar->columns[col], row, p, end));
+    }
+  }
+  columnar->rows++;
+  return 0;
+}
+
+// Stitches formatted cells into rows
+static int stitch_rows(columnar_t *columnar) {
+  buffer_t *out = &columnar->out;
+  out->size = 0;
+
+  size_t size = 0;
+  for (size_t i = 0; i < columnar->columns_count; ++i) {
+    const column_t *col = &columnar->columns[i];
+    size += col->text.size + (col->key_size + 1) * columnar->rows;
+  }
+  CHECKED_EV(buffer_reserve(out, size + 3 * columnar->rows));
+
+  for (size_t row = 0; row < columnar->rows; ++row) {
+    char *dest = out->data + out->size;
+    int first = 1;
+    if (!columnar->csv) {
+      *dest++ = '{';
+    }
+    for (size_t i = 0; i < columnar->columns_count; ++i) {
+      const column_t *col = &columnar->columns[i];
+      if (columnar->prune && (col->kind == COL_NULL || !is_valid(col, row))) {
+        continue;
+      }
+      if (!first) {
+        *dest++ = ',';
+      }
+      first = 0;
+      if (!columnar->csv) {
+        memcpy(dest, col->key, col->key_size);
+        dest += col->key_size;
+      }
+      size_t start = row > 0 ? col->cell_ends[row - 1] : 0;
+      memcpy(dest, col->text.data + start, col->cell_ends[row] - start);
+      dest += col->cell_ends[row] - start;
+    }
+    if (!columnar->csv) {
+      *dest++ = '}';
+    }
+    *dest++ = '\n';
+    out->size = (size_t)(dest - out->data);
+  }
+  return 0;
+}
+
+int columnar_flush(columnar_t *columnar, FILE *dest, size_t *records) {
+  *records = 0;
+  if (columnar->rows == 0) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < columnar->columns_count; ++i) {
+    CHECKED_EV(format_column(columnar, &columnar->columns[i]));
+  }
+  CHECKED_EV(stitch_rows(columnar));
+  if (fwrite(columnar->out.data, 1, columnar->out.size, dest) < columnar->out.size) {
+    return ferror(dest);
+  }
+
+  *records = columnar->rows;
+  for (size_t i = 0; i < columnar->columns_count; ++i) {
+    column_t *col = &columnar->columns[i];
+    memset(col->validity, 0, (columnar->rows + 7) / 8);
+    col->data.size = 0;
+  }
+  columnar->rows = 0;
+  return 0;
+}
+
+/*
+ * Setup
+ */
+
+static int primitive_kind(avro_schema_t schema, enum column_kind *kind) {
+  switch (avro_typeof(schema)) {
+  case AVRO_NULL: *kind = COL_NULL; return 1;
+  case AVRO_BOOLEAN: *kind = COL_BOOLEAN; return 1;
+  case AVRO_INT32: *kind = COL_INT; return 1;
+  case AVRO_INT64: *kind = COL_LONG; return 1;
+  case AVRO_FLOAT: *kind = COL_FLOAT; return 1;
+  case AVRO_DOUBLE: *kind = COL_DOUBLE; return 1;
+  case AVRO_STRING: *kind = COL_STRING; return 1;
+  case AVRO_ENUM: *kind = COL_ENUM; return 1;
+  default: return 0;
+  }
+}
+
+// Sets up column of the given field schema, returns 0 if it's not supported
+static int setup_column(column_t *col, avro_schema_t schema, const config_t *conf,
+                        int transformed) {
+  schema = binary_resolve_schema(schema);
+  col->null_branch = -1;
+
+  if (is_avro_union(schema)) {
+    if (avro_schema_union_size(schema) != 2) {
+      return 0;
+    }
+    avro_schema_t first = binary_resolve_schema(avro_schema_union_branch(schema, 0));
+    avro_schema_t second = binary_resolve_schema(avro_schema_union_branch(schema, 1));
+    if (is_avro_null(first) == is_avro_null(second)) {
+      return 0;
+    }
+    col->null_branch = is_avro_null(first) ? 0 : 1;
+    col->value_branch = 1 - col->null_branch;
+    schema = col->null_branch == 0 ? second : first;
+  }
+
+  if (!primitive_kind(schema, &col->kind)) {
+    return 0;
+  }
+  col->schema = schema;
+  col->format = FMT_PLAIN;
+
+  if (transformed) {
+    // Transformations take precedence over logical types
+    return 1;
+  }
+
+  avro_logical_schema_t *logical_type = NULL;
+  if (conf->logical_types && (col->kind == COL_INT || col->kind == COL_LONG)) {
+    logical_type = avro_logical_schema(schema);
+  }
+  if (logical_type != NULL) {
+    if (col->kind == COL_INT && logical_type->type == AVRO_DATE) {
+      col->format = FMT_DATE;
+    } else if (col->kind == COL_INT && logical_type->type == AVRO_TIME_MILLIS) {
+      col->format = FMT_TIME_MILLIS;
+    } else if (col->kind == COL_LONG && logical_type->type == AVRO_TIME_MICROS) {
+      col->format = FMT_TIME_MICROS;
+    } else if (col->kind == COL_LONG && logical_type->type == AVRO_TIMESTAMP_MILLIS) {
+      col->format = FMT_TIMESTAMP_MILLIS;
+    } else if (col->kind == COL_LONG && logical_type->type == AVRO_TIMESTAMP_MICROS) {
+      col->format = FMT_TIMESTAMP_MICROS;
+    } else {
+      // Reported as an error by row conversion
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int setup_key(column_t *col) {
+  size_t size = strlen(col->name);
+  col->key = (char *)malloc(6 * size + 3);
+  if (col->key == NULL) {
+    return out_of_memory();
+  }
+  CHECKED_EV(format_json_string(col->key, col->name, size, &col->key_size));
+  col->key[col->key_size++] = ':';
+  return 0;
+}
+
+// Renders the symbols once, or returns NULL so that they're escaped for every
+// value
+static name_text_t *render_symbols(avro_schema_t schema) {
+  size_t count = (size_t)avro_schema_enum_number_of_symbols(schema);
+  const char **symbols = (const char **)malloc((count + 1) * sizeof(const char *));
+  if (symbols == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    symbols[i] = avro_schema_enum_get(schema, (int)i);
+  }
+  name_text_t *texts = names_render(symbols, count, 0);
+  free(symbols);
+  return texts;
+}
+
+int columnar_new(avro_schema_t schema, const config_t *conf, columnar_t **result) {
+  *result = NULL;
+  schema = binary_resolve_schema(schema);
+  if (!is_avro_record(schema)) {
+    return 0;
+  }
+
+  columnar_t *columnar = (columnar_t *)calloc(1, sizeof(columnar_t));
+  if (columnar == NULL) {
+    return out_of_memory();
+  }
+  columnar->csv = conf->output_csv;
+  columnar->prune = conf->prune && !conf->output_csv;
+  columnar->fields_count = avro_schema_record_size(schema);
+  columnar->columns_count = conf->columns_size > 0 ? conf->columns_size : columnar->fields_count;
+  columnar->field_schemas = (avro_schema_t *)calloc(columnar->fields_count + 1, sizeof(avro_schema_t));
+  columnar->field_columns = (int *)calloc(columnar->fields_count + 1, sizeof(int));
+  columnar->columns = (column_t *)calloc(columnar->columns_count + 1, sizeof(column_t));
+  if (columnar->field_schemas == NULL || columnar->field_columns == NULL ||
+      columnar->columns == NULL) {
+    columnar_free(columnar);
+    return out_of_memory();
+  }
+
+  for (size_t i = 0; i < columnar->fields_count; ++i) {
+    columnar->field_schemas[i] = avro_schema_record_field_get_by_index(schema, (int)i);
+    columnar->field_columns[i] = conf->columns_size > 0 ? -1 : (int)i;
+  }
+
+  int supported = 1;
+  for (size_t i = 0; i < columnar->columns_count && supported; ++i) {
+    column_t *col = &columnar->columns[i];
+    int field_idx = (int)i;
+    int transformed = 0;
+    if (conf->columns_size > 0) {
+      field_idx = avro_schema_record_field_get_index(schema, conf->columns[i].column_name);
+      // Missing and repeated columns are handled by row conversion
+      if (field_idx < 0 || columnar->field_columns[field_idx] >= 0) {
+        supported = 0;
+        break;
+      }
+      columnar->field_columns[field_idx] = (int)i;
+      transformed = conf->columns[i].transformation != TRANSFORM_NONE;
+    }
+    col->name = avro_schema_record_field_name(schema, field_idx);
+    supported = setup_column(col, columnar->field_schemas[field_idx], conf, transformed);
+    if (supported) {
+      int rval = setup_key(col);
+      if (rval == 0 && col->format != FMT_PLAIN) {
+        col->memo = memo_new();
+        if (col->memo == NULL) {
+          rval = out_of_memory();
+        }
+      }
+      if (rval == 0 && col->kind == COL_ENUM && !columnar->csv) {
+        col->symbols = render_symbols(col->schema);
+      }
+      if (rval == 0 && transformed) {
+        rval = transform_new(&conf->columns[i], columnar->field_schemas[field_idx], &col->transform);
+      }
+      if (rval != 0) {
+        columnar_free(columnar);
+        return rval;
+      }
+    }
+  }
+
+  if (!supported) {
+    columnar_free(columnar);
+    return 0;
+  }
+  *result = columnar;
+  return 0;
+}
+
+void columnar_memo_stats(const columnar_t *columnar, uint64_t *lookups, uint64_t *hits) {
+  for (size_t i = 0; i < columnar->columns_count; ++i) {
+    const memo_t *memo = columnar->columns[i].memo;
+    if (memo != NULL) {
+      *lookups += memo->lookups;
+      *hits += memo->hits;
+    }
+  }
+}
+
+void columnar_free(columnar_t *columnar) {
+  if (columnar->columns != NULL) {
+    for (size_t i = 0; i < columnar->columns_count; ++i) {
+      column_t *col = &columnar->columns[i];
+      free(col->key);
+      memo_free(col->memo);
+      free(col->symbols);
+      transform_free(col->transform);
+      free(col->validity);
+      free(col->ints);
+      free(col->reals);
+      free(col->offsets);
+      memstats_free(MEM_OUTPUT, col->data.data);
+      free(col->cell_ends);
+      memstats_free(MEM_OUTPUT, col->text.data);
+    }
+  }
+  free(columnar->columns);
+  free(columnar->field_columns);
+  free(columnar->field_schemas);
+  memstats_free(MEM_OUTPUT, columnar->out.data);
+  free(columnar);
+}
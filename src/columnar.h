@@ -0,0 +1,46 @@
+#pragma once
+
+#include <avro.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+
+/**
+ * Batch conversion of flat records. Records of a block are decoded straight
+ * from their binary encoding into per-column vectors (integers, reals,
+ * string offsets and data, with validity bitmaps for nullable columns), every
+ * column is then formatted by a loop over its vector, and rows are stitched
+ * from the formatted cells at the end.
+ *
+ * Only records whose output columns are primitives (or nullable primitives)
+ * are supported, other schemas are converted row by row.
+ */
+typedef struct columnar_t columnar_t;
+
+/**
+ * Prepares batch conversion of records of the given schema. Sets
+ * '*columnar' to NULL when the schema or options aren't supported.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int columnar_new(avro_schema_t schema, const config_t *conf, columnar_t **columnar);
+
+void columnar_free(columnar_t *columnar);
+
+/**
+ * Decodes a binary encoded record starting at '*p' into the batch,
+ * advancing '*p' past the end of the record.
+ */
+int columnar_append(columnar_t *columnar, const char **p, const char *end);
+
+/**
+ * Formats and writes all records of the batch, and clears the batch.
+ * Returns number of written records in '*records'.
+ */
+int columnar_flush(columnar_t *columnar, FILE *dest, size_t *records);
+
+/**
+ * Adds the number of lookups of formatted dates, times and timestamps, and
+ * how many of them were memoized, to '*lookups' and '*hits'.
+ */
+void columnar_memo_stats(const columnar_t *columnar, uint64_t *lookups, uint64_t *hits);
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MILLIS_IN_SEC 1000UL
+#define NANOS_IN_SEC 1000000000UL
+
+// Upper bound of --format-threads
+#define FORMAT_THREADS_MAX 64
+
+// Default of --memory-limit
+#define DEFAULT_MEMORY_LIMIT ((size_t)256 * 1024 * 1024)
+
+#define TRANSFORM_TS_SECS_STR "ts-s"
+#define TRANSFORM_TS_MILLIS_STR "ts-ms"
+#define TRANSFORM_TS_MICROS_STR "ts-us"
+#define TRANSFORM_TS_NANOS_STR "ts-ns"
+#define TRANSFORM_REAL_STR "real"
+#define TRANSFORM_SCALE_STR "scale"
+#define TRANSFORM_TRUNCATE_STR "truncate"
+#define TRANSFORM_BASE64_STR "base64"
+
+enum TransformationType {
+    TRANSFORM_NONE,  // No transformation required
+    TRANSFORM_TS_SECS,
+    TRANSFORM_TS_MILLIS,
+    TRANSFORM_TS_MICROS,
+    TRANSFORM_TS_NANOS,
+    TRANSFORM_REAL,
+    TRANSFORM_SCALE,
+    TRANSFORM_TRUNCATE,
+    TRANSFORM_BASE64
+};
+
+// Page compression of --parquet output
+enum ParquetCodec {
+    PARQUET_CODEC_SNAPPY,
+    PARQUET_CODEC_GZIP,
+    PARQUET_CODEC_NONE
+};
+
+// Framing of --datums input
+enum DatumFraming {
+    DATUMS_NONE, // Avro object container file
+    DATUMS_LENGTH_PREFIXED,
+    DATUMS_SINGLE_OBJECT
+};
+
+// Define a struct for column information
+typedef struct {
+    char *column_name;
+    enum TransformationType transformation; // Transformation for the column
+    double transformation_arg; // Factor of 'scale', length of 'truncate'
+    char *output_name; // Name in output when it differs from the column (--flatten), or NULL
+} column_info_t;
+
+static inline const char *column_output_name(const column_info_t *column) {
+    return column->output_name != NULL ? column->output_name : column->column_name;
+}
+
+// Conversion options, parsed from command line or from --serve job options
+typedef struct config_t {
+  int prune;
+  int logical_types;
+  int ms_hadoop_logical_types;
+  int show_schema;
+  int scan;
+  int output_csv;
+  const char *flatten; // separator of --flatten, NULL without it
+  column_info_t *columns;
+  size_t columns_size;
+  const char *where;
+  double sample_blocks;
+  size_t sample_rows;
+  uint64_t seed;
+  size_t memory_limit;
+  int skip_corrupt_blocks;
+  const char *partition_by;
+  size_t partitions;          // 0 for the default
+  int partition_by_value;
+  size_t max_open_partitions; // 0 for the default
+  const char *partition_prefix;
+  const char *parquet_path;
+  size_t row_group_size; // 0 for the default
+  enum ParquetCodec parquet_codec;
+  int follow;
+  size_t format_threads; // 0 or 1 to format in the converting thread
+  int pipeline;
+  const char *checkpoint;
+  int build_index;
+  int rows;           // --rows N:M given
+  int64_t rows_begin; // first record
+  int64_t rows_end;   // record after the last one, INT64_MAX for N:
+  const char *outputs_json; // --outputs, parsed into 'outputs'
+  struct config_t *outputs;  // each with its own format options
+  size_t outputs_size;
+  char *output_path; // of an output in --outputs, "-" for standard output
+  int mem_stats;
+  int async_io;
+  size_t io_depth; // 0 for the default
+  const char *serve_socket;
+  size_t serve_workers;
+  int emit_converter;
+  const char *converter_path;               // --converter, loaded into 'converter'
+  const struct converter_plugin_t *converter; // NULL without --converter
+  enum DatumFraming datums;
+  const char *schema_path; // of --datums, a schema file or a directory of them
+} config_t;
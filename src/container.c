@@ -0,0 +1,445 @@
+#include <avro.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "avro_private.h"
+#include "container.h"
+
+#if defined(_WIN32)
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+#define CONTAINER_MAGIC "Obj\x01"
+#define CONTAINER_MAGIC_SIZE 4
+#define MAX_METADATA_VALUE_SIZE (64 * 1024 * 1024)
+#define MAX_BLOCK_SIZE (INT64_C(1) << 40)
+#define RESYNC_CHUNK_SIZE (64 * 1024)
+#define INFLATED_MIN_CAPACITY (64 * 1024)
+
+// Reports a short read: data ending early is malformed (EILSEQ), unlike a
+// failure to read the file (EIO)
+static int read_failed(FILE *fp) {
+  if (ferror(fp)) {
+    avro_set_error("Cannot read file: %s", strerror(errno));
+    return EIO;
+  }
+  avro_set_error("Unexpected end of file");
+  return EILSEQ;
+}
+
+// Reads zig-zag encoded long. Returns CONTAINER_EOF if there's no more data.
+static int read_long(FILE *fp, int64_t *value) {
+  uint64_t result = 0;
+  int shift = 0;
+  int b;
+  do {
+    if (shift >= 64) {
+      avro_set_error("Invalid varint encoding");
+      return EILSEQ;
+    }
+    if ((b = getc(fp)) == EOF) {
+      if (shift == 0 && !ferror(fp)) {
+        return CONTAINER_EOF;
+      }
+      return read_failed(fp);
+    }
+    result |= (uint64_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+
+  *value = (int64_t)((result >> 1) ^ -(result & 1));
+  return 0;
+}
+
+static int read_exact(FILE *fp, void *buf, size_t size) {
+  if (size > 0 && fread(buf, size, 1, fp) != 1) {
+    return read_failed(fp);
+  }
+  return 0;
+}
+
+static int read_required_long(FILE *fp, int64_t *value) {
+  int rval = read_long(fp, value);
+  if (rval == CONTAINER_EOF) {
+    avro_set_error("Unexpected end of file");
+    return EILSEQ;
+  }
+  return rval;
+}
+
+// Reads length-prefixed bytes into a newly allocated zero-terminated buffer
+static int read_bytes(FILE *fp, char **buf, int64_t *size) {
+  int rval = read_required_long(fp, size);
+  if (rval != 0) {
+    return rval;
+  }
+  if (*size < 0 || *size > MAX_METADATA_VALUE_SIZE) {
+    avro_set_error("Invalid length of file metadata value");
+    return EILSEQ;
+  }
+  if ((*buf = (char *)malloc(*size + 1)) == NULL) {
+    return ENOMEM;
+  }
+  if ((rval = read_exact(fp, *buf, *size)) != 0) {
+    free(*buf);
+    return rval;
+  }
+  (*buf)[*size] = '\0';
+  return 0;
+}
+
+static int read_header(container_reader_t *reader) {
+  FILE *fp = reader->fp;
+  char magic[CONTAINER_MAGIC_SIZE];
+  int rval;
+
+  if (read_exact(fp, magic, sizeof(magic)) != 0 ||
+      memcmp(magic, CONTAINER_MAGIC, CONTAINER_MAGIC_SIZE)) {
+    avro_set_error("Not an Avro object container file");
+    return EILSEQ;
+  }
+
+  strcpy(reader->codec, "null");
+
+  for (;;) {
+    int64_t count;
+    if ((rval = read_required_long(fp, &count)) != 0) {
+      return rval;
+    }
+    if (count == 0) {
+      break;
+    }
+    if (count < 0) {
+      // Negative count is followed by the size of the map block in bytes
+      int64_t block_size;
+      if ((rval = read_required_long(fp, &block_size)) != 0) {
+        return rval;
+      }
+      count = -count;
+    }
+
+    for (int64_t i = 0; i < count; ++i) {
+      char *key, *value;
+      int64_t key_size, value_size;
+      if ((rval = read_bytes(fp, &key, &key_size)) != 0) {
+        return rval;
+      }
+      if ((rval = read_bytes(fp, &value, &value_size)) != 0) {
+        free(key);
+        return rval;
+      }
+
+      if (!strcmp(key, "avro.schema")) {
+        if (reader->schema != NULL) {
+          avro_schema_decref(reader->schema);
+          reader->schema = NULL;
+        }
+        rval = avro_schema_from_json_length(value, value_size, &reader->schema);
+      } else if (!strcmp(key, "avro.codec")) {
+        if (value_size >= CONTAINER_CODEC_NAME_SIZE) {
+          avro_set_error("Unknown codec: %s", value);
+          rval = EILSEQ;
+        } else {
+          strcpy(reader->codec, value);
+        }
+      }
+      free(key);
+      free(value);
+      if (rval != 0) {
+        return rval;
+      }
+    }
+  }
+
+  if (reader->schema == NULL) {
+    avro_set_error("File header has no schema");
+    return EILSEQ;
+  }
+
+  if ((rval = read_exact(fp, reader->sync, CONTAINER_SYNC_SIZE)) != 0) {
+    return rval;
+  }
+
+  reader->header_size = ftello(fp);
+  return 0;
+}
+
+int container_open(const char *path, container_reader_t **reader) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    int rval = errno;
+    avro_set_error("Cannot open file: %s", strerror(rval));
+    return rval;
+  }
+  int rval = container_open_fp(fp, reader);
+  if (rval == 0 && ((*reader)->path = strdup(path)) == NULL) {
+    container_close(*reader);
+    return ENOMEM;
+  }
+  return rval;
+}
+
+int container_open_fp(FILE *fp, container_reader_t **reader) {
+  container_reader_t *r = (container_reader_t *)calloc(1, sizeof(container_reader_t));
+  if (r == NULL) {
+    fclose(fp);
+    return ENOMEM;
+  }
+  r->fp = fp;
+
+  int rval = read_header(r);
+  if (rval == 0) {
+    avro_codec_t codec = (avro_codec_t)calloc(1, sizeof(struct avro_codec_t_));
+    if (codec == NULL) {
+      rval = ENOMEM;
+    } else if ((rval = avro_codec(codec, r->codec)) != 0) {
+      free(codec);
+    } else {
+      r->codec_state = codec;
+    }
+  }
+
+  if (rval != 0) {
+    container_close(r);
+    return rval;
+  }
+
+  *reader = r;
+  return 0;
+}
+
+void container_close(container_reader_t *reader) {
+  if (reader->codec_state != NULL) {
+    avro_codec_reset((avro_codec_t)reader->codec_state);
+    free(reader->codec_state);
+  }
+  if (reader->schema != NULL) {
+    avro_schema_decref(reader->schema);
+  }
+  if (reader->fp != NULL) {
+    fclose(reader->fp);
+  }
+  if (reader->inflater != NULL) {
+    inflateEnd((z_stream *)reader->inflater);
+    free(reader->inflater);
+  }
+  free(reader->payload);
+  free(reader->inflated);
+  free(reader->path);
+  free(reader);
+}
+
+int container_next_block(container_reader_t *reader, block_header_t *block) {
+  int rval;
+  block->offset = ftello(reader->fp);
+
+  if ((rval = read_long(reader->fp, &block->count)) != 0) {
+    return rval;
+  }
+  if ((rval = read_required_long(reader->fp, &block->size)) != 0) {
+    return rval;
+  }
+  if (block->count < 0 || block->size < 0 || block->size > MAX_BLOCK_SIZE) {
+    avro_set_error("Invalid block header at offset %lld", (long long)block->offset);
+    return EILSEQ;
+  }
+
+  block->data_offset = ftello(reader->fp);
+  return 0;
+}
+
+static int check_sync(container_reader_t *reader, const block_header_t *block) {
+  char sync[CONTAINER_SYNC_SIZE];
+  int rval = read_exact(reader->fp, sync, CONTAINER_SYNC_SIZE);
+  if (rval != 0) {
+    return rval;
+  }
+  if (memcmp(sync, reader->sync, CONTAINER_SYNC_SIZE)) {
+    avro_set_error("Sync marker mismatch after block at offset %lld",
+                   (long long)block->offset);
+    return EILSEQ;
+  }
+  return 0;
+}
+
+int container_skip_block(container_reader_t *reader, const block_header_t *block) {
+  if (fseeko(reader->fp, block->size, SEEK_CUR) != 0) {
+    // Not seekable, so read through the payload
+    char buf[4096];
+    for (int64_t left = block->size; left > 0;) {
+      size_t chunk = left < (int64_t)sizeof(buf) ? (size_t)left : sizeof(buf);
+      int rval = read_exact(reader->fp, buf, chunk);
+      if (rval != 0) {
+        return rval;
+      }
+      left -= chunk;
+    }
+  }
+  return check_sync(reader, block);
+}
+
+static int decoded_too_large(const block_header_t *block, size_t limit) {
+  avro_set_error("Block at offset %lld decompresses to more than the memory limit of %zu bytes",
+                 (long long)block->offset, limit);
+  return EFBIG;
+}
+
+// Inflates the deflate payload into a buffer of at most limit + 1 bytes, so
+// that payloads over the limit are found without inflating them whole
+static int inflate_block(container_reader_t *reader, const block_header_t *block, size_t limit,
+                         const char **data, size_t *size) {
+  z_stream *stream = (z_stream *)reader->inflater;
+  if (stream == NULL) {
+    if ((stream = (z_stream *)calloc(1, sizeof(z_stream))) == NULL) {
+      return ENOMEM;
+    }
+    // Avro deflate payloads have neither zlib header nor checksum
+    if (inflateInit2(stream, -15) != Z_OK) {
+      free(stream);
+      return ENOMEM;
+    }
+    reader->inflater = stream;
+  } else {
+    inflateReset(stream);
+  }
+
+  const char *in = reader->payload, *in_end = reader->payload + block->size;
+  size_t used = 0;
+  int rval = Z_OK;
+  while (rval == Z_OK) {
+    if (used > limit) {
+      return decoded_too_large(block, limit);
+    }
+    if (used == reader->inflated_capacity) {
+      size_t capacity = used > INFLATED_MIN_CAPACITY / 2 ? used * 2 : INFLATED_MIN_CAPACITY;
+      capacity = capacity > limit ? limit + 1 : capacity;
+      char *inflated = (char *)realloc(reader->inflated, capacity);
+      if (inflated == NULL) {
+        return ENOMEM;
+      }
+      reader->inflated = inflated;
+      reader->inflated_capacity = capacity;
+    }
+    // Sizes given to zlib are 32-bit
+    size_t in_left = in_end - in;
+    size_t out_left = (reader->inflated_capacity < limit ? reader->inflated_capacity : limit + 1) - used;
+    stream->next_in = (Bytef *)in;
+    stream->avail_in = in_left < UINT32_MAX ? (uInt)in_left : UINT32_MAX;
+    stream->next_out = (Bytef *)reader->inflated + used;
+    stream->avail_out = out_left < UINT32_MAX ? (uInt)out_left : UINT32_MAX;
+    uInt avail_in = stream->avail_in, avail_out = stream->avail_out;
+    rval = inflate(stream, Z_NO_FLUSH);
+    in += avail_in - stream->avail_in;
+    used += avail_out - stream->avail_out;
+  }
+  if (rval == Z_MEM_ERROR) {
+    return ENOMEM;
+  }
+  if (rval != Z_STREAM_END) {
+    avro_set_error("Cannot inflate block at offset %lld", (long long)block->offset);
+    return EILSEQ;
+  }
+  if (used > limit) {
+    return decoded_too_large(block, limit);
+  }
+  *data = reader->inflated;
+  *size = used;
+  return 0;
+}
+
+int container_read_block(container_reader_t *reader, const block_header_t *block, size_t limit,
+                         const char **data, size_t *size) {
+  int rval;
+  if ((size_t)block->size > reader->payload_capacity) {
+    char *payload = (char *)realloc(reader->payload, block->size);
+    if (payload == NULL) {
+      return ENOMEM;
+    }
+    reader->payload = payload;
+    reader->payload_capacity = block->size;
+  }
+
+  if ((rval = read_exact(reader->fp, reader->payload, block->size)) != 0 ||
+      (rval = check_sync(reader, block)) != 0) {
+    return rval;
+  }
+
+  if (!strcmp(reader->codec, "deflate")) {
+    return inflate_block(reader, block, limit, data, size);
+  }
+  if (!strcmp(reader->codec, "snappy")) {
+    // Snappy data starts with its decompressed size, as a varint of at most
+    // 5 bytes. Malformed sizes are left for the codec to report.
+    uint64_t decoded = 0;
+    for (int64_t i = 0; i < block->size && i < 5; ++i) {
+      decoded |= (uint64_t)(reader->payload[i] & 0x7f) << (7 * i);
+      if (!(reader->payload[i] & 0x80)) {
+        break;
+      }
+    }
+    if (decoded > limit) {
+      return decoded_too_large(block, limit);
+    }
+  }
+
+  avro_codec_t codec = (avro_codec_t)reader->codec_state;
+  if (avro_codec_decode(codec, reader->payload, block->size) != 0) {
+    // Avro codecs don't tell corrupt data from other failures
+    return EILSEQ;
+  }
+  // Other codecs, like xz, can only be checked once decompressed
+  if ((size_t)codec->used_size > limit) {
+    return decoded_too_large(block, limit);
+  }
+  *data = (const char *)codec->block_data;
+  *size = (size_t)codec->used_size;
+  return 0;
+}
+
+int container_seek(container_reader_t *reader, int64_t offset) {
+  if (fseeko(reader->fp, offset, SEEK_SET) != 0) {
+    avro_set_error("Cannot seek to offset %lld: %s", (long long)offset,
+                   strerror(errno));
+    return errno;
+  }
+  return 0;
+}
+
+int container_resync(container_reader_t *reader, int64_t offset, int64_t *next) {
+  int rval = container_seek(reader, offset);
+  if (rval != 0) {
+    return rval;
+  }
+
+  // Chunks are kept overlapping, so that markers across chunks are found
+  char buf[RESYNC_CHUNK_SIZE + CONTAINER_SYNC_SIZE - 1];
+  size_t kept = 0;
+  for (;;) {
+    size_t read = fread(buf + kept, 1, RESYNC_CHUNK_SIZE, reader->fp);
+    size_t available = kept + read;
+    const char *p = buf, *end = buf + available;
+    while (end - p >= CONTAINER_SYNC_SIZE &&
+           (p = (const char *)memchr(p, reader->sync[0], end - p - CONTAINER_SYNC_SIZE + 1)) != NULL) {
+      if (!memcmp(p, reader->sync, CONTAINER_SYNC_SIZE)) {
+        *next = offset + (p - buf) + CONTAINER_SYNC_SIZE;
+        return container_seek(reader, *next);
+      }
+      p++;
+    }
+
+    if (read == 0) {
+      if (ferror(reader->fp)) {
+        avro_set_error("Cannot read file: %s", strerror(errno));
+        return EIO;
+      }
+      *next = offset + available;
+      return CONTAINER_EOF;
+    }
+    kept = available < CONTAINER_SYNC_SIZE - 1 ? available : CONTAINER_SYNC_SIZE - 1;
+    memmove(buf, buf + available - kept, kept);
+    offset += available - kept;
+  }
+}
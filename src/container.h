@@ -0,0 +1,96 @@
+#pragma once
+
+#include <avro.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CONTAINER_SYNC_SIZE 16
+#define CONTAINER_CODEC_NAME_SIZE 32
+// Block count and size are varints of at most 10 bytes each
+#define CONTAINER_BLOCK_HEADER_MAX_SIZE 20
+
+// Returned when there are no more blocks in the file
+#define CONTAINER_EOF -1
+
+/**
+ * Header of a single data block, as written in Avro object container file.
+ */
+typedef struct {
+  int64_t offset;      // file offset where the block starts
+  int64_t count;       // number of records in the block
+  int64_t size;        // size of the (compressed) payload
+  int64_t data_offset; // file offset of the payload
+} block_header_t;
+
+/**
+ * Reader of Avro object container file, that gives access to the file
+ * structure: blocks can be inspected and skipped without being decoded.
+ */
+typedef struct {
+  FILE *fp;
+  char *path; // NULL when opened with container_open_fp()
+  avro_schema_t schema;
+  char codec[CONTAINER_CODEC_NAME_SIZE];
+  char sync[CONTAINER_SYNC_SIZE];
+  int64_t header_size; // offset of the first block
+  void *codec_state;
+  char *payload;
+  size_t payload_capacity;
+  void *inflater; // z_stream of deflate payloads, inflated up to a limit
+  char *inflated;
+  size_t inflated_capacity;
+} container_reader_t;
+
+/**
+ * Opens the file, and reads its header.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int container_open(const char *path, container_reader_t **reader);
+
+/**
+ * Same as container_open(), but reads the already opened file. The file is
+ * owned by the reader from now on, and is closed even if opening fails.
+ */
+int container_open_fp(FILE *fp, container_reader_t **reader);
+
+void container_close(container_reader_t *reader);
+
+/**
+ * Reads header of the next block, leaving the reader positioned at its
+ * payload. Returns CONTAINER_EOF when there are no more blocks.
+ */
+int container_next_block(container_reader_t *reader, block_header_t *block);
+
+/**
+ * Seeks past the payload of the block just read by container_next_block(),
+ * and verifies the sync marker that follows.
+ */
+int container_skip_block(container_reader_t *reader, const block_header_t *block);
+
+/**
+ * Reads the payload of the block just read by container_next_block(),
+ * verifies the sync marker, and decompresses the payload. The returned data
+ * is valid until the next call.
+ *
+ * Payloads decompressing to more than 'limit' bytes are reported as EFBIG.
+ * Deflate payloads are inflated no further than that, and snappy ones are
+ * checked by the size they start with, before they are decompressed.
+ *
+ * Malformed or truncated blocks are reported as EILSEQ, by this function and
+ * container_next_block(), and failures to read the file as EIO.
+ */
+int container_read_block(container_reader_t *reader, const block_header_t *block, size_t limit,
+                         const char **data, size_t *size);
+
+/**
+ * Positions the reader at the block starting at the given file offset.
+ */
+int container_seek(container_reader_t *reader, int64_t offset);
+
+/**
+ * Scans the file from the given offset for the next sync marker, and
+ * positions the reader right after it, where the next block starts. Sets
+ * '*next' to that offset, or to the end of file when CONTAINER_EOF is
+ * returned because there's no more sync marker.
+ */
+int container_resync(container_reader_t *reader, int64_t offset, int64_t *next);
@@ -0,0 +1,401 @@
+#include <avro.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include "binary.h"
+#include "datum.h"
+#include "fingerprint.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+#define INPUT_CHUNK_SIZE (64 * 1024)
+
+// Marker and fingerprint of single-object encoding
+#define SINGLE_OBJECT_HEADER_SIZE 10
+// Longest framing of a datum
+#define FRAMING_MAX_SIZE 10
+
+// Returned by parse_datum() when the datum isn't completely read yet
+#define DATUM_INCOMPLETE -2
+
+/*
+ * Schemas
+ */
+
+int datum_read_schema(const char *path, avro_schema_t *schema) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    int rval = errno;
+    avro_set_error("Cannot open schema file '%s': %s", path, strerror(rval));
+    return rval;
+  }
+  char *json = NULL;
+  size_t size = 0, capacity = 0, n;
+  do {
+    if (size == capacity) {
+      capacity = capacity > 0 ? capacity * 2 : 4096;
+      char *grown = (char *)realloc(json, capacity);
+      if (grown == NULL) {
+        free(json);
+        fclose(fp);
+        return ENOMEM;
+      }
+      json = grown;
+    }
+    n = fread(json + size, 1, capacity - size, fp);
+    size += n;
+  } while (n > 0);
+  int rval = ferror(fp) ? EIO : 0;
+  fclose(fp);
+  if (rval != 0) {
+    avro_set_error("Cannot read schema file '%s'", path);
+  } else if (avro_schema_from_json_length(json, size, schema) != 0) {
+    rval = EINVAL;
+  }
+  free(json);
+  return rval;
+}
+
+static int add_schema(datum_reader_t *reader, const char *path) {
+  avro_schema_t schema;
+  uint64_t fingerprint;
+  CHECKED_EV(datum_read_schema(path, &schema));
+  int rval = schema_fingerprint(schema, &fingerprint);
+  datum_schema_t *schemas = NULL;
+  if (rval == 0) {
+    schemas = (datum_schema_t *)realloc(reader->schemas,
+                                        (reader->schemas_count + 1) * sizeof(datum_schema_t));
+    rval = schemas == NULL ? ENOMEM : 0;
+  }
+  if (rval != 0) {
+    avro_schema_decref(schema);
+    return rval;
+  }
+  reader->schemas = schemas;
+  reader->schemas[reader->schemas_count].fingerprint = fingerprint;
+  reader->schemas[reader->schemas_count].schema = schema;
+  reader->schemas_count++;
+  return 0;
+}
+
+static int is_schema_file(const char *name) {
+  size_t size = strlen(name);
+  return name[0] != '.' && ((size > 5 && !strcmp(name + size - 5, ".avsc")) ||
+                            (size > 5 && !strcmp(name + size - 5, ".json")));
+}
+
+static int add_schema_in(datum_reader_t *reader, const char *dir, const char *name) {
+  size_t size = strlen(dir) + strlen(name) + 2;
+  char *path = (char *)malloc(size);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  snprintf(path, size, "%s/%s", dir, name);
+  int rval = add_schema(reader, path);
+  free(path);
+  return rval;
+}
+
+// Adds schemas of all schema files of the directory
+static int add_schema_dir(datum_reader_t *reader, const char *dir) {
+  int rval = 0;
+#if defined(_WIN32)
+  size_t size = strlen(dir) + 3;
+  char *pattern = (char *)malloc(size);
+  if (pattern == NULL) {
+    return ENOMEM;
+  }
+  snprintf(pattern, size, "%s/*", dir);
+  struct _finddata_t entry;
+  intptr_t handle = _findfirst(pattern, &entry);
+  free(pattern);
+  if (handle != -1) {
+    do {
+      if (!(entry.attrib & _A_SUBDIR) && is_schema_file(entry.name)) {
+        rval = add_schema_in(reader, dir, entry.name);
+      }
+    } while (rval == 0 && _findnext(handle, &entry) == 0);
+    _findclose(handle);
+  }
+#else
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    rval = errno;
+    avro_set_error("Cannot open schema directory '%s': %s", dir, strerror(rval));
+    return rval;
+  }
+  struct dirent *entry;
+  while (rval == 0 && (entry = readdir(d)) != NULL) {
+    if (is_schema_file(entry->d_name)) {
+      rval = add_schema_in(reader, dir, entry->d_name);
+    }
+  }
+  closedir(d);
+#endif
+  if (rval == 0 && reader->schemas_count == 0) {
+    avro_set_error("No .avsc or .json schema files in '%s'", dir);
+    rval = EINVAL;
+  }
+  return rval;
+}
+
+static int load_schemas(datum_reader_t *reader, const char *schema_path) {
+  struct stat st;
+  if (stat(schema_path, &st) != 0 || (st.st_mode & S_IFMT) != S_IFDIR) {
+    return add_schema(reader, schema_path);
+  }
+  if (reader->framing == DATUMS_LENGTH_PREFIXED) {
+    avro_set_error("Length-prefixed datums need a single schema file, not a directory");
+    return EINVAL;
+  }
+  return add_schema_dir(reader, schema_path);
+}
+
+static avro_schema_t find_schema(const datum_reader_t *reader, uint64_t fingerprint) {
+  for (size_t i = 0; i < reader->schemas_count; ++i) {
+    if (reader->schemas[i].fingerprint == fingerprint) {
+      return reader->schemas[i].schema;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Input
+ */
+
+int datum_open(const char *path, enum DatumFraming framing, const char *schema_path,
+               size_t max_datum_size, datum_reader_t **reader) {
+  datum_reader_t *r = (datum_reader_t *)calloc(1, sizeof(datum_reader_t));
+  if (r == NULL) {
+    return ENOMEM;
+  }
+  r->framing = framing;
+  r->max_datum_size = max_datum_size;
+  int rval = load_schemas(r, schema_path);
+  if (rval == 0) {
+    r->fp = !strcmp(path, "-") ? stdin : fopen(path, "rb");
+    if (r->fp == NULL) {
+      rval = errno;
+      avro_set_error("Cannot open '%s': %s", path, strerror(rval));
+    }
+  }
+  if (rval != 0) {
+    datum_close(r);
+    return rval;
+  }
+  *reader = r;
+  return 0;
+}
+
+void datum_close(datum_reader_t *reader) {
+  if (reader->fp != NULL && reader->fp != stdin) {
+    fclose(reader->fp);
+  }
+  for (size_t i = 0; i < reader->schemas_count; ++i) {
+    avro_schema_decref(reader->schemas[i].schema);
+  }
+  free(reader->schemas);
+  free(reader->input);
+  free(reader->block);
+  free(reader);
+}
+
+// Reads whatever input is available, after moving the unread part to the
+// start of the buffer. The buffer only grows for datums larger than it.
+static int read_input(datum_reader_t *reader) {
+  if (reader->pos > 0) {
+    memmove(reader->input, reader->input + reader->pos, reader->size - reader->pos);
+    reader->size -= reader->pos;
+    reader->offset += (int64_t)reader->pos;
+    reader->pos = 0;
+  }
+  if (reader->size == reader->capacity) {
+    if (reader->capacity >= reader->max_datum_size + FRAMING_MAX_SIZE) {
+      avro_set_error("Datum at offset %lld exceeds memory limit of %zu bytes (see --memory-limit)",
+                     (long long)reader->offset, reader->max_datum_size);
+      return EFBIG;
+    }
+    size_t capacity = reader->capacity > 0 ? 2 * reader->capacity : INPUT_CHUNK_SIZE;
+    char *input = (char *)realloc(reader->input, capacity);
+    if (input == NULL) {
+      return ENOMEM;
+    }
+    reader->input = input;
+    reader->capacity = capacity;
+  }
+
+  size_t wanted = reader->capacity - reader->size;
+#if defined(_WIN32)
+  size_t n = fread(reader->input + reader->size, 1, wanted, reader->fp);
+  if (n == 0 && ferror(reader->fp)) {
+    avro_set_error("Cannot read datums");
+    return EIO;
+  }
+#else
+  // Unlike fread(), returns as soon as some input is available
+  ssize_t n;
+  do {
+    n = read(fileno(reader->fp), reader->input + reader->size, wanted);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    int rval = errno;
+    avro_set_error("Cannot read datums: %s", strerror(rval));
+    return rval;
+  }
+#endif
+  reader->size += (size_t)n;
+  reader->eof = n == 0;
+  return 0;
+}
+
+static int invalid_datum(const datum_reader_t *reader, const char *message) {
+  avro_set_error("%s at offset %lld", message, (long long)(reader->offset + reader->pos));
+  return EILSEQ;
+}
+
+// Whether the buffer holds a complete varint
+static int has_long(const char *p, const char *end) {
+  for (int i = 0; i < FRAMING_MAX_SIZE && p + i < end; ++i) {
+    if (!((unsigned char)p[i] & 0x80)) {
+      return 1;
+    }
+  }
+  return end - p >= FRAMING_MAX_SIZE;
+}
+
+// Parses the framing of the next datum, and finds where the datum ends.
+// Returns DATUM_INCOMPLETE when it isn't completely read yet.
+static int parse_datum(datum_reader_t *reader, avro_schema_t *schema, const char **datum,
+                       size_t *datum_size, size_t *framed_size) {
+  const char *start = reader->input + reader->pos, *p = start;
+  const char *end = reader->input + reader->size;
+  const char *datum_end;
+
+  if (reader->framing == DATUMS_LENGTH_PREFIXED) {
+    int64_t size;
+    if (!has_long(p, end)) {
+      return DATUM_INCOMPLETE;
+    }
+    if (binary_read_long(&p, end, &size) != 0 || size < 0) {
+      return invalid_datum(reader, "Invalid datum length");
+    }
+    if ((uint64_t)size > reader->max_datum_size) {
+      avro_set_error("Datum at offset %lld exceeds memory limit of %zu bytes (see --memory-limit)",
+                     (long long)(reader->offset + reader->pos), reader->max_datum_size);
+      return EFBIG;
+    }
+    if (end - p < size) {
+      return DATUM_INCOMPLETE;
+    }
+    *schema = reader->schemas[0].schema;
+    datum_end = p;
+    if (binary_skip(*schema, &datum_end, p + size) != 0 || datum_end != p + size) {
+      return invalid_datum(reader, "Datum doesn't match its length or schema");
+    }
+  } else {
+    if (end - p < SINGLE_OBJECT_HEADER_SIZE) {
+      return DATUM_INCOMPLETE;
+    }
+    if ((unsigned char)p[0] != 0xc3 || (unsigned char)p[1] != 0x01) {
+      return invalid_datum(reader, "Missing single-object marker");
+    }
+    uint64_t fingerprint = 0;
+    for (int i = 9; i >= 2; --i) {
+      fingerprint = (fingerprint << 8) | (unsigned char)p[i];
+    }
+    if ((*schema = find_schema(reader, fingerprint)) == NULL) {
+      avro_set_error("No schema with fingerprint %016llx for datum at offset %lld",
+                     (unsigned long long)fingerprint, (long long)(reader->offset + reader->pos));
+      return EINVAL;
+    }
+    p += SINGLE_OBJECT_HEADER_SIZE;
+    // The datum ends where its value does, unless it's read only partly
+    datum_end = p;
+    int rval = binary_skip_available(*schema, &datum_end, end);
+    if (rval == BINARY_INCOMPLETE && !reader->eof) {
+      return DATUM_INCOMPLETE;
+    }
+    if (rval != 0) {
+      return invalid_datum(reader, "Truncated or malformed datum");
+    }
+  }
+
+  *datum = p;
+  *datum_size = datum_end - p;
+  *framed_size = datum_end - start;
+  return 0;
+}
+
+static int append_datum(datum_reader_t *reader, const char *datum, size_t size) {
+  if (reader->block_capacity - reader->block_size < size) {
+    size_t capacity = reader->block_capacity > 0 ? reader->block_capacity : INPUT_CHUNK_SIZE;
+    while (capacity - reader->block_size < size) {
+      capacity *= 2;
+    }
+    char *block = (char *)realloc(reader->block, capacity);
+    if (block == NULL) {
+      return ENOMEM;
+    }
+    reader->block = block;
+    reader->block_capacity = capacity;
+  }
+  memcpy(reader->block + reader->block_size, datum, size);
+  reader->block_size += size;
+  return 0;
+}
+
+int datum_next_block(datum_reader_t *reader, avro_schema_t *schema, const char **data,
+                     size_t *size, int64_t *count) {
+  reader->block_size = 0;
+  reader->drained = 0;
+  *schema = NULL;
+  *count = 0;
+  for (;;) {
+    avro_schema_t datum_schema;
+    const char *datum;
+    size_t datum_size, framed_size;
+    int rval = parse_datum(reader, &datum_schema, &datum, &datum_size, &framed_size);
+    if (rval == DATUM_INCOMPLETE) {
+      // Datums read so far are converted before waiting for more
+      if (*count > 0) {
+        reader->drained = 1;
+        break;
+      }
+      if (reader->eof) {
+        return reader->pos == reader->size ? DATUM_EOF
+                                           : invalid_datum(reader, "Truncated datum");
+      }
+      CHECKED_EV(read_input(reader));
+      continue;
+    }
+    CHECKED_EV(rval);
+    if (*count > 0 &&
+        (datum_schema != *schema || reader->block_size + datum_size > DATUM_BLOCK_SIZE)) {
+      break;
+    }
+    CHECKED_EV(append_datum(reader, datum, datum_size));
+    reader->pos += framed_size;
+    *schema = datum_schema;
+    (*count)++;
+  }
+  *data = reader->block;
+  *size = reader->block_size;
+  return 0;
+}
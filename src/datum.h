@@ -0,0 +1,78 @@
+#pragma once
+
+#include <avro.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+
+/*
+ * Reader of Avro datums that aren't in a container file, as held by message
+ * queue consumers, from a file or standard input (--datums):
+ *
+ * - length-prefixed: every datum is preceded by its size as an Avro long,
+ *   and encoded with the schema of --schema FILE.
+ * - single-object: every datum is in Avro single-object encoding, the marker
+ *   C3 01 and the 64-bit little-endian Rabin fingerprint of its schema,
+ *   followed by the datum. Schemas are those of --schema FILE, or of every
+ *   .avsc and .json file of --schema DIRECTORY.
+ *
+ * Consecutive datums of the same schema are gathered into blocks, so that
+ * they're converted just like records of a container file block. A block
+ * ends at a change of schema, at DATUM_BLOCK_SIZE bytes, or when no more
+ * input is available yet, so that a stream from a consumer is converted as
+ * it arrives.
+ */
+
+// Returned when there are no more datums
+#define DATUM_EOF -1
+
+#define DATUM_BLOCK_SIZE (1024 * 1024)
+
+typedef struct {
+  uint64_t fingerprint;
+  avro_schema_t schema;
+} datum_schema_t;
+
+typedef struct {
+  FILE *fp;
+  enum DatumFraming framing;
+  datum_schema_t *schemas;
+  size_t schemas_count;
+  size_t max_datum_size;
+  char *input; // read ahead, the next datum starts at input + pos
+  size_t pos;
+  size_t size;
+  size_t capacity;
+  int eof;
+  int drained;    // the last block ended since no more input was available
+  int64_t offset; // input offset of input[0]
+  char *block;    // datums of the block, without framing
+  size_t block_size;
+  size_t block_capacity;
+} datum_reader_t;
+
+/**
+ * Reads the JSON schema file.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int datum_read_schema(const char *path, avro_schema_t *schema);
+
+/**
+ * Opens the file, or standard input for "-", and loads the schemas of
+ * 'schema_path'. Datums larger than 'max_datum_size' are rejected.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int datum_open(const char *path, enum DatumFraming framing, const char *schema_path,
+               size_t max_datum_size, datum_reader_t **reader);
+
+void datum_close(datum_reader_t *reader);
+
+/**
+ * Reads the next block of datums, all of the same schema. The returned data
+ * is valid until the next call. Returns DATUM_EOF when there are no more
+ * datums, 0 on success, or error code (with Avro error set) otherwise.
+ */
+int datum_next_block(datum_reader_t *reader, avro_schema_t *schema, const char **data,
+                     size_t *size, int64_t *count);
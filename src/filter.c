@@ -0,0 +1,935 @@
+#include <avro.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary.h"
+#include "filter.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+enum token_type {
+  TOK_END,
+  TOK_IDENT,
+  TOK_STRING,
+  TOK_NUMBER,
+  TOK_LPAREN,
+  TOK_RPAREN,
+  TOK_LBRACKET,
+  TOK_RBRACKET,
+  TOK_COMMA,
+  TOK_EQ,
+  TOK_NE,
+  TOK_LT,
+  TOK_LE,
+  TOK_GT,
+  TOK_GE,
+  TOK_AND,
+  TOK_OR,
+  TOK_NOT
+};
+
+typedef struct {
+  enum token_type type;
+  const char *start;
+  size_t len;
+  char *str; // unescaped value of string literal
+} token_t;
+
+enum literal_kind { LIT_NULL, LIT_BOOL, LIT_INT, LIT_REAL, LIT_STRING };
+
+typedef struct {
+  enum literal_kind kind;
+  int64_t i;
+  double d;
+  char *s;
+  size_t len;
+} literal_t;
+
+enum value_kind { VAL_NULL, VAL_BOOL, VAL_INT, VAL_REAL, VAL_STRING, VAL_OTHER };
+
+// Value of a field decoded from the current record
+typedef struct {
+  enum value_kind kind;
+  int64_t i;
+  double d;
+  const char *s;
+  size_t len;
+} slot_t;
+
+enum node_kind { NODE_AND, NODE_OR, NODE_NOT, NODE_CMP, NODE_IN, NODE_IS_NULL };
+
+typedef struct node_t {
+  enum node_kind kind;
+  struct node_t *left;
+  struct node_t *right;
+  size_t column;
+  enum token_type op;
+  literal_t *literals;
+  size_t literals_count;
+} node_t;
+
+typedef struct {
+  size_t field_idx;
+  slot_t slot;
+} column_t;
+
+struct filter_t {
+  node_t *root;
+  avro_schema_t schema;  // top-level schema
+  int record_branch;     // branch of the record when top-level is a union, or -1
+  avro_schema_t record;  // top-level record schema
+  size_t fields_count;
+  avro_schema_t *field_schemas;
+  int *field_columns;    // column index of every field, or -1 if not referenced
+  column_t *columns;
+  size_t columns_count;
+};
+
+typedef struct {
+  const char *expr;
+  const char *pos;
+  token_t tok;
+  filter_t *filter;
+} parser_t;
+
+// Letters that form identifiers (field names and keywords)
+static int is_ident_char(int ch) { return isalnum(ch) || ch == '_'; }
+
+static int syntax_error(parser_t *parser, const char *what) {
+  avro_set_error("Invalid --where expression at position %d: %s",
+                 (int)(parser->tok.start - parser->expr) + 1, what);
+  return EINVAL;
+}
+
+static int token_is(const token_t *tok, const char *keyword) {
+  return tok->type == TOK_IDENT && strlen(keyword) == tok->len &&
+         !strncmp(tok->start, keyword, tok->len);
+}
+
+static int next_token(parser_t *parser) {
+  token_t *tok = &parser->tok;
+  free(tok->str);
+  tok->str = NULL;
+
+  const char *p = parser->pos;
+  while (isspace((unsigned char)*p)) {
+    p++;
+  }
+  tok->start = p;
+
+  if (*p == '\0') {
+    tok->type = TOK_END;
+  } else if (isalpha((unsigned char)*p) || *p == '_') {
+    while (is_ident_char((unsigned char)*p)) {
+      p++;
+    }
+    tok->type = TOK_IDENT;
+    tok->len = p - tok->start;
+    if (token_is(tok, "and")) {
+      tok->type = TOK_AND;
+    } else if (token_is(tok, "or")) {
+      tok->type = TOK_OR;
+    } else if (token_is(tok, "not")) {
+      tok->type = TOK_NOT;
+    }
+  } else if (isdigit((unsigned char)*p) ||
+             ((*p == '-' || *p == '+' || *p == '.') && isdigit((unsigned char)p[1]))) {
+    p++;
+    while (isalnum((unsigned char)*p) || *p == '.' ||
+           ((*p == '-' || *p == '+') && (p[-1] == 'e' || p[-1] == 'E'))) {
+      p++;
+    }
+    tok->type = TOK_NUMBER;
+  } else if (*p == '"' || *p == '\'') {
+    char quote = *p++;
+    size_t size = 0;
+    if ((tok->str = (char *)malloc(strlen(p) + 1)) == NULL) {
+      return ENOMEM;
+    }
+    while (*p != quote) {
+      if (*p == '\0') {
+        return syntax_error(parser, "unterminated string");
+      }
+      if (*p == '\\' && p[1] != '\0') {
+        p++;
+        switch (*p) {
+        case 'n': tok->str[size++] = '\n'; break;
+        case 'r': tok->str[size++] = '\r'; break;
+        case 't': tok->str[size++] = '\t'; break;
+        default: tok->str[size++] = *p; break;
+        }
+        p++;
+      } else {
+        tok->str[size++] = *p++;
+      }
+    }
+    tok->str[size] = '\0';
+    tok->len = size;
+    p++;
+    tok->type = TOK_STRING;
+  } else {
+    static const struct {
+      const char *str;
+      enum token_type type;
+    } operators[] = {{"==", TOK_EQ}, {"!=", TOK_NE}, {"<>", TOK_NE},
+                     {"<=", TOK_LE}, {">=", TOK_GE}, {"&&", TOK_AND},
+                     {"||", TOK_OR}, {"=", TOK_EQ},  {"<", TOK_LT},
+                     {">", TOK_GT},  {"!", TOK_NOT}, {"(", TOK_LPAREN},
+                     {")", TOK_RPAREN}, {"[", TOK_LBRACKET},
+                     {"]", TOK_RBRACKET}, {",", TOK_COMMA}};
+    size_t i;
+    for (i = 0; i < sizeof(operators) / sizeof(operators[0]); ++i) {
+      size_t len = strlen(operators[i].str);
+      if (!strncmp(p, operators[i].str, len)) {
+        tok->type = operators[i].type;
+        p += len;
+        break;
+      }
+    }
+    if (i == sizeof(operators) / sizeof(operators[0])) {
+      return syntax_error(parser, "unexpected character");
+    }
+  }
+
+  if (tok->type != TOK_STRING) {
+    tok->len = p - tok->start;
+  }
+  parser->pos = p;
+  return 0;
+}
+
+static node_t *node_new(enum node_kind kind, node_t *left, node_t *right) {
+  node_t *node = (node_t *)calloc(1, sizeof(node_t));
+  if (node != NULL) {
+    node->kind = kind;
+    node->left = left;
+    node->right = right;
+  }
+  return node;
+}
+
+static void node_free(node_t *node) {
+  if (node == NULL) {
+    return;
+  }
+  node_free(node->left);
+  node_free(node->right);
+  for (size_t i = 0; i < node->literals_count; ++i) {
+    free(node->literals[i].s);
+  }
+  free(node->literals);
+  free(node);
+}
+
+// Nullable types are represented as UNION of NULL and target schema.
+static avro_schema_t non_null_schema(avro_schema_t schema) {
+  schema = binary_resolve_schema(schema);
+  if (is_avro_union(schema) && avro_schema_union_size(schema) == 2) {
+    avro_schema_t first = binary_resolve_schema(avro_schema_union_branch(schema, 0));
+    avro_schema_t second = binary_resolve_schema(avro_schema_union_branch(schema, 1));
+    if (avro_typeof(first) == AVRO_NULL) {
+      return second;
+    }
+    if (avro_typeof(second) == AVRO_NULL) {
+      return first;
+    }
+  }
+  return schema;
+}
+
+#define KIND_MASK(kind) (1 << (kind))
+
+// Kinds of values a field of given schema may have
+static int schema_value_kinds(avro_schema_t schema) {
+  schema = binary_resolve_schema(schema);
+  switch (avro_typeof(schema)) {
+  case AVRO_NULL:
+    return KIND_MASK(VAL_NULL);
+  case AVRO_BOOLEAN:
+    return KIND_MASK(VAL_BOOL);
+  case AVRO_INT32:
+  case AVRO_INT64:
+  case AVRO_FLOAT:
+  case AVRO_DOUBLE:
+    return KIND_MASK(VAL_INT) | KIND_MASK(VAL_REAL);
+  case AVRO_STRING:
+  case AVRO_BYTES:
+  case AVRO_ENUM:
+  case AVRO_FIXED:
+    return KIND_MASK(VAL_STRING);
+  case AVRO_UNION: {
+    int kinds = 0;
+    for (size_t i = 0; i < avro_schema_union_size(schema); ++i) {
+      kinds |= schema_value_kinds(avro_schema_union_branch(schema, (int)i));
+    }
+    return kinds;
+  }
+  default:
+    return KIND_MASK(VAL_OTHER);
+  }
+}
+
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+// Parses 'yyyy-mm-dd[Thh:mm[:ss[.fffffff]]][Z]' into days and nanoseconds of the day
+static int parse_datetime(const char *str, int64_t *days, int64_t *nanos) {
+  int year, month, day, hour = 0, minute = 0, second = 0, n = 0;
+  if (sscanf(str, "%4d-%2d-%2d%n", &year, &month, &day, &n) != 3 ||
+      month < 1 || month > 12 || day < 1 || day > 31) {
+    return EINVAL;
+  }
+  str += n;
+  *nanos = 0;
+  if (*str == 'T' || *str == ' ') {
+    str++;
+    if (sscanf(str, "%2d:%2d%n", &hour, &minute, &n) != 2) {
+      return EINVAL;
+    }
+    str += n;
+    if (*str == ':') {
+      str++;
+      if (sscanf(str, "%2d%n", &second, &n) != 1) {
+        return EINVAL;
+      }
+      str += n;
+      if (*str == '.') {
+        int64_t scale = 100000000;
+        for (str++; isdigit((unsigned char)*str); str++, scale /= 10) {
+          *nanos += (*str - '0') * scale;
+        }
+      }
+    }
+  }
+  if (*str == 'Z') {
+    str++;
+  }
+  if (*str != '\0') {
+    return EINVAL;
+  }
+  *days = days_from_civil(year, (unsigned)month, (unsigned)day);
+  *nanos += ((int64_t)hour * 3600 + minute * 60 + second) * 1000000000;
+  return 0;
+}
+
+// String literals compared with date/time fields are converted to field units
+static int convert_time_literal(parser_t *parser, avro_schema_t schema,
+                                literal_t *literal) {
+  avro_logical_schema_t *logical_type = avro_logical_schema(non_null_schema(schema));
+  if (literal->kind != LIT_STRING || logical_type == NULL) {
+    return 0;
+  }
+
+  int64_t days, nanos;
+  switch (logical_type->type) {
+  case AVRO_DATE:
+  case AVRO_TIMESTAMP_MILLIS:
+  case AVRO_TIMESTAMP_MICROS:
+    if (parse_datetime(literal->s, &days, &nanos) != 0) {
+      return syntax_error(parser, "invalid date/time literal");
+    }
+    break;
+  default:
+    return 0;
+  }
+
+  if (logical_type->type == AVRO_DATE) {
+    literal->i = days;
+  } else if (logical_type->type == AVRO_TIMESTAMP_MILLIS) {
+    literal->i = days * 86400000 + nanos / 1000000;
+  } else {
+    literal->i = days * 86400000000 + nanos / 1000;
+  }
+  free(literal->s);
+  literal->s = NULL;
+  literal->kind = LIT_INT;
+  return 0;
+}
+
+static int parse_literal(parser_t *parser, literal_t *literal) {
+  token_t *tok = &parser->tok;
+  memset(literal, 0, sizeof(literal_t));
+
+  if (tok->type == TOK_STRING) {
+    literal->kind = LIT_STRING;
+    literal->s = tok->str;
+    literal->len = tok->len;
+    tok->str = NULL;
+  } else if (tok->type == TOK_NUMBER) {
+    char num[64];
+    if (tok->len >= sizeof(num)) {
+      return syntax_error(parser, "number is too long");
+    }
+    memcpy(num, tok->start, tok->len);
+    num[tok->len] = '\0';
+    char *end;
+    if (strpbrk(num, ".eE") == NULL) {
+      errno = 0;
+      literal->kind = LIT_INT;
+      literal->i = strtoll(num, &end, 10);
+      if (errno == ERANGE) {
+        return syntax_error(parser, "number is out of range");
+      }
+    } else {
+      literal->kind = LIT_REAL;
+      literal->d = strtod(num, &end);
+    }
+    if (*end != '\0') {
+      return syntax_error(parser, "invalid number");
+    }
+  } else if (token_is(tok, "true") || token_is(tok, "false")) {
+    literal->kind = LIT_BOOL;
+    literal->i = token_is(tok, "true");
+  } else if (token_is(tok, "null")) {
+    literal->kind = LIT_NULL;
+  } else {
+    return syntax_error(parser, "expected a literal");
+  }
+  return next_token(parser);
+}
+
+static int check_literal(parser_t *parser, const char *field_name,
+                         avro_schema_t schema, literal_t *literal) {
+  int rval = convert_time_literal(parser, schema, literal);
+  if (rval != 0) {
+    return rval;
+  }
+
+  int kinds = schema_value_kinds(schema);
+  int compatible = 0;
+  const char *literal_type = "";
+  switch (literal->kind) {
+  case LIT_NULL:
+    compatible = 1;
+    break;
+  case LIT_BOOL:
+    compatible = kinds & KIND_MASK(VAL_BOOL);
+    literal_type = "a boolean";
+    break;
+  case LIT_INT:
+  case LIT_REAL:
+    compatible = kinds & (KIND_MASK(VAL_INT) | KIND_MASK(VAL_REAL));
+    literal_type = "a number";
+    break;
+  case LIT_STRING:
+    compatible = kinds & KIND_MASK(VAL_STRING);
+    literal_type = "a string";
+    break;
+  }
+  if (!compatible) {
+    avro_set_error("Invalid --where expression: field '%s' can't be compared with %s",
+                   field_name, literal_type);
+    return EINVAL;
+  }
+  return 0;
+}
+
+static int resolve_column(parser_t *parser, const char *name, size_t *column) {
+  filter_t *filter = parser->filter;
+  int field_idx = avro_schema_record_field_get_index(filter->record, name);
+  if (field_idx < 0) {
+    avro_set_error("Invalid --where expression: unknown field '%s'", name);
+    return EINVAL;
+  }
+
+  if (filter->field_columns[field_idx] < 0) {
+    column_t *columns = (column_t *)realloc(
+        filter->columns, sizeof(column_t) * (filter->columns_count + 1));
+    if (columns == NULL) {
+      return ENOMEM;
+    }
+    filter->columns = columns;
+    filter->columns[filter->columns_count].field_idx = field_idx;
+    filter->field_columns[field_idx] = (int)filter->columns_count++;
+  }
+  *column = filter->field_columns[field_idx];
+  return 0;
+}
+
+static int parse_or(parser_t *parser, node_t **node);
+
+static int parse_predicate(parser_t *parser, node_t **node) {
+  token_t *tok = &parser->tok;
+  int rval;
+  if (tok->type != TOK_IDENT) {
+    return syntax_error(parser, "expected a field name");
+  }
+
+  char name[256];
+  if (tok->len >= sizeof(name)) {
+    return syntax_error(parser, "field name is too long");
+  }
+  memcpy(name, tok->start, tok->len);
+  name[tok->len] = '\0';
+
+  size_t column;
+  if ((rval = resolve_column(parser, name, &column)) != 0 ||
+      (rval = next_token(parser)) != 0) {
+    return rval;
+  }
+  avro_schema_t schema =
+      parser->filter->field_schemas[parser->filter->columns[column].field_idx];
+
+  if (token_is(tok, "is")) {
+    CHECKED_EV(next_token(parser));
+    int negate = 0;
+    if (tok->type == TOK_NOT) {
+      negate = 1;
+      CHECKED_EV(next_token(parser));
+    }
+    if (!token_is(tok, "null")) {
+      return syntax_error(parser, "expected 'null'");
+    }
+    CHECKED_EV(next_token(parser));
+    node_t *is_null = node_new(NODE_IS_NULL, NULL, NULL);
+    if (is_null == NULL) {
+      return ENOMEM;
+    }
+    is_null->column = column;
+    *node = negate ? node_new(NODE_NOT, is_null, NULL) : is_null;
+    if (*node == NULL) {
+      node_free(is_null);
+      return ENOMEM;
+    }
+    return 0;
+  }
+
+  if (token_is(tok, "in")) {
+    CHECKED_EV(next_token(parser));
+    enum token_type close;
+    if (tok->type == TOK_LBRACKET) {
+      close = TOK_RBRACKET;
+    } else if (tok->type == TOK_LPAREN) {
+      close = TOK_RPAREN;
+    } else {
+      return syntax_error(parser, "expected a list of literals");
+    }
+    CHECKED_EV(next_token(parser));
+
+    if ((*node = node_new(NODE_IN, NULL, NULL)) == NULL) {
+      return ENOMEM;
+    }
+    (*node)->column = column;
+    while (tok->type != close) {
+      if ((*node)->literals_count > 0) {
+        if (tok->type != TOK_COMMA) {
+          return syntax_error(parser, "expected ','");
+        }
+        CHECKED_EV(next_token(parser));
+      }
+      literal_t *literals = (literal_t *)realloc(
+          (*node)->literals, sizeof(literal_t) * ((*node)->literals_count + 1));
+      if (literals == NULL) {
+        return ENOMEM;
+      }
+      (*node)->literals = literals;
+      literal_t *literal = &literals[(*node)->literals_count];
+      const char *literal_start = tok->start;
+      CHECKED_EV(parse_literal(parser, literal));
+      (*node)->literals_count++;
+      if (literal->kind == LIT_NULL) {
+        parser->tok.start = literal_start;
+        return syntax_error(parser, "null is not allowed in a list, use 'is null'");
+      }
+      CHECKED_EV(check_literal(parser, name, schema, literal));
+    }
+    return next_token(parser);
+  }
+
+  switch (tok->type) {
+  case TOK_EQ:
+  case TOK_NE:
+  case TOK_LT:
+  case TOK_LE:
+  case TOK_GT:
+  case TOK_GE:
+    break;
+  default:
+    return syntax_error(parser, "expected a comparison operator");
+  }
+
+  enum token_type op = tok->type;
+  CHECKED_EV(next_token(parser));
+
+  if ((*node = node_new(NODE_CMP, NULL, NULL)) == NULL ||
+      ((*node)->literals = (literal_t *)calloc(1, sizeof(literal_t))) == NULL) {
+    return ENOMEM;
+  }
+  (*node)->column = column;
+  (*node)->op = op;
+  (*node)->literals_count = 1;
+  literal_t *literal = (*node)->literals;
+  CHECKED_EV(parse_literal(parser, literal));
+
+  if (literal->kind == LIT_NULL) {
+    // '== null' and '!= null' are the same as 'is null' and 'is not null'
+    if (op != TOK_EQ && op != TOK_NE) {
+      return syntax_error(parser, "null can only be compared with == or !=");
+    }
+    (*node)->kind = NODE_IS_NULL;
+    if (op == TOK_NE) {
+      node_t *not_node = node_new(NODE_NOT, *node, NULL);
+      if (not_node == NULL) {
+        return ENOMEM;
+      }
+      *node = not_node;
+    }
+    return 0;
+  }
+  return check_literal(parser, name, schema, literal);
+}
+
+static int parse_unary(parser_t *parser, node_t **node) {
+  token_t *tok = &parser->tok;
+
+  if (tok->type == TOK_NOT) {
+    CHECKED_EV(next_token(parser));
+    node_t *child = NULL;
+    int rval = parse_unary(parser, &child);
+    if ((*node = node_new(NODE_NOT, child, NULL)) == NULL) {
+      node_free(child);
+      return ENOMEM;
+    }
+    return rval;
+  }
+
+  if (tok->type == TOK_LPAREN) {
+    CHECKED_EV(next_token(parser));
+    CHECKED_EV(parse_or(parser, node));
+    if (tok->type != TOK_RPAREN) {
+      return syntax_error(parser, "expected ')'");
+    }
+    return next_token(parser);
+  }
+
+  return parse_predicate(parser, node);
+}
+
+static int parse_and(parser_t *parser, node_t **node) {
+  CHECKED_EV(parse_unary(parser, node));
+  while (parser->tok.type == TOK_AND) {
+    CHECKED_EV(next_token(parser));
+    node_t *right = NULL;
+    int rval = parse_unary(parser, &right);
+    node_t *and_node = node_new(NODE_AND, *node, right);
+    if (and_node == NULL) {
+      node_free(right);
+      return ENOMEM;
+    }
+    *node = and_node;
+    if (rval != 0) {
+      return rval;
+    }
+  }
+  return 0;
+}
+
+static int parse_or(parser_t *parser, node_t **node) {
+  CHECKED_EV(parse_and(parser, node));
+  while (parser->tok.type == TOK_OR) {
+    CHECKED_EV(next_token(parser));
+    node_t *right = NULL;
+    int rval = parse_and(parser, &right);
+    node_t *or_node = node_new(NODE_OR, *node, right);
+    if (or_node == NULL) {
+      node_free(right);
+      return ENOMEM;
+    }
+    *node = or_node;
+    if (rval != 0) {
+      return rval;
+    }
+  }
+  return 0;
+}
+
+void filter_free(filter_t *filter) {
+  node_free(filter->root);
+  free(filter->field_schemas);
+  free(filter->field_columns);
+  free(filter->columns);
+  free(filter);
+}
+
+int filter_compile(const char *expr, avro_schema_t schema, filter_t **result) {
+  filter_t *filter = (filter_t *)calloc(1, sizeof(filter_t));
+  if (filter == NULL) {
+    return ENOMEM;
+  }
+
+  filter->schema = binary_resolve_schema(schema);
+  filter->record = non_null_schema(schema);
+  filter->record_branch = -1;
+  if (!is_avro_record(filter->record)) {
+    avro_set_error("Can't find root record schema");
+    filter_free(filter);
+    return EINVAL;
+  }
+  if (is_avro_union(filter->schema)) {
+    avro_schema_t first = binary_resolve_schema(avro_schema_union_branch(filter->schema, 0));
+    filter->record_branch = first == filter->record ? 0 : 1;
+  }
+
+  filter->fields_count = avro_schema_record_size(filter->record);
+  filter->field_schemas = (avro_schema_t *)calloc(filter->fields_count + 1, sizeof(avro_schema_t));
+  filter->field_columns = (int *)malloc(sizeof(int) * (filter->fields_count + 1));
+  if (filter->field_schemas == NULL || filter->field_columns == NULL) {
+    filter_free(filter);
+    return ENOMEM;
+  }
+  for (size_t i = 0; i < filter->fields_count; ++i) {
+    filter->field_schemas[i] = avro_schema_record_field_get_by_index(filter->record, (int)i);
+    filter->field_columns[i] = -1;
+  }
+
+  parser_t parser = {.expr = expr, .pos = expr, .filter = filter};
+  int rval = next_token(&parser);
+  if (rval == 0) {
+    rval = parse_or(&parser, &filter->root);
+  }
+  if (rval == 0 && parser.tok.type != TOK_END) {
+    rval = syntax_error(&parser, "unexpected token");
+  }
+  free(parser.tok.str);
+
+  if (rval != 0) {
+    filter_free(filter);
+    return rval;
+  }
+  *result = filter;
+  return 0;
+}
+
+static int decode_slot(avro_schema_t schema, const char **p, const char *end,
+                       slot_t *slot) {
+  int rval;
+  schema = binary_resolve_schema(schema);
+
+  switch (avro_typeof(schema)) {
+  case AVRO_NULL:
+    slot->kind = VAL_NULL;
+    return 0;
+
+  case AVRO_BOOLEAN:
+    if (end - *p < 1) {
+      return binary_skip(schema, p, end);
+    }
+    slot->kind = VAL_BOOL;
+    slot->i = *(*p)++ != 0;
+    return 0;
+
+  case AVRO_INT32:
+  case AVRO_INT64:
+    slot->kind = VAL_INT;
+    return binary_read_long(p, end, &slot->i);
+
+  case AVRO_FLOAT: {
+    float val;
+    slot->kind = VAL_REAL;
+    rval = binary_read_float(p, end, &val);
+    slot->d = val;
+    return rval;
+  }
+
+  case AVRO_DOUBLE:
+    slot->kind = VAL_REAL;
+    return binary_read_double(p, end, &slot->d);
+
+  case AVRO_STRING:
+  case AVRO_BYTES:
+    slot->kind = VAL_STRING;
+    return binary_read_bytes(p, end, &slot->s, &slot->len);
+
+  case AVRO_ENUM: {
+    int64_t symbol;
+    if ((rval = binary_read_long(p, end, &symbol)) != 0) {
+      return rval;
+    }
+    if (symbol < 0 || symbol >= avro_schema_enum_number_of_symbols(schema)) {
+      avro_set_error("Invalid enum symbol index");
+      return EILSEQ;
+    }
+    slot->kind = VAL_STRING;
+    slot->s = avro_schema_enum_get(schema, (int)symbol);
+    slot->len = strlen(slot->s);
+    return 0;
+  }
+
+  case AVRO_FIXED:
+    slot->kind = VAL_STRING;
+    slot->s = *p;
+    slot->len = (size_t)avro_schema_fixed_size(schema);
+    return binary_skip(schema, p, end);
+
+  case AVRO_UNION: {
+    int64_t branch;
+    if ((rval = binary_read_long(p, end, &branch)) != 0) {
+      return rval;
+    }
+    if (branch < 0 || (size_t)branch >= avro_schema_union_size(schema)) {
+      avro_set_error("Invalid union branch index");
+      return EILSEQ;
+    }
+    return decode_slot(avro_schema_union_branch(schema, (int)branch), p, end, slot);
+  }
+
+  default:
+    slot->kind = VAL_OTHER;
+    return binary_skip(schema, p, end);
+  }
+}
+
+// Returns 1 and sets '*result' to comparison result if the values are comparable
+static int compare(const slot_t *slot, const literal_t *literal, int *result) {
+  switch (slot->kind) {
+  case VAL_BOOL:
+    if (literal->kind != LIT_BOOL) {
+      return 0;
+    }
+    *result = (int)(slot->i - literal->i);
+    return 1;
+
+  case VAL_INT:
+    if (literal->kind == LIT_INT) {
+      *result = slot->i < literal->i ? -1 : slot->i > literal->i;
+      return 1;
+    }
+    if (literal->kind == LIT_REAL) {
+      double val = (double)slot->i;
+      *result = val < literal->d ? -1 : val > literal->d;
+      return !isnan(literal->d);
+    }
+    return 0;
+
+  case VAL_REAL: {
+    double other;
+    if (literal->kind == LIT_INT) {
+      other = (double)literal->i;
+    } else if (literal->kind == LIT_REAL) {
+      other = literal->d;
+    } else {
+      return 0;
+    }
+    if (isnan(slot->d) || isnan(other)) {
+      return 0;
+    }
+    *result = slot->d < other ? -1 : slot->d > other;
+    return 1;
+  }
+
+  case VAL_STRING: {
+    if (literal->kind != LIT_STRING) {
+      return 0;
+    }
+    size_t len = slot->len < literal->len ? slot->len : literal->len;
+    int cmp = memcmp(slot->s, literal->s, len);
+    if (cmp == 0) {
+      cmp = slot->len < literal->len ? -1 : slot->len > literal->len;
+    }
+    *result = cmp;
+    return 1;
+  }
+
+  default:
+    return 0;
+  }
+}
+
+static int eval_node(const filter_t *filter, const node_t *node) {
+  switch (node->kind) {
+  case NODE_AND:
+    return eval_node(filter, node->left) && eval_node(filter, node->right);
+
+  case NODE_OR:
+    return eval_node(filter, node->left) || eval_node(filter, node->right);
+
+  case NODE_NOT:
+    return !eval_node(filter, node->left);
+
+  case NODE_IS_NULL:
+    return filter->columns[node->column].slot.kind == VAL_NULL;
+
+  case NODE_IN: {
+    const slot_t *slot = &filter->columns[node->column].slot;
+    for (size_t i = 0; i < node->literals_count; ++i) {
+      int result;
+      if (compare(slot, &node->literals[i], &result) && result == 0) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  case NODE_CMP: {
+    int result;
+    if (!compare(&filter->columns[node->column].slot, node->literals, &result)) {
+      return 0;
+    }
+    switch (node->op) {
+    case TOK_EQ: return result == 0;
+    case TOK_NE: return result != 0;
+    case TOK_LT: return result < 0;
+    case TOK_LE: return result <= 0;
+    case TOK_GT: return result > 0;
+    case TOK_GE: return result >= 0;
+    default: return 0;
+    }
+  }
+  }
+  return 0;
+}
+
+int filter_eval(filter_t *filter, const char **p, const char *end, int *matches) {
+  int rval;
+
+  if (filter->record_branch >= 0) {
+    int64_t branch;
+    if ((rval = binary_read_long(p, end, &branch)) != 0) {
+      return rval;
+    }
+    if (branch < 0 || (size_t)branch >= avro_schema_union_size(filter->schema)) {
+      avro_set_error("Invalid union branch index");
+      return EILSEQ;
+    }
+    if (branch != filter->record_branch) {
+      // Null record, none of the fields has a value
+      for (size_t i = 0; i < filter->columns_count; ++i) {
+        filter->columns[i].slot.kind = VAL_NULL;
+      }
+      *matches = eval_node(filter, filter->root);
+      return binary_skip(avro_schema_union_branch(filter->schema, (int)branch), p, end);
+    }
+  }
+
+  for (size_t i = 0; i < filter->fields_count; ++i) {
+    int column = filter->field_columns[i];
+    if (column >= 0) {
+      rval = decode_slot(filter->field_schemas[i], p, end, &filter->columns[column].slot);
+    } else {
+      rval = binary_skip(filter->field_schemas[i], p, end);
+    }
+    if (rval != 0) {
+      return rval;
+    }
+  }
+
+  *matches = eval_node(filter, filter->root);
+  return 0;
+}
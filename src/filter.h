@@ -0,0 +1,32 @@
+#pragma once
+
+#include <avro.h>
+
+/**
+ * Row filter (--where), compiled against the writer schema.
+ *
+ * Expressions compare top-level fields with literals:
+ *
+ *   Level == "Error" and (Timestamp >= "2024-01-01" or not Region in ["eu", "us"])
+ *
+ * Supported operators are ==, !=, <, <=, >, >=, in [...], is null,
+ * is not null, and, or, not (also &&, || and !). Comparisons with a null
+ * value are false. String literals compared with date or timestamp fields
+ * are parsed as 'yyyy-mm-dd[Thh:mm:ss[.fffffff]][Z]' UTC times.
+ */
+typedef struct filter_t filter_t;
+
+/**
+ * Compiles the expression against the schema of the top-level record.
+ * Returns 0 on success, or EINVAL (with Avro error set) otherwise.
+ */
+int filter_compile(const char *expr, avro_schema_t schema, filter_t **filter);
+
+void filter_free(filter_t *filter);
+
+/**
+ * Evaluates the filter on a binary encoded record that starts at '*p'.
+ * Only fields referenced by the filter are decoded, the rest are skipped.
+ * On success '*p' is advanced past the end of the record.
+ */
+int filter_eval(filter_t *filter, const char **p, const char *end, int *matches);
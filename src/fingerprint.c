@@ -0,0 +1,357 @@
+#include <avro.h>
+#include <errno.h>
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fingerprint.h"
+
+#define RABIN_EMPTY 0xc15d213aa4d7a795ULL
+#define SCHEMA_JSON_INITIAL_SIZE 4096
+#define SCHEMA_JSON_MAX_SIZE (64 * 1024 * 1024)
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+uint64_t rabin_fingerprint(const void *buf, size_t size) {
+  uint64_t table[256];
+  for (int i = 0; i < 256; ++i) {
+    uint64_t fp = i;
+    for (int j = 0; j < 8; ++j) {
+      fp = (fp >> 1) ^ (RABIN_EMPTY & -(fp & 1));
+    }
+    table[i] = fp;
+  }
+
+  uint64_t fp = RABIN_EMPTY;
+  const unsigned char *p = (const unsigned char *)buf;
+  for (size_t i = 0; i < size; ++i) {
+    fp = (fp >> 8) ^ table[(fp ^ p[i]) & 0xff];
+  }
+  return fp;
+}
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+} strbuf_t;
+
+static int strbuf_append(strbuf_t *buf, const char *str, size_t size) {
+  if (buf->size + size + 1 > buf->capacity) {
+    size_t capacity = buf->capacity ? buf->capacity : 256;
+    while (capacity < buf->size + size + 1) {
+      capacity *= 2;
+    }
+    char *data = (char *)realloc(buf->data, capacity);
+    if (data == NULL) {
+      return ENOMEM;
+    }
+    buf->data = data;
+    buf->capacity = capacity;
+  }
+  memcpy(buf->data + buf->size, str, size);
+  buf->size += size;
+  buf->data[buf->size] = '\0';
+  return 0;
+}
+
+static int strbuf_puts(strbuf_t *buf, const char *str) {
+  return strbuf_append(buf, str, strlen(str));
+}
+
+static int strbuf_quoted(strbuf_t *buf, const char *str) {
+  json_t *json = json_string(str);
+  if (json == NULL) {
+    return EINVAL;
+  }
+  char *quoted = json_dumps(json, JSON_ENCODE_ANY);
+  json_decref(json);
+  if (quoted == NULL) {
+    return ENOMEM;
+  }
+  int rval = strbuf_puts(buf, quoted);
+  free(quoted);
+  return rval;
+}
+
+static int is_primitive_type_name(const char *name) {
+  static const char *primitives[] = {"null",   "boolean", "int",   "long",
+                                     "float",  "double",  "bytes", "string"};
+  for (size_t i = 0; i < sizeof(primitives) / sizeof(primitives[0]); ++i) {
+    if (!strcmp(name, primitives[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Appends fully qualified name, resolving it against enclosing namespace.
+static int strbuf_fullname(strbuf_t *buf, const char *name, const char *ns) {
+  if (strchr(name, '.') || ns == NULL || *ns == '\0') {
+    return strbuf_quoted(buf, name);
+  }
+  size_t size = strlen(ns) + strlen(name) + 2;
+  char *fullname = (char *)malloc(size);
+  if (fullname == NULL) {
+    return ENOMEM;
+  }
+  snprintf(fullname, size, "%s.%s", ns, name);
+  int rval = strbuf_quoted(buf, fullname);
+  free(fullname);
+  return rval;
+}
+
+static int canonicalize(strbuf_t *buf, const json_t *node, const char *ns);
+
+static int canonicalize_named(strbuf_t *buf, const json_t *node,
+                              const char *type, const char *ns) {
+  int rval = 0;
+  const char *name = json_string_value(json_object_get(node, "name"));
+  if (name == NULL) {
+    avro_set_error("Named schema '%s' has no name", type);
+    return EINVAL;
+  }
+
+  // Namespace of this type, which is also inherited by nested types
+  char *type_ns = NULL;
+  const char *last_dot = strrchr(name, '.');
+  if (last_dot != NULL) {
+    type_ns = (char *)malloc(last_dot - name + 1);
+    if (type_ns == NULL) {
+      return ENOMEM;
+    }
+    memcpy(type_ns, name, last_dot - name);
+    type_ns[last_dot - name] = '\0';
+  } else {
+    const json_t *ns_json = json_object_get(node, "namespace");
+    const char *explicit_ns = json_is_string(ns_json) ? json_string_value(ns_json) : ns;
+    type_ns = explicit_ns ? strdup(explicit_ns) : NULL;
+  }
+
+  if ((rval = strbuf_puts(buf, "{\"name\":")) != 0 ||
+      (rval = strbuf_fullname(buf, name, type_ns)) != 0 ||
+      (rval = strbuf_puts(buf, ",\"type\":")) != 0 ||
+      (rval = strbuf_quoted(buf, type)) != 0) {
+    goto out;
+  }
+
+  if (!strcmp(type, "record") || !strcmp(type, "error")) {
+    const json_t *fields = json_object_get(node, "fields");
+    if ((rval = strbuf_puts(buf, ",\"fields\":[")) != 0) {
+      goto out;
+    }
+    for (size_t i = 0; i < json_array_size(fields); ++i) {
+      const json_t *field = json_array_get(fields, i);
+      const char *field_name = json_string_value(json_object_get(field, "name"));
+      if (field_name == NULL) {
+        avro_set_error("Field of record '%s' has no name", name);
+        rval = EINVAL;
+        goto out;
+      }
+      if ((i > 0 && (rval = strbuf_puts(buf, ",")) != 0) ||
+          (rval = strbuf_puts(buf, "{\"name\":")) != 0 ||
+          (rval = strbuf_quoted(buf, field_name)) != 0 ||
+          (rval = strbuf_puts(buf, ",\"type\":")) != 0 ||
+          (rval = canonicalize(buf, json_object_get(field, "type"), type_ns)) != 0 ||
+          (rval = strbuf_puts(buf, "}")) != 0) {
+        goto out;
+      }
+    }
+    rval = strbuf_puts(buf, "]");
+  } else if (!strcmp(type, "enum")) {
+    const json_t *symbols = json_object_get(node, "symbols");
+    if ((rval = strbuf_puts(buf, ",\"symbols\":[")) != 0) {
+      goto out;
+    }
+    for (size_t i = 0; i < json_array_size(symbols); ++i) {
+      if ((i > 0 && (rval = strbuf_puts(buf, ",")) != 0) ||
+          (rval = strbuf_quoted(buf, json_string_value(json_array_get(symbols, i)))) != 0) {
+        goto out;
+      }
+    }
+    rval = strbuf_puts(buf, "]");
+  } else if (!strcmp(type, "fixed")) {
+    char size[32];
+    snprintf(size, sizeof(size), ",\"size\":%" JSON_INTEGER_FORMAT,
+             json_integer_value(json_object_get(node, "size")));
+    rval = strbuf_puts(buf, size);
+  }
+
+  if (rval == 0) {
+    rval = strbuf_puts(buf, "}");
+  }
+
+out:
+  free(type_ns);
+  return rval;
+}
+
+static int canonicalize(strbuf_t *buf, const json_t *node, const char *ns) {
+  if (json_is_string(node)) {
+    const char *name = json_string_value(node);
+    if (is_primitive_type_name(name)) {
+      return strbuf_quoted(buf, name);
+    }
+    return strbuf_fullname(buf, name, ns);
+  }
+
+  if (json_is_array(node)) {
+    CHECKED_EV(strbuf_puts(buf, "["));
+    for (size_t i = 0; i < json_array_size(node); ++i) {
+      if (i > 0) {
+        CHECKED_EV(strbuf_puts(buf, ","));
+      }
+      CHECKED_EV(canonicalize(buf, json_array_get(node, i), ns));
+    }
+    return strbuf_puts(buf, "]");
+  }
+
+  if (json_is_object(node)) {
+    const json_t *type_json = json_object_get(node, "type");
+    if (!json_is_string(type_json)) {
+      // {"type": {...}} or {"type": [...]}
+      return canonicalize(buf, type_json, ns);
+    }
+    const char *type = json_string_value(type_json);
+    if (is_primitive_type_name(type)) {
+      // Drops any attributes, like logical type annotations
+      return strbuf_quoted(buf, type);
+    }
+    if (!strcmp(type, "array")) {
+      CHECKED_EV(strbuf_puts(buf, "{\"type\":\"array\",\"items\":"));
+      CHECKED_EV(canonicalize(buf, json_object_get(node, "items"), ns));
+      return strbuf_puts(buf, "}");
+    }
+    if (!strcmp(type, "map")) {
+      CHECKED_EV(strbuf_puts(buf, "{\"type\":\"map\",\"values\":"));
+      CHECKED_EV(canonicalize(buf, json_object_get(node, "values"), ns));
+      return strbuf_puts(buf, "}");
+    }
+    if (!strcmp(type, "record") || !strcmp(type, "error") ||
+        !strcmp(type, "enum") || !strcmp(type, "fixed")) {
+      return canonicalize_named(buf, node, type, ns);
+    }
+    // A reference to a named type written in the object form
+    return strbuf_fullname(buf, type, ns);
+  }
+
+  avro_set_error("Unexpected JSON element in schema");
+  return EINVAL;
+}
+
+static char *schema_to_json_string(avro_schema_t schema) {
+  for (size_t size = SCHEMA_JSON_INITIAL_SIZE; size <= SCHEMA_JSON_MAX_SIZE; size *= 2) {
+    char *json = (char *)malloc(size);
+    if (json == NULL) {
+      return NULL;
+    }
+    avro_writer_t writer = avro_writer_memory(json, size - 1);
+    int rval = avro_schema_to_json(schema, writer);
+    if (rval == 0) {
+      json[avro_writer_tell(writer)] = '\0';
+      avro_writer_free(writer);
+      return json;
+    }
+    avro_writer_free(writer);
+    free(json);
+    if (rval != ENOSPC) {
+      return NULL;
+    }
+  }
+  avro_set_error("Schema is too large");
+  return NULL;
+}
+
+char *schema_canonical_form(avro_schema_t schema) {
+  char *schema_json = schema_to_json_string(schema);
+  if (schema_json == NULL) {
+    return NULL;
+  }
+
+  json_error_t error;
+  json_t *root = json_loads(schema_json, JSON_DECODE_ANY, &error);
+  free(schema_json);
+  if (root == NULL) {
+    avro_set_error("Cannot parse schema JSON: %s", error.text);
+    return NULL;
+  }
+
+  strbuf_t buf = {0};
+  int rval = canonicalize(&buf, root, NULL);
+  json_decref(root);
+  if (rval != 0) {
+    free(buf.data);
+    return NULL;
+  }
+  return buf.data;
+}
+
+int schema_fingerprint(avro_schema_t schema, uint64_t *fingerprint) {
+  char *canonical = schema_canonical_form(schema);
+  if (canonical == NULL) {
+    return EINVAL;
+  }
+  *fingerprint = rabin_fingerprint(canonical, strlen(canonical));
+  free(canonical);
+  return 0;
+}
+
+// Appends logical annotations of the schema and of all schemas nested in it,
+// one token per schema in depth-first order. Named types are only walked
+// where they're defined, since later uses are links.
+static int append_logical(strbuf_t *buf, avro_schema_t schema) {
+  avro_logical_schema_t *logical = avro_logical_schema(schema);
+  if (logical != NULL) {
+    char token[64];
+    snprintf(token, sizeof(token), "(%d,%zu,%zu)", (int)logical->type,
+             (size_t)logical->precision, (size_t)logical->scale);
+    CHECKED_EV(strbuf_puts(buf, token));
+  } else {
+    CHECKED_EV(strbuf_puts(buf, "."));
+  }
+
+  switch (avro_typeof(schema)) {
+  case AVRO_RECORD: {
+    size_t fields_count = avro_schema_record_size(schema);
+    for (size_t i = 0; i < fields_count; ++i) {
+      CHECKED_EV(append_logical(buf, avro_schema_record_field_get_by_index(schema, (int)i)));
+    }
+    return 0;
+  }
+  case AVRO_ARRAY:
+    return append_logical(buf, avro_schema_array_items(schema));
+  case AVRO_MAP:
+    return append_logical(buf, avro_schema_map_values(schema));
+  case AVRO_UNION: {
+    size_t branches = avro_schema_union_size(schema);
+    for (size_t i = 0; i < branches; ++i) {
+      CHECKED_EV(append_logical(buf, avro_schema_union_branch(schema, (int)i)));
+    }
+    return 0;
+  }
+  default:
+    return 0;
+  }
+}
+
+int schema_logical_fingerprint(avro_schema_t schema, uint64_t *fingerprint) {
+  char *canonical = schema_canonical_form(schema);
+  if (canonical == NULL) {
+    return EINVAL;
+  }
+  strbuf_t buf = {canonical, strlen(canonical), strlen(canonical) + 1};
+  int rval = append_logical(&buf, schema);
+  if (rval == 0) {
+    *fingerprint = rabin_fingerprint(buf.data, buf.size);
+  }
+  free(buf.data);
+  return rval;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <avro.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Computes 64-bit Rabin fingerprint (CRC-64-AVRO) of the given bytes.
+ */
+uint64_t rabin_fingerprint(const void *buf, size_t size);
+
+/**
+ * Renders schema in Parsing Canonical Form as defined by Avro specification.
+ * The returned string must be released with free().
+ */
+char *schema_canonical_form(avro_schema_t schema);
+
+/**
+ * Computes Rabin fingerprint of schema's Parsing Canonical Form.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int schema_fingerprint(avro_schema_t schema, uint64_t *fingerprint);
+
+/**
+ * Computes Rabin fingerprint of schema's Parsing Canonical Form together with
+ * the logical type annotations that the canonical form drops, so that schemas
+ * which only differ in logical types, precision or scale don't match.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int schema_logical_fingerprint(avro_schema_t schema, uint64_t *fingerprint);
@@ -0,0 +1,165 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary.h"
+#include "flatten.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+// Records nested deeper than this are kept as single columns
+#define FLATTEN_MAX_DEPTH 64
+
+typedef struct {
+  flatten_t *flatten;
+  size_t capacity;
+  const char *separator;
+  avro_schema_t ancestors[FLATTEN_MAX_DEPTH]; // records being expanded
+  size_t depth;
+} walk_t;
+
+// Gets the non-null branch of a nullable union, or the schema itself
+static avro_schema_t nullable_target(avro_schema_t schema) {
+  schema = binary_resolve_schema(schema);
+  if (is_avro_union(schema) && avro_schema_union_size(schema) == 2) {
+    for (int i = 0; i < 2; ++i) {
+      if (is_avro_null(binary_resolve_schema(avro_schema_union_branch(schema, 1 - i)))) {
+        return binary_resolve_schema(avro_schema_union_branch(schema, i));
+      }
+    }
+  }
+  return schema;
+}
+
+static char *join(const char *prefix, const char *separator, const char *name) {
+  size_t prefix_size = prefix != NULL ? strlen(prefix) + strlen(separator) : 0;
+  char *result = (char *)malloc(prefix_size + strlen(name) + 1);
+  if (result == NULL) {
+    return NULL;
+  }
+  result[0] = '\0';
+  if (prefix != NULL) {
+    strcat(strcat(result, prefix), separator);
+  }
+  return strcat(result, name);
+}
+
+// Appends the column, taking ownership of 'path' and 'name'
+static int add_column(walk_t *walk, char *path, char *name, avro_schema_t leaf) {
+  flatten_t *flatten = walk->flatten;
+  for (size_t i = 0; i < flatten->columns_size; ++i) {
+    if (!strcmp(flatten->columns[i].output_name, name)) {
+      avro_set_error("Fields '%s' and '%s' flatten to the same column '%s'",
+                     flatten->columns[i].column_name, path, name);
+      free(path);
+      free(name);
+      return EINVAL;
+    }
+  }
+  if (flatten->columns_size == walk->capacity) {
+    size_t capacity = walk->capacity > 0 ? walk->capacity * 2 : 16;
+    column_info_t *columns =
+        (column_info_t *)realloc(flatten->columns, capacity * sizeof(column_info_t));
+    if (columns != NULL) {
+      flatten->columns = columns;
+    }
+    avro_schema_t *leaves =
+        (avro_schema_t *)realloc(flatten->leaves, capacity * sizeof(avro_schema_t));
+    if (leaves != NULL) {
+      flatten->leaves = leaves;
+    }
+    if (columns == NULL || leaves == NULL) {
+      free(path);
+      free(name);
+      return ENOMEM;
+    }
+    walk->capacity = capacity;
+  }
+  column_info_t *column = &flatten->columns[flatten->columns_size];
+  memset(column, 0, sizeof(column_info_t));
+  column->column_name = path;
+  column->output_name = name;
+  column->transformation = TRANSFORM_NONE;
+  flatten->leaves[flatten->columns_size++] = leaf;
+  return 0;
+}
+
+static int is_expanded(const walk_t *walk, avro_schema_t record) {
+  for (size_t i = 0; i < walk->depth; ++i) {
+    if (walk->ancestors[i] == record) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Adds columns of the record, whose path and name are NULL at the top level
+static int flatten_record(walk_t *walk, avro_schema_t record, const char *path,
+                          const char *name) {
+  walk->ancestors[walk->depth++] = record;
+  size_t size = avro_schema_record_size(record);
+  for (size_t i = 0; i < size; ++i) {
+    const char *field_name = avro_schema_record_field_name(record, (int)i);
+    avro_schema_t field = avro_schema_record_field_get_by_index(record, (int)i);
+    char *field_path = join(path, ".", field_name);
+    char *field_output = join(name, walk->separator, field_name);
+    if (field_path == NULL || field_output == NULL) {
+      free(field_path);
+      free(field_output);
+      return ENOMEM;
+    }
+
+    avro_schema_t target = nullable_target(field);
+    if (is_avro_record(target) && walk->depth < FLATTEN_MAX_DEPTH && !is_expanded(walk, target)) {
+      int rval = flatten_record(walk, target, field_path, field_output);
+      free(field_path);
+      free(field_output);
+      CHECKED_EV(rval);
+    } else {
+      CHECKED_EV(add_column(walk, field_path, field_output, field));
+    }
+  }
+  walk->depth--;
+  return 0;
+}
+
+int flatten_new(avro_schema_t record, const char *separator, flatten_t **flatten) {
+  *flatten = NULL;
+  record = nullable_target(record);
+  if (!is_avro_record(record)) {
+    avro_set_error("Can't find root record schema");
+    return EINVAL;
+  }
+
+  walk_t walk;
+  memset(&walk, 0, sizeof(walk_t));
+  walk.separator = separator;
+  walk.flatten = (flatten_t *)calloc(1, sizeof(flatten_t));
+  if (walk.flatten == NULL) {
+    return ENOMEM;
+  }
+  int rval = flatten_record(&walk, record, NULL, NULL);
+  if (rval != 0) {
+    flatten_free(walk.flatten);
+    return rval;
+  }
+  *flatten = walk.flatten;
+  return 0;
+}
+
+void flatten_free(flatten_t *flatten) {
+  for (size_t i = 0; i < flatten->columns_size; ++i) {
+    free(flatten->columns[i].column_name);
+    free(flatten->columns[i].output_name);
+  }
+  free(flatten->columns);
+  free(flatten->leaves);
+  free(flatten);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <avro.h>
+#include <stddef.h>
+
+#include "config.h"
+
+/*
+ * Column layout of --flatten. Fields of nested records, entered through
+ * nullable unions, are expanded into separate columns named by joining the
+ * field names with a separator, e.g. body.user.id becomes body_user_id.
+ * The layout is computed once from the writer schema, and converted as
+ * --columns of nested paths, so that engines don't have to know about it.
+ */
+
+// Default separator of --flatten
+#define DEFAULT_FLATTEN_SEPARATOR "_"
+
+typedef struct {
+  column_info_t *columns; // paths of the leaves, with output names set
+  avro_schema_t *leaves;  // schemas of the leaves, for --show-schema
+  size_t columns_size;
+} flatten_t;
+
+/**
+ * Computes columns of the record schema. Values other than records, e.g.
+ * arrays, maps and unions which aren't nullable, become single columns, as
+ * do records nested in themselves. Returns 0 on success, ENOMEM, or EINVAL
+ * (with Avro error set) when two fields flatten to the same column name.
+ */
+int flatten_new(avro_schema_t record, const char *separator, flatten_t **flatten);
+
+void flatten_free(flatten_t *flatten);
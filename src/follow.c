@@ -0,0 +1,94 @@
+#include <avro.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+#include "follow.h"
+
+// Upper bound of the wait for a change, also when inotify is used, so that
+// a missed event (e.g. on network file systems) only delays the output
+#define FOLLOW_POLL_INTERVAL_MS 1000
+
+struct follow_t {
+  int fd;
+  int inotify_fd; // -1 when polling
+};
+
+int follow_new(const char *path, int fd, follow_t **follow) {
+  follow_t *f = (follow_t *)calloc(1, sizeof(follow_t));
+  if (f == NULL) {
+    return ENOMEM;
+  }
+  f->fd = fd;
+  f->inotify_fd = -1;
+#if defined(__linux__)
+  f->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (f->inotify_fd >= 0 && inotify_add_watch(f->inotify_fd, path, IN_MODIFY) < 0) {
+    close(f->inotify_fd);
+    f->inotify_fd = -1;
+  }
+#else
+  (void)path;
+#endif
+  *follow = f;
+  return 0;
+}
+
+void follow_free(follow_t *follow) {
+  if (follow->inotify_fd >= 0) {
+    close(follow->inotify_fd);
+  }
+  free(follow);
+}
+
+int follow_size(follow_t *follow, int64_t *size) {
+  struct stat st;
+  if (fstat(follow->fd, &st) != 0) {
+    int rval = errno;
+    avro_set_error("Cannot stat followed file: %s", strerror(rval));
+    return rval;
+  }
+  *size = (int64_t)st.st_size;
+  return 0;
+}
+
+// Waits for a modification event, or for the poll interval to pass
+static void wait_change(follow_t *follow) {
+  if (follow->inotify_fd < 0) {
+    poll(NULL, 0, FOLLOW_POLL_INTERVAL_MS);
+    return;
+  }
+  struct pollfd pfd = {.fd = follow->inotify_fd, .events = POLLIN};
+  if (poll(&pfd, 1, FOLLOW_POLL_INTERVAL_MS) > 0) {
+    // Events are only a wake-up, the file size is what counts
+    char events[4096];
+    while (read(follow->inotify_fd, events, sizeof(events)) > 0) {
+    }
+  }
+}
+
+int follow_wait(follow_t *follow, int64_t size) {
+  for (;;) {
+    int64_t current;
+    int rval = follow_size(follow, &current);
+    if (rval != 0) {
+      return rval;
+    }
+    if (current > size) {
+      return 0;
+    }
+    if (current < size) {
+      avro_set_error("Followed file was truncated from %lld to %lld bytes",
+                     (long long)size, (long long)current);
+      return EIO;
+    }
+    wait_change(follow);
+  }
+}
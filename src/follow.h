@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Waiting for a file that is still being appended to, for --follow. Uses
+ * inotify where available, and falls back to polling the file size.
+ */
+
+typedef struct follow_t follow_t;
+
+/**
+ * Starts watching the file at 'path', opened as descriptor 'fd'.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int follow_new(const char *path, int fd, follow_t **follow);
+
+void follow_free(follow_t *follow);
+
+/**
+ * Gets the current size of the file.
+ */
+int follow_size(follow_t *follow, int64_t *size);
+
+/**
+ * Waits until the file grows beyond 'size' bytes. Returns EIO if the file
+ * shrinks, since it was truncated or replaced while being followed.
+ */
+int follow_wait(follow_t *follow, int64_t size);
@@ -0,0 +1,208 @@
+#include <avro.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "format.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+size_t format_int64(char *buf, int64_t value) {
+  char digits[MAX_INT_SIZE];
+  uint64_t u = value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+  size_t count = 0;
+  do {
+    digits[count++] = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+
+  size_t size = 0;
+  if (value < 0) {
+    buf[size++] = '-';
+  }
+  while (count > 0) {
+    buf[size++] = digits[--count];
+  }
+  return size;
+}
+
+size_t format_real(char *buf, double value, int csv) {
+  if (value != value) {
+    memcpy(buf, csv ? "NaN" : "\"NaN\"", csv ? 3 : 5);
+    return csv ? 3 : 5;
+  }
+  if (value - value != value - value) {
+    memcpy(buf, csv ? "Infinity" : "\"Infinity\"", csv ? 8 : 10);
+    return csv ? 8 : 10;
+  }
+
+  int size = snprintf(buf, MAX_REAL_SIZE, "%.17g", value);
+  if (csv) {
+    return (size_t)size;
+  }
+
+  // Keep reals distinguishable from integers
+  if (strpbrk(buf, ".e") == NULL) {
+    memcpy(buf + size, ".0", 2);
+    return (size_t)size + 2;
+  }
+
+  // Drop '+' and leading zeros of the exponent
+  char *exp = strchr(buf, 'e');
+  if (exp != NULL) {
+    char *start = exp + 1, *digits = exp + 1;
+    if (*start == '-') {
+      start++;
+      digits++;
+    } else if (*start == '+') {
+      digits++;
+    }
+    while (*digits == '0' && digits[1] != '\0') {
+      digits++;
+    }
+    if (digits != start) {
+      memmove(start, digits, (size_t)(buf + size - digits) + 1);
+      size -= (int)(digits - start);
+    }
+  }
+  return (size_t)size;
+}
+
+// Decodes a single UTF-8 sequence, rejecting overlong forms and surrogates,
+// as jansson does. Returns its length, or 0 when invalid.
+static size_t utf8_decode(const unsigned char *s, const unsigned char *end,
+                          int32_t *codepoint) {
+  unsigned char first = s[0];
+  size_t size;
+  int32_t value;
+  if (first < 0x80) {
+    *codepoint = first;
+    return 1;
+  } else if (first < 0xc2) {
+    return 0;
+  } else if (first < 0xe0) {
+    size = 2;
+    value = first & 0x1f;
+  } else if (first < 0xf0) {
+    size = 3;
+    value = first & 0x0f;
+  } else if (first < 0xf5) {
+    size = 4;
+    value = first & 0x07;
+  } else {
+    return 0;
+  }
+
+  if ((size_t)(end - s) < size) {
+    return 0;
+  }
+  for (size_t i = 1; i < size; ++i) {
+    if ((s[i] & 0xc0) != 0x80) {
+      return 0;
+    }
+    value = (value << 6) | (s[i] & 0x3f);
+  }
+
+  if ((size == 3 && value < 0x800) || (size == 4 && value < 0x10000) ||
+      value > 0x10ffff || (value >= 0xd800 && value <= 0xdfff)) {
+    return 0;
+  }
+  *codepoint = value;
+  return size;
+}
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static char *write_unicode_escape(char *out, int32_t codepoint) {
+  out[0] = '\\';
+  out[1] = 'u';
+  out[2] = HEX_DIGITS[(codepoint >> 12) & 0xf];
+  out[3] = HEX_DIGITS[(codepoint >> 8) & 0xf];
+  out[4] = HEX_DIGITS[(codepoint >> 4) & 0xf];
+  out[5] = HEX_DIGITS[codepoint & 0xf];
+  return out + 6;
+}
+
+int format_json_chars(char *buf, const char *str, size_t size, size_t *written) {
+  const unsigned char *s = (const unsigned char *)str, *end = s + size;
+  char *out = buf;
+  while (s < end) {
+    // Copy the run of characters that don't need escaping at once
+    const unsigned char *run = s;
+    while (s < end && *s >= 0x20 && *s < 0x80 && *s != '"' && *s != '\\') {
+      s++;
+    }
+    memcpy(out, run, (size_t)(s - run));
+    out += s - run;
+    if (s == end) {
+      break;
+    }
+
+    int32_t codepoint;
+    size_t len = utf8_decode(s, end, &codepoint);
+    if (len == 0) {
+      avro_set_error("Invalid UTF-8 string");
+      return EILSEQ;
+    }
+    s += len;
+
+    switch (codepoint) {
+    case '"': *out++ = '\\'; *out++ = '"'; break;
+    case '\\': *out++ = '\\'; *out++ = '\\'; break;
+    case '\b': *out++ = '\\'; *out++ = 'b'; break;
+    case '\f': *out++ = '\\'; *out++ = 'f'; break;
+    case '\n': *out++ = '\\'; *out++ = 'n'; break;
+    case '\r': *out++ = '\\'; *out++ = 'r'; break;
+    case '\t': *out++ = '\\'; *out++ = 't'; break;
+    default:
+      if (codepoint < 0x10000) {
+        out = write_unicode_escape(out, codepoint);
+      } else {
+        // UTF-16 surrogate pair
+        codepoint -= 0x10000;
+        out = write_unicode_escape(out, 0xd800 | ((codepoint >> 10) & 0x3ff));
+        out = write_unicode_escape(out, 0xdc00 | (codepoint & 0x3ff));
+      }
+    }
+  }
+  *written = (size_t)(out - buf);
+  return 0;
+}
+
+int format_json_string(char *buf, const char *str, size_t size, size_t *written) {
+  buf[0] = '"';
+  CHECKED_EV(format_json_chars(buf + 1, str, size, written));
+  buf[++*written] = '"';
+  ++*written;
+  return 0;
+}
+
+int csv_needs_quotes(const char *str, size_t size) {
+  return memchr(str, '"', size) || memchr(str, ',', size) ||
+         memchr(str, '\n', size) || memchr(str, '\r', size);
+}
+
+size_t format_csv_string(char *buf, const char *str, size_t size) {
+  if (!csv_needs_quotes(str, size)) {
+    memcpy(buf, str, size);
+    return size;
+  }
+  char *out = buf;
+  *out++ = '"';
+  for (size_t i = 0; i < size; ++i) {
+    if (str[i] == '"') {
+      *out++ = '"';
+    }
+    *out++ = str[i];
+  }
+  *out++ = '"';
+  return (size_t)(out - buf);
+}
+
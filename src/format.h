@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Formatting of scalar values, producing the same text as jansson does
+ * (with JSON_ENSURE_ASCII), so that streamed and batch output is identical
+ * to output of jansson trees. Buffers are provided by callers, and must be
+ * large enough for the longest result.
+ */
+
+// Longest formatted integer: "-9223372036854775808"
+#define MAX_INT_SIZE 20
+// Longest formatted real, e.g. "-2.2250738585072014e-308" (with quotes)
+#define MAX_REAL_SIZE 32
+// Guid is formatted as 36 characters (32 nibbles plus 4 hyphens): xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx
+// The byte order is a bit tricky: https://stackoverflow.com/questions/10862171/convert-byte-or-object-to-guid
+#define GUID_FORMAT "%02hhX%02hhX%02hhX%02hhX-%02hhX%02hhX-%02hhX%02hhX-%02hhX%02hhX-%02hhX%02hhX%02hhX%02hhX%02hhX%02hhX"
+#define GUID_ARG(guid) (guid)[3], (guid)[2], (guid)[1], (guid)[0], (guid)[5], (guid)[4], (guid)[7], (guid)[6], (guid)[8], (guid)[9], (guid)[10], (guid)[11], (guid)[12], (guid)[13], (guid)[14], (guid)[15]
+
+// Longest escaped form of a single UTF-8 encoded character (surrogate pair)
+#define MAX_ESCAPED_CHAR_SIZE 12
+
+size_t format_int64(char *buf, int64_t value);
+
+/**
+ * Formats double like jansson's json_real(), or like "%.17g" for CSV.
+ * Infinity and NaN are rendered as strings (quoted in JSON).
+ */
+size_t format_real(char *buf, double value, int csv);
+
+/**
+ * Escapes UTF-8 characters for use in JSON string, without the quotes.
+ * Needs up to 6 * size bytes. Returns EILSEQ (with Avro error set) when
+ * string isn't valid UTF-8.
+ */
+int format_json_chars(char *buf, const char *str, size_t size, size_t *written);
+
+/**
+ * Writes quoted and escaped JSON string. Needs up to 6 * size + 2 bytes.
+ */
+int format_json_string(char *buf, const char *str, size_t size, size_t *written);
+
+/**
+ * Returns whether CSV field must be quoted.
+ */
+int csv_needs_quotes(const char *str, size_t size);
+
+/**
+ * Writes CSV field, quoted only when needed. Needs up to 2 * size + 2 bytes.
+ */
+size_t format_csv_string(char *buf, const char *str, size_t size);
@@ -0,0 +1,248 @@
+#include <avro.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "binary.h"
+#include "index.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+static const char INDEX_MAGIC[8] = {'A', 'V', 'R', 'O', 'I', 'D', 'X', '1'};
+
+// Longest zig-zag varint of a 64-bit number
+#define VARINT_MAX_SIZE 10
+
+int index_add(record_index_t *index, const block_header_t *block) {
+  if (index->entries_count == index->capacity) {
+    size_t capacity = index->capacity > 0 ? index->capacity * 2 : 256;
+    index_entry_t *entries =
+        (index_entry_t *)realloc(index->entries, capacity * sizeof(index_entry_t));
+    if (entries == NULL) {
+      return ENOMEM;
+    }
+    index->entries = entries;
+    index->capacity = capacity;
+  }
+  index_entry_t *entry = &index->entries[index->entries_count];
+  entry->offset = block->offset;
+  entry->first_record = 0;
+  if (index->entries_count > 0) {
+    entry->first_record = entry[-1].first_record + entry[-1].count;
+  }
+  entry->count = block->count;
+  entry->size = block->size;
+  index->entries_count++;
+  return 0;
+}
+
+static size_t write_long(char *buf, int64_t value) {
+  uint64_t n = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+  size_t size = 0;
+  while (n >= 0x80) {
+    buf[size++] = (char)(n | 0x80);
+    n >>= 7;
+  }
+  buf[size++] = (char)n;
+  return size;
+}
+
+// Writes the index to a temporary file, and makes sure it's on disk before
+// it replaces the previous one
+static int write_file(const char *path, const char *content, size_t size) {
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) {
+    return errno;
+  }
+  int rval = fwrite(content, 1, size, fp) < size || fflush(fp) != 0 ? errno : 0;
+#if !defined(_WIN32)
+  if (rval == 0 && fsync(fileno(fp)) != 0) {
+    rval = errno;
+  }
+#endif
+  if (fclose(fp) != 0 && rval == 0) {
+    rval = errno;
+  }
+  return rval;
+}
+
+int index_save(const char *path, const record_index_t *index) {
+  size_t capacity = sizeof(INDEX_MAGIC) + CONTAINER_SYNC_SIZE +
+                    (1 + 4 * index->entries_count) * VARINT_MAX_SIZE;
+  size_t tmp_size = strlen(path) + 5;
+  char *content = (char *)malloc(capacity);
+  char *tmp_path = (char *)malloc(tmp_size);
+  if (content == NULL || tmp_path == NULL) {
+    free(content);
+    free(tmp_path);
+    return ENOMEM;
+  }
+  snprintf(tmp_path, tmp_size, "%s.tmp", path);
+
+  size_t size = 0;
+  memcpy(content, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  size += sizeof(INDEX_MAGIC);
+  memcpy(content + size, index->sync, CONTAINER_SYNC_SIZE);
+  size += CONTAINER_SYNC_SIZE;
+  size += write_long(content + size, (int64_t)index->entries_count);
+  int64_t offset = 0, first_record = 0;
+  for (size_t i = 0; i < index->entries_count; ++i) {
+    const index_entry_t *entry = &index->entries[i];
+    size += write_long(content + size, entry->offset - offset);
+    size += write_long(content + size, entry->first_record - first_record);
+    size += write_long(content + size, entry->count);
+    size += write_long(content + size, entry->size);
+    offset = entry->offset;
+    first_record = entry->first_record;
+  }
+
+  int rval = write_file(tmp_path, content, size);
+#if defined(_WIN32)
+  // rename() doesn't replace an existing file on Windows
+  if (rval == 0) {
+    remove(path);
+  }
+#endif
+  if (rval == 0 && rename(tmp_path, path) != 0) {
+    rval = errno;
+  }
+  if (rval != 0) {
+    avro_set_error("Cannot save index file '%s': %s", path, strerror(rval));
+    remove(tmp_path);
+  }
+  free(content);
+  free(tmp_path);
+  return rval;
+}
+
+static int invalid(const char *path) {
+  avro_set_error("Invalid index file '%s'", path);
+  return EINVAL;
+}
+
+static int read_file(const char *path, char **content, size_t *size) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    if (errno == ENOENT) {
+      return ENOENT;
+    }
+    int rval = errno;
+    avro_set_error("Cannot open index file '%s': %s", path, strerror(rval));
+    return rval;
+  }
+  *content = NULL;
+  *size = 0;
+  size_t capacity = 0;
+  int rval = 0;
+  for (;;) {
+    if (*size == capacity) {
+      capacity = capacity > 0 ? capacity * 2 : 4096;
+      char *grown = (char *)realloc(*content, capacity);
+      if (grown == NULL) {
+        rval = ENOMEM;
+        break;
+      }
+      *content = grown;
+    }
+    size_t read = fread(*content + *size, 1, capacity - *size, fp);
+    *size += read;
+    if (read == 0) {
+      if (ferror(fp)) {
+        rval = EIO;
+        avro_set_error("Cannot read index file '%s'", path);
+      }
+      break;
+    }
+  }
+  fclose(fp);
+  if (rval != 0) {
+    free(*content);
+  }
+  return rval;
+}
+
+int index_load(const char *path, record_index_t *index) {
+  char *content;
+  size_t size;
+  CHECKED_EV(read_file(path, &content, &size));
+
+  memset(index, 0, sizeof(record_index_t));
+  const char *p = content, *end = content + size;
+  int64_t count;
+  int rval = 0;
+  if (size < sizeof(INDEX_MAGIC) + CONTAINER_SYNC_SIZE ||
+      memcmp(p, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+    rval = invalid(path);
+  } else {
+    p += sizeof(INDEX_MAGIC);
+    memcpy(index->sync, p, CONTAINER_SYNC_SIZE);
+    p += CONTAINER_SYNC_SIZE;
+    // Every entry takes at least 4 bytes
+    if (binary_read_long(&p, end, &count) != 0 || count < 0 || count > (end - p) / 4) {
+      rval = invalid(path);
+    }
+  }
+  if (rval == 0 && count > 0) {
+    index->entries = (index_entry_t *)malloc((size_t)count * sizeof(index_entry_t));
+    if (index->entries == NULL) {
+      rval = ENOMEM;
+    }
+    index->capacity = (size_t)count;
+  }
+  int64_t offset = 0, first_record = 0;
+  for (int64_t i = 0; rval == 0 && i < count; ++i) {
+    index_entry_t *entry = &index->entries[i];
+    if (binary_read_long(&p, end, &entry->offset) != 0 ||
+        binary_read_long(&p, end, &entry->first_record) != 0 ||
+        binary_read_long(&p, end, &entry->count) != 0 ||
+        binary_read_long(&p, end, &entry->size) != 0) {
+      rval = invalid(path);
+      break;
+    }
+    entry->offset += offset;
+    entry->first_record += first_record;
+    offset = entry->offset;
+    first_record = entry->first_record;
+    index->entries_count++;
+  }
+  free(content);
+  if (rval != 0) {
+    index_free(index);
+  }
+  return rval;
+}
+
+const index_entry_t *index_find(const record_index_t *index, int64_t record) {
+  if (index->entries_count == 0) {
+    return NULL;
+  }
+  // Blocks are ordered by their first record
+  size_t low = 0, high = index->entries_count;
+  while (high - low > 1) {
+    size_t middle = low + (high - low) / 2;
+    if (index->entries[middle].first_record <= record) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return &index->entries[low];
+}
+
+void index_free(record_index_t *index) {
+  free(index->entries);
+  index->entries = NULL;
+  index->entries_count = 0;
+  index->capacity = 0;
+}
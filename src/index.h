@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "container.h"
+
+/*
+ * Record index of an Avro file, built with --build-index into a sidecar
+ * file <file>.avroidx, so that --rows can seek straight to the block that
+ * holds its first record instead of walking all the block headers before it.
+ *
+ * The sidecar starts with a magic number and the sync marker of the indexed
+ * file, followed by the number of blocks and, for every block, its offset,
+ * first record ordinal, record count and compressed size. Numbers are Avro
+ * longs (zig-zag varints); offsets and ordinals are written as deltas from
+ * the previous block, so most entries take a few bytes.
+ */
+
+#define INDEX_SUFFIX ".avroidx"
+
+typedef struct {
+  int64_t offset;       // file offset where the block starts
+  int64_t first_record; // ordinal of the first record of the block
+  int64_t count;
+  int64_t size; // of the compressed payload
+} index_entry_t;
+
+typedef struct {
+  char sync[CONTAINER_SYNC_SIZE]; // sync marker identifying the indexed file
+  index_entry_t *entries;
+  size_t entries_count;
+  size_t capacity;
+} record_index_t;
+
+/**
+ * Appends the block, which follows the blocks added before.
+ * Returns 0 on success, or ENOMEM.
+ */
+int index_add(record_index_t *index, const block_header_t *block);
+
+/**
+ * Saves the index to 'path', replacing the previous one.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int index_save(const char *path, const record_index_t *index);
+
+/**
+ * Loads the index saved at 'path'.
+ * Returns 0 on success, ENOENT if there's no index, or error code (with Avro
+ * error set) otherwise.
+ */
+int index_load(const char *path, record_index_t *index);
+
+/**
+ * Finds the last block starting at or before the record, or NULL when the
+ * index is empty.
+ */
+const index_entry_t *index_find(const record_index_t *index, int64_t record);
+
+void index_free(record_index_t *index);
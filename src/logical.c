@@ -9,6 +9,14 @@
 #define max(a, b) (((a) > (b)) ? (a) : (b))
 #endif
 
+// Formatting buffers are per-thread, so that files can be converted
+// concurrently (see --serve).
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 decimal_t *decimal_new() {
   decimal_t *value = (decimal_t *)malloc(sizeof(decimal_t));
   if (!value) {
@@ -143,7 +151,7 @@ char *decimal_to_str(decimal_t *value, char **buf, size_t *buf_size) {
 #define NANOS_IN_SEC 1000000000UL
 
 char *epoch_days_to_str(int32_t days) {
-  static char buf[sizeof(MIN_DATE) + 1];
+  static THREAD_LOCAL char buf[sizeof(MIN_DATE) + 1];
 
   struct tm dt = {0};
   dt.tm_year = 70;
@@ -163,7 +171,7 @@ char *epoch_days_to_str(int32_t days) {
 }
 
 char *time_millis_to_str(int32_t millis) {
-  static char buf[sizeof(TIME_MILLIS_EMPTY) + 1];
+  static THREAD_LOCAL char buf[sizeof(TIME_MILLIS_EMPTY) + 1];
 
   if (millis <= 0) {
     return TIME_MILLIS_EMPTY;
@@ -185,7 +193,7 @@ char *time_millis_to_str(int32_t millis) {
 }
 
 char *time_micros_to_str(int64_t micros) {
-  static char buf[sizeof(TIME_MICROS_EMPTY) + 1];
+  static THREAD_LOCAL char buf[sizeof(TIME_MICROS_EMPTY) + 1];
 
   if (micros <= 0) {
     return TIME_MICROS_EMPTY;
@@ -209,7 +217,7 @@ char *time_micros_to_str(int64_t micros) {
 }
 
 char *timestamp_millis_to_str(int64_t millis) {
-  static char buf[sizeof(MIN_DATETIME_MILLIS) + 1];
+  static THREAD_LOCAL char buf[sizeof(MIN_DATETIME_MILLIS) + 1];
 
   struct tm dt = {0};
   dt.tm_year = 70;
@@ -233,7 +241,7 @@ char *timestamp_millis_to_str(int64_t millis) {
 }
 
 char *timestamp_micros_to_str(int64_t micros) {
-  static char buf[sizeof(MIN_DATETIME_MICROS) + 1];
+  static THREAD_LOCAL char buf[sizeof(MIN_DATETIME_MICROS) + 1];
 
   struct tm dt = {0};
   dt.tm_year = 70;
@@ -257,15 +265,16 @@ char *timestamp_micros_to_str(int64_t micros) {
 }
 
 char *epoch_nanos_to_utc_str(int64_t nanos_since_epoch) {
-    static char buf[45];
+    static THREAD_LOCAL char buf[45];
 
     struct tm dt = {0};
     dt.tm_year = 70;
     dt.tm_mon = 0;
     dt.tm_mday = 1;
-    dt.tm_sec = (int32_t)(nanos_since_epoch / NANOS_IN_SEC);
+    int64_t secs = nanos_since_epoch / NANOS_IN_SEC;
+    dt.tm_sec = (int32_t)secs;
 
-    if (mktime(&dt) == -1) {
+    if (secs != dt.tm_sec || mktime(&dt) == -1) {
         if (nanos_since_epoch < 0) {
           return MIN_DATETIME_UTC;
         }
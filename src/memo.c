@@ -0,0 +1,62 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "memo.h"
+
+static size_t slot_of(const void *key, size_t key_size) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < key_size; ++i) {
+    hash = (hash ^ ((const unsigned char *)key)[i]) * 16777619u;
+  }
+  return (hash ^ (hash >> 16)) % MEMO_SLOTS;
+}
+
+static int matches(const memo_entry_t *entry, avro_schema_t schema, const void *key,
+                   size_t key_size) {
+  return entry->key_size == key_size && entry->schema == schema &&
+         memcmp(entry->key, key, key_size) == 0;
+}
+
+memo_t *memo_new(void) {
+  return (memo_t *)calloc(1, sizeof(memo_t));
+}
+
+void memo_free(memo_t *memo) {
+  free(memo);
+}
+
+const char *memo_get(memo_t *memo, avro_schema_t schema, const void *key, size_t key_size) {
+  if (memo == NULL || key_size == 0 || key_size > MEMO_KEY_SIZE) {
+    return NULL;
+  }
+  memo->lookups++;
+  if (memo->last != NULL && matches(memo->last, schema, key, key_size)) {
+    memo->hits++;
+    return memo->last->text;
+  }
+  const memo_entry_t *entry = &memo->entries[slot_of(key, key_size)];
+  if (!matches(entry, schema, key, key_size)) {
+    return NULL;
+  }
+  memo->hits++;
+  memo->last = entry;
+  return entry->text;
+}
+
+void memo_put(memo_t *memo, avro_schema_t schema, const void *key, size_t key_size,
+              const char *text) {
+  if (memo == NULL || key_size == 0 || key_size > MEMO_KEY_SIZE) {
+    return;
+  }
+  size_t text_size = strlen(text);
+  if (text_size >= MEMO_TEXT_SIZE) {
+    return;
+  }
+  memo_entry_t *entry = &memo->entries[slot_of(key, key_size)];
+  entry->schema = schema;
+  entry->key_size = key_size;
+  memcpy(entry->key, key, key_size);
+  memcpy(entry->text, text, text_size + 1);
+  memo->last = entry;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <avro.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Memoization of formatted values of a column. Dates, times, timestamps,
+ * decimals and GUIDs are expensive to format and often repeat within a
+ * column, so their text is remembered by raw value: the last value hit is
+ * checked first, then a small direct-mapped table indexed by a hash of the
+ * value. Values are keyed by their schema too, since a column may hold values
+ * of several types, which are formatted differently.
+ *
+ * Raw values and texts too large for an entry aren't memoized.
+ */
+
+#define MEMO_SLOTS 64
+#define MEMO_KEY_SIZE 16
+// Longest memoized text, including the terminating null
+#define MEMO_TEXT_SIZE 48
+
+typedef struct {
+  avro_schema_t schema;
+  size_t key_size; // 0 for empty entries
+  unsigned char key[MEMO_KEY_SIZE];
+  char text[MEMO_TEXT_SIZE];
+} memo_entry_t;
+
+typedef struct {
+  const memo_entry_t *last; // entry of the last hit or insertion
+  memo_entry_t entries[MEMO_SLOTS];
+  uint64_t lookups;
+  uint64_t hits;
+} memo_t;
+
+memo_t *memo_new(void);
+
+void memo_free(memo_t *memo);
+
+/**
+ * Gets the text of the raw value of the given schema, or NULL when it's not
+ * memoized. 'memo' may be NULL, when nothing is ever found.
+ */
+const char *memo_get(memo_t *memo, avro_schema_t schema, const void *key, size_t key_size);
+
+/**
+ * Remembers the text of the raw value, replacing the entry of its slot.
+ * Does nothing when 'memo' is NULL.
+ */
+void memo_put(memo_t *memo, avro_schema_t schema, const void *key, size_t key_size,
+              const char *text);
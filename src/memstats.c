@@ -0,0 +1,173 @@
+#include <avro.h>
+#include <errno.h>
+#include <gmp.h>
+#include <inttypes.h>
+#include <jansson.h>
+#include <malloc.h>
+#include <stdatomic.h>
+
+#include "memstats.h"
+
+typedef struct {
+  atomic_uint_fast64_t allocations;
+  atomic_uint_fast64_t bytes;
+  atomic_int_fast64_t live;
+  atomic_int_fast64_t peak[MEM_SCOPES];
+} counters_t;
+
+static counters_t subsystems[MEM_SUBSYSTEMS];
+static counters_t total;
+
+static const char *const SUBSYSTEM_NAMES[MEM_SUBSYSTEMS] = {"avro", "json", "decimal", "output"};
+
+static void raise_peak(atomic_int_fast64_t *peak, int64_t live) {
+  int_fast64_t current = atomic_load_explicit(peak, memory_order_relaxed);
+  while (live > current &&
+         !atomic_compare_exchange_weak_explicit(peak, &current, live, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+static void update(counters_t *counters, size_t old_size, size_t new_size) {
+  if (new_size > 0) {
+    atomic_fetch_add_explicit(&counters->allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counters->bytes, new_size, memory_order_relaxed);
+  }
+  int64_t delta = (int64_t)new_size - (int64_t)old_size;
+  int64_t live = atomic_fetch_add_explicit(&counters->live, delta, memory_order_relaxed) + delta;
+  if (delta > 0) {
+    for (int scope = 0; scope < MEM_SCOPES; ++scope) {
+      raise_peak(&counters->peak[scope], live);
+    }
+  }
+}
+
+static void account(mem_subsystem_t subsystem, size_t old_size, size_t new_size) {
+  update(&subsystems[subsystem], old_size, new_size);
+  update(&total, old_size, new_size);
+}
+
+void *memstats_realloc(mem_subsystem_t subsystem, void *ptr, size_t size) {
+  if (size == 0) {
+    memstats_free(subsystem, ptr);
+    return NULL;
+  }
+  size_t old_size = ptr != NULL ? malloc_usable_size(ptr) : 0;
+  void *result = realloc(ptr, size);
+  if (result != NULL) {
+    account(subsystem, old_size, malloc_usable_size(result));
+  }
+  return result;
+}
+
+void memstats_free(mem_subsystem_t subsystem, void *ptr) {
+  if (ptr != NULL) {
+    account(subsystem, malloc_usable_size(ptr), 0);
+    free(ptr);
+  }
+}
+
+/*
+ * Allocator hooks
+ */
+
+static void *avro_allocator(void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud;
+  (void)osize;
+  return memstats_realloc(MEM_AVRO, ptr, nsize);
+}
+
+static void *json_malloc(size_t size) {
+  return memstats_realloc(MEM_JSON, NULL, size);
+}
+
+static void json_free(void *ptr) {
+  memstats_free(MEM_JSON, ptr);
+}
+
+static void *gmp_malloc(size_t size) {
+  return memstats_realloc(MEM_DECIMAL, NULL, size);
+}
+
+static void *gmp_realloc(void *ptr, size_t old_size, size_t new_size) {
+  (void)old_size;
+  return memstats_realloc(MEM_DECIMAL, ptr, new_size);
+}
+
+static void gmp_free(void *ptr, size_t size) {
+  (void)size;
+  memstats_free(MEM_DECIMAL, ptr);
+}
+
+void memstats_install(void) {
+  avro_set_allocator(avro_allocator, NULL);
+  json_set_alloc_funcs(json_malloc, json_free);
+  mp_set_memory_functions(gmp_malloc, gmp_realloc, gmp_free);
+}
+
+/*
+ * Reporting
+ */
+
+static void load(const counters_t *counters, mem_counters_t *result) {
+  result->allocations = atomic_load_explicit(&counters->allocations, memory_order_relaxed);
+  result->bytes = atomic_load_explicit(&counters->bytes, memory_order_relaxed);
+  result->live = atomic_load_explicit(&counters->live, memory_order_relaxed);
+  for (int scope = 0; scope < MEM_SCOPES; ++scope) {
+    result->peak[scope] = atomic_load_explicit(&counters->peak[scope], memory_order_relaxed);
+  }
+}
+
+static void reset_peak(counters_t *counters, mem_scope_t scope) {
+  atomic_store_explicit(&counters->peak[scope],
+                        atomic_load_explicit(&counters->live, memory_order_relaxed),
+                        memory_order_relaxed);
+}
+
+void memstats_begin(mem_scope_t scope, mem_snapshot_t *start) {
+  for (int i = 0; i < MEM_SUBSYSTEMS; ++i) {
+    reset_peak(&subsystems[i], scope);
+    load(&subsystems[i], &start->subsystems[i]);
+  }
+  reset_peak(&total, scope);
+  load(&total, &start->total);
+}
+
+static void print_counters(FILE *dest, mem_scope_t scope, const mem_counters_t *start,
+                           const mem_counters_t *now) {
+  fprintf(dest,
+          "\"allocations\":%" PRIu64 ",\"bytes\":%" PRIu64 ",\"start_live_bytes\":%" PRId64
+          ",\"live_bytes\":%" PRId64 ",\"peak_live_bytes\":%" PRId64,
+          now->allocations - start->allocations, now->bytes - start->bytes, start->live,
+          now->live, now->peak[scope]);
+}
+
+int memstats_report(FILE *dest, mem_scope_t scope, const char *file, int64_t block,
+                    const mem_snapshot_t *start) {
+  mem_snapshot_t now;
+  for (int i = 0; i < MEM_SUBSYSTEMS; ++i) {
+    load(&subsystems[i], &now.subsystems[i]);
+  }
+  load(&total, &now.total);
+
+  fprintf(dest, "{\"mem_stats\":\"%s\",\"file\":\"", scope == MEM_SCOPE_FILE ? "file" : "block");
+  for (const char *c = file; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', dest);
+    }
+    fputc(*c, dest);
+  }
+  fputs("\",", dest);
+  if (scope == MEM_SCOPE_BLOCK) {
+    fprintf(dest, "\"block\":%" PRId64 ",", block);
+  }
+  print_counters(dest, scope, &start->total, &now.total);
+  fputs(",\"subsystems\":{", dest);
+  for (int i = 0; i < MEM_SUBSYSTEMS; ++i) {
+    fprintf(dest, "%s\"%s\":{", i > 0 ? "," : "", SUBSYSTEM_NAMES[i]);
+    print_counters(dest, scope, &start->subsystems[i], &now.subsystems[i]);
+    fputc('}', dest);
+  }
+  fputs("}}\n", dest);
+  return ferror(dest) ? EIO : 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Allocation accounting of --mem-stats. Allocators of Avro, jansson and GMP
+ * are replaced by counting ones, and output buffers are allocated through
+ * memstats_realloc(), so that allocations are attributed to the subsystem
+ * which made them. Sizes are taken from malloc_usable_size(), which is why
+ * this is only available on Linux; elsewhere memstats_realloc() and
+ * memstats_free() are plain realloc() and free().
+ *
+ * Counters are process wide, and updated atomically, so allocations made by
+ * --format-threads are included.
+ */
+
+typedef enum {
+  MEM_AVRO,    // schemas, generic values and codecs of the Avro library
+  MEM_JSON,    // jansson values of row conversion
+  MEM_DECIMAL, // GMP numbers of decimal formatting
+  MEM_OUTPUT,  // output and column buffers
+  MEM_SUBSYSTEMS
+} mem_subsystem_t;
+
+// Peaks are tracked separately since the start of the file and of the block
+typedef enum { MEM_SCOPE_FILE, MEM_SCOPE_BLOCK, MEM_SCOPES } mem_scope_t;
+
+typedef struct {
+  uint64_t allocations; // including reallocations
+  uint64_t bytes;       // allocated, not taking frees into account
+  int64_t live;         // bytes allocated and not freed yet
+  int64_t peak[MEM_SCOPES];
+} mem_counters_t;
+
+typedef struct {
+  mem_counters_t subsystems[MEM_SUBSYSTEMS];
+  mem_counters_t total;
+} mem_snapshot_t;
+
+#if defined(__linux__)
+
+/**
+ * Replaces allocators of Avro, jansson and GMP by counting ones, once
+ * --mem-stats is parsed. Sizes are taken from malloc_usable_size(), so memory
+ * allocated before can be freed through the counting allocators too.
+ */
+void memstats_install(void);
+
+void *memstats_realloc(mem_subsystem_t subsystem, void *ptr, size_t size);
+
+void memstats_free(mem_subsystem_t subsystem, void *ptr);
+
+/**
+ * Resets peaks of the scope to the bytes live now, and takes a snapshot of
+ * counters for memstats_report().
+ */
+void memstats_begin(mem_scope_t scope, mem_snapshot_t *start);
+
+/**
+ * Writes a JSON line with allocations made since memstats_begin(), live
+ * bytes then and now, and the peak of live bytes of the scope, in total and
+ * by subsystem. 'block' is the
+ * index of the block in the file, ignored for MEM_SCOPE_FILE.
+ */
+int memstats_report(FILE *dest, mem_scope_t scope, const char *file, int64_t block,
+                    const mem_snapshot_t *start);
+
+#else
+#define memstats_realloc(subsystem, ptr, size) realloc(ptr, size)
+#define memstats_free(subsystem, ptr) free(ptr)
+#endif
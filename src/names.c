@@ -0,0 +1,226 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary.h"
+#include "format.h"
+#include "names.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+name_text_t *names_render(const char *const *strings, size_t count, int fields) {
+  size_t capacity = count * sizeof(name_text_t);
+  for (size_t i = 0; i < count; ++i) {
+    capacity += 6 * strlen(strings[i]) + 3;
+  }
+  name_text_t *texts = (name_text_t *)malloc(capacity > 0 ? capacity : 1);
+  if (texts == NULL) {
+    return NULL;
+  }
+  char *buf = (char *)(texts + count);
+  for (size_t i = 0; i < count; ++i) {
+    size_t written;
+    if (format_json_string(buf, strings[i], strlen(strings[i]), &written) != 0) {
+      free(texts);
+      return NULL;
+    }
+    if (fields) {
+      buf[written++] = ':';
+    }
+    texts[i].data = buf;
+    texts[i].size = written;
+    buf += written;
+  }
+  return texts;
+}
+
+static size_t slot_of(const names_t *names, avro_schema_t schema) {
+  // Fibonacci hashing of the address
+  uint64_t hash = (uint64_t)(uintptr_t)schema * UINT64_C(0x9e3779b97f4a7c15);
+  return (size_t)(hash >> 32) & (names->capacity - 1);
+}
+
+const name_text_t *names_get(const names_t *names, avro_schema_t schema) {
+  if (names == NULL) {
+    return NULL;
+  }
+  for (size_t i = slot_of(names, schema);; i = (i + 1) & (names->capacity - 1)) {
+    const names_entry_t *entry = &names->entries[i];
+    if (entry->schema == schema || entry->schema == NULL) {
+      return entry->texts;
+    }
+  }
+}
+
+static int is_added(const names_t *names, avro_schema_t schema) {
+  for (size_t i = slot_of(names, schema);; i = (i + 1) & (names->capacity - 1)) {
+    if (names->entries[i].schema == schema) {
+      return 1;
+    }
+    if (names->entries[i].schema == NULL) {
+      return 0;
+    }
+  }
+}
+
+static void insert(names_t *names, avro_schema_t schema, name_text_t *texts) {
+  size_t i = slot_of(names, schema);
+  while (names->entries[i].schema != NULL) {
+    i = (i + 1) & (names->capacity - 1);
+  }
+  names->entries[i].schema = schema;
+  names->entries[i].texts = texts;
+  names->count++;
+}
+
+// Keeps the table at most half full, so that probing stays short
+static int add(names_t *names, avro_schema_t schema, name_text_t *texts) {
+  if (2 * (names->count + 1) > names->capacity) {
+    names_t grown = {NULL, names->capacity * 2, 0};
+    grown.entries = (names_entry_t *)calloc(grown.capacity, sizeof(names_entry_t));
+    if (grown.entries == NULL) {
+      free(texts);
+      return ENOMEM;
+    }
+    for (size_t i = 0; i < names->capacity; ++i) {
+      if (names->entries[i].schema != NULL) {
+        insert(&grown, names->entries[i].schema, names->entries[i].texts);
+      }
+    }
+    free(names->entries);
+    *names = grown;
+  }
+  insert(names, schema, texts);
+  return 0;
+}
+
+// Renders the names of a record or enum. Schemas whose names can't be
+// rendered are still added, without texts, so they're visited once.
+static int add_names(names_t *names, avro_schema_t schema, int is_record) {
+  size_t count = is_record ? avro_schema_record_size(schema)
+                           : (size_t)avro_schema_enum_number_of_symbols(schema);
+  const char **strings = (const char **)malloc((count + 1) * sizeof(const char *));
+  if (strings == NULL) {
+    return ENOMEM;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    strings[i] = is_record ? avro_schema_record_field_name(schema, (int)i)
+                           : avro_schema_enum_get(schema, (int)i);
+  }
+  name_text_t *texts = names_render(strings, count, is_record);
+  free(strings);
+  return add(names, schema, texts);
+}
+
+static int walk(names_t *names, avro_schema_t schema) {
+  schema = binary_resolve_schema(schema);
+  switch (avro_typeof(schema)) {
+  case AVRO_RECORD: {
+    if (is_added(names, schema)) {
+      return 0;
+    }
+    CHECKED_EV(add_names(names, schema, 1));
+    size_t fields_count = avro_schema_record_size(schema);
+    for (size_t i = 0; i < fields_count; ++i) {
+      CHECKED_EV(walk(names, avro_schema_record_field_get_by_index(schema, (int)i)));
+    }
+    return 0;
+  }
+
+  case AVRO_ENUM:
+    return is_added(names, schema) ? 0 : add_names(names, schema, 0);
+
+  case AVRO_ARRAY:
+    return walk(names, avro_schema_array_items(schema));
+
+  case AVRO_MAP:
+    return walk(names, avro_schema_map_values(schema));
+
+  case AVRO_UNION: {
+    size_t branches = avro_schema_union_size(schema);
+    for (size_t i = 0; i < branches; ++i) {
+      CHECKED_EV(walk(names, avro_schema_union_branch(schema, (int)i)));
+    }
+    return 0;
+  }
+
+  default:
+    return 0;
+  }
+}
+
+int names_new(avro_schema_t schema, names_t **result) {
+  names_t *names = (names_t *)calloc(1, sizeof(names_t));
+  if (names == NULL) {
+    return ENOMEM;
+  }
+  names->capacity = 16;
+  names->entries = (names_entry_t *)calloc(names->capacity, sizeof(names_entry_t));
+  int rval = names->entries != NULL ? walk(names, schema) : ENOMEM;
+  if (rval != 0) {
+    names_free(names);
+    return rval;
+  }
+  *result = names;
+  return 0;
+}
+
+void names_free(names_t *names) {
+  if (names == NULL) {
+    return;
+  }
+  if (names->entries != NULL) {
+    for (size_t i = 0; i < names->capacity; ++i) {
+      free(names->entries[i].texts);
+    }
+    free(names->entries);
+  }
+  free(names);
+}
+
+/*
+ * Map keys
+ */
+
+key_cache_t *key_cache_new(void) {
+  return (key_cache_t *)calloc(1, sizeof(key_cache_t));
+}
+
+void key_cache_free(key_cache_t *cache) {
+  free(cache);
+}
+
+int key_cache_get(key_cache_t *cache, const char *key, size_t key_size, const char **text,
+                  size_t *text_size) {
+  if (key_size > KEY_CACHE_KEY_SIZE) {
+    *text = NULL;
+    return 0;
+  }
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < key_size; ++i) {
+    hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+  }
+  key_cache_entry_t *entry = &cache->entries[(hash ^ (hash >> 16)) % KEY_CACHE_SLOTS];
+  if (entry->text_size == 0 || entry->key_size != key_size ||
+      memcmp(entry->key, key, key_size) != 0) {
+    size_t written;
+    entry->text_size = 0;
+    CHECKED_EV(format_json_string(entry->text, key, key_size, &written));
+    entry->text[written++] = ':';
+    entry->key_size = key_size;
+    memcpy(entry->key, key, key_size);
+    entry->text_size = written;
+  }
+  *text = entry->text;
+  *text_size = entry->text_size;
+  return 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <avro.h>
+#include <stddef.h>
+
+/*
+ * JSON text of names that come from the schema, rendered once per schema
+ * instead of escaped for every value: the "name": prefixes of the fields of
+ * every record, and the quoted symbols of every enum. Records and enums are
+ * found by schema in a small open addressing table.
+ *
+ * Map keys come from the data, so they're interned in a direct-mapped cache
+ * of their rendered "key": text instead, since maps usually repeat a few keys
+ * in every record.
+ *
+ * Names that aren't valid UTF-8 aren't rendered, so that writing them reports
+ * the error as usual.
+ */
+
+typedef struct {
+  const char *data;
+  size_t size;
+} name_text_t;
+
+typedef struct {
+  avro_schema_t schema; // record or enum, NULL for empty slots
+  name_text_t *texts;   // of every field or symbol
+} names_entry_t;
+
+typedef struct {
+  names_entry_t *entries;
+  size_t capacity; // power of two
+  size_t count;
+} names_t;
+
+#define KEY_CACHE_SLOTS 128
+// Longest interned map key
+#define KEY_CACHE_KEY_SIZE 24
+
+typedef struct {
+  size_t key_size;
+  size_t text_size; // 0 for empty entries
+  char key[KEY_CACHE_KEY_SIZE];
+  char text[6 * KEY_CACHE_KEY_SIZE + 3];
+} key_cache_entry_t;
+
+typedef struct {
+  key_cache_entry_t entries[KEY_CACHE_SLOTS];
+} key_cache_t;
+
+/**
+ * Renders the names of all records and enums reachable from the schema.
+ * Returns 0 on success, or ENOMEM.
+ */
+int names_new(avro_schema_t schema, names_t **result);
+
+void names_free(names_t *names);
+
+/**
+ * Gets the texts of the fields of the record, or the symbols of the enum, or
+ * NULL when they aren't rendered.
+ */
+const name_text_t *names_get(const names_t *names, avro_schema_t schema);
+
+/**
+ * Renders the strings as field name prefixes, when 'fields' is set, or as
+ * quoted strings otherwise. The result is a single allocation, released with
+ * free(). Returns NULL when out of memory or a string isn't valid UTF-8.
+ */
+name_text_t *names_render(const char *const *strings, size_t count, int fields);
+
+key_cache_t *key_cache_new(void);
+
+void key_cache_free(key_cache_t *cache);
+
+/**
+ * Gets the "key": text of the map key, rendering it on a miss. Sets '*text'
+ * to NULL when the key is too long to intern. Returns 0 on success, or
+ * EILSEQ (with Avro error set) when the key isn't valid UTF-8.
+ */
+int key_cache_get(key_cache_t *cache, const char *key, size_t key_size, const char **text,
+                  size_t *text_size);
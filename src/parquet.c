@@ -0,0 +1,1115 @@
+#include <avro.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avro_private.h"
+#include "binary.h"
+#include "logical.h"
+#include "parquet.h"
+#include "path.h"
+#include "stream.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+#define PARQUET_MAGIC "PAR1"
+#define PARQUET_CREATED_BY "avro2json"
+
+// Dictionary of a column chunk larger than this falls back to plain encoding
+#define PARQUET_MAX_DICTIONARY_SIZE (1024 * 1024)
+// Row groups are written early when their buffers grow larger than this,
+// so that page sizes stay well within 32 bits
+#define PARQUET_MAX_ROW_GROUP_BYTES ((size_t)512 * 1024 * 1024)
+
+// Physical types
+enum {
+  PT_BOOLEAN = 0,
+  PT_INT32 = 1,
+  PT_INT64 = 2,
+  PT_FLOAT = 4,
+  PT_DOUBLE = 5,
+  PT_BYTE_ARRAY = 6,
+  PT_FIXED_LEN_BYTE_ARRAY = 7
+};
+
+// Converted (logical) types
+enum {
+  CT_NONE = -1,
+  CT_UTF8 = 0,
+  CT_DECIMAL = 5,
+  CT_DATE = 6,
+  CT_TIME_MILLIS = 7,
+  CT_TIME_MICROS = 8,
+  CT_TIMESTAMP_MILLIS = 9,
+  CT_TIMESTAMP_MICROS = 10,
+  CT_JSON = 19,
+  CT_INTERVAL = 21
+};
+
+enum { ENC_PLAIN = 0, ENC_PLAIN_DICTIONARY = 2, ENC_RLE = 3 };
+
+enum { PAGE_DATA = 0, PAGE_DICTIONARY = 2 };
+
+enum { CODEC_UNCOMPRESSED = 0, CODEC_SNAPPY = 1, CODEC_GZIP = 2 };
+
+enum { REQUIRED = 0, OPTIONAL = 1 };
+
+// Thrift compact protocol types
+enum {
+  TC_TRUE = 1,
+  TC_FALSE = 2,
+  TC_I32 = 5,
+  TC_I64 = 6,
+  TC_BINARY = 8,
+  TC_LIST = 9,
+  TC_STRUCT = 12
+};
+
+// How values of a column are decoded
+enum value_kind {
+  VK_NULL,
+  VK_BOOLEAN,
+  VK_INT,
+  VK_LONG,
+  VK_FLOAT,
+  VK_DOUBLE,
+  VK_BYTES, // string, bytes or decimal bytes
+  VK_ENUM,
+  VK_FIXED,
+  VK_JSON
+};
+
+/*
+ * Growable byte buffer, which remembers allocation failures so that
+ * encoders don't need to check every write
+ */
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+  int failed;
+} buf_t;
+
+static char *buf_reserve(buf_t *buf, size_t size) {
+  if (buf->size + size > buf->capacity) {
+    size_t capacity = buf->capacity > 0 ? buf->capacity : 256;
+    while (capacity < buf->size + size) {
+      capacity *= 2;
+    }
+    char *data = buf->failed ? NULL : (char *)realloc(buf->data, capacity);
+    if (data == NULL) {
+      buf->failed = 1;
+      return NULL;
+    }
+    buf->data = data;
+    buf->capacity = capacity;
+  }
+  return buf->data + buf->size;
+}
+
+static void buf_append(buf_t *buf, const void *data, size_t size) {
+  char *dest = buf_reserve(buf, size);
+  if (dest != NULL) {
+    memcpy(dest, data, size);
+    buf->size += size;
+  }
+}
+
+static void buf_byte(buf_t *buf, unsigned char byte) {
+  buf_append(buf, &byte, 1);
+}
+
+static void buf_u32(buf_t *buf, uint32_t value) {
+  unsigned char bytes[4] = {(unsigned char)value, (unsigned char)(value >> 8),
+                            (unsigned char)(value >> 16), (unsigned char)(value >> 24)};
+  buf_append(buf, bytes, 4);
+}
+
+static void buf_u64(buf_t *buf, uint64_t value) {
+  buf_u32(buf, (uint32_t)value);
+  buf_u32(buf, (uint32_t)(value >> 32));
+}
+
+static void buf_varint(buf_t *buf, uint64_t value) {
+  while (value >= 0x80) {
+    buf_byte(buf, (unsigned char)(value | 0x80));
+    value >>= 7;
+  }
+  buf_byte(buf, (unsigned char)value);
+}
+
+static void buf_free(buf_t *buf) {
+  free(buf->data);
+  memset(buf, 0, sizeof(buf_t));
+}
+
+/*
+ * Thrift compact protocol, enough to write page headers and file metadata
+ */
+
+#define THRIFT_MAX_DEPTH 8
+
+typedef struct {
+  buf_t *buf;
+  int16_t last_id[THRIFT_MAX_DEPTH];
+  int depth;
+} thrift_t;
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static void tc_field(thrift_t *t, int16_t id, int type) {
+  int delta = id - t->last_id[t->depth];
+  if (delta > 0 && delta <= 15) {
+    buf_byte(t->buf, (unsigned char)(delta << 4 | type));
+  } else {
+    buf_byte(t->buf, (unsigned char)type);
+    buf_varint(t->buf, zigzag(id));
+  }
+  t->last_id[t->depth] = id;
+}
+
+static void tc_i32(thrift_t *t, int16_t id, int32_t value) {
+  tc_field(t, id, TC_I32);
+  buf_varint(t->buf, zigzag(value));
+}
+
+static void tc_i64(thrift_t *t, int16_t id, int64_t value) {
+  tc_field(t, id, TC_I64);
+  buf_varint(t->buf, zigzag(value));
+}
+
+static void tc_string(thrift_t *t, int16_t id, const char *str) {
+  tc_field(t, id, TC_BINARY);
+  buf_varint(t->buf, strlen(str));
+  buf_append(t->buf, str, strlen(str));
+}
+
+static void tc_list(thrift_t *t, int16_t id, int element_type, size_t size) {
+  tc_field(t, id, TC_LIST);
+  if (size < 15) {
+    buf_byte(t->buf, (unsigned char)(size << 4 | element_type));
+  } else {
+    buf_byte(t->buf, (unsigned char)(0xf0 | element_type));
+    buf_varint(t->buf, size);
+  }
+}
+
+// Starts a struct, either as a field (id > 0) or as a list element
+static void tc_struct_begin(thrift_t *t, int16_t id) {
+  if (id > 0) {
+    tc_field(t, id, TC_STRUCT);
+  }
+  t->last_id[++t->depth] = 0;
+}
+
+static void tc_struct_end(thrift_t *t) {
+  buf_byte(t->buf, 0);
+  t->depth--;
+}
+
+/*
+ * RLE / bit-packing hybrid encoding
+ */
+
+typedef uint32_t (*value_getter_t)(const void *values, size_t i);
+
+static uint32_t get_level(const void *values, size_t i) {
+  return ((const uint8_t *)values)[i];
+}
+
+static uint32_t get_index(const void *values, size_t i) {
+  uint32_t index;
+  memcpy(&index, (const char *)values + 4 * i, 4);
+  return index;
+}
+
+static size_t run_length(const void *values, value_getter_t get, size_t i, size_t count) {
+  uint32_t value = get(values, i);
+  size_t run = 1;
+  while (i + run < count && get(values, i + run) == value) {
+    run++;
+  }
+  return run;
+}
+
+// Packs values [start, end) LSB first, padded with zeros to 'padded' values
+static void bit_pack(buf_t *out, const void *values, value_getter_t get, size_t start,
+                     size_t end, size_t padded, int bit_width) {
+  uint64_t acc = 0;
+  int bits = 0;
+  for (size_t i = start; i < start + padded; ++i) {
+    acc |= (uint64_t)(i < end ? get(values, i) : 0) << bits;
+    bits += bit_width;
+    while (bits >= 8) {
+      buf_byte(out, (unsigned char)acc);
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  if (bits > 0) {
+    buf_byte(out, (unsigned char)acc);
+  }
+}
+
+static void rle_encode(buf_t *out, const void *values, value_getter_t get, size_t count,
+                       int bit_width) {
+  size_t i = 0;
+  while (i < count) {
+    size_t run = run_length(values, get, i, count);
+    if (run >= 8) {
+      uint32_t value = get(values, i);
+      buf_varint(out, (uint64_t)run << 1);
+      for (int shift = 0; shift < bit_width; shift += 8) {
+        buf_byte(out, (unsigned char)(value >> shift));
+      }
+      i += run;
+      continue;
+    }
+    // Groups of 8 bit-packed values, up to where a long enough run starts.
+    // Only the last group may be padded, as readers know the value count.
+    size_t start = i;
+    do {
+      i += 8;
+    } while (i < count && run_length(values, get, i, count) < 8);
+    size_t end = i < count ? i : count;
+    buf_varint(out, (uint64_t)((i - start) / 8) << 1 | 1);
+    bit_pack(out, values, get, start, end, i - start, bit_width);
+    i = end;
+  }
+}
+
+static int bit_width(uint32_t max_value) {
+  int width = 1;
+  while (width < 32 && (max_value >> width) != 0) {
+    width++;
+  }
+  return width;
+}
+
+/*
+ * Page compression
+ */
+
+static uint32_t gzip_crc32(const char *data, size_t size) {
+  static uint32_t table[256];
+  static int initialized = 0;
+  if (!initialized) {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    initialized = 1;
+  }
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ (unsigned char)data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffff;
+}
+
+/*
+ * Columns
+ */
+
+typedef struct {
+  uint64_t hash;
+  uint32_t offset; // of the value in dictionary buffer
+  uint32_t size;
+} dict_entry_t;
+
+// Metadata of a column chunk written to the file
+typedef struct {
+  int64_t file_offset;
+  int64_t data_page_offset;
+  int64_t dictionary_page_offset; // -1 if there's no dictionary page
+  int64_t uncompressed_size;
+  int64_t compressed_size;
+  int64_t num_values;
+  int dictionary;
+} chunk_meta_t;
+
+typedef struct {
+  int64_t num_rows;
+  int64_t total_byte_size;
+  chunk_meta_t *chunks;
+} row_group_meta_t;
+
+typedef struct {
+  const char *name;
+  avro_schema_t schema; // schema of the field
+  avro_schema_t value;  // schema of non-null values
+  int null_branch;      // branch of null in a nullable union, or -1
+  enum value_kind kind;
+  int physical_type;
+  int converted_type;
+  int type_length; // of fixed length byte arrays
+  int scale;
+  int precision;
+  int repetition;
+
+  // Row group being buffered
+  buf_t levels; // definition level of every row, for optional columns
+  buf_t values; // plain encoded values, or dictionary indices
+  int dictionary_encoded;
+  buf_t dictionary; // plain encoded distinct values
+  dict_entry_t *entries;
+  size_t entries_count;
+  int32_t *slots; // hash table of entry indices, -1 for empty slots
+  size_t slots_count;
+} column_t;
+
+struct parquet_t {
+  config_t conf; // copy without --columns, for the JSON columns
+  FILE *dest;
+  int64_t offset;
+  avro_schema_t record;
+  size_t fields_count;
+  int *field_columns; // column of every field, or -1 if it isn't written
+  column_t *columns;
+  size_t columns_count;
+  stream_t *json;
+
+  size_t rows;     // rows in current row group
+  size_t buffered; // bytes in current row group
+  size_t row_group_size;
+  int64_t total_rows;
+  row_group_meta_t *row_groups;
+  size_t row_groups_count;
+
+  int codec;
+  struct avro_codec_t_ avro_codec;
+  buf_t page;
+  buf_t compressed;
+  buf_t header;
+};
+
+static uint64_t hash_bytes(const char *data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static int is_dictionary_type(const column_t *col) {
+  return col->physical_type == PT_BYTE_ARRAY || col->physical_type == PT_FIXED_LEN_BYTE_ARRAY;
+}
+
+static void column_reset(column_t *col) {
+  col->levels.size = 0;
+  col->values.size = 0;
+  col->dictionary.size = 0;
+  col->entries_count = 0;
+  if (col->slots != NULL) {
+    memset(col->slots, -1, col->slots_count * sizeof(int32_t));
+  }
+  col->dictionary_encoded = is_dictionary_type(col);
+}
+
+static void column_free(column_t *col) {
+  buf_free(&col->levels);
+  buf_free(&col->values);
+  buf_free(&col->dictionary);
+  free(col->entries);
+  free(col->slots);
+}
+
+// Maps the field schema to Parquet types
+static int column_init(column_t *col, const char *name, avro_schema_t schema) {
+  memset(col, 0, sizeof(column_t));
+  col->name = name;
+  col->schema = schema;
+  col->value = schema;
+  col->null_branch = -1;
+  col->converted_type = CT_NONE;
+  col->repetition = REQUIRED;
+
+  if (is_avro_union(schema) && avro_schema_union_size(schema) == 2) {
+    for (int i = 0; i < 2; ++i) {
+      if (is_avro_null(avro_schema_union_branch(schema, i))) {
+        col->null_branch = i;
+        col->value = binary_resolve_schema(avro_schema_union_branch(schema, 1 - i));
+      }
+    }
+  }
+  if (col->null_branch >= 0 || is_avro_null(schema)) {
+    col->repetition = OPTIONAL;
+  }
+
+  avro_schema_t value = col->value;
+  avro_logical_schema_t *logical = avro_logical_schema(value);
+  switch (avro_typeof(value)) {
+  case AVRO_NULL:
+    col->kind = VK_NULL;
+    col->physical_type = PT_BYTE_ARRAY;
+    col->converted_type = CT_UTF8;
+    break;
+  case AVRO_BOOLEAN:
+    col->kind = VK_BOOLEAN;
+    col->physical_type = PT_BOOLEAN;
+    break;
+  case AVRO_INT32:
+    col->kind = VK_INT;
+    col->physical_type = PT_INT32;
+    if (logical != NULL && logical->type == AVRO_DATE) {
+      col->converted_type = CT_DATE;
+    } else if (logical != NULL && logical->type == AVRO_TIME_MILLIS) {
+      // Time of day, unlike the datetime of --show-schema, see parquet.h
+      col->converted_type = CT_TIME_MILLIS;
+    }
+    break;
+  case AVRO_INT64:
+    col->kind = VK_LONG;
+    col->physical_type = PT_INT64;
+    if (logical != NULL && logical->type == AVRO_TIME_MICROS) {
+      col->converted_type = CT_TIME_MICROS;
+    } else if (logical != NULL && logical->type == AVRO_TIMESTAMP_MILLIS) {
+      col->converted_type = CT_TIMESTAMP_MILLIS;
+    } else if (logical != NULL && logical->type == AVRO_TIMESTAMP_MICROS) {
+      col->converted_type = CT_TIMESTAMP_MICROS;
+    }
+    break;
+  case AVRO_FLOAT:
+    col->kind = VK_FLOAT;
+    col->physical_type = PT_FLOAT;
+    break;
+  case AVRO_DOUBLE:
+    col->kind = VK_DOUBLE;
+    col->physical_type = PT_DOUBLE;
+    break;
+  case AVRO_STRING:
+    col->kind = VK_BYTES;
+    col->physical_type = PT_BYTE_ARRAY;
+    col->converted_type = CT_UTF8;
+    break;
+  case AVRO_ENUM:
+    col->kind = VK_ENUM;
+    col->physical_type = PT_BYTE_ARRAY;
+    col->converted_type = CT_UTF8;
+    break;
+  case AVRO_BYTES:
+    // Binary, unlike the dynamic of --show-schema, see parquet.h
+    col->kind = VK_BYTES;
+    col->physical_type = PT_BYTE_ARRAY;
+    break;
+  case AVRO_FIXED:
+    col->kind = VK_FIXED;
+    col->physical_type = PT_FIXED_LEN_BYTE_ARRAY;
+    col->type_length = (int)avro_schema_fixed_size(value);
+    if (logical != NULL && logical->type == AVRO_DURATION && col->type_length == 12) {
+      col->converted_type = CT_INTERVAL;
+    }
+    break;
+  default:
+    // Anything else is JSON, and might be null in non-nullable unions too
+    col->kind = VK_JSON;
+    col->physical_type = PT_BYTE_ARRAY;
+    col->converted_type = CT_JSON;
+    col->repetition = OPTIONAL;
+    break;
+  }
+  // Two's complement big-endian unscaled values, in both formats
+  if (logical != NULL && logical->type == AVRO_DECIMAL &&
+      (col->kind == VK_BYTES || col->kind == VK_FIXED)) {
+    col->converted_type = CT_DECIMAL;
+    col->scale = (int)logical->scale;
+    col->precision = (int)logical->precision;
+  }
+
+  column_reset(col);
+  return 0;
+}
+
+// Copies dictionary encoded values out as plain values, once the dictionary
+// gets too large to be worth it
+static void dictionary_fallback(parquet_t *parquet, column_t *col) {
+  buf_t plain = {0};
+  for (size_t i = 0; i < col->values.size / 4; ++i) {
+    const dict_entry_t *entry = &col->entries[get_index(col->values.data, i)];
+    if (col->physical_type == PT_BYTE_ARRAY) {
+      buf_u32(&plain, entry->size);
+    }
+    buf_append(&plain, col->dictionary.data + entry->offset, entry->size);
+  }
+  parquet->buffered += plain.size - col->values.size;
+  buf_free(&col->values);
+  col->values = plain;
+  col->dictionary_encoded = 0;
+}
+
+static int grow_slots(column_t *col) {
+  size_t count = col->slots_count > 0 ? 2 * col->slots_count : 1024;
+  int32_t *slots = (int32_t *)malloc(count * sizeof(int32_t));
+  if (slots == NULL) {
+    return ENOMEM;
+  }
+  memset(slots, -1, count * sizeof(int32_t));
+  for (size_t i = 0; i < col->entries_count; ++i) {
+    size_t slot = col->entries[i].hash & (count - 1);
+    while (slots[slot] >= 0) {
+      slot = (slot + 1) & (count - 1);
+    }
+    slots[slot] = (int32_t)i;
+  }
+  free(col->slots);
+  col->slots = slots;
+  col->slots_count = count;
+  return 0;
+}
+
+// Appends a byte array value, as dictionary index when possible
+static int append_bytes(parquet_t *parquet, column_t *col, const char *data, size_t size) {
+  if (size > UINT32_MAX) {
+    avro_set_error("Value of column '%s' is too large for Parquet", col->name);
+    return EINVAL;
+  }
+  if (!col->dictionary_encoded) {
+    if (col->physical_type == PT_BYTE_ARRAY) {
+      buf_u32(&col->values, (uint32_t)size);
+    }
+    buf_append(&col->values, data, size);
+    parquet->buffered += size + 4;
+    return col->values.failed ? ENOMEM : 0;
+  }
+
+  // Table is kept at most half full
+  if (2 * (col->entries_count + 1) > col->slots_count) {
+    CHECKED_EV(grow_slots(col));
+  }
+  uint64_t hash = hash_bytes(data, size);
+  size_t slot = hash & (col->slots_count - 1);
+  while (col->slots[slot] >= 0) {
+    const dict_entry_t *entry = &col->entries[col->slots[slot]];
+    if (entry->hash == hash && entry->size == size &&
+        !memcmp(col->dictionary.data + entry->offset, data, size)) {
+      break;
+    }
+    slot = (slot + 1) & (col->slots_count - 1);
+  }
+
+  if (col->slots[slot] < 0) {
+    if (col->dictionary.size + size + 4 > PARQUET_MAX_DICTIONARY_SIZE) {
+      dictionary_fallback(parquet, col);
+      return append_bytes(parquet, col, data, size);
+    }
+    dict_entry_t *entries = (dict_entry_t *)realloc(col->entries, (col->entries_count + 1) * sizeof(dict_entry_t));
+    if (entries == NULL) {
+      return ENOMEM;
+    }
+    col->entries = entries;
+    if (col->physical_type == PT_BYTE_ARRAY) {
+      buf_u32(&col->dictionary, (uint32_t)size);
+    }
+    entries[col->entries_count].hash = hash;
+    entries[col->entries_count].offset = (uint32_t)col->dictionary.size;
+    entries[col->entries_count].size = (uint32_t)size;
+    buf_append(&col->dictionary, data, size);
+    col->slots[slot] = (int32_t)col->entries_count++;
+    parquet->buffered += size + 4;
+  }
+  buf_u32(&col->values, (uint32_t)col->slots[slot]);
+  parquet->buffered += 4;
+  return col->values.failed || col->dictionary.failed ? ENOMEM : 0;
+}
+
+static int append_value(parquet_t *parquet, column_t *col, const char **p, const char *end) {
+  avro_schema_t schema = col->value;
+  if (col->null_branch >= 0 || (col->kind == VK_JSON && is_avro_union(col->schema))) {
+    const char *branch_start = *p;
+    int64_t branch;
+    CHECKED_EV(binary_read_long(p, end, &branch));
+    if (branch < 0 || (size_t)branch >= avro_schema_union_size(col->schema)) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    if (is_avro_null(avro_schema_union_branch(col->schema, (int)branch))) {
+      buf_byte(&col->levels, 0);
+      return col->levels.failed ? ENOMEM : 0;
+    }
+    if (col->kind == VK_JSON) {
+      // Whole union is converted
+      *p = branch_start;
+      schema = col->schema;
+    }
+  }
+  if (col->repetition == OPTIONAL) {
+    if (col->kind == VK_NULL) {
+      buf_byte(&col->levels, 0);
+      return col->levels.failed ? ENOMEM : 0;
+    }
+    buf_byte(&col->levels, 1);
+  }
+
+  switch (col->kind) {
+  case VK_BOOLEAN:
+    if (*p >= end) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    buf_byte(&col->values, *(*p)++ ? 1 : 0);
+    parquet->buffered += 1;
+    break;
+
+  case VK_INT: {
+    int64_t value;
+    CHECKED_EV(binary_read_long(p, end, &value));
+    buf_u32(&col->values, (uint32_t)(int32_t)value);
+    parquet->buffered += 4;
+    break;
+  }
+
+  case VK_LONG: {
+    int64_t value;
+    CHECKED_EV(binary_read_long(p, end, &value));
+    buf_u64(&col->values, (uint64_t)value);
+    parquet->buffered += 8;
+    break;
+  }
+
+  case VK_FLOAT:
+  case VK_DOUBLE: {
+    // Both formats are little-endian IEEE 754
+    size_t size = col->kind == VK_FLOAT ? 4 : 8;
+    if ((size_t)(end - *p) < size) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    buf_append(&col->values, *p, size);
+    *p += size;
+    parquet->buffered += size;
+    break;
+  }
+
+  case VK_BYTES: {
+    const char *bytes;
+    size_t size;
+    CHECKED_EV(binary_read_bytes(p, end, &bytes, &size));
+    return append_bytes(parquet, col, bytes, size);
+  }
+
+  case VK_ENUM: {
+    int64_t index;
+    CHECKED_EV(binary_read_long(p, end, &index));
+    if (index < 0 || index >= avro_schema_enum_number_of_symbols(schema)) {
+      avro_set_error("Invalid enum index %lld", (long long)index);
+      return EILSEQ;
+    }
+    const char *symbol = avro_schema_enum_get(schema, (int)index);
+    return append_bytes(parquet, col, symbol, strlen(symbol));
+  }
+
+  case VK_FIXED: {
+    if (end - *p < col->type_length) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    const char *bytes = *p;
+    *p += col->type_length;
+    return append_bytes(parquet, col, bytes, (size_t)col->type_length);
+  }
+
+  case VK_JSON: {
+    const char *json;
+    size_t size;
+    CHECKED_EV(stream_json(parquet->json, schema, p, end, &json, &size));
+    return append_bytes(parquet, col, json, size);
+  }
+
+  default:
+    break;
+  }
+  return col->values.failed || col->levels.failed ? ENOMEM : 0;
+}
+
+/*
+ * Writing
+ */
+
+static int write_bytes(parquet_t *parquet, const char *data, size_t size) {
+  if (size > 0 && fwrite(data, 1, size, parquet->dest) < size) {
+    avro_set_error("Cannot write Parquet file: %s", strerror(errno));
+    return EIO;
+  }
+  parquet->offset += (int64_t)size;
+  return 0;
+}
+
+// Compresses the page body into parquet->compressed, or leaves it as it is
+static int compress_page(parquet_t *parquet, const buf_t *body, const char **data,
+                         size_t *size) {
+  if (parquet->codec == CODEC_UNCOMPRESSED || body->size == 0) {
+    *data = body->data;
+    *size = body->size;
+    return 0;
+  }
+  if (avro_codec_encode(&parquet->avro_codec, body->data, (int64_t)body->size) != 0) {
+    avro_set_error("Cannot compress Parquet page");
+    return EIO;
+  }
+  const char *encoded = (const char *)parquet->avro_codec.block_data;
+  size_t encoded_size = (size_t)parquet->avro_codec.used_size;
+
+  buf_t *out = &parquet->compressed;
+  out->size = 0;
+  if (parquet->codec == CODEC_SNAPPY) {
+    // Avro appends CRC32 of the data to Snappy blocks, Parquet doesn't
+    buf_append(out, encoded, encoded_size - 4);
+  } else {
+    // Avro deflate blocks are raw deflate streams, wrapped here in gzip
+    static const unsigned char GZIP_HEADER[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+    buf_append(out, GZIP_HEADER, sizeof(GZIP_HEADER));
+    buf_append(out, encoded, encoded_size);
+    buf_u32(out, gzip_crc32(body->data, body->size));
+    buf_u32(out, (uint32_t)body->size);
+  }
+  if (out->failed) {
+    return ENOMEM;
+  }
+  *data = out->data;
+  *size = out->size;
+  return 0;
+}
+
+static int write_page(parquet_t *parquet, int type, int encoding, size_t num_values,
+                      chunk_meta_t *meta) {
+  const buf_t *body = &parquet->page;
+  const char *data;
+  size_t size;
+  CHECKED_EV(compress_page(parquet, body, &data, &size));
+
+  buf_t *header = &parquet->header;
+  header->size = 0;
+  thrift_t t = {header, {0}, 0};
+  tc_i32(&t, 1, type);
+  tc_i32(&t, 2, (int32_t)body->size);
+  tc_i32(&t, 3, (int32_t)size);
+  if (type == PAGE_DATA) {
+    tc_struct_begin(&t, 5);
+    tc_i32(&t, 1, (int32_t)num_values);
+    tc_i32(&t, 2, encoding);
+    tc_i32(&t, 3, ENC_RLE);
+    tc_i32(&t, 4, ENC_RLE);
+    tc_struct_end(&t);
+  } else {
+    tc_struct_begin(&t, 7);
+    tc_i32(&t, 1, (int32_t)num_values);
+    tc_i32(&t, 2, encoding);
+    tc_struct_end(&t);
+  }
+  buf_byte(header, 0);
+  if (header->failed) {
+    return ENOMEM;
+  }
+
+  meta->uncompressed_size += (int64_t)(header->size + body->size);
+  meta->compressed_size += (int64_t)(header->size + size);
+  CHECKED_EV(write_bytes(parquet, header->data, header->size));
+  return write_bytes(parquet, data, size);
+}
+
+static int write_column_chunk(parquet_t *parquet, column_t *col, size_t rows,
+                              chunk_meta_t *meta) {
+  memset(meta, 0, sizeof(chunk_meta_t));
+  meta->file_offset = parquet->offset;
+  meta->dictionary_page_offset = -1;
+  meta->num_values = (int64_t)rows;
+
+  buf_t *page = &parquet->page;
+  int dictionary = col->dictionary_encoded && col->entries_count > 0;
+  if (dictionary) {
+    meta->dictionary = 1;
+    meta->dictionary_page_offset = parquet->offset;
+    page->size = 0;
+    buf_append(page, col->dictionary.data, col->dictionary.size);
+    CHECKED_EV(write_page(parquet, PAGE_DICTIONARY, ENC_PLAIN_DICTIONARY, col->entries_count, meta));
+  }
+
+  // Definition levels are prefixed with their size, values follow
+  page->size = 0;
+  if (col->repetition == OPTIONAL) {
+    buf_u32(page, 0);
+    size_t levels_start = page->size;
+    rle_encode(page, col->levels.data, get_level, col->levels.size, 1);
+    if (!page->failed) {
+      uint32_t levels_size = (uint32_t)(page->size - levels_start);
+      unsigned char bytes[4] = {(unsigned char)levels_size, (unsigned char)(levels_size >> 8),
+                                (unsigned char)(levels_size >> 16), (unsigned char)(levels_size >> 24)};
+      memcpy(page->data + levels_start - 4, bytes, 4);
+    }
+  }
+  if (dictionary) {
+    int width = bit_width((uint32_t)(col->entries_count - 1));
+    buf_byte(page, (unsigned char)width);
+    rle_encode(page, col->values.data, get_index, col->values.size / 4, width);
+  } else if (col->kind == VK_BOOLEAN) {
+    size_t count = col->values.size;
+    bit_pack(page, col->values.data, get_level, 0, count, count, 1);
+  } else {
+    buf_append(page, col->values.data, col->values.size);
+  }
+  if (page->failed) {
+    return ENOMEM;
+  }
+  meta->data_page_offset = parquet->offset;
+  return write_page(parquet, PAGE_DATA, dictionary ? ENC_PLAIN_DICTIONARY : ENC_PLAIN, rows, meta);
+}
+
+static int flush_row_group(parquet_t *parquet) {
+  if (parquet->rows == 0) {
+    return 0;
+  }
+  row_group_meta_t *row_groups = (row_group_meta_t *)realloc(
+      parquet->row_groups, (parquet->row_groups_count + 1) * sizeof(row_group_meta_t));
+  if (row_groups == NULL) {
+    return ENOMEM;
+  }
+  parquet->row_groups = row_groups;
+  row_group_meta_t *row_group = &row_groups[parquet->row_groups_count];
+  row_group->chunks = (chunk_meta_t *)calloc(parquet->columns_count + 1, sizeof(chunk_meta_t));
+  if (row_group->chunks == NULL) {
+    return ENOMEM;
+  }
+  parquet->row_groups_count++;
+  row_group->num_rows = (int64_t)parquet->rows;
+  row_group->total_byte_size = 0;
+
+  for (size_t i = 0; i < parquet->columns_count; ++i) {
+    column_t *col = &parquet->columns[i];
+    CHECKED_EV(write_column_chunk(parquet, col, parquet->rows, &row_group->chunks[i]));
+    row_group->total_byte_size += row_group->chunks[i].uncompressed_size;
+    column_reset(col);
+  }
+  parquet->total_rows += (int64_t)parquet->rows;
+  parquet->rows = 0;
+  parquet->buffered = 0;
+  return 0;
+}
+
+static void write_schema(thrift_t *t, const parquet_t *parquet) {
+  tc_list(t, 2, TC_STRUCT, parquet->columns_count + 1);
+  tc_struct_begin(t, 0);
+  tc_string(t, 4, "schema");
+  tc_i32(t, 5, (int32_t)parquet->columns_count);
+  tc_struct_end(t);
+
+  for (size_t i = 0; i < parquet->columns_count; ++i) {
+    const column_t *col = &parquet->columns[i];
+    tc_struct_begin(t, 0);
+    tc_i32(t, 1, col->physical_type);
+    if (col->physical_type == PT_FIXED_LEN_BYTE_ARRAY) {
+      tc_i32(t, 2, col->type_length);
+    }
+    tc_i32(t, 3, col->repetition);
+    tc_string(t, 4, col->name);
+    if (col->converted_type != CT_NONE) {
+      tc_i32(t, 6, col->converted_type);
+    }
+    if (col->converted_type == CT_DECIMAL) {
+      tc_i32(t, 7, col->scale);
+      tc_i32(t, 8, col->precision);
+    }
+    tc_struct_end(t);
+  }
+}
+
+static void write_column_meta(thrift_t *t, const column_t *col, const chunk_meta_t *meta,
+                              int codec) {
+  tc_struct_begin(t, 3);
+  tc_i32(t, 1, col->physical_type);
+  tc_list(t, 2, TC_I32, 2);
+  buf_varint(t->buf, zigzag(meta->dictionary ? ENC_PLAIN_DICTIONARY : ENC_PLAIN));
+  buf_varint(t->buf, zigzag(ENC_RLE));
+  tc_list(t, 3, TC_BINARY, 1);
+  buf_varint(t->buf, strlen(col->name));
+  buf_append(t->buf, col->name, strlen(col->name));
+  tc_i32(t, 4, codec);
+  tc_i64(t, 5, meta->num_values);
+  tc_i64(t, 6, meta->uncompressed_size);
+  tc_i64(t, 7, meta->compressed_size);
+  tc_i64(t, 9, meta->data_page_offset);
+  if (meta->dictionary_page_offset >= 0) {
+    tc_i64(t, 11, meta->dictionary_page_offset);
+  }
+  tc_struct_end(t);
+}
+
+static int write_footer(parquet_t *parquet) {
+  buf_t *footer = &parquet->header;
+  footer->size = 0;
+  thrift_t t = {footer, {0}, 0};
+  tc_i32(&t, 1, 1);
+  write_schema(&t, parquet);
+  tc_i64(&t, 3, parquet->total_rows);
+  tc_list(&t, 4, TC_STRUCT, parquet->row_groups_count);
+  for (size_t i = 0; i < parquet->row_groups_count; ++i) {
+    const row_group_meta_t *row_group = &parquet->row_groups[i];
+    tc_struct_begin(&t, 0);
+    tc_list(&t, 1, TC_STRUCT, parquet->columns_count);
+    for (size_t j = 0; j < parquet->columns_count; ++j) {
+      tc_struct_begin(&t, 0);
+      tc_i64(&t, 2, row_group->chunks[j].file_offset);
+      write_column_meta(&t, &parquet->columns[j], &row_group->chunks[j], parquet->codec);
+      tc_struct_end(&t);
+    }
+    tc_i64(&t, 2, row_group->total_byte_size);
+    tc_i64(&t, 3, row_group->num_rows);
+    tc_struct_end(&t);
+  }
+  tc_string(&t, 6, PARQUET_CREATED_BY);
+  buf_byte(footer, 0);
+
+  uint32_t size = (uint32_t)footer->size;
+  buf_u32(footer, size);
+  buf_append(footer, PARQUET_MAGIC, 4);
+  if (footer->failed) {
+    return ENOMEM;
+  }
+  return write_bytes(parquet, footer->data, footer->size);
+}
+
+/*
+ * Public API
+ */
+
+static int find_columns(parquet_t *parquet, const config_t *conf) {
+  size_t count = conf->columns_size > 0 ? conf->columns_size : parquet->fields_count;
+  parquet->columns = (column_t *)calloc(count > 0 ? count : 1, sizeof(column_t));
+  parquet->field_columns = (int *)malloc((parquet->fields_count + 1) * sizeof(int));
+  if (parquet->columns == NULL || parquet->field_columns == NULL) {
+    return ENOMEM;
+  }
+  for (size_t i = 0; i < parquet->fields_count; ++i) {
+    parquet->field_columns[i] = conf->columns_size > 0 ? -1 : (int)i;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    int field_index = (int)i;
+    if (conf->columns_size > 0) {
+      const column_info_t *column = &conf->columns[i];
+      if (column->transformation != TRANSFORM_NONE) {
+        avro_set_error("Transformations of --columns aren't supported with --parquet");
+        return EINVAL;
+      }
+      if (path_is_nested(column->column_name)) {
+        avro_set_error("Nested columns of --columns aren't supported with --parquet");
+        return EINVAL;
+      }
+      // Columns which don't exist are skipped, as in JSON output
+      field_index = avro_schema_record_field_get_index(parquet->record, column->column_name);
+      if (field_index < 0) {
+        continue;
+      }
+      if (parquet->field_columns[field_index] >= 0) {
+        avro_set_error("Column '%s' is listed more than once", column->column_name);
+        return EINVAL;
+      }
+    }
+    parquet->field_columns[field_index] = (int)parquet->columns_count;
+    CHECKED_EV(column_init(&parquet->columns[parquet->columns_count++],
+                           avro_schema_record_field_name(parquet->record, field_index),
+                           binary_resolve_schema(avro_schema_record_field_get_by_index(parquet->record, field_index))));
+  }
+  return 0;
+}
+
+int parquet_new(avro_schema_t schema, const config_t *conf, FILE *dest, parquet_t **result) {
+  schema = binary_resolve_schema(schema);
+  if (!is_avro_record(schema)) {
+    avro_set_error("Can't find root record schema");
+    return EINVAL;
+  }
+
+  parquet_t *parquet = (parquet_t *)calloc(1, sizeof(parquet_t));
+  if (parquet == NULL) {
+    return ENOMEM;
+  }
+  *result = parquet;
+  parquet->conf = *conf;
+  parquet->conf.columns = NULL;
+  parquet->conf.columns_size = 0;
+  parquet->conf.output_csv = 0;
+  parquet->dest = dest;
+  parquet->record = schema;
+  parquet->fields_count = avro_schema_record_size(schema);
+  parquet->row_group_size = conf->row_group_size > 0 ? conf->row_group_size : DEFAULT_ROW_GROUP_SIZE;
+
+  CHECKED_EV(find_columns(parquet, conf));
+  CHECKED_EV(stream_new(schema, &parquet->conf, NULL, &parquet->json));
+
+  switch (conf->parquet_codec) {
+  case PARQUET_CODEC_SNAPPY:
+    parquet->codec = CODEC_SNAPPY;
+    break;
+  case PARQUET_CODEC_GZIP:
+    parquet->codec = CODEC_GZIP;
+    break;
+  default:
+    parquet->codec = CODEC_UNCOMPRESSED;
+    break;
+  }
+  if (parquet->codec != CODEC_UNCOMPRESSED &&
+      avro_codec(&parquet->avro_codec, parquet->codec == CODEC_SNAPPY ? "snappy" : "deflate") != 0) {
+    parquet->codec = CODEC_UNCOMPRESSED;
+    avro_set_error("Codec of --parquet-codec isn't available in this build");
+    return EINVAL;
+  }
+  return write_bytes(parquet, PARQUET_MAGIC, 4);
+}
+
+void parquet_free(parquet_t *parquet) {
+  if (parquet->columns != NULL) {
+    for (size_t i = 0; i < parquet->columns_count; ++i) {
+      column_free(&parquet->columns[i]);
+    }
+    free(parquet->columns);
+  }
+  for (size_t i = 0; i < parquet->row_groups_count; ++i) {
+    free(parquet->row_groups[i].chunks);
+  }
+  free(parquet->row_groups);
+  free(parquet->field_columns);
+  if (parquet->json != NULL) {
+    stream_free(parquet->json);
+  }
+  if (parquet->codec != CODEC_UNCOMPRESSED) {
+    avro_codec_reset(&parquet->avro_codec);
+  }
+  buf_free(&parquet->page);
+  buf_free(&parquet->compressed);
+  buf_free(&parquet->header);
+  free(parquet);
+}
+
+int parquet_append(parquet_t *parquet, const char **p, const char *end) {
+  for (size_t i = 0; i < parquet->fields_count; ++i) {
+    int column = parquet->field_columns[i];
+    if (column < 0) {
+      CHECKED_EV(binary_skip(avro_schema_record_field_get_by_index(parquet->record, (int)i), p, end));
+    } else {
+      CHECKED_EV(append_value(parquet, &parquet->columns[column], p, end));
+    }
+  }
+  if (++parquet->rows >= parquet->row_group_size || parquet->buffered >= PARQUET_MAX_ROW_GROUP_BYTES) {
+    return flush_row_group(parquet);
+  }
+  return 0;
+}
+
+int parquet_finish(parquet_t *parquet) {
+  CHECKED_EV(flush_row_group(parquet));
+  return write_footer(parquet);
+}
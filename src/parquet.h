@@ -0,0 +1,55 @@
+#pragma once
+
+#include <avro.h>
+#include <stdio.h>
+
+#include "config.h"
+
+/**
+ * Parquet output (--parquet). Records are decoded straight from their binary
+ * encoding into column chunks, which are written as row groups of
+ * conf->row_group_size rows.
+ *
+ * Fields are mapped to Parquet types mostly the same way --show-schema maps
+ * them to Kusto types: decimals are DECIMAL, dates and timestamps are DATE
+ * and TIMESTAMP, durations are INTERVAL, strings and enums are UTF8, ints,
+ * longs, floats, doubles and booleans are their Parquet counterparts, and
+ * anything else (records, arrays, maps and other unions) is JSON text.
+ * Nullable unions are optional columns.
+ *
+ * Where Parquet has a closer type than Kusto, it's used instead:
+ * - time-millis and time-micros are TIME rather than timestamps, since they
+ *   are times of day and not instants
+ * - bytes are plain BYTE_ARRAY rather than JSON arrays of numbers, and fixed
+ *   are FIXED_LEN_BYTE_ARRAY rather than strings, keeping their binary value
+ *
+ * String and binary columns are dictionary encoded, unless the dictionary
+ * of a chunk grows too large, and definition levels and dictionary indices
+ * use the RLE / bit-packing hybrid encoding. Pages are compressed with
+ * Snappy or gzip using the codecs of the Avro library.
+ */
+typedef struct parquet_t parquet_t;
+
+// Default of --row-group-size
+#define DEFAULT_ROW_GROUP_SIZE 131072
+
+/**
+ * Prepares writing of records of the given schema to 'dest', writing the
+ * file header.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int parquet_new(avro_schema_t schema, const config_t *conf, FILE *dest, parquet_t **parquet);
+
+void parquet_free(parquet_t *parquet);
+
+/**
+ * Decodes a binary encoded record starting at '*p' into the current row
+ * group, advancing '*p' past the end of the record. Full row groups are
+ * written out.
+ */
+int parquet_append(parquet_t *parquet, const char **p, const char *end);
+
+/**
+ * Writes the last row group and the file footer.
+ */
+int parquet_finish(parquet_t *parquet);
@@ -0,0 +1,430 @@
+#include <avro.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary.h"
+#include "fingerprint.h"
+#include "partition.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+// Output buffer of every open partition
+#define PARTITION_BUFFER_SIZE (64 * 1024)
+#define PARTITION_INITIAL_BUCKETS 64
+
+// Key of null values with --by-value; escaped keys never contain '%' that
+// isn't followed by two hex digits, so it can't clash with any value
+#define NULL_KEY "%null"
+
+typedef struct partition_t {
+  char *key;
+  uint64_t hash;
+  FILE *fp;          // NULL when closed
+  int written;       // file was created by this run, so it's appended to
+  struct partition_t *next;     // in hash bucket
+  struct partition_t *lru_prev; // in list of open partitions
+  struct partition_t *lru_next;
+} partition_t;
+
+struct partitioner_t {
+  const config_t *conf;
+  avro_schema_t record;
+  int field_index;
+  avro_schema_t field;
+  const char *extension;
+
+  partition_t **buckets;
+  size_t buckets_count;
+  size_t size;
+
+  // Open partitions, most recently used first
+  partition_t *lru_head;
+  partition_t *lru_tail;
+  size_t open;
+
+  partition_t *last; // partition of the previous record
+  char *key;         // key of the current record
+  size_t key_size;
+  size_t key_capacity;
+};
+
+static int is_key_type(avro_schema_t schema) {
+  switch (avro_typeof(schema)) {
+  case AVRO_STRING:
+  case AVRO_BYTES:
+  case AVRO_FIXED:
+  case AVRO_INT32:
+  case AVRO_INT64:
+  case AVRO_BOOLEAN:
+  case AVRO_ENUM:
+  case AVRO_NULL:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int check_key_type(avro_schema_t schema, const char *column) {
+  int supported = 1;
+  if (is_avro_union(schema)) {
+    for (size_t i = 0; i < avro_schema_union_size(schema); ++i) {
+      supported &= is_key_type(binary_resolve_schema(avro_schema_union_branch(schema, (int)i)));
+    }
+  } else {
+    supported = is_key_type(schema);
+  }
+  if (!supported) {
+    avro_set_error("Column '%s' of type %s can't be used to partition by value",
+                   column, avro_schema_type_name(schema));
+    return EINVAL;
+  }
+  return 0;
+}
+
+int partitioner_new(avro_schema_t schema, const config_t *conf, partitioner_t **result) {
+  schema = binary_resolve_schema(schema);
+  int field_index = is_avro_record(schema)
+                        ? avro_schema_record_field_get_index(schema, conf->partition_by)
+                        : -1;
+  if (field_index < 0) {
+    avro_set_error("Partition column '%s' doesn't exist", conf->partition_by);
+    return EINVAL;
+  }
+  avro_schema_t field = binary_resolve_schema(avro_schema_record_field_get_by_index(schema, field_index));
+  if (conf->partition_by_value) {
+    CHECKED_EV(check_key_type(field, conf->partition_by));
+  }
+
+  partitioner_t *partitioner = (partitioner_t *)calloc(1, sizeof(partitioner_t));
+  if (partitioner == NULL) {
+    return ENOMEM;
+  }
+  partitioner->conf = conf;
+  partitioner->record = schema;
+  partitioner->field_index = field_index;
+  partitioner->field = field;
+  partitioner->extension = conf->output_csv ? ".csv" : ".json";
+  partitioner->buckets_count = PARTITION_INITIAL_BUCKETS;
+  partitioner->buckets = (partition_t **)calloc(partitioner->buckets_count, sizeof(partition_t *));
+  if (partitioner->buckets == NULL) {
+    free(partitioner);
+    return ENOMEM;
+  }
+  *result = partitioner;
+  return 0;
+}
+
+/*
+ * Partition keys
+ */
+
+static int key_reserve(partitioner_t *partitioner, size_t size) {
+  if (partitioner->key_size + size + 1 > partitioner->key_capacity) {
+    size_t capacity = 2 * (partitioner->key_size + size + 1);
+    char *key = (char *)realloc(partitioner->key, capacity);
+    if (key == NULL) {
+      return ENOMEM;
+    }
+    partitioner->key = key;
+    partitioner->key_capacity = capacity;
+  }
+  return 0;
+}
+
+static int key_append(partitioner_t *partitioner, const char *str, size_t size) {
+  CHECKED_EV(key_reserve(partitioner, size));
+  memcpy(partitioner->key + partitioner->key_size, str, size);
+  partitioner->key_size += size;
+  partitioner->key[partitioner->key_size] = '\0';
+  return 0;
+}
+
+// Appends the value escaped for use in a file name: characters other than
+// lower-case letters, digits, '-', '_' and '.' are written as %XX. Upper-case
+// letters are escaped too, so that values differing in case only don't share
+// a file on case-insensitive file systems.
+static int key_append_escaped(partitioner_t *partitioner, const char *str, size_t size) {
+  static const char HEX_DIGITS[] = "0123456789ABCDEF";
+  CHECKED_EV(key_reserve(partitioner, 3 * size));
+  char *out = partitioner->key + partitioner->key_size;
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char c = (unsigned char)str[i];
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.') {
+      *out++ = (char)c;
+    } else {
+      *out++ = '%';
+      *out++ = HEX_DIGITS[c >> 4];
+      *out++ = HEX_DIGITS[c & 0xf];
+    }
+  }
+  partitioner->key_size = out - partitioner->key;
+  partitioner->key[partitioner->key_size] = '\0';
+  return 0;
+}
+
+// Renders the value of a --by-value column starting at '*p'
+static int value_key(partitioner_t *partitioner, avro_schema_t schema,
+                     const char **p, const char *end) {
+  char number[32];
+  if (is_avro_union(schema)) {
+    int64_t branch;
+    CHECKED_EV(binary_read_long(p, end, &branch));
+    if (branch < 0 || (size_t)branch >= avro_schema_union_size(schema)) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    schema = binary_resolve_schema(avro_schema_union_branch(schema, (int)branch));
+  }
+
+  switch (avro_typeof(schema)) {
+  case AVRO_NULL:
+    return key_append(partitioner, NULL_KEY, strlen(NULL_KEY));
+
+  case AVRO_BOOLEAN:
+    if (*p >= end) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    return *(*p)++ ? key_append(partitioner, "true", 4) : key_append(partitioner, "false", 5);
+
+  case AVRO_INT32:
+  case AVRO_INT64: {
+    int64_t value;
+    CHECKED_EV(binary_read_long(p, end, &value));
+    int size = snprintf(number, sizeof(number), "%" PRId64, value);
+    return key_append(partitioner, number, (size_t)size);
+  }
+
+  case AVRO_ENUM: {
+    int64_t index;
+    CHECKED_EV(binary_read_long(p, end, &index));
+    const char *symbol = index >= 0 && index < avro_schema_enum_number_of_symbols(schema)
+                             ? avro_schema_enum_get(schema, (int)index)
+                             : NULL;
+    if (symbol == NULL) {
+      avro_set_error("Invalid enum index %" PRId64, index);
+      return EILSEQ;
+    }
+    return key_append_escaped(partitioner, symbol, strlen(symbol));
+  }
+
+  case AVRO_FIXED: {
+    const char *bytes = *p;
+    CHECKED_EV(binary_skip(schema, p, end));
+    return key_append_escaped(partitioner, bytes, *p - bytes);
+  }
+
+  default: {
+    const char *bytes;
+    size_t size;
+    CHECKED_EV(binary_read_bytes(p, end, &bytes, &size));
+    return key_append_escaped(partitioner, bytes, size);
+  }
+  }
+}
+
+// Sets the key of the record: its partition number by hash of the encoded
+// column value, or the escaped value itself with --by-value
+static int record_key(partitioner_t *partitioner, const char *p, const char *end) {
+  for (int i = 0; i < partitioner->field_index; ++i) {
+    CHECKED_EV(binary_skip(avro_schema_record_field_get_by_index(partitioner->record, i), &p, end));
+  }
+  partitioner->key_size = 0;
+  if (partitioner->conf->partition_by_value) {
+    return value_key(partitioner, partitioner->field, &p, end);
+  }
+
+  const char *value = p;
+  CHECKED_EV(binary_skip(partitioner->field, &p, end));
+  size_t partitions = partitioner->conf->partitions > 0 ? partitioner->conf->partitions
+                                                        : DEFAULT_PARTITIONS;
+  char number[32];
+  int size = snprintf(number, sizeof(number), "%zu",
+                      (size_t)(rabin_fingerprint(value, p - value) % partitions));
+  return key_append(partitioner, number, (size_t)size);
+}
+
+/*
+ * Partition files
+ */
+
+static void lru_unlink(partitioner_t *partitioner, partition_t *partition) {
+  if (partition->lru_prev != NULL) {
+    partition->lru_prev->lru_next = partition->lru_next;
+  } else {
+    partitioner->lru_head = partition->lru_next;
+  }
+  if (partition->lru_next != NULL) {
+    partition->lru_next->lru_prev = partition->lru_prev;
+  } else {
+    partitioner->lru_tail = partition->lru_prev;
+  }
+  partition->lru_prev = partition->lru_next = NULL;
+}
+
+static void lru_push(partitioner_t *partitioner, partition_t *partition) {
+  partition->lru_next = partitioner->lru_head;
+  if (partitioner->lru_head != NULL) {
+    partitioner->lru_head->lru_prev = partition;
+  } else {
+    partitioner->lru_tail = partition;
+  }
+  partitioner->lru_head = partition;
+}
+
+static int close_partition(partitioner_t *partitioner, partition_t *partition) {
+  lru_unlink(partitioner, partition);
+  partitioner->open--;
+  int failed = fclose(partition->fp) != 0;
+  partition->fp = NULL;
+  if (failed) {
+    avro_set_error("Cannot write partition '%s': %s", partition->key, strerror(errno));
+    return EIO;
+  }
+  return 0;
+}
+
+static int open_partition(partitioner_t *partitioner, partition_t *partition) {
+  size_t max_open = partitioner->conf->max_open_partitions > 0
+                        ? partitioner->conf->max_open_partitions
+                        : DEFAULT_MAX_OPEN_PARTITIONS;
+  if (partitioner->open >= max_open) {
+    CHECKED_EV(close_partition(partitioner, partitioner->lru_tail));
+  }
+
+  const char *prefix = partitioner->conf->partition_prefix != NULL
+                           ? partitioner->conf->partition_prefix
+                           : DEFAULT_PARTITION_PREFIX;
+  size_t path_size = strlen(prefix) + strlen(partition->key) + strlen(partitioner->extension) + 1;
+  char *path = (char *)malloc(path_size);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  snprintf(path, path_size, "%s%s%s", prefix, partition->key, partitioner->extension);
+  // Files are truncated when first opened by this run, appended to later
+  partition->fp = fopen(path, partition->written ? "ab" : "wb");
+  if (partition->fp == NULL) {
+    int rval = errno;
+    avro_set_error("Cannot open partition file '%s': %s", path, strerror(rval));
+    free(path);
+    return rval;
+  }
+  free(path);
+  setvbuf(partition->fp, NULL, _IOFBF, PARTITION_BUFFER_SIZE);
+  partition->written = 1;
+  partitioner->open++;
+  lru_push(partitioner, partition);
+  return 0;
+}
+
+static int grow_buckets(partitioner_t *partitioner) {
+  size_t count = 2 * partitioner->buckets_count;
+  partition_t **buckets = (partition_t **)calloc(count, sizeof(partition_t *));
+  if (buckets == NULL) {
+    return ENOMEM;
+  }
+  for (size_t i = 0; i < partitioner->buckets_count; ++i) {
+    partition_t *partition = partitioner->buckets[i];
+    while (partition != NULL) {
+      partition_t *next = partition->next;
+      partition->next = buckets[partition->hash % count];
+      buckets[partition->hash % count] = partition;
+      partition = next;
+    }
+  }
+  free(partitioner->buckets);
+  partitioner->buckets = buckets;
+  partitioner->buckets_count = count;
+  return 0;
+}
+
+static int find_partition(partitioner_t *partitioner, partition_t **result) {
+  uint64_t hash = rabin_fingerprint(partitioner->key, partitioner->key_size);
+  partition_t *partition = partitioner->buckets[hash % partitioner->buckets_count];
+  while (partition != NULL &&
+         (partition->hash != hash || strcmp(partition->key, partitioner->key))) {
+    partition = partition->next;
+  }
+
+  if (partition == NULL) {
+    if (partitioner->size >= partitioner->buckets_count) {
+      CHECKED_EV(grow_buckets(partitioner));
+    }
+    partition = (partition_t *)calloc(1, sizeof(partition_t));
+    if (partition == NULL || (partition->key = strdup(partitioner->key)) == NULL) {
+      free(partition);
+      return ENOMEM;
+    }
+    partition->hash = hash;
+    partition->next = partitioner->buckets[hash % partitioner->buckets_count];
+    partitioner->buckets[hash % partitioner->buckets_count] = partition;
+    partitioner->size++;
+  }
+  *result = partition;
+  return 0;
+}
+
+int partitioner_route(partitioner_t *partitioner, const char *record, const char *end,
+                      FILE **dest) {
+  CHECKED_EV(record_key(partitioner, record, end));
+
+  partition_t *partition = partitioner->last;
+  if (partition == NULL || strcmp(partition->key, partitioner->key)) {
+    CHECKED_EV(find_partition(partitioner, &partition));
+  }
+  if (partition->fp == NULL) {
+    CHECKED_EV(open_partition(partitioner, partition));
+  } else if (partition != partitioner->lru_head) {
+    lru_unlink(partitioner, partition);
+    lru_push(partitioner, partition);
+  }
+  partitioner->last = partition;
+  *dest = partition->fp;
+  return 0;
+}
+
+int partitioner_flush(partitioner_t *partitioner) {
+  for (partition_t *partition = partitioner->lru_head; partition != NULL;
+       partition = partition->lru_next) {
+    if (fflush(partition->fp) != 0) {
+      avro_set_error("Cannot write partition '%s': %s", partition->key, strerror(errno));
+      return EIO;
+    }
+  }
+  return 0;
+}
+
+int partitioner_close(partitioner_t *partitioner) {
+  int rval = 0;
+  while (partitioner->lru_head != NULL) {
+    int closed = close_partition(partitioner, partitioner->lru_head);
+    rval = rval != 0 ? rval : closed;
+  }
+  return rval;
+}
+
+void partitioner_free(partitioner_t *partitioner) {
+  partitioner_close(partitioner);
+  for (size_t i = 0; i < partitioner->buckets_count; ++i) {
+    partition_t *partition = partitioner->buckets[i];
+    while (partition != NULL) {
+      partition_t *next = partition->next;
+      free(partition->key);
+      free(partition);
+      partition = next;
+    }
+  }
+  free(partitioner->buckets);
+  free(partitioner->key);
+  free(partitioner);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <avro.h>
+#include <stdio.h>
+
+#include "config.h"
+
+/*
+ * Routing of records to output files by the value of a top-level column
+ * (--partition-by). Records go either to one of a fixed number of files by
+ * hash of the column value, or to a file per distinct value (--by-value).
+ *
+ * Every partition is written through its own buffered stream. At most
+ * 'max_open_partitions' files are kept open: the least recently used one is
+ * closed when another needs to be opened, and reopened for appending when
+ * it's needed again.
+ */
+typedef struct partitioner_t partitioner_t;
+
+// Default of --partitions
+#define DEFAULT_PARTITIONS 16
+// Default of --max-open-partitions
+#define DEFAULT_MAX_OPEN_PARTITIONS 64
+// Default of --partition-prefix, files are named <prefix><partition>.json
+#define DEFAULT_PARTITION_PREFIX "part-"
+
+/**
+ * Prepares routing of records of the given schema.
+ * Returns 0 on success, or EINVAL (with Avro error set) if the column
+ * doesn't exist, or can't be used to partition by value.
+ */
+int partitioner_new(avro_schema_t schema, const config_t *conf, partitioner_t **partitioner);
+
+/**
+ * Closes all files without reporting errors, see partitioner_close().
+ */
+void partitioner_free(partitioner_t *partitioner);
+
+/**
+ * Gets the output stream of the binary encoded record [record, end). The
+ * stream is valid until the next call, which might close it.
+ */
+int partitioner_route(partitioner_t *partitioner, const char *record, const char *end,
+                      FILE **dest);
+
+/**
+ * Flushes output of all open partitions.
+ */
+int partitioner_flush(partitioner_t *partitioner);
+
+/**
+ * Flushes and closes all open partitions, reporting write errors.
+ */
+int partitioner_close(partitioner_t *partitioner);
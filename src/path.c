@@ -0,0 +1,228 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary.h"
+#include "path.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+int path_is_nested(const char *column) {
+  return strchr(column, '.') != NULL || strchr(column, '[') != NULL;
+}
+
+static int malformed(const char *column) {
+  avro_set_error("Invalid column path '%s', expected e.g. a.b[\"key\"].c", column);
+  return EINVAL;
+}
+
+static path_step_t *add_step(path_t *path) {
+  path_step_t *steps =
+      (path_step_t *)realloc(path->steps, (path->steps_count + 1) * sizeof(path_step_t));
+  if (steps == NULL) {
+    return NULL;
+  }
+  path->steps = steps;
+  path_step_t *step = &steps[path->steps_count++];
+  memset(step, 0, sizeof(path_step_t));
+  step->branch = -1;
+  return step;
+}
+
+// Parses a quoted map key, where quotes and backslashes are escaped with
+// a backslash, up to the closing bracket
+static int parse_key(const char *column, const char **p, path_step_t *step) {
+  const char *s = *p;
+  if (*s++ != '"') {
+    return malformed(column);
+  }
+  step->key = (char *)malloc(strlen(s) + 1);
+  if (step->key == NULL) {
+    return ENOMEM;
+  }
+  while (*s != '"') {
+    if (*s == '\0') {
+      return malformed(column);
+    }
+    if (*s == '\\' && (s[1] == '"' || s[1] == '\\')) {
+      s++;
+    }
+    step->key[step->key_size++] = *s++;
+  }
+  step->key[step->key_size] = '\0';
+  if (s[1] != ']') {
+    return malformed(column);
+  }
+  *p = s + 2;
+  return 0;
+}
+
+// Enters the non-null branch of a nullable union, remembering it in the step
+static int enter_union(const char *column, avro_schema_t *schema, path_step_t *step) {
+  if (!is_avro_union(*schema)) {
+    return 0;
+  }
+  if (avro_schema_union_size(*schema) == 2) {
+    for (int i = 0; i < 2; ++i) {
+      if (is_avro_null(binary_resolve_schema(avro_schema_union_branch(*schema, 1 - i)))) {
+        step->branch = i;
+        *schema = binary_resolve_schema(avro_schema_union_branch(*schema, i));
+        return 0;
+      }
+    }
+  }
+  avro_set_error("Column path '%s' goes through a union which isn't nullable", column);
+  return EINVAL;
+}
+
+// Parses the path into steps, resolving every step against the schema. Sets
+// 'missing' when a record lacks the field.
+static int resolve(const char *column, path_t *path, int *missing) {
+  avro_schema_t schema = path->leaf;
+  const char *p = column;
+  for (;;) {
+    path_step_t *step = add_step(path);
+    if (step == NULL) {
+      return ENOMEM;
+    }
+    schema = binary_resolve_schema(schema);
+    CHECKED_EV(enter_union(column, &schema, step));
+    step->schema = schema;
+
+    if (*p == '[') {
+      p++;
+      step->kind = PATH_MAP_KEY;
+      CHECKED_EV(parse_key(column, &p, step));
+      if (!is_avro_map(schema)) {
+        avro_set_error("Column path '%s' looks up a key in a value which isn't a map", column);
+        return EINVAL;
+      }
+      schema = avro_schema_map_values(schema);
+    } else {
+      const char *name = p;
+      while (isalnum((unsigned char)*p) || *p == '_') {
+        p++;
+      }
+      if (p == name) {
+        return malformed(column);
+      }
+      if (!is_avro_record(schema)) {
+        avro_set_error("Column path '%s' looks up a field in a value which isn't a record", column);
+        return EINVAL;
+      }
+      char field_name[256];
+      if ((size_t)(p - name) >= sizeof(field_name)) {
+        return malformed(column);
+      }
+      memcpy(field_name, name, p - name);
+      field_name[p - name] = '\0';
+      step->kind = PATH_FIELD;
+      step->field_index = avro_schema_record_field_get_index(schema, field_name);
+      if (step->field_index < 0) {
+        *missing = 1;
+        return 0;
+      }
+      schema = avro_schema_record_field_get_by_index(schema, step->field_index);
+    }
+
+    path->leaf = schema;
+    if (*p == '\0') {
+      return 0;
+    }
+    // Map keys follow without a dot
+    if (*p == '.') {
+      p++;
+    } else if (*p != '[') {
+      return malformed(column);
+    }
+  }
+}
+
+int path_new(const char *column, avro_schema_t record, path_t **path) {
+  *path = (path_t *)calloc(1, sizeof(path_t));
+  if (*path == NULL) {
+    return ENOMEM;
+  }
+  (*path)->leaf = record;
+  int missing = 0;
+  int rval = resolve(column, *path, &missing);
+  if (rval != 0 || missing) {
+    path_free(*path);
+    *path = NULL;
+  }
+  return rval;
+}
+
+void path_free(path_t *path) {
+  for (size_t i = 0; i < path->steps_count; ++i) {
+    free(path->steps[i].key);
+  }
+  free(path->steps);
+  free(path);
+}
+
+// Finds the value of the key in the map, leaving '*p' at its start
+static int find_map_key(const path_step_t *step, const char **p, const char *end,
+                        int *found) {
+  avro_schema_t values = avro_schema_map_values(step->schema);
+  for (;;) {
+    int64_t count;
+    CHECKED_EV(binary_read_long(p, end, &count));
+    if (count == 0) {
+      *found = 0;
+      return 0;
+    }
+    // Negative count is followed by size of the block in bytes
+    if (count < 0) {
+      int64_t size;
+      CHECKED_EV(binary_read_long(p, end, &size));
+      count = -count;
+    }
+    for (int64_t i = 0; i < count; ++i) {
+      const char *key;
+      size_t size;
+      CHECKED_EV(binary_read_bytes(p, end, &key, &size));
+      if (size == step->key_size && !memcmp(key, step->key, size)) {
+        *found = 1;
+        return 0;
+      }
+      CHECKED_EV(binary_skip(values, p, end));
+    }
+  }
+}
+
+int path_read(const path_t *path, size_t first, const char *p, const char *end,
+              const char **value) {
+  *value = NULL;
+  for (size_t i = first; i < path->steps_count; ++i) {
+    const path_step_t *step = &path->steps[i];
+    if (step->branch >= 0) {
+      int64_t branch;
+      CHECKED_EV(binary_read_long(&p, end, &branch));
+      if (branch != step->branch) {
+        return 0;
+      }
+    }
+    if (step->kind == PATH_FIELD) {
+      for (int j = 0; j < step->field_index; ++j) {
+        CHECKED_EV(binary_skip(avro_schema_record_field_get_by_index(step->schema, j), &p, end));
+      }
+    } else {
+      int found;
+      CHECKED_EV(find_map_key(step, &p, end, &found));
+      if (!found) {
+        return 0;
+      }
+    }
+  }
+  *value = p;
+  return 0;
+}
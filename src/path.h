@@ -0,0 +1,51 @@
+#pragma once
+
+#include <avro.h>
+#include <stddef.h>
+
+/*
+ * Paths of nested values in --columns, e.g. body.user.id or props["k"].
+ * They are resolved against the writer schema once, so that a record is
+ * only walked as far as the addressed value, skipping everything else.
+ */
+
+typedef enum { PATH_FIELD, PATH_MAP_KEY } path_step_kind_t;
+
+typedef struct {
+  path_step_kind_t kind;
+  int branch;           // of nullable union entered before the step, or -1
+  avro_schema_t schema; // record or map the step goes into
+  int field_index;      // with PATH_FIELD
+  char *key;            // with PATH_MAP_KEY
+  size_t key_size;
+} path_step_t;
+
+typedef struct {
+  path_step_t *steps;
+  size_t steps_count;
+  avro_schema_t leaf; // schema of the addressed value
+} path_t;
+
+/**
+ * Tells whether the column of --columns is a path rather than a field name.
+ */
+int path_is_nested(const char *column);
+
+/**
+ * Parses the path and resolves it against the record schema. Sets '*path'
+ * to NULL when a field on the path doesn't exist, since missing columns are
+ * skipped. Returns EINVAL (with Avro error set) when the path is malformed,
+ * or goes through a value which is neither record, map nor nullable union.
+ */
+int path_new(const char *column, avro_schema_t record, path_t **path);
+
+void path_free(path_t *path);
+
+/**
+ * Locates the addressed value in binary encoded data, starting from 'p'
+ * where the value entered by step 'first' starts. Sets '*value' to the
+ * start of the addressed value, or to NULL when it's null: a nullable union
+ * on the way is null, or a map lacks the key.
+ */
+int path_read(const path_t *path, size_t first, const char *p, const char *end,
+              const char **value);
@@ -0,0 +1,26 @@
+#include <avro.h>
+#include <dlfcn.h>
+#include <errno.h>
+
+#include "plugin.h"
+
+int plugin_load(const char *path, const converter_plugin_t **plugin) {
+  void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (handle == NULL) {
+    avro_set_error("Cannot load converter '%s': %s", path, dlerror());
+    return EINVAL;
+  }
+  const converter_plugin_t *loaded = (const converter_plugin_t *)dlsym(handle, PLUGIN_SYMBOL);
+  if (loaded == NULL) {
+    avro_set_error("'%s' is not a converter generated by --emit-converter", path);
+    dlclose(handle);
+    return EINVAL;
+  }
+  if (loaded->abi_version != PLUGIN_ABI_VERSION) {
+    avro_set_error("Converter '%s' was generated by an incompatible version of avro2json", path);
+    dlclose(handle);
+    return EINVAL;
+  }
+  *plugin = loaded;
+  return 0;
+}
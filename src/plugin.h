@@ -0,0 +1,14 @@
+#pragma once
+
+#include "plugin_abi.h"
+
+/*
+ * Loading of converters generated by --emit-converter, with --converter.
+ */
+
+/**
+ * Loads the converter from the shared library at 'path'. The library stays
+ * loaded until exit, since converters are used by conversions of every file.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int plugin_load(const char *path, const converter_plugin_t **plugin);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Interface between avro2json and converters generated by --emit-converter,
+ * built as shared libraries and loaded with --converter. A converter is
+ * specialized to one writer schema and one set of format options: it decodes
+ * fields in their fixed order, with formatters and field name prefixes known
+ * when it was generated. avro2json only uses it for files whose writer schema
+ * has the same fingerprint, and converts other files as usual.
+ *
+ * Converters are built from the generated source together with binary.c,
+ * format.c and logical.c of avro2json, against the Avro library. They may
+ * link a copy of it other than that of avro2json, whose errors avro2json
+ * can't see, so they hand error messages back in their output buffer.
+ */
+
+// Changes whenever the structures below, or the fingerprint, change
+#define PLUGIN_ABI_VERSION 2
+
+// Name of the converter_plugin_t exported by converters
+#define PLUGIN_SYMBOL "avro2json_converter"
+
+// Format options a converter was generated for
+#define PLUGIN_LOGICAL_TYPES 1
+#define PLUGIN_MS_HADOOP_LOGICAL_TYPES 2
+
+// Output of a record, grown by avro2json on demand
+typedef struct plugin_buffer_t {
+  char *data;
+  size_t size;
+  size_t capacity;
+  // Makes room for 'size' more bytes. Returns 0 on success, or error code
+  // (with 'error' set) otherwise.
+  int (*grow)(struct plugin_buffer_t *buffer, size_t size);
+  // Message of the last error, cleared by avro2json before every record
+  char error[256];
+} plugin_buffer_t;
+
+typedef struct converter_plugin_t {
+  int abi_version;      // PLUGIN_ABI_VERSION
+  uint64_t fingerprint; // of the writer schema, with its logical types
+  int options;          // PLUGIN_* format options
+  // Converts the binary encoded record at '*p' to a JSON line appended to
+  // 'out', advancing '*p' past its end. Returns 0 on success, or error code
+  // (with out->error set) otherwise.
+  int (*convert_record)(const char **p, const char *end, plugin_buffer_t *out);
+} converter_plugin_t;
+
+static inline int plugin_reserve(plugin_buffer_t *out, size_t size) {
+  return out->capacity - out->size >= size ? 0 : out->grow(out, size);
+}
+
+static inline int plugin_write(plugin_buffer_t *out, const char *data, size_t size) {
+  int rval = plugin_reserve(out, size);
+  if (rval == 0) {
+    memcpy(out->data + out->size, data, size);
+    out->size += size;
+  }
+  return rval;
+}
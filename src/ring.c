@@ -0,0 +1,100 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include "ring.h"
+
+int ring_init(ring_t *ring, size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  ring->slots = (void **)calloc(size, sizeof(void *));
+  if (ring->slots == NULL) {
+    return ENOMEM;
+  }
+  ring->capacity = size;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->closed, 0);
+  atomic_init(&ring->waiting, 0);
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->changed, NULL);
+  return 0;
+}
+
+void ring_destroy(ring_t *ring) {
+  pthread_cond_destroy(&ring->changed);
+  pthread_mutex_destroy(&ring->lock);
+  free(ring->slots);
+  ring->slots = NULL;
+}
+
+// Sleeps until the other side moves its index away from the one seen by the
+// caller, or closes the ring. Setting 'waiting' before checking the indexes
+// again means that the other side either sees it and wakes the caller up, or
+// has already moved its index.
+static void ring_sleep(ring_t *ring, size_t head, size_t tail) {
+  pthread_mutex_lock(&ring->lock);
+  atomic_fetch_add(&ring->waiting, 1);
+  if (atomic_load(&ring->head) == head && atomic_load(&ring->tail) == tail &&
+      !atomic_load(&ring->closed)) {
+    pthread_cond_wait(&ring->changed, &ring->lock);
+  }
+  atomic_fetch_sub(&ring->waiting, 1);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+static void ring_wake(ring_t *ring) {
+  if (atomic_load(&ring->waiting)) {
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+  }
+}
+
+int ring_push(ring_t *ring, void *item) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  for (;;) {
+    if (atomic_load(&ring->closed)) {
+      return EPIPE;
+    }
+    size_t head = atomic_load(&ring->head);
+    if (tail - head < ring->capacity) {
+      break;
+    }
+    ring_sleep(ring, head, tail);
+  }
+  ring->slots[tail & (ring->capacity - 1)] = item;
+  atomic_store(&ring->tail, tail + 1);
+  ring_wake(ring);
+  return 0;
+}
+
+void *ring_pop(ring_t *ring) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  for (;;) {
+    size_t tail = atomic_load(&ring->tail);
+    if (tail != head) {
+      break;
+    }
+    // Items pushed before the ring was closed are still popped
+    if (atomic_load(&ring->closed)) {
+      if (atomic_load(&ring->tail) == head) {
+        return NULL;
+      }
+      continue;
+    }
+    ring_sleep(ring, head, tail);
+  }
+  void *item = ring->slots[head & (ring->capacity - 1)];
+  atomic_store(&ring->head, head + 1);
+  ring_wake(ring);
+  return item;
+}
+
+void ring_close(ring_t *ring) {
+  atomic_store(&ring->closed, 1);
+  pthread_mutex_lock(&ring->lock);
+  pthread_cond_broadcast(&ring->changed);
+  pthread_mutex_unlock(&ring->lock);
+}
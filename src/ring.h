@@ -0,0 +1,49 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+/*
+ * Bounded single-producer/single-consumer queue of pointers, connecting the
+ * stages of --pipeline. Pushing and popping don't take a lock; the lock is
+ * only taken by a side that has to sleep until the ring is no longer full
+ * (or empty), and by the other side to wake it up.
+ */
+
+typedef struct {
+  void **slots;
+  size_t capacity;    // power of two
+  atomic_size_t head; // next slot to pop, advanced by the consumer only
+  atomic_size_t tail; // next slot to push, advanced by the producer only
+  atomic_int closed;
+  atomic_int waiting; // number of sleeping sides
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} ring_t;
+
+/**
+ * Initializes the ring holding up to 'capacity' items, rounded up to a power
+ * of two. Returns 0 on success, or ENOMEM.
+ */
+int ring_init(ring_t *ring, size_t capacity);
+
+void ring_destroy(ring_t *ring);
+
+/**
+ * Pushes the item, waiting while the ring is full. Returns EPIPE when the
+ * ring has been closed.
+ */
+int ring_push(ring_t *ring, void *item);
+
+/**
+ * Pops the oldest item, waiting while the ring is empty. Returns NULL when
+ * the ring has been closed and there are no more items.
+ */
+void *ring_pop(ring_t *ring);
+
+/**
+ * Closes the ring, waking up both sides: the producer when it's done, or the
+ * consumer when it stops early.
+ */
+void ring_close(ring_t *ring);
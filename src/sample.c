@@ -0,0 +1,90 @@
+#include <avro.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample.h"
+
+// SplitMix64 finalizer, see http://xoshiro.di.unimi.it/splitmix64.c
+static uint64_t mix64(uint64_t x) {
+  x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return x ^ (x >> 31);
+}
+
+static uint64_t next_random(uint64_t *state) {
+  *state += UINT64_C(0x9e3779b97f4a7c15);
+  return mix64(*state);
+}
+
+// Uniform double in [0, 1) from the upper 53 bits
+static double to_unit(uint64_t x) {
+  return (double)(x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int sample_block_selected(uint64_t seed, int64_t block_index, double fraction) {
+  if (fraction >= 1.0) {
+    return 1;
+  }
+  uint64_t x = mix64(seed + UINT64_C(0x9e3779b97f4a7c15) * (uint64_t)(block_index + 1));
+  return to_unit(x) < fraction;
+}
+
+int reservoir_init(reservoir_t *reservoir, size_t capacity, uint64_t seed) {
+  memset(reservoir, 0, sizeof(reservoir_t));
+  reservoir->slots = (reservoir_slot_t *)calloc(capacity, sizeof(reservoir_slot_t));
+  if (reservoir->slots == NULL) {
+    avro_set_error("Cannot allocate sample of %zu records", capacity);
+    return ENOMEM;
+  }
+  reservoir->capacity = capacity;
+  reservoir->rng = seed;
+  return 0;
+}
+
+void reservoir_free(reservoir_t *reservoir) {
+  for (size_t i = 0; i < reservoir->capacity; ++i) {
+    free(reservoir->slots[i].data);
+  }
+  free(reservoir->slots);
+}
+
+static int slot_store(reservoir_slot_t *slot, uint64_t seq, const char *data,
+                      size_t size) {
+  if (slot->capacity < size) {
+    char *buf = (char *)realloc(slot->data, size);
+    if (buf == NULL) {
+      avro_set_error("Cannot allocate sampled record");
+      return ENOMEM;
+    }
+    slot->data = buf;
+    slot->capacity = size;
+  }
+  memcpy(slot->data, data, size);
+  slot->size = size;
+  slot->seq = seq;
+  return 0;
+}
+
+int reservoir_offer(reservoir_t *reservoir, const char *data, size_t size) {
+  uint64_t seq = reservoir->seen++;
+  if (reservoir->size < reservoir->capacity) {
+    return slot_store(&reservoir->slots[reservoir->size++], seq, data, size);
+  }
+  // Algorithm R: the n-th record replaces a random slot with probability k/n
+  uint64_t j = next_random(&reservoir->rng) % reservoir->seen;
+  if (j < reservoir->capacity) {
+    return slot_store(&reservoir->slots[j], seq, data, size);
+  }
+  return 0;
+}
+
+static int compare_slots(const void *a, const void *b) {
+  uint64_t x = ((const reservoir_slot_t *)a)->seq;
+  uint64_t y = ((const reservoir_slot_t *)b)->seq;
+  return x < y ? -1 : x > y;
+}
+
+void reservoir_finish(reservoir_t *reservoir) {
+  qsort(reservoir->slots, reservoir->size, sizeof(reservoir_slot_t), compare_slots);
+}
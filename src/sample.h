@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decides whether the block with the given index belongs to a sample of
+ * 'fraction' of blocks. The decision depends only on seed and block index,
+ * so the same seed always selects the same blocks.
+ */
+int sample_block_selected(uint64_t seed, int64_t block_index, double fraction);
+
+typedef struct {
+  uint64_t seq;  // position of the record in the input
+  char *data;    // binary encoded record
+  size_t size;
+  size_t capacity;
+} reservoir_slot_t;
+
+/**
+ * Uniform sample of up to 'capacity' records (reservoir sampling), holding
+ * copies of binary encoded records until the whole input is seen.
+ */
+typedef struct {
+  reservoir_slot_t *slots;
+  size_t capacity;
+  size_t size;
+  uint64_t seen;
+  uint64_t rng;
+} reservoir_t;
+
+/**
+ * Returns 0 on success, or ENOMEM (with Avro error set) otherwise.
+ */
+int reservoir_init(reservoir_t *reservoir, size_t capacity, uint64_t seed);
+
+void reservoir_free(reservoir_t *reservoir);
+
+/**
+ * Offers a binary encoded record to the sample, copying it if selected.
+ */
+int reservoir_offer(reservoir_t *reservoir, const char *data, size_t size);
+
+/**
+ * Sorts sampled records in input order, so they can be emitted from slots.
+ */
+void reservoir_finish(reservoir_t *reservoir);
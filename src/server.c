@@ -0,0 +1,402 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+
+#define LISTEN_BACKLOG 64
+#define RECEIVE_CHUNK_SIZE 4096
+#define MAX_REQUEST_SIZE (1024 * 1024)
+#define MAX_PENDING_FDS 16
+
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+typedef struct connection_t {
+  int fd;
+  struct connection_t *next;
+} connection_t;
+
+typedef struct {
+  job_handler_t handler;
+  void *ctx;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  connection_t *head;
+  connection_t *tail;
+  int *active_fds; // connection served by every worker, or -1
+  size_t workers;
+  int shutdown;
+} server_t;
+
+typedef struct {
+  server_t *server;
+  size_t idx;
+} worker_t;
+
+// State of a single client connection
+typedef struct {
+  int fd;
+  char *buf;
+  size_t size;
+  size_t capacity;
+  int fds[MAX_PENDING_FDS]; // descriptors received via SCM_RIGHTS, in order
+  size_t fds_count;
+} conn_state_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop_signal(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+static ssize_t conn_receive(conn_state_t *conn) {
+  if (conn->capacity - conn->size < RECEIVE_CHUNK_SIZE) {
+    size_t capacity = conn->capacity + RECEIVE_CHUNK_SIZE;
+    char *buf = (char *)realloc(conn->buf, capacity);
+    if (buf == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+    conn->buf = buf;
+    conn->capacity = capacity;
+  }
+
+  struct iovec iov = {.iov_base = conn->buf + conn->size,
+                      .iov_len = conn->capacity - conn->size};
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * MAX_PENDING_FDS)];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg = {0};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t n;
+  do {
+    n = recvmsg(conn->fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    return n;
+  }
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    int *fds = (int *)CMSG_DATA(cmsg);
+    for (size_t i = 0; i < count; ++i) {
+      if (conn->fds_count < MAX_PENDING_FDS) {
+        conn->fds[conn->fds_count++] = fds[i];
+      } else {
+        close(fds[i]);
+      }
+    }
+  }
+
+  conn->size += n;
+  return n;
+}
+
+static int conn_pop_fd(conn_state_t *conn) {
+  if (conn->fds_count == 0) {
+    return -1;
+  }
+  int fd = conn->fds[0];
+  memmove(conn->fds, conn->fds + 1, sizeof(int) * --conn->fds_count);
+  return fd;
+}
+
+static void send_response(int fd, json_t *response) {
+  char *str = json_dumps(response, JSON_COMPACT);
+  if (str == NULL) {
+    return;
+  }
+  size_t size = strlen(str);
+  str[size++] = '\n'; // replaces the terminating zero, which isn't sent
+
+  for (size_t sent = 0; sent < size;) {
+    ssize_t n = send(fd, str + sent, size - sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    sent += n;
+  }
+  free(str);
+}
+
+static void handle_request(server_t *server, conn_state_t *conn,
+                           const char *line) {
+  json_t *response = json_object();
+  if (response == NULL) {
+    return;
+  }
+
+  json_error_t error;
+  json_t *request = json_loads(line, 0, &error);
+  if (!json_is_object(request)) {
+    json_object_set_new(response, "status", json_string("error"));
+    json_object_set_new(response, "error",
+                        json_string(request ? "Job request must be a JSON object"
+                                            : error.text));
+  } else {
+    json_t *id = json_object_get(request, "id");
+    if (id != NULL) {
+      json_object_set(response, "id", id);
+    }
+    // Jobs that don't specify an output path consume descriptors passed
+    // on this connection, in the order they were sent.
+    int out_fd = -1;
+    if (json_object_get(request, "output") == NULL) {
+      out_fd = conn_pop_fd(conn);
+    }
+    server->handler(request, out_fd, response, server->ctx);
+    if (out_fd >= 0) {
+      close(out_fd);
+    }
+  }
+
+  send_response(conn->fd, response);
+  json_decref(response);
+  json_decref(request);
+}
+
+static void handle_connection(server_t *server, int fd) {
+  conn_state_t conn = {.fd = fd};
+
+  for (;;) {
+    char *eol = NULL;
+    while (conn.size == 0 ||
+           (eol = (char *)memchr(conn.buf, '\n', conn.size)) == NULL) {
+      if (conn.size >= MAX_REQUEST_SIZE) {
+        json_t *response = json_pack("{s:s, s:s}", "status", "error", "error",
+                                     "Job request is too large");
+        send_response(fd, response);
+        json_decref(response);
+        goto out;
+      }
+      if (conn_receive(&conn) <= 0) {
+        goto out;
+      }
+    }
+
+    *eol = '\0';
+    handle_request(server, &conn, conn.buf);
+
+    size_t consumed = eol - conn.buf + 1;
+    memmove(conn.buf, conn.buf + consumed, conn.size - consumed);
+    conn.size -= consumed;
+  }
+
+out:
+  while (conn.fds_count > 0) {
+    close(conn_pop_fd(&conn));
+  }
+  free(conn.buf);
+  close(fd);
+}
+
+static void *worker_main(void *arg) {
+  worker_t *worker = (worker_t *)arg;
+  server_t *server = worker->server;
+
+  for (;;) {
+    pthread_mutex_lock(&server->lock);
+    while (server->head == NULL && !server->shutdown) {
+      pthread_cond_wait(&server->cond, &server->lock);
+    }
+    if (server->head == NULL) {
+      pthread_mutex_unlock(&server->lock);
+      break;
+    }
+    connection_t *conn = server->head;
+    server->head = conn->next;
+    if (server->head == NULL) {
+      server->tail = NULL;
+    }
+    server->active_fds[worker->idx] = conn->fd;
+    pthread_mutex_unlock(&server->lock);
+
+    handle_connection(server, conn->fd);
+
+    pthread_mutex_lock(&server->lock);
+    server->active_fds[worker->idx] = -1;
+    pthread_mutex_unlock(&server->lock);
+    free(conn);
+  }
+  return NULL;
+}
+
+static int enqueue_connection(server_t *server, int fd) {
+  connection_t *conn = (connection_t *)malloc(sizeof(connection_t));
+  if (conn == NULL) {
+    return ENOMEM;
+  }
+  conn->fd = fd;
+  conn->next = NULL;
+
+  pthread_mutex_lock(&server->lock);
+  if (server->tail != NULL) {
+    server->tail->next = conn;
+  } else {
+    server->head = conn;
+  }
+  server->tail = conn;
+  pthread_cond_signal(&server->cond);
+  pthread_mutex_unlock(&server->lock);
+  return 0;
+}
+
+static int listen_on(const char *socket_path) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Error: socket path '%s' is too long\n", socket_path);
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    fprintf(stderr, "Error creating socket: %s\n", strerror(errno));
+    return -1;
+  }
+
+  unlink(socket_path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(fd, LISTEN_BACKLOG) < 0) {
+    fprintf(stderr, "Error listening on '%s': %s\n", socket_path,
+            strerror(errno));
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+int serve(const char *socket_path, size_t workers, job_handler_t handler,
+          void *ctx) {
+  int listen_fd = listen_on(socket_path);
+  if (listen_fd < 0) {
+    return errno;
+  }
+
+  // Clients that go away must not terminate the server
+  signal(SIGPIPE, SIG_IGN);
+
+  struct sigaction sa = {0};
+  sa.sa_handler = on_stop_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  server_t server = {.handler = handler, .ctx = ctx, .workers = workers};
+  pthread_mutex_init(&server.lock, NULL);
+  pthread_cond_init(&server.cond, NULL);
+  server.active_fds = (int *)malloc(sizeof(int) * workers);
+  worker_t *worker_args = (worker_t *)malloc(sizeof(worker_t) * workers);
+  pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * workers);
+  if (server.active_fds == NULL || worker_args == NULL || threads == NULL) {
+    free(server.active_fds);
+    free(worker_args);
+    free(threads);
+    close(listen_fd);
+    return ENOMEM;
+  }
+
+  // Stop signals must interrupt accept() below, so workers don't receive them
+  sigset_t stop_signals, old_mask;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+
+  size_t started = 0;
+  for (; started < workers; ++started) {
+    server.active_fds[started] = -1;
+    worker_args[started].server = &server;
+    worker_args[started].idx = started;
+    if (pthread_create(&threads[started], NULL, worker_main,
+                       &worker_args[started]) != 0) {
+      break;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+  int rval = 0;
+  if (started < workers) {
+    fprintf(stderr, "Error starting worker threads\n");
+    rval = EAGAIN;
+  }
+
+  while (rval == 0 && !stop_requested) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      fprintf(stderr, "Error accepting connection: %s\n", strerror(errno));
+      if (errno == EMFILE || errno == ENFILE) {
+        sleep(1);
+        continue;
+      }
+      rval = errno;
+      break;
+    }
+    if ((rval = enqueue_connection(&server, fd)) != 0) {
+      close(fd);
+    }
+  }
+
+  // Let workers finish jobs in progress, and stop reading new ones
+  pthread_mutex_lock(&server.lock);
+  server.shutdown = 1;
+  for (connection_t *conn = server.head; conn != NULL; conn = conn->next) {
+    shutdown(conn->fd, SHUT_RD);
+  }
+  for (size_t i = 0; i < started; ++i) {
+    if (server.active_fds[i] >= 0) {
+      shutdown(server.active_fds[i], SHUT_RD);
+    }
+  }
+  pthread_cond_broadcast(&server.cond);
+  pthread_mutex_unlock(&server.lock);
+
+  for (size_t i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  while (server.head != NULL) {
+    connection_t *conn = server.head;
+    server.head = conn->next;
+    close(conn->fd);
+    free(conn);
+  }
+
+  close(listen_fd);
+  unlink(socket_path);
+  pthread_cond_destroy(&server.cond);
+  pthread_mutex_destroy(&server.lock);
+  free(server.active_fds);
+  free(worker_args);
+  free(threads);
+  return rval;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <jansson.h>
+#include <stddef.h>
+
+/**
+ * Handles a single conversion job.
+ *
+ * 'request' is the parsed JSON job description, 'out_fd' is the descriptor
+ * passed along with the request via SCM_RIGHTS (or -1 if none was passed).
+ * The handler fills 'response' with job status and statistics, and must not
+ * close 'out_fd'.
+ */
+typedef void (*job_handler_t)(const json_t *request, int out_fd,
+                              json_t *response, void *ctx);
+
+/**
+ * Listens on a Unix domain socket at 'socket_path', and dispatches jobs
+ * arriving on accepted connections to a pool of 'workers' threads.
+ *
+ * Every connection carries a sequence of newline-delimited JSON job
+ * requests, each answered with a single newline-delimited JSON response.
+ * Returns when the process receives SIGINT or SIGTERM.
+ */
+int serve(const char *socket_path, size_t workers, job_handler_t handler,
+          void *ctx);
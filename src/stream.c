@@ -0,0 +1,1042 @@
+#include <avro.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary.h"
+#include "format.h"
+#include "logical.h"
+#include "memo.h"
+#include "memstats.h"
+#include "names.h"
+#include "path.h"
+#include "stream.h"
+#include "transform.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+#define WRITER_BUFFER_SIZE (64 * 1024)
+
+// Strings are escaped in chunks of this size (plus an incomplete character)
+#define ESCAPE_CHUNK_SIZE 4096
+#define ESCAPE_BUFFER_SIZE (6 * (ESCAPE_CHUNK_SIZE + 4))
+
+typedef struct {
+  FILE *dest; // NULL when writing to memory, see stream_json()
+  char buf[WRITER_BUFFER_SIZE];
+  size_t size;
+  int csv_quoted; // writing JSON into a CSV field, so quotes are doubled
+  size_t record_start; // where the record being written starts in buf
+  char *mem; // all output when writing to memory, or else the part of the
+             // record being written that didn't fit in buf
+  size_t mem_size;
+  size_t mem_capacity;
+} writer_t;
+
+struct stream_t {
+  const config_t *conf;
+  size_t memory_limit;
+  avro_schema_t record;
+  size_t fields_count;
+  int *columns;              // field of every --columns entry, or NULL
+  const char **field_starts; // where every field starts, with --columns
+  transform_t **transforms;  // transformation of every --columns entry
+  path_t **paths;            // of nested --columns entries, NULL for fields
+  writer_t out;
+  char escaped[ESCAPE_BUFFER_SIZE];
+  decimal_t *dec;
+  char *dec_str;
+  size_t dec_str_size;
+  char *dec_bytes; // copy of decimal bytes, as they are converted in place
+  size_t dec_bytes_capacity;
+  memo_t **memos; // formatted values of every output column, created on use
+  size_t memos_count;
+  size_t column; // output column being written, or SIZE_MAX
+  names_t *names;              // rendered names of records and enums
+  name_text_t *column_names;   // "name": of every output column
+  key_cache_t *keys;           // rendered map keys
+  const converter_plugin_t *plugin; // of --converter, converting whole records
+  plugin_buffer_t plugin_out;
+};
+
+static int stream_json_value(stream_t *stream, avro_schema_t schema,
+                             const char **p, const char *end);
+
+/*
+ * Output buffering
+ */
+
+// Moves the buffer to the end of memory
+static int writer_spill(writer_t *out) {
+  if (out->mem_size + out->size > out->mem_capacity) {
+    size_t capacity = 2 * (out->mem_size + out->size);
+    char *mem = (char *)memstats_realloc(MEM_OUTPUT, out->mem, capacity);
+    if (mem == NULL) {
+      return ENOMEM;
+    }
+    out->mem = mem;
+    out->mem_capacity = capacity;
+  }
+  memcpy(out->mem + out->mem_size, out->buf, out->size);
+  out->mem_size += out->size;
+  out->size = 0;
+  return 0;
+}
+
+static int writer_write_dest(writer_t *out, const char *data, size_t size) {
+  if (size > 0 && fwrite(data, 1, size, out->dest) < size) {
+    return ferror(out->dest);
+  }
+  return 0;
+}
+
+static int writer_flush(writer_t *out) {
+  if (out->dest == NULL) {
+    return writer_spill(out);
+  }
+  CHECKED_EV(writer_write_dest(out, out->mem, out->mem_size));
+  out->mem_size = 0;
+  CHECKED_EV(writer_write_dest(out, out->buf, out->size));
+  out->size = 0;
+  out->record_start = 0;
+  return 0;
+}
+
+// Makes room in the full buffer. Only complete records are written to the
+// destination file, so that a record failing halfway can be discarded.
+static int writer_make_room(writer_t *out) {
+  if (out->dest == NULL || out->record_start == 0) {
+    // The record being written takes the whole buffer
+    return writer_spill(out);
+  }
+  CHECKED_EV(writer_write_dest(out, out->mem, out->mem_size));
+  out->mem_size = 0;
+  CHECKED_EV(writer_write_dest(out, out->buf, out->record_start));
+  out->size -= out->record_start;
+  memmove(out->buf, out->buf + out->record_start, out->size);
+  out->record_start = 0;
+  return 0;
+}
+
+static int writer_begin_record(writer_t *out) {
+  if (out->dest != NULL && out->mem_size > 0) {
+    // Previous record that didn't fit in the buffer
+    CHECKED_EV(writer_write_dest(out, out->mem, out->mem_size));
+    out->mem_size = 0;
+  }
+  out->record_start = out->size;
+  return 0;
+}
+
+static void writer_discard_record(writer_t *out) {
+  out->size = out->record_start;
+  if (out->dest != NULL) {
+    out->mem_size = 0;
+  }
+}
+
+static int writer_write(writer_t *out, const char *data, size_t size) {
+  if (!out->csv_quoted) {
+    while (size > 0) {
+      if (out->size == WRITER_BUFFER_SIZE) {
+        CHECKED_EV(writer_make_room(out));
+      }
+      size_t chunk = WRITER_BUFFER_SIZE - out->size;
+      if (chunk > size) {
+        chunk = size;
+      }
+      memcpy(out->buf + out->size, data, chunk);
+      out->size += chunk;
+      data += chunk;
+      size -= chunk;
+    }
+    return 0;
+  }
+
+  for (size_t i = 0; i < size; ++i) {
+    if (WRITER_BUFFER_SIZE - out->size < 2) {
+      CHECKED_EV(writer_make_room(out));
+    }
+    if (data[i] == '"') {
+      out->buf[out->size++] = '"';
+    }
+    out->buf[out->size++] = data[i];
+  }
+  return 0;
+}
+
+static int writer_puts(writer_t *out, const char *str) {
+  return writer_write(out, str, strlen(str));
+}
+
+static int writer_putc(writer_t *out, char ch) {
+  return writer_write(out, &ch, 1);
+}
+
+/*
+ * Scalars
+ */
+
+static int check_scalar_size(stream_t *stream, size_t size) {
+  if (size > stream->memory_limit) {
+    avro_set_error("Value of %zu bytes exceeds memory limit of %zu bytes (see --memory-limit)",
+                   size, stream->memory_limit);
+    return EFBIG;
+  }
+  return 0;
+}
+
+static avro_logical_schema_t *logical_type(stream_t *stream, avro_schema_t schema) {
+  return stream->conf->logical_types ? avro_logical_schema(schema) : NULL;
+}
+
+static int write_json_string(stream_t *stream, const char *str, size_t size) {
+  CHECKED_EV(check_scalar_size(stream, size));
+  CHECKED_EV(writer_putc(&stream->out, '"'));
+  size_t pos = 0;
+  while (pos < size) {
+    size_t chunk_end = size - pos > ESCAPE_CHUNK_SIZE ? pos + ESCAPE_CHUNK_SIZE : size;
+    // Don't split UTF-8 encoded characters between chunks
+    while (chunk_end < size && ((unsigned char)str[chunk_end] & 0xc0) == 0x80 &&
+           chunk_end - pos < ESCAPE_CHUNK_SIZE + 3) {
+      chunk_end++;
+    }
+    size_t written;
+    CHECKED_EV(format_json_chars(stream->escaped, str + pos, chunk_end - pos, &written));
+    CHECKED_EV(writer_write(&stream->out, stream->escaped, written));
+    pos = chunk_end;
+  }
+  return writer_putc(&stream->out, '"');
+}
+
+static int write_csv_string(stream_t *stream, const char *str, size_t size) {
+  CHECKED_EV(check_scalar_size(stream, size));
+  if (!csv_needs_quotes(str, size)) {
+    return writer_write(&stream->out, str, size);
+  }
+  CHECKED_EV(writer_putc(&stream->out, '"'));
+  stream->out.csv_quoted = 1;
+  int rval = writer_write(&stream->out, str, size);
+  stream->out.csv_quoted = 0;
+  CHECKED_EV(rval);
+  return writer_putc(&stream->out, '"');
+}
+
+// Writes text that never needs escaping, quoted in JSON
+static int write_text(stream_t *stream, const char *str, int csv) {
+  if (!csv) {
+    CHECKED_EV(writer_putc(&stream->out, '"'));
+  }
+  CHECKED_EV(writer_puts(&stream->out, str));
+  return csv ? 0 : writer_putc(&stream->out, '"');
+}
+
+// Gets the memo of the column being written. Without memory for it, values
+// are just formatted every time.
+static memo_t *column_memo(stream_t *stream) {
+  if (stream->column >= stream->memos_count) {
+    return NULL;
+  }
+  if (stream->memos[stream->column] == NULL) {
+    stream->memos[stream->column] = memo_new();
+  }
+  return stream->memos[stream->column];
+}
+
+static int write_int(stream_t *stream, int64_t value) {
+  char buf[MAX_INT_SIZE];
+  return writer_write(&stream->out, buf, format_int64(buf, value));
+}
+
+static int write_bytes(stream_t *stream, avro_schema_t schema, const char *bytes,
+                       size_t size, int csv) {
+  static int printedByteArrayTelemetry = 0;
+
+  CHECKED_EV(check_scalar_size(stream, size));
+  avro_logical_schema_t *logical = logical_type(stream, schema);
+  if (logical != NULL) {
+    if (logical->type != AVRO_DECIMAL) {
+      avro_set_error("Unsupported logical type annotation in BYTES/FIXED type");
+      return EINVAL;
+    }
+    memo_t *memo = column_memo(stream);
+    const char *text = memo_get(memo, schema, bytes, size);
+    if (text != NULL) {
+      return write_text(stream, text, csv);
+    }
+    if (stream->dec_bytes_capacity < size) {
+      char *buf = (char *)realloc(stream->dec_bytes, size);
+      if (buf == NULL) {
+        return ENOMEM;
+      }
+      stream->dec_bytes = buf;
+      stream->dec_bytes_capacity = size;
+    }
+    memcpy(stream->dec_bytes, bytes, size);
+    decimal_from_bytes(stream->dec, (int8_t *)stream->dec_bytes, size, logical->scale);
+    char *str = decimal_to_str(stream->dec, &stream->dec_str, &stream->dec_str_size);
+    if (str == NULL) {
+      return ENOMEM;
+    }
+    memo_put(memo, schema, bytes, size, str);
+    return write_text(stream, str, csv);
+  }
+
+  if (!printedByteArrayTelemetry++) {
+    fprintf(stderr, "Byte array detected\n");
+  }
+  CHECKED_EV(writer_puts(&stream->out, csv ? "\"[" : "["));
+  for (size_t i = 0; i < size; ++i) {
+    if (i > 0) {
+      CHECKED_EV(writer_putc(&stream->out, ','));
+    }
+    CHECKED_EV(write_int(stream, (unsigned char)bytes[i]));
+  }
+  return writer_puts(&stream->out, csv ? "]\"" : "]");
+}
+
+static int is_ms_hadoop_guid(avro_schema_t schema, int64_t size) {
+  const char *ns = avro_schema_namespace(schema);
+  return size == 16 && ns != NULL && !strcmp(ns, "System") &&
+         !strcmp(avro_schema_name(schema), "Guid");
+}
+
+// Writes values of types that are neither collections nor unions
+static int stream_scalar(stream_t *stream, avro_schema_t schema, const char **p,
+                         const char *end, int csv) {
+  switch (avro_typeof(schema)) {
+  case AVRO_NULL:
+    return csv ? 0 : writer_puts(&stream->out, "null");
+
+  case AVRO_BOOLEAN:
+    if (*p >= end) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    return writer_puts(&stream->out, *(*p)++ ? "true" : "false");
+
+  case AVRO_INT32: {
+    int64_t value;
+    CHECKED_EV(binary_read_long(p, end, &value));
+    avro_logical_schema_t *logical = logical_type(stream, schema);
+    if (logical != NULL) {
+      memo_t *memo = column_memo(stream);
+      const char *text = memo_get(memo, schema, &value, sizeof(value));
+      if (text == NULL) {
+        if (logical->type == AVRO_DATE) {
+          text = epoch_days_to_str((int32_t)value);
+        } else if (logical->type == AVRO_TIME_MILLIS) {
+          text = time_millis_to_str((int32_t)value);
+        } else {
+          avro_set_error("INT type is annotated by an unsupported logical type");
+          return EINVAL;
+        }
+        memo_put(memo, schema, &value, sizeof(value), text);
+      }
+      return write_text(stream, text, csv);
+    }
+    return write_int(stream, (int32_t)value);
+  }
+
+  case AVRO_INT64: {
+    int64_t value;
+    CHECKED_EV(binary_read_long(p, end, &value));
+    avro_logical_schema_t *logical = logical_type(stream, schema);
+    if (logical != NULL) {
+      memo_t *memo = column_memo(stream);
+      const char *text = memo_get(memo, schema, &value, sizeof(value));
+      if (text == NULL) {
+        if (logical->type == AVRO_TIME_MICROS) {
+          text = time_micros_to_str(value);
+        } else if (logical->type == AVRO_TIMESTAMP_MILLIS) {
+          text = timestamp_millis_to_str(value);
+        } else if (logical->type == AVRO_TIMESTAMP_MICROS) {
+          text = timestamp_micros_to_str(value);
+        } else {
+          avro_set_error("LONG type is annotated by an unsupported logical type");
+          return EINVAL;
+        }
+        memo_put(memo, schema, &value, sizeof(value), text);
+      }
+      return write_text(stream, text, csv);
+    }
+    return write_int(stream, value);
+  }
+
+  case AVRO_FLOAT:
+  case AVRO_DOUBLE: {
+    double value;
+    if (avro_typeof(schema) == AVRO_FLOAT) {
+      float f;
+      CHECKED_EV(binary_read_float(p, end, &f));
+      value = f;
+    } else {
+      CHECKED_EV(binary_read_double(p, end, &value));
+    }
+    char buf[MAX_REAL_SIZE];
+    return writer_write(&stream->out, buf, format_real(buf, value, csv));
+  }
+
+  case AVRO_STRING: {
+    const char *str;
+    size_t size;
+    CHECKED_EV(binary_read_bytes(p, end, &str, &size));
+    return csv ? write_csv_string(stream, str, size) : write_json_string(stream, str, size);
+  }
+
+  case AVRO_BYTES: {
+    const char *bytes;
+    size_t size;
+    CHECKED_EV(binary_read_bytes(p, end, &bytes, &size));
+    return write_bytes(stream, schema, bytes, size, csv);
+  }
+
+  case AVRO_FIXED: {
+    int64_t size = avro_schema_fixed_size(schema);
+    CHECKED_EV(check_scalar_size(stream, (size_t)size));
+    if (end - *p < size) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    const char *bytes = *p;
+    *p += size;
+    if (stream->conf->ms_hadoop_logical_types && is_ms_hadoop_guid(schema, size)) {
+      memo_t *memo = column_memo(stream);
+      const char *text = memo_get(memo, schema, bytes, (size_t)size);
+      if (text != NULL) {
+        return write_text(stream, text, csv);
+      }
+      char guid[37];
+      snprintf(guid, sizeof(guid), GUID_FORMAT, GUID_ARG(bytes));
+      memo_put(memo, schema, bytes, (size_t)size, guid);
+      return write_text(stream, guid, csv);
+    }
+    return write_bytes(stream, schema, bytes, (size_t)size, csv);
+  }
+
+  case AVRO_ENUM: {
+    int64_t index;
+    CHECKED_EV(binary_read_long(p, end, &index));
+    if (index < 0 || index >= avro_schema_enum_number_of_symbols(schema)) {
+      avro_set_error("Invalid enum symbol index");
+      return EILSEQ;
+    }
+    const char *symbol = avro_schema_enum_get(schema, (int)index);
+    const name_text_t *symbols = csv ? NULL : names_get(stream->names, schema);
+    if (symbols != NULL) {
+      return writer_write(&stream->out, symbols[index].data, symbols[index].size);
+    }
+    return csv ? writer_puts(&stream->out, symbol)
+               : write_json_string(stream, symbol, strlen(symbol));
+  }
+
+  default:
+    avro_set_error("Unsupported schema type");
+    return EINVAL;
+  }
+}
+
+/*
+ * Collections
+ */
+
+static int read_branch(avro_schema_t *schema, const char **p, const char *end) {
+  int64_t branch;
+  CHECKED_EV(binary_read_long(p, end, &branch));
+  if (branch < 0 || (size_t)branch >= avro_schema_union_size(*schema)) {
+    avro_set_error("Invalid union branch index");
+    return EILSEQ;
+  }
+  *schema = binary_resolve_schema(avro_schema_union_branch(*schema, (int)branch));
+  return 0;
+}
+
+// Whether --prune would omit the value: null, empty array, map, byte array
+// or record, without consuming the data
+static int is_prunable(stream_t *stream, avro_schema_t schema, const char *p,
+                       const char *end) {
+  schema = binary_resolve_schema(schema);
+  switch (avro_typeof(schema)) {
+  case AVRO_NULL:
+    return 1;
+
+  case AVRO_ARRAY:
+  case AVRO_MAP: {
+    int64_t count;
+    return binary_read_long(&p, end, &count) == 0 && count == 0;
+  }
+
+  case AVRO_BYTES: {
+    const char *bytes;
+    size_t size;
+    return logical_type(stream, schema) == NULL &&
+           binary_read_bytes(&p, end, &bytes, &size) == 0 && size == 0;
+  }
+
+  case AVRO_UNION:
+    return read_branch(&schema, &p, end) == 0 && is_prunable(stream, schema, p, end);
+
+  case AVRO_RECORD: {
+    size_t fields_count = avro_schema_record_size(schema);
+    for (size_t i = 0; i < fields_count; ++i) {
+      avro_schema_t field = avro_schema_record_field_get_by_index(schema, (int)i);
+      if (!is_prunable(stream, field, p, end) || binary_skip(field, &p, end) != 0) {
+        return 0;
+      }
+    }
+    return 1;
+  }
+
+  default:
+    return 0;
+  }
+}
+
+static int write_map_key(stream_t *stream, const char *key, size_t key_size) {
+  const char *text = NULL;
+  size_t text_size;
+  if (stream->keys != NULL) {
+    CHECKED_EV(key_cache_get(stream->keys, key, key_size, &text, &text_size));
+  }
+  if (text != NULL) {
+    return writer_write(&stream->out, text, text_size);
+  }
+  CHECKED_EV(write_json_string(stream, key, key_size));
+  return writer_putc(&stream->out, ':');
+}
+
+// Writes array or map element by element, straight from its blocks
+static int stream_collection(stream_t *stream, avro_schema_t items, int is_map,
+                             const char **p, const char *end) {
+  CHECKED_EV(writer_putc(&stream->out, is_map ? '{' : '['));
+  int first = 1;
+  for (;;) {
+    int64_t count;
+    CHECKED_EV(binary_read_long(p, end, &count));
+    if (count == 0) {
+      break;
+    }
+    if (count < 0) {
+      // Negative count is followed by block size in bytes
+      int64_t size;
+      CHECKED_EV(binary_read_long(p, end, &size));
+      count = -count;
+    }
+    for (int64_t i = 0; i < count; ++i) {
+      if (!first) {
+        CHECKED_EV(writer_putc(&stream->out, ','));
+      }
+      first = 0;
+      if (is_map) {
+        const char *key;
+        size_t key_size;
+        CHECKED_EV(binary_read_bytes(p, end, &key, &key_size));
+        CHECKED_EV(write_map_key(stream, key, key_size));
+      }
+      CHECKED_EV(stream_json_value(stream, items, p, end));
+    }
+  }
+  return writer_putc(&stream->out, is_map ? '}' : ']');
+}
+
+static int write_field_name(stream_t *stream, const char *name) {
+  CHECKED_EV(write_json_string(stream, name, strlen(name)));
+  return writer_putc(&stream->out, ':');
+}
+
+static int write_name_text(stream_t *stream, const name_text_t *text) {
+  return writer_write(&stream->out, text->data, text->size);
+}
+
+static int write_column_name(stream_t *stream, size_t column, const char *name) {
+  return stream->column_names != NULL ? write_name_text(stream, &stream->column_names[column])
+                                      : write_field_name(stream, name);
+}
+
+static int stream_record_fields(stream_t *stream, avro_schema_t record,
+                                const char **p, const char *end) {
+  CHECKED_EV(writer_putc(&stream->out, '{'));
+  size_t fields_count = avro_schema_record_size(record);
+  const name_text_t *names = names_get(stream->names, record);
+  int first = 1;
+  for (size_t i = 0; i < fields_count; ++i) {
+    avro_schema_t field = avro_schema_record_field_get_by_index(record, (int)i);
+    if (stream->conf->prune && is_prunable(stream, field, *p, end)) {
+      CHECKED_EV(binary_skip(field, p, end));
+      continue;
+    }
+    if (!first) {
+      CHECKED_EV(writer_putc(&stream->out, ','));
+    }
+    first = 0;
+    if (names != NULL) {
+      CHECKED_EV(write_name_text(stream, &names[i]));
+    } else {
+      CHECKED_EV(write_field_name(stream, avro_schema_record_field_name(record, (int)i)));
+    }
+    CHECKED_EV(stream_json_value(stream, field, p, end));
+  }
+  return writer_putc(&stream->out, '}');
+}
+
+static int stream_json_value(stream_t *stream, avro_schema_t schema,
+                             const char **p, const char *end) {
+  schema = binary_resolve_schema(schema);
+  switch (avro_typeof(schema)) {
+  case AVRO_ARRAY:
+    return stream_collection(stream, avro_schema_array_items(schema), 0, p, end);
+  case AVRO_MAP:
+    return stream_collection(stream, avro_schema_map_values(schema), 1, p, end);
+  case AVRO_RECORD:
+    return stream_record_fields(stream, schema, p, end);
+  case AVRO_UNION:
+    CHECKED_EV(read_branch(&schema, p, end));
+    return stream_json_value(stream, schema, p, end);
+  default:
+    return stream_scalar(stream, schema, p, end, 0);
+  }
+}
+
+// Writes a top-level field as CSV cell. Collections and records are written
+// as quoted JSON.
+static int stream_csv_value(stream_t *stream, avro_schema_t schema, const char **p,
+                            const char *end) {
+  schema = binary_resolve_schema(schema);
+  switch (avro_typeof(schema)) {
+  case AVRO_UNION:
+    CHECKED_EV(read_branch(&schema, p, end));
+    return stream_csv_value(stream, schema, p, end);
+
+  case AVRO_ARRAY:
+  case AVRO_MAP:
+  case AVRO_RECORD: {
+    if (stream->conf->prune && is_prunable(stream, schema, *p, end)) {
+      return binary_skip(schema, p, end);
+    }
+    CHECKED_EV(writer_putc(&stream->out, '"'));
+    stream->out.csv_quoted = 1;
+    int rval = stream_json_value(stream, schema, p, end);
+    stream->out.csv_quoted = 0;
+    CHECKED_EV(rval);
+    return writer_putc(&stream->out, '"');
+  }
+
+  default:
+    return stream_scalar(stream, schema, p, end, 1);
+  }
+}
+
+/*
+ * Transformed columns
+ */
+
+// Reads value of a transformed column, null values aren't transformed
+static int read_transformed(stream_t *stream, avro_schema_t schema, transform_t *transform,
+                            const char **p, const char *end, transform_value_t *result) {
+  schema = binary_resolve_schema(schema);
+  if (is_avro_union(schema)) {
+    CHECKED_EV(read_branch(&schema, p, end));
+  }
+
+  switch (avro_typeof(schema)) {
+  case AVRO_NULL:
+    result->kind = TV_NULL;
+    return 0;
+
+  case AVRO_INT32:
+  case AVRO_INT64: {
+    int64_t value;
+    CHECKED_EV(binary_read_long(p, end, &value));
+    return transform_long(transform, value, result);
+  }
+
+  case AVRO_FLOAT: {
+    float value;
+    CHECKED_EV(binary_read_float(p, end, &value));
+    return transform_double(transform, value, result);
+  }
+
+  case AVRO_DOUBLE: {
+    double value;
+    CHECKED_EV(binary_read_double(p, end, &value));
+    return transform_double(transform, value, result);
+  }
+
+  case AVRO_STRING:
+  case AVRO_BYTES: {
+    const char *bytes;
+    size_t size;
+    CHECKED_EV(binary_read_bytes(p, end, &bytes, &size));
+    CHECKED_EV(check_scalar_size(stream, size));
+    return transform_bytes(transform, bytes, size, result);
+  }
+
+  case AVRO_FIXED: {
+    int64_t size = avro_schema_fixed_size(schema);
+    CHECKED_EV(check_scalar_size(stream, (size_t)size));
+    if (end - *p < size) {
+      avro_set_error("Truncated or malformed Avro data");
+      return EILSEQ;
+    }
+    const char *bytes = *p;
+    *p += size;
+    return transform_bytes(transform, bytes, (size_t)size, result);
+  }
+
+  default:
+    avro_set_error("Unsupported type of transformed column");
+    return EINVAL;
+  }
+}
+
+static int write_transformed(stream_t *stream, const transform_value_t *value, int csv) {
+  switch (value->kind) {
+  case TV_NULL:
+    return csv ? 0 : writer_puts(&stream->out, "null");
+
+  case TV_INT:
+    return write_int(stream, value->integer);
+
+  case TV_REAL: {
+    char buf[MAX_REAL_SIZE];
+    return writer_write(&stream->out, buf, format_real(buf, value->real, csv));
+  }
+
+  case TV_TEXT:
+    if (!csv) {
+      CHECKED_EV(writer_putc(&stream->out, '"'));
+    }
+    CHECKED_EV(writer_write(&stream->out, value->str, value->size));
+    return csv ? 0 : writer_putc(&stream->out, '"');
+
+  case TV_STRING:
+    return csv ? write_csv_string(stream, value->str, value->size)
+               : write_json_string(stream, value->str, value->size);
+  }
+  return 0;
+}
+
+/*
+ * Records
+ */
+
+static int grow_plugin_out(plugin_buffer_t *buffer, size_t size) {
+  size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+  while (capacity - buffer->size < size) {
+    capacity *= 2;
+  }
+  char *data = (char *)memstats_realloc(MEM_OUTPUT, buffer->data, capacity);
+  if (data == NULL) {
+    snprintf(buffer->error, sizeof(buffer->error), "Cannot allocate output of converter");
+    return ENOMEM;
+  }
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return 0;
+}
+
+// Converts the record with the generated converter, into its own buffer
+static int plugin_record(stream_t *stream, const char **p, const char *end) {
+  stream->plugin_out.size = 0;
+  stream->plugin_out.error[0] = '\0';
+  int rval = stream->plugin->convert_record(p, end, &stream->plugin_out);
+  if (rval != 0) {
+    avro_set_error("%s", stream->plugin_out.error);
+    return rval;
+  }
+  return writer_write(&stream->out, stream->plugin_out.data, stream->plugin_out.size);
+}
+
+static int write_record(stream_t *stream, const char **p, const char *end) {
+  const config_t *conf = stream->conf;
+  size_t count = stream->columns != NULL ? conf->columns_size : stream->fields_count;
+
+  // Columns are written in the order of --columns, so locate all fields first
+  const char *record_end = NULL;
+  if (stream->columns != NULL) {
+    const char *q = *p;
+    for (size_t i = 0; i < stream->fields_count; ++i) {
+      stream->field_starts[i] = q;
+      CHECKED_EV(binary_skip(avro_schema_record_field_get_by_index(stream->record, (int)i), &q, end));
+    }
+    record_end = q;
+  }
+
+  if (!conf->output_csv) {
+    CHECKED_EV(writer_putc(&stream->out, '{'));
+  }
+  int first = 1;
+  for (size_t i = 0; i < count; ++i) {
+    int field_idx = stream->columns != NULL ? stream->columns[i] : (int)i;
+    avro_schema_t field = avro_schema_record_field_get_by_index(stream->record, field_idx);
+    const char *name = avro_schema_record_field_name(stream->record, field_idx);
+    const char *q = stream->columns != NULL ? stream->field_starts[field_idx] : *p;
+    transform_t *transform = stream->transforms != NULL ? stream->transforms[i] : NULL;
+    stream->column = i;
+
+    // Nested column is read from the field its path starts with
+    const path_t *path = stream->paths != NULL ? stream->paths[i] : NULL;
+    if (path != NULL) {
+      field = path->leaf;
+      name = column_output_name(&conf->columns[i]);
+      CHECKED_EV(path_read(path, 1, q, end, &q));
+    }
+
+    if (q == NULL) {
+      // Null on the way to the nested column
+      if (conf->output_csv) {
+        if (i > 0) {
+          CHECKED_EV(writer_putc(&stream->out, ','));
+        }
+      } else if (!conf->prune) {
+        if (!first) {
+          CHECKED_EV(writer_putc(&stream->out, ','));
+        }
+        first = 0;
+        CHECKED_EV(write_column_name(stream, i, name));
+        CHECKED_EV(writer_puts(&stream->out, "null"));
+      }
+    } else if (transform != NULL) {
+      transform_value_t value;
+      CHECKED_EV(read_transformed(stream, field, transform, &q, end, &value));
+      if (conf->output_csv) {
+        if (i > 0) {
+          CHECKED_EV(writer_putc(&stream->out, ','));
+        }
+        CHECKED_EV(write_transformed(stream, &value, 1));
+      } else if (!conf->prune || value.kind != TV_NULL) {
+        if (!first) {
+          CHECKED_EV(writer_putc(&stream->out, ','));
+        }
+        first = 0;
+        CHECKED_EV(write_column_name(stream, i, name));
+        CHECKED_EV(write_transformed(stream, &value, 0));
+      }
+    } else if (conf->output_csv) {
+      if (i > 0) {
+        CHECKED_EV(writer_putc(&stream->out, ','));
+      }
+      CHECKED_EV(stream_csv_value(stream, field, &q, end));
+    } else if (conf->prune && is_prunable(stream, field, q, end)) {
+      CHECKED_EV(binary_skip(field, &q, end));
+    } else {
+      if (!first) {
+        CHECKED_EV(writer_putc(&stream->out, ','));
+      }
+      first = 0;
+      CHECKED_EV(write_column_name(stream, i, name));
+      CHECKED_EV(stream_json_value(stream, field, &q, end));
+    }
+
+    if (stream->columns == NULL) {
+      *p = q;
+    }
+  }
+  stream->column = SIZE_MAX;
+  if (!conf->output_csv) {
+    CHECKED_EV(writer_putc(&stream->out, '}'));
+  }
+  if (record_end != NULL) {
+    *p = record_end;
+  }
+  return writer_putc(&stream->out, '\n');
+}
+
+int stream_record(stream_t *stream, const char **p, const char *end) {
+  CHECKED_EV(writer_begin_record(&stream->out));
+  int rval = stream->plugin != NULL ? plugin_record(stream, p, end) : write_record(stream, p, end);
+  if (rval != 0) {
+    // Output of the record so far isn't valid JSON or CSV, so it's dropped
+    // before it reaches the destination
+    stream->column = SIZE_MAX;
+    writer_discard_record(&stream->out);
+  }
+  return rval;
+}
+
+int stream_flush(stream_t *stream) {
+  return writer_flush(&stream->out);
+}
+
+void stream_set_dest(stream_t *stream, FILE *dest) {
+  stream->out.dest = dest;
+}
+
+void stream_set_plugin(stream_t *stream, const converter_plugin_t *plugin) {
+  stream->plugin = plugin;
+  stream->plugin_out.grow = grow_plugin_out;
+}
+
+void stream_memo_stats(const stream_t *stream, uint64_t *lookups, uint64_t *hits) {
+  for (size_t i = 0; i < stream->memos_count; ++i) {
+    if (stream->memos[i] != NULL) {
+      *lookups += stream->memos[i]->lookups;
+      *hits += stream->memos[i]->hits;
+    }
+  }
+}
+
+int stream_json(stream_t *stream, avro_schema_t schema, const char **p, const char *end,
+                const char **json, size_t *size) {
+  stream->out.size = 0;
+  stream->out.mem_size = 0;
+  CHECKED_EV(stream_json_value(stream, schema, p, end));
+  CHECKED_EV(writer_flush(&stream->out));
+  *json = stream->out.mem;
+  *size = stream->out.mem_size;
+  return 0;
+}
+
+int stream_new(avro_schema_t schema, const config_t *conf, FILE *dest, stream_t **result) {
+  *result = NULL;
+  schema = binary_resolve_schema(schema);
+  if (!is_avro_record(schema)) {
+    return 0;
+  }
+
+  stream_t *stream = (stream_t *)calloc(1, sizeof(stream_t));
+  if (stream == NULL) {
+    return ENOMEM;
+  }
+  stream->conf = conf;
+  stream->memory_limit = conf->memory_limit > 0 ? conf->memory_limit : DEFAULT_MEMORY_LIMIT;
+  stream->record = schema;
+  stream->fields_count = avro_schema_record_size(schema);
+  stream->out.dest = dest;
+  stream->dec = decimal_new();
+  stream->memos_count = conf->columns_size > 0 ? conf->columns_size : stream->fields_count;
+  stream->memos = (memo_t **)calloc(stream->memos_count + 1, sizeof(memo_t *));
+  stream->column = SIZE_MAX;
+  if (stream->memos == NULL) {
+    stream_free(stream);
+    return ENOMEM;
+  }
+
+  if (conf->columns_size > 0) {
+    stream->columns = (int *)calloc(conf->columns_size, sizeof(int));
+    stream->field_starts = (const char **)calloc(stream->fields_count + 1, sizeof(const char *));
+    if (stream->columns == NULL || stream->field_starts == NULL) {
+      stream_free(stream);
+      return ENOMEM;
+    }
+    stream->paths = (path_t **)calloc(conf->columns_size, sizeof(path_t *));
+    if (stream->paths == NULL) {
+      stream_free(stream);
+      return ENOMEM;
+    }
+    for (size_t i = 0; i < conf->columns_size; ++i) {
+      const char *name = conf->columns[i].column_name;
+      int field_idx = -1;
+      if (path_is_nested(name)) {
+        int rval = path_new(name, schema, &stream->paths[i]);
+        if (rval != 0) {
+          stream_free(stream);
+          return rval;
+        }
+        if (stream->paths[i] != NULL) {
+          field_idx = stream->paths[i]->steps[0].field_index;
+        }
+      } else {
+        field_idx = avro_schema_record_field_get_index(schema, name);
+      }
+      // Missing and repeated columns are handled by row conversion. Nested
+      // columns may share the field their paths start with.
+      for (size_t j = 0; j < i && field_idx >= 0; ++j) {
+        if (stream->paths[i] == NULL ? stream->paths[j] == NULL && stream->columns[j] == field_idx
+                                     : !strcmp(conf->columns[j].column_name, name)) {
+          field_idx = -1;
+        }
+      }
+      if (field_idx < 0) {
+        stream_free(stream);
+        return 0;
+      }
+      stream->columns[i] = field_idx;
+    }
+
+    stream->transforms = (transform_t **)calloc(conf->columns_size, sizeof(transform_t *));
+    if (stream->transforms == NULL) {
+      stream_free(stream);
+      return ENOMEM;
+    }
+    for (size_t i = 0; i < conf->columns_size; ++i) {
+      avro_schema_t field = stream->paths[i] != NULL
+                                ? stream->paths[i]->leaf
+                                : avro_schema_record_field_get_by_index(schema, stream->columns[i]);
+      int rval = transform_new(&conf->columns[i], field, &stream->transforms[i]);
+      if (rval != 0) {
+        stream_free(stream);
+        return rval;
+      }
+    }
+  }
+
+  int rval = names_new(schema, &stream->names);
+  stream->keys = key_cache_new();
+  if (rval != 0 || stream->keys == NULL) {
+    stream_free(stream);
+    return ENOMEM;
+  }
+  if (!conf->output_csv) {
+    const char **names = (const char **)malloc((stream->memos_count + 1) * sizeof(const char *));
+    if (names == NULL) {
+      stream_free(stream);
+      return ENOMEM;
+    }
+    for (size_t i = 0; i < stream->memos_count; ++i) {
+      names[i] = stream->paths != NULL && stream->paths[i] != NULL
+                     ? column_output_name(&conf->columns[i])
+                     : avro_schema_record_field_name(schema, stream->columns != NULL
+                                                                 ? stream->columns[i]
+                                                                 : (int)i);
+    }
+    // Without rendered names, they're escaped for every record
+    stream->column_names = names_render(names, stream->memos_count, 1);
+    free(names);
+  }
+
+  *result = stream;
+  return 0;
+}
+
+void stream_free(stream_t *stream) {
+  if (stream->transforms != NULL) {
+    for (size_t i = 0; i < stream->conf->columns_size; ++i) {
+      transform_free(stream->transforms[i]);
+    }
+    free(stream->transforms);
+  }
+  if (stream->paths != NULL) {
+    for (size_t i = 0; i < stream->conf->columns_size; ++i) {
+      if (stream->paths[i] != NULL) {
+        path_free(stream->paths[i]);
+      }
+    }
+    free(stream->paths);
+  }
+  if (stream->memos != NULL) {
+    for (size_t i = 0; i < stream->memos_count; ++i) {
+      memo_free(stream->memos[i]);
+    }
+    free(stream->memos);
+  }
+  names_free(stream->names);
+  free(stream->column_names);
+  key_cache_free(stream->keys);
+  decimal_free(stream->dec);
+  free(stream->dec_str);
+  free(stream->dec_bytes);
+  free(stream->columns);
+  free(stream->field_starts);
+  memstats_free(MEM_OUTPUT, stream->out.mem);
+  memstats_free(MEM_OUTPUT, stream->plugin_out.data);
+  free(stream);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <avro.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "plugin_abi.h"
+
+/**
+ * Streaming conversion of records, writing JSON or CSV straight from their
+ * binary encoding. Arrays and maps are converted element by element, so no
+ * generic value or JSON tree is ever built, and memory used on top of the
+ * decoded block stays bounded regardless of the size of collections.
+ *
+ * Scalar values (strings, bytes and fixed) larger than the configured memory
+ * limit are reported as errors.
+ */
+typedef struct stream_t stream_t;
+
+/**
+ * Prepares streaming conversion of records of the given schema. Sets
+ * '*stream' to NULL when the schema or options aren't supported.
+ * Returns 0 on success, or error code (with Avro error set) otherwise.
+ */
+int stream_new(avro_schema_t schema, const config_t *conf, FILE *dest, stream_t **stream);
+
+void stream_free(stream_t *stream);
+
+/**
+ * Converts a binary encoded record starting at '*p', advancing '*p' past
+ * the end of the record.
+ */
+int stream_record(stream_t *stream, const char **p, const char *end);
+
+/**
+ * Writes buffered output to the destination file.
+ */
+int stream_flush(stream_t *stream);
+
+/**
+ * Changes the destination file, after buffered output was flushed.
+ */
+void stream_set_dest(stream_t *stream, FILE *dest);
+
+/**
+ * Converts whole records with a converter generated by --emit-converter,
+ * which the caller checked to match the schema and format options.
+ */
+void stream_set_plugin(stream_t *stream, const converter_plugin_t *plugin);
+
+/**
+ * Adds the number of lookups of formatted dates, times, timestamps, decimals
+ * and GUIDs, and how many of them were memoized, to '*lookups' and '*hits'.
+ */
+void stream_memo_stats(const stream_t *stream, uint64_t *lookups, uint64_t *hits);
+
+/**
+ * Converts a single binary encoded value of the given schema to JSON,
+ * advancing '*p' past its end. The JSON text is kept in memory owned by the
+ * stream until the next call, and the stream must have been created without
+ * a destination file.
+ */
+int stream_json(stream_t *stream, avro_schema_t schema, const char **p, const char *end,
+                const char **json, size_t *size);
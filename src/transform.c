@@ -0,0 +1,466 @@
+#include <avro.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary.h"
+#include "logical.h"
+#include "transform.h"
+
+#define CHECKED_EV(call)                                                       \
+  do {                                                                         \
+    int __rc;                                                                  \
+    __rc = call;                                                               \
+    if (__rc != 0) {                                                           \
+      return __rc;                                                             \
+    }                                                                          \
+  } while (0)
+
+// Integers and reals in this range convert to each other exactly
+#define MAX_EXACT_INTEGER 9007199254740992.0
+// Products below this magnitude fit into int64_t
+#define MAX_INT64_PRODUCT 9.2e18
+
+static const struct {
+  const char *name;
+  enum TransformationType type;
+  int has_argument;
+} transformations[] = {
+    {TRANSFORM_TS_SECS_STR, TRANSFORM_TS_SECS, 0},
+    {TRANSFORM_TS_MILLIS_STR, TRANSFORM_TS_MILLIS, 0},
+    {TRANSFORM_TS_MICROS_STR, TRANSFORM_TS_MICROS, 0},
+    {TRANSFORM_TS_NANOS_STR, TRANSFORM_TS_NANOS, 0},
+    {TRANSFORM_REAL_STR, TRANSFORM_REAL, 0},
+    {TRANSFORM_SCALE_STR, TRANSFORM_SCALE, 1},
+    {TRANSFORM_TRUNCATE_STR, TRANSFORM_TRUNCATE, 1},
+    {TRANSFORM_BASE64_STR, TRANSFORM_BASE64, 0},
+};
+
+#define TRANSFORMATIONS_COUNT (sizeof(transformations) / sizeof(transformations[0]))
+
+struct transform_t {
+  enum TransformationType type;
+  int64_t nanos_scale; // nanoseconds in a unit of timestamps
+
+  // Scaling by an integer factor keeps integers, and scaling by an inverse
+  // of an integer divides, which is exact for e.g. 12345 scaled by 0.01
+  double factor;
+  int integral_factor;
+  double divisor;
+
+  size_t length;        // characters kept by truncation
+  int decimal;          // bytes or fixed are decimals, with the scale below
+  size_t decimal_scale;
+  decimal_t *dec;
+  char *dec_str;
+  size_t dec_str_size;
+
+  char *buf; // base64 output, or copy of decimal bytes converted in place
+  size_t buf_capacity;
+};
+
+static const char *transformation_name(enum TransformationType type) {
+  for (size_t i = 0; i < TRANSFORMATIONS_COUNT; ++i) {
+    if (transformations[i].type == type) {
+      return transformations[i].name;
+    }
+  }
+  return "none";
+}
+
+int transform_parse(const char *name, const json_t *argument, column_info_t *column) {
+  size_t i = 0;
+  while (i < TRANSFORMATIONS_COUNT && strcmp(transformations[i].name, name)) {
+    i++;
+  }
+  if (i == TRANSFORMATIONS_COUNT) {
+    avro_set_error("Invalid or unsupported transformation '%s' of column '%s'", name,
+                   column->column_name);
+    return EINVAL;
+  }
+  if (transformations[i].has_argument != (argument != NULL)) {
+    avro_set_error(transformations[i].has_argument
+                       ? "Transformation '%s' of column '%s' requires a numeric argument"
+                       : "Transformation '%s' of column '%s' takes no argument",
+                   name, column->column_name);
+    return EINVAL;
+  }
+
+  column->transformation = transformations[i].type;
+  column->transformation_arg = 0;
+  if (argument == NULL) {
+    return 0;
+  }
+
+  double value = json_number_value(argument);
+  int valid = json_is_number(argument) && isfinite(value);
+  if (column->transformation == TRANSFORM_TRUNCATE) {
+    valid = json_is_integer(argument) && value >= 0;
+  }
+  if (!valid) {
+    avro_set_error("Invalid argument of transformation '%s' of column '%s'", name,
+                   column->column_name);
+    return EINVAL;
+  }
+  column->transformation_arg = value;
+  return 0;
+}
+
+/*
+ * Binding
+ */
+
+// Type of values of the field, looking through nullable unions
+static avro_schema_t value_schema(avro_schema_t schema) {
+  schema = binary_resolve_schema(schema);
+  if (!is_avro_union(schema) || avro_schema_union_size(schema) != 2) {
+    return schema;
+  }
+  avro_schema_t first = binary_resolve_schema(avro_schema_union_branch(schema, 0));
+  avro_schema_t second = binary_resolve_schema(avro_schema_union_branch(schema, 1));
+  if (is_avro_null(first) == is_avro_null(second)) {
+    return schema;
+  }
+  return is_avro_null(first) ? second : first;
+}
+
+static int is_number(avro_type_t type) {
+  return type == AVRO_INT32 || type == AVRO_INT64 || type == AVRO_FLOAT || type == AVRO_DOUBLE;
+}
+
+static int is_decimal(avro_schema_t schema) {
+  avro_logical_schema_t *logical = avro_logical_schema(schema);
+  return logical != NULL && logical->type == AVRO_DECIMAL;
+}
+
+static int applies_to(const transform_t *transform, avro_schema_t schema) {
+  avro_type_t type = avro_typeof(schema);
+  switch (transform->type) {
+  case TRANSFORM_REAL:
+    return is_number(type) || ((type == AVRO_BYTES || type == AVRO_FIXED) && is_decimal(schema));
+  case TRANSFORM_TRUNCATE:
+    return type == AVRO_STRING;
+  case TRANSFORM_BASE64:
+    return type == AVRO_BYTES || type == AVRO_FIXED;
+  default:
+    return is_number(type);
+  }
+}
+
+int transform_new(const column_info_t *column, avro_schema_t schema, transform_t **result) {
+  *result = NULL;
+  if (column->transformation == TRANSFORM_NONE) {
+    return 0;
+  }
+
+  transform_t *transform = (transform_t *)calloc(1, sizeof(transform_t));
+  if (transform == NULL) {
+    avro_set_error("Cannot allocate transformation");
+    return ENOMEM;
+  }
+  transform->type = column->transformation;
+
+  schema = value_schema(schema);
+  if (!applies_to(transform, schema)) {
+    avro_set_error("Transformation '%s' doesn't apply to column '%s' of type %s",
+                   transformation_name(transform->type), column->column_name,
+                   avro_schema_type_name(schema));
+    free(transform);
+    return EINVAL;
+  }
+
+  switch (transform->type) {
+  case TRANSFORM_TS_SECS:
+    transform->nanos_scale = NANOS_IN_SEC;
+    break;
+  case TRANSFORM_TS_MILLIS:
+    transform->nanos_scale = NANOS_IN_SEC / MILLIS_IN_SEC;
+    break;
+  case TRANSFORM_TS_MICROS:
+    transform->nanos_scale = 1000;
+    break;
+  case TRANSFORM_TS_NANOS:
+    transform->nanos_scale = 1;
+    break;
+
+  case TRANSFORM_REAL:
+    if (avro_typeof(schema) == AVRO_BYTES || avro_typeof(schema) == AVRO_FIXED) {
+      transform->decimal = 1;
+      transform->decimal_scale = avro_logical_schema(schema)->scale;
+      if ((transform->dec = decimal_new()) == NULL) {
+        free(transform);
+        avro_set_error("Cannot allocate transformation");
+        return ENOMEM;
+      }
+    }
+    break;
+
+  case TRANSFORM_SCALE: {
+    double factor = column->transformation_arg;
+    transform->factor = factor;
+    transform->integral_factor = factor == floor(factor) && fabs(factor) <= MAX_EXACT_INTEGER;
+    if (!transform->integral_factor && fabs(factor) < 1 && factor != 0) {
+      double inverse = 1 / factor;
+      if (inverse == floor(inverse) && fabs(inverse) <= MAX_EXACT_INTEGER) {
+        transform->divisor = inverse;
+      }
+    }
+    break;
+  }
+
+  case TRANSFORM_TRUNCATE:
+    transform->length = (size_t)column->transformation_arg;
+    break;
+
+  default:
+    break;
+  }
+
+  *result = transform;
+  return 0;
+}
+
+void transform_free(transform_t *transform) {
+  if (transform == NULL) {
+    return;
+  }
+  if (transform->dec != NULL) {
+    decimal_free(transform->dec);
+  }
+  free(transform->dec_str);
+  free(transform->buf);
+  free(transform);
+}
+
+/*
+ * Conversion
+ */
+
+static int reserve(transform_t *transform, size_t size) {
+  if (transform->buf_capacity >= size) {
+    return 0;
+  }
+  char *buf = (char *)realloc(transform->buf, size);
+  if (buf == NULL) {
+    avro_set_error("Cannot allocate transformed value");
+    return ENOMEM;
+  }
+  transform->buf = buf;
+  transform->buf_capacity = size;
+  return 0;
+}
+
+static void set_text(transform_value_t *result, const char *str) {
+  result->kind = TV_TEXT;
+  result->str = str;
+  result->size = strlen(str);
+}
+
+static void set_real(transform_value_t *result, double value) {
+  result->kind = TV_REAL;
+  result->real = value;
+}
+
+static double scale_real(const transform_t *transform, double value) {
+  return transform->divisor != 0 ? value / transform->divisor : value * transform->factor;
+}
+
+int transform_long(transform_t *transform, int64_t value, transform_value_t *result) {
+  switch (transform->type) {
+  case TRANSFORM_TS_SECS:
+  case TRANSFORM_TS_MILLIS:
+  case TRANSFORM_TS_MICROS:
+  case TRANSFORM_TS_NANOS: {
+    // Out of range values are clamped, as real values are
+    int64_t scale = transform->nanos_scale;
+    int64_t nanos = value > INT64_MAX / scale    ? INT64_MAX
+                    : value < INT64_MIN / scale ? INT64_MIN
+                                                : value * scale;
+    set_text(result, epoch_nanos_to_utc_str(nanos));
+    return 0;
+  }
+
+  case TRANSFORM_REAL:
+    set_real(result, (double)value);
+    return 0;
+
+  case TRANSFORM_SCALE:
+    if (transform->integral_factor) {
+      double product = (double)value * transform->factor;
+      if (fabs(product) < MAX_INT64_PRODUCT) {
+        result->kind = TV_INT;
+        result->integer = value * (int64_t)transform->factor;
+        return 0;
+      }
+      set_real(result, product);
+      return 0;
+    }
+    set_real(result, scale_real(transform, (double)value));
+    return 0;
+
+  default:
+    avro_set_error("Transformation doesn't apply to integer values");
+    return EINVAL;
+  }
+}
+
+int transform_double(transform_t *transform, double value, transform_value_t *result) {
+  switch (transform->type) {
+  case TRANSFORM_TS_SECS:
+  case TRANSFORM_TS_MILLIS:
+  case TRANSFORM_TS_MICROS:
+  case TRANSFORM_TS_NANOS: {
+    double nanos = value * (double)transform->nanos_scale;
+    if (nanos != nanos) {
+      result->kind = TV_NULL;
+      return 0;
+    }
+    // Out of range values are clamped, and shown as minimal or maximal date
+    int64_t rounded = nanos >= MAX_INT64_PRODUCT    ? INT64_MAX
+                      : nanos <= -MAX_INT64_PRODUCT ? INT64_MIN
+                                                    : (int64_t)floor(nanos + 0.5);
+    set_text(result, epoch_nanos_to_utc_str(rounded));
+    return 0;
+  }
+
+  case TRANSFORM_REAL:
+    set_real(result, value);
+    return 0;
+
+  case TRANSFORM_SCALE:
+    set_real(result, scale_real(transform, value));
+    return 0;
+
+  default:
+    avro_set_error("Transformation doesn't apply to real values");
+    return EINVAL;
+  }
+}
+
+static const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int to_base64(transform_t *transform, const unsigned char *bytes, size_t size,
+                     transform_value_t *result) {
+  CHECKED_EV(reserve(transform, (size + 2) / 3 * 4 + 1));
+  char *out = transform->buf;
+  size_t i = 0;
+  for (; i + 2 < size; i += 3) {
+    uint32_t triple = (uint32_t)bytes[i] << 16 | (uint32_t)bytes[i + 1] << 8 | bytes[i + 2];
+    *out++ = base64_alphabet[triple >> 18];
+    *out++ = base64_alphabet[(triple >> 12) & 0x3f];
+    *out++ = base64_alphabet[(triple >> 6) & 0x3f];
+    *out++ = base64_alphabet[triple & 0x3f];
+  }
+  if (i < size) {
+    uint32_t triple = (uint32_t)bytes[i] << 16 | (i + 1 < size ? (uint32_t)bytes[i + 1] << 8 : 0);
+    *out++ = base64_alphabet[triple >> 18];
+    *out++ = base64_alphabet[(triple >> 12) & 0x3f];
+    *out++ = i + 1 < size ? base64_alphabet[(triple >> 6) & 0x3f] : '=';
+    *out++ = '=';
+  }
+  *out = '\0';
+
+  result->kind = TV_TEXT;
+  result->str = transform->buf;
+  result->size = (size_t)(out - transform->buf);
+  return 0;
+}
+
+int transform_bytes(transform_t *transform, const char *bytes, size_t size,
+                    transform_value_t *result) {
+  switch (transform->type) {
+  case TRANSFORM_TRUNCATE: {
+    // Keep whole UTF-8 encoded characters, continuation bytes are 10xxxxxx
+    size_t chars = 0, end = 0;
+    for (; end < size; ++end) {
+      if (((unsigned char)bytes[end] & 0xc0) != 0x80 && chars++ == transform->length) {
+        break;
+      }
+    }
+    result->kind = TV_STRING;
+    result->str = bytes;
+    result->size = end;
+    return 0;
+  }
+
+  case TRANSFORM_BASE64:
+    return to_base64(transform, (const unsigned char *)bytes, size, result);
+
+  case TRANSFORM_REAL: {
+    if (!transform->decimal) {
+      break;
+    }
+    CHECKED_EV(reserve(transform, size));
+    memcpy(transform->buf, bytes, size);
+    decimal_from_bytes(transform->dec, (int8_t *)transform->buf, size, transform->decimal_scale);
+    char *str = decimal_to_str(transform->dec, &transform->dec_str, &transform->dec_str_size);
+    if (str == NULL) {
+      avro_set_error("Cannot allocate transformed value");
+      return ENOMEM;
+    }
+    set_real(result, strtod(str, NULL));
+    return 0;
+  }
+
+  default:
+    break;
+  }
+  avro_set_error("Transformation doesn't apply to string or bytes values");
+  return EINVAL;
+}
+
+int transform_value(transform_t *transform, const avro_value_t *value,
+                    transform_value_t *result) {
+  switch (avro_value_get_type(value)) {
+  case AVRO_INT32: {
+    int32_t val;
+    CHECKED_EV(avro_value_get_int(value, &val));
+    return transform_long(transform, val, result);
+  }
+
+  case AVRO_INT64: {
+    int64_t val;
+    CHECKED_EV(avro_value_get_long(value, &val));
+    return transform_long(transform, val, result);
+  }
+
+  case AVRO_FLOAT: {
+    float val;
+    CHECKED_EV(avro_value_get_float(value, &val));
+    return transform_double(transform, val, result);
+  }
+
+  case AVRO_DOUBLE: {
+    double val;
+    CHECKED_EV(avro_value_get_double(value, &val));
+    return transform_double(transform, val, result);
+  }
+
+  case AVRO_STRING: {
+    const char *val;
+    size_t size;
+    CHECKED_EV(avro_value_get_string(value, &val, &size));
+    return transform_bytes(transform, val, size - 1, result);
+  }
+
+  case AVRO_BYTES: {
+    const void *val;
+    size_t size;
+    CHECKED_EV(avro_value_get_bytes(value, &val, &size));
+    return transform_bytes(transform, (const char *)val, size, result);
+  }
+
+  case AVRO_FIXED: {
+    const void *val;
+    size_t size;
+    CHECKED_EV(avro_value_get_fixed(value, &val, &size));
+    return transform_bytes(transform, (const char *)val, size, result);
+  }
+
+  default:
+    avro_set_error("Transformation doesn't apply to values of this type");
+    return EINVAL;
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <avro.h>
+#include <jansson.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Typed transformations of --columns values, e.g. ["Timestamp","ts-ms"] or
+ * ["Amount","scale",0.01]. Transformations are parsed along with options,
+ * and bound to the type of their column once the schema is known, so that
+ * converting a value doesn't need to look at the schema or options again.
+ *
+ * All conversion engines (row, streaming and columnar) apply them, in both
+ * JSON and CSV output.
+ */
+
+enum transform_value_kind {
+  TV_NULL,  // value has no representation, e.g. NaN timestamp
+  TV_INT,
+  TV_REAL,
+  TV_TEXT,  // string which never needs escaping (dates, base64)
+  TV_STRING // string which might need escaping
+};
+
+typedef struct {
+  enum transform_value_kind kind;
+  int64_t integer;
+  double real;
+  const char *str; // valid until the next use of the transformation
+  size_t size;
+} transform_value_t;
+
+typedef struct transform_t transform_t;
+
+/**
+ * Sets the transformation of the column by name, with an optional argument
+ * (JSON number, or NULL).
+ * Returns 0 on success, or EINVAL (with Avro error set) otherwise.
+ */
+int transform_parse(const char *name, const json_t *argument, column_info_t *column);
+
+/**
+ * Binds the transformation of the column to the schema of its field. Sets
+ * '*transform' to NULL when the column has no transformation.
+ * Returns 0 on success, or EINVAL (with Avro error set) if the transformation
+ * doesn't apply to the type of the field.
+ */
+int transform_new(const column_info_t *column, avro_schema_t schema, transform_t **transform);
+
+void transform_free(transform_t *transform);
+
+/**
+ * Transforms non-null values of int or long fields.
+ */
+int transform_long(transform_t *transform, int64_t value, transform_value_t *result);
+
+/**
+ * Transforms non-null values of float or double fields.
+ */
+int transform_double(transform_t *transform, double value, transform_value_t *result);
+
+/**
+ * Transforms non-null values of string, bytes or fixed fields.
+ */
+int transform_bytes(transform_t *transform, const char *bytes, size_t size,
+                    transform_value_t *result);
+
+/**
+ * Transforms a non-null generic value, of any of the types above.
+ */
+int transform_value(transform_t *transform, const avro_value_t *value,
+                    transform_value_t *result);
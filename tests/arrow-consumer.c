@@ -0,0 +1,312 @@
+/*
+ * Consumer of the avro2arrow library, built and run by run.sh. It reads one
+ * of the test files through the Arrow C stream interface, in batches of two
+ * records, and compares the schema, the buffers of every batch and their null
+ * counts with the values expected for that file. Arrays are released after
+ * the stream, checking that they outlive it.
+ *
+ *   arrow-consumer file1|decimals|dates FILE
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arrow.h"
+
+#define BATCH_SIZE 2
+#define MAX_FIELDS 8
+#define MAX_ROWS 16
+
+typedef struct {
+  const char *name;
+  const char *format;
+  int64_t flags;
+  int json; // of the arrow.json extension type
+} expected_field_t;
+
+typedef struct {
+  const char *name;
+  expected_field_t fields[MAX_FIELDS];
+  size_t fields_count;
+  // Values rendered as text, NULL for nulls
+  const char *rows[MAX_ROWS][MAX_FIELDS];
+  size_t rows_count;
+} expected_file_t;
+
+static const expected_file_t EXPECTED[] = {
+    {"file1",
+     {{"f1", "u", ARROW_FLAG_NULLABLE, 0},
+      {"f2", "g", 0, 0},
+      {"f3", "b", 0, 0},
+      {"f4", "u", ARROW_FLAG_NULLABLE, 1},
+      {"f5", "u", ARROW_FLAG_NULLABLE, 1},
+      {"f6", "tsu:UTC", ARROW_FLAG_NULLABLE, 0}},
+     6,
+     {{"a", "0.10000000000000001", "false", "[\"a\",\"b\"]", "{\"f1\":\"a\"}", "1000"},
+      {NULL, "0.10000000000000001", "false", "[]", "{\"f1\":null}", NULL}},
+     2},
+    {"decimals",
+     {{"n", "d:38,18", ARROW_FLAG_NULLABLE, 0}},
+     1,
+     {{"0"},
+      {"-0.0000123"},
+      {"0.0000123"},
+      {"1234567890"},
+      {"-2002.2"},
+      {"-12345"},
+      {"-70500"},
+      {"-7050"},
+      {"7500"}},
+     9},
+    {"dates",
+     {{"d", "tdD", ARROW_FLAG_NULLABLE, 0}},
+     1,
+     {{"2020-03-15"}, {"1970-01-01"}, {"1970-01-01"}, {"2337-02-03"}},
+     4},
+};
+
+static int failures = 0;
+
+static void fail(const char *format, const char *detail) {
+  fprintf(stderr, format, detail);
+  fputc('\n', stderr);
+  failures++;
+}
+
+static int is_valid(const struct ArrowArray *array, int64_t i) {
+  const unsigned char *validity = (const unsigned char *)array->buffers[0];
+  i += array->offset;
+  return validity == NULL || (validity[i / 8] >> (i % 8)) & 1;
+}
+
+// Days since the epoch as YYYY-MM-DD, in the proleptic Gregorian calendar
+static void format_date(char *out, size_t size, int32_t days) {
+  int64_t z = (int64_t)days + 719468;
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  int64_t doe = z - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  int64_t day = doy - (153 * mp + 2) / 5 + 1;
+  int64_t month = mp < 10 ? mp + 3 : mp - 9;
+  int64_t year = yoe + era * 400 + (month <= 2);
+  snprintf(out, size, "%04" PRId64 "-%02" PRId64 "-%02" PRId64, year, month, day);
+}
+
+// Little-endian 128-bit unscaled value with the given scale, without
+// trailing zeros, as decimals are converted to JSON
+static void format_decimal(char *out, size_t size, const unsigned char *value, int scale) {
+  unsigned char magnitude[16];
+  int negative = value[15] & 0x80;
+  unsigned carry = 1;
+  for (int i = 0; i < 16; ++i) {
+    magnitude[i] = negative ? (unsigned char)(~value[i] + carry) : value[i];
+    carry = negative && carry && magnitude[i] == 0;
+  }
+  // Digits from the least significant one, by long division by 10
+  char digits[48];
+  int count = 0;
+  int zero;
+  do {
+    unsigned remainder = 0;
+    zero = 1;
+    for (int i = 15; i >= 0; --i) {
+      unsigned current = (remainder << 8) | magnitude[i];
+      magnitude[i] = (unsigned char)(current / 10);
+      remainder = current % 10;
+      zero = zero && magnitude[i] == 0;
+    }
+    digits[count++] = (char)('0' + remainder);
+  } while (!zero);
+  while (count <= scale) {
+    digits[count++] = '0';
+  }
+  int last = 0; // least significant digit written
+  while (last < scale && digits[last] == '0') {
+    last++;
+  }
+  size_t n = 0;
+  if (negative && n + 1 < size) {
+    out[n++] = '-';
+  }
+  for (int i = count - 1; i >= last && n + 2 < size; --i) {
+    out[n++] = digits[i];
+    if (i == scale && i > last) {
+      out[n++] = '.';
+    }
+  }
+  out[n] = '\0';
+}
+
+static void format_value(char *out, size_t size, const char *format,
+                         const struct ArrowArray *array, int64_t i) {
+  i += array->offset;
+  if (!strcmp(format, "u")) {
+    const int32_t *offsets = (const int32_t *)array->buffers[1];
+    const char *data = (const char *)array->buffers[2];
+    snprintf(out, size, "%.*s", (int)(offsets[i + 1] - offsets[i]), data + offsets[i]);
+  } else if (!strcmp(format, "g")) {
+    snprintf(out, size, "%.17g", ((const double *)array->buffers[1])[i]);
+  } else if (!strcmp(format, "b")) {
+    const unsigned char *bits = (const unsigned char *)array->buffers[1];
+    snprintf(out, size, "%s", (bits[i / 8] >> (i % 8)) & 1 ? "true" : "false");
+  } else if (!strcmp(format, "tsu:UTC")) {
+    snprintf(out, size, "%" PRId64, ((const int64_t *)array->buffers[1])[i]);
+  } else if (!strcmp(format, "tdD")) {
+    format_date(out, size, ((const int32_t *)array->buffers[1])[i]);
+  } else if (!strncmp(format, "d:38,", 5)) {
+    format_decimal(out, size, (const unsigned char *)array->buffers[1] + 16 * i,
+                   atoi(format + 5));
+  } else {
+    snprintf(out, size, "<format %s>", format);
+  }
+}
+
+// Metadata of the arrow.json extension type, as int32 count, then
+// length-prefixed key and value
+static int is_json_extension(const char *metadata) {
+  static const char KEY[] = "ARROW:extension:name";
+  static const char VALUE[] = "arrow.json";
+  int32_t count, key_size, value_size;
+  if (metadata == NULL) {
+    return 0;
+  }
+  memcpy(&count, metadata, 4);
+  memcpy(&key_size, metadata + 4, 4);
+  if (count != 1 || key_size != (int32_t)strlen(KEY) || memcmp(metadata + 8, KEY, strlen(KEY))) {
+    return 0;
+  }
+  memcpy(&value_size, metadata + 8 + key_size, 4);
+  return value_size == (int32_t)strlen(VALUE) &&
+         !memcmp(metadata + 12 + key_size, VALUE, strlen(VALUE));
+}
+
+// Buffers can only be read when their fields have the expected formats, so
+// this returns whether they do
+static int check_schema(const expected_file_t *expected, struct ArrowSchema *schema) {
+  int failed = failures;
+  if (strcmp(schema->format, "+s") || schema->n_children != (int64_t)expected->fields_count) {
+    fail("Schema isn't a struct of %s fields", expected->name);
+    schema->release(schema);
+    return 0;
+  }
+  for (size_t i = 0; i < expected->fields_count; ++i) {
+    const expected_field_t *field = &expected->fields[i];
+    const struct ArrowSchema *child = schema->children[i];
+    if (strcmp(child->name, field->name) || strcmp(child->format, field->format) ||
+        child->flags != field->flags || is_json_extension(child->metadata) != field->json ||
+        child->release == NULL) {
+      fail("Field %s doesn't have the expected name, format, flags or metadata", field->name);
+    }
+  }
+  schema->release(schema);
+  if (schema->release != NULL) {
+    fail("Release of the %s schema isn't marked", expected->name);
+  }
+  return failures == failed;
+}
+
+static void check_batch(const expected_file_t *expected, const struct ArrowArray *batch,
+                        size_t first_row) {
+  if (batch->length < 1 || batch->length > BATCH_SIZE ||
+      first_row + (size_t)batch->length > expected->rows_count ||
+      batch->n_children != (int64_t)expected->fields_count) {
+    fail("Batch of %s has an unexpected length or children", expected->name);
+    return;
+  }
+  for (size_t i = 0; i < expected->fields_count; ++i) {
+    const expected_field_t *field = &expected->fields[i];
+    const struct ArrowArray *column = batch->children[i];
+    if (column->length != batch->length || column->release == NULL ||
+        column->n_buffers != (!strcmp(field->format, "u") ? 3 : 2)) {
+      fail("Column %s has an unexpected length or buffers", field->name);
+      continue;
+    }
+    int64_t null_count = 0;
+    for (int64_t row = 0; row < column->length; ++row) {
+      const char *value = expected->rows[first_row + (size_t)row][i];
+      char text[256];
+      if (!is_valid(column, row)) {
+        null_count++;
+        if (value != NULL) {
+          fail("Value of %s is null", field->name);
+        }
+        continue;
+      }
+      format_value(text, sizeof(text), field->format, column, row);
+      if (value == NULL || strcmp(text, value)) {
+        fprintf(stderr, "Row %zu of %s is %s, expected %s\n", first_row + (size_t)row,
+                field->name, text, value != NULL ? value : "null");
+        failures++;
+      }
+    }
+    if (column->null_count != null_count) {
+      fail("Null count of %s doesn't match its validity bitmap", field->name);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  const expected_file_t *expected = NULL;
+  for (size_t i = 0; argc == 3 && i < sizeof(EXPECTED) / sizeof(EXPECTED[0]); ++i) {
+    if (!strcmp(argv[1], EXPECTED[i].name)) {
+      expected = &EXPECTED[i];
+    }
+  }
+  if (expected == NULL) {
+    fprintf(stderr, "Usage: %s file1|decimals|dates FILE\n", argv[0]);
+    return 2;
+  }
+
+  struct ArrowArrayStream stream;
+  if (avro2arrow_open(argv[2], BATCH_SIZE, &stream) != 0) {
+    fail("Cannot open %s", argv[2]);
+    return 1;
+  }
+  struct ArrowSchema schema;
+  if (stream.get_schema(&stream, &schema) != 0) {
+    fail("Cannot get schema: %s", stream.get_last_error(&stream));
+    stream.release(&stream);
+    return 1;
+  }
+  if (!check_schema(expected, &schema)) {
+    stream.release(&stream);
+    return 1;
+  }
+
+  struct ArrowArray batches[MAX_ROWS];
+  size_t batches_count = 0, rows = 0;
+  for (;;) {
+    struct ArrowArray *batch = &batches[batches_count];
+    if (stream.get_next(&stream, batch) != 0) {
+      fail("Cannot get next batch: %s", stream.get_last_error(&stream));
+      break;
+    }
+    if (batch->release == NULL) {
+      break;
+    }
+    check_batch(expected, batch, rows);
+    rows += (size_t)batch->length;
+    batches_count++;
+  }
+  if (rows != expected->rows_count) {
+    fail("Stream of %s doesn't have the expected number of rows", expected->name);
+  }
+
+  stream.release(&stream);
+  if (stream.release != NULL) {
+    fail("Release of the %s stream isn't marked", expected->name);
+  }
+  // Batches stay valid after the stream is released
+  for (size_t i = 0, row = 0; i < batches_count; ++i) {
+    check_batch(expected, &batches[i], row);
+    row += (size_t)batches[i].length;
+    batches[i].release(&batches[i]);
+    if (batches[i].release != NULL) {
+      fail("Release of a %s batch isn't marked", expected->name);
+    }
+  }
+  return failures > 0 ? 1 : 0;
+}
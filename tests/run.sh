@@ -42,3 +42,400 @@ run_test dates dates-l --logical-types
 run_test datetimes datetimes-l --logical-types
 run_test escaping escaping
 run_test datetimes-from-unix datetimes-from-unix --columns "[[\"UnixSeconds\",\"ts-s\"],[\"UnixMilliseconds\",\"ts-ms\"],[\"UnixNanoseconds\",\"ts-ns\"]]"
+run_test decimals-bytes decimals-bytes-scan --scan
+run_test columns columns-where --columns "[\"a\",\"d\"]" --where "a in ['a','c'] and d is not null"
+run_test columns columns-where-compare --columns "[\"a\",\"b\"]" --where "b >= 2 and c < 3.3"
+run_test columns columns-where-or --columns "[\"a\",\"b\"]" --where "b < 2 or not a != 'c'"
+run_test file1 file1-where-ne --where "f1 != 'x'"
+run_test file1 file1-where-null --where "f1 is null and f6 is null"
+run_test decimals-bytes decimals-bytes-sample-blocks --sample-blocks 0.5 --seed 42
+run_test decimals-bytes decimals-bytes-sample-rows --sample-rows 3 --seed 7
+run_test file1 file1 --memory-limit 1K
+run_test file1 file1 --async-io --io-depth 2
+run_test datetimes-from-unix datetimes-from-unix-transform --columns "[[\"UnixMicroseconds\",\"ts-us\"],[\"UnixSeconds\",\"real\"]]"
+run_test datetimes-from-unix datetimes-from-unix-overflow --columns "[[\"UnixMicroseconds\",\"ts-s\"],[\"UnixNanoseconds\",\"ts-ms\"],[\"UnixSeconds\",\"ts-ns\"]]"
+run_test decimals-bytes decimals-bytes-real --columns "[[\"n\",\"real\"]]"
+run_test decimals-bytes decimals-bytes-base64 --columns "[[\"n\",\"base64\"]]"
+run_test columns columns-scale --columns "[[\"b\",\"scale\",0.5],[\"c\",\"scale\",1000],\"a\"]"
+run_test escaping escaping-truncate --columns "[[\"field4\",\"truncate\",13],[\"field3\",\"truncate\",22]]"
+run_test nested nested-paths --columns "[\"id\",\"body.user.id\",\"body.props[\\\"k\\\"]\",\"body.user.name\"]"
+run_test nested nested-flatten --flatten
+run_test nested nested-rows --rows 1:3
+run_test corrupt-blocks corrupt-blocks --on-error=skip-block
+run_test file1 file1 --pipeline
+run_test file1 file1 --format-threads 4 --pipeline
+run_test corrupt-blocks corrupt-blocks --on-error=skip-block --pipeline
+
+# Resuming from the checkpoint of a finished conversion appends nothing more
+checkpoint="$tmpfile.checkpoint"
+echo "Running: ./avro2json --checkpoint $checkpoint ../tests/file1.avro (twice)"
+./avro2json --checkpoint "$checkpoint" ../tests/file1.avro > $tmpfile
+./avro2json --checkpoint "$checkpoint" ../tests/file1.avro >> $tmpfile
+rm -f "$checkpoint"
+if ! diff -a $tmpfile ../tests/file1.json; then
+  exit 1
+fi
+
+# A run failing on a block that isn't complete yet leaves the checkpoint after
+# the blocks before it. Runs with other output options refuse to resume it,
+# and the next one with the same options resumes there, without duplicated or
+# missing records.
+echo "Running: ./avro2json --flatten --checkpoint $checkpoint <truncated copy of ../tests/nested.avro> (three times)"
+head -c 540 ../tests/nested.avro > "$tmpfile.avro"
+./avro2json --flatten --checkpoint "$checkpoint" "$tmpfile.avro" > $tmpfile 2> /dev/null
+truncated_status=$?
+cp ../tests/nested.avro "$tmpfile.avro"
+./avro2json --checkpoint "$checkpoint" "$tmpfile.avro" >> $tmpfile 2> "$tmpfile.err"
+other_status=$?
+./avro2json --flatten --checkpoint "$checkpoint" "$tmpfile.avro" >> $tmpfile
+rm -f "$checkpoint" "$tmpfile.avro"
+if [ $truncated_status -eq 0 ] || [ $other_status -eq 0 ] ||
+   ! grep -q 'saved with other output options' "$tmpfile.err" ||
+   ! diff -a $tmpfile ../tests/nested-flatten.json; then
+  rm -f "$tmpfile.err"
+  exit 1
+fi
+rm -f "$tmpfile.err"
+
+# Partitions by value, concatenated in order of values, give the whole output
+prefix="$tmpfile-"
+echo "Running: ./avro2json --partition-by a --by-value ../tests/columns.avro"
+./avro2json --columns "[\"a\",\"d\"]" --partition-by a --by-value --max-open-partitions 1 \
+  --partition-prefix "$prefix" ../tests/columns.avro
+cat "${prefix}a.json" "${prefix}b.json" "${prefix}c.json" > $tmpfile
+rm -f "${prefix}"*.json
+if ! diff -a $tmpfile ../tests/columns-3.json; then
+  exit 1
+fi
+
+# Upper-case letters are escaped in names of partitions by value, which
+# case-insensitive file systems would otherwise share between values
+echo "Running: ./avro2json --partition-by field1 --by-value ../tests/escaping.avro"
+./avro2json --partition-by field1 --by-value --partition-prefix "$prefix" ../tests/escaping.avro
+cat "${prefix}%52egular%20string.json" "${prefix}%41nother%20regular%20string.json" > $tmpfile
+rm -f "${prefix}"*.json
+if ! diff -a $tmpfile ../tests/escaping.json; then
+  exit 1
+fi
+
+# Partitions by hash hold all the records between them, in at most the given
+# number of files, and evicting and reopening partitions with
+# --max-open-partitions 1 doesn't change any of them
+./avro2json ../tests/large-block.avro | sort > "$tmpfile.all"
+for partitions in 4 default; do
+  if [ $partitions = default ]; then
+    options=""
+    max=16
+  else
+    options="--partitions $partitions"
+    max=$partitions
+  fi
+  echo "Running: ./avro2json --partition-by id $options ../tests/large-block.avro"
+  ./avro2json --partition-by id $options --partition-prefix "${prefix}open-" ../tests/large-block.avro
+  ./avro2json --partition-by id $options --max-open-partitions 1 --partition-prefix "${prefix}evict-" \
+    ../tests/large-block.avro
+  cat "${prefix}open-"*.json | sort > $tmpfile
+  failed=0
+  if ! cmp $tmpfile "$tmpfile.all" ||
+     [ $(ls "${prefix}open-"*.json | wc -l) -ne $(ls "${prefix}evict-"*.json | wc -l) ]; then
+    failed=1
+  fi
+  for file in "${prefix}open-"*.json; do
+    partition=${file#${prefix}open-}
+    partition=${partition%.json}
+    if [ "$partition" -ge $max ] || ! cmp "$file" "${prefix}evict-$partition.json"; then
+      failed=1
+    fi
+  done
+  rm -f "${prefix}"*.json
+  if [ $failed -ne 0 ]; then
+    rm -f "$tmpfile.all"
+    exit 1
+  fi
+done
+rm -f "$tmpfile.all"
+
+# Uncompressed Parquet file matches the expected one byte for byte
+echo "Running: ./avro2json --parquet $tmpfile --parquet-codec none ../tests/file1.avro"
+./avro2json --parquet $tmpfile --parquet-codec none ../tests/file1.avro
+if ! cmp $tmpfile ../tests/file1.parquet; then
+  exit 1
+fi
+
+# Each of the outputs of a single pass matches its separate conversion
+outputs='[{"output":"'$tmpfile'.json","options":["--columns","[\"a\"]"]},
+          {"output":"-","options":["--csv","--columns","[\"a\",\"d\"]"]}]'
+echo "Running: ./avro2json --outputs '$outputs' ../tests/columns.avro"
+./avro2json --outputs "$outputs" ../tests/columns.avro > $tmpfile
+if ! diff -a $tmpfile ../tests/columns-3.csv || ! diff -a "$tmpfile.json" ../tests/columns-1.json; then
+  rm -f "$tmpfile.json"
+  exit 1
+fi
+rm -f "$tmpfile.json"
+
+# Rows found through the index match rows found by walking block headers,
+# and indexes of other files are rejected, even when they share the sync
+# marker of the file
+echo "Running: ./avro2json --build-index ../tests/nested.avro"
+cp ../tests/nested.avro "$tmpfile.avro"
+./avro2json --build-index "$tmpfile.avro"
+./avro2json --rows 2:3 "$tmpfile.avro" > $tmpfile
+if ! diff -a $tmpfile ../tests/nested-rows-index.json; then
+  rm -f "$tmpfile.avro" "$tmpfile.avro.avroidx"
+  exit 1
+fi
+for other in file1 large-block; do
+  echo "Running: ./avro2json --rows 2:3 <nested.avro with index of $other.avro>"
+  cp ../tests/$other.avro "$tmpfile.other.avro"
+  ./avro2json --build-index "$tmpfile.other.avro"
+  mv "$tmpfile.other.avro.avroidx" "$tmpfile.avro.avroidx"
+  rm -f "$tmpfile.other.avro"
+  if ./avro2json --rows 2:3 "$tmpfile.avro" > $tmpfile 2>&1 ||
+     ! grep -q -e "was built for another file" -e "doesn't match the file" $tmpfile; then
+    rm -f "$tmpfile.avro" "$tmpfile.avro.avroidx"
+    exit 1
+  fi
+done
+rm -f "$tmpfile.avro" "$tmpfile.avro.avroidx"
+
+# Memory statistics go to stderr, one line per block and one per file, and
+# everything allocated for the file is freed by its end
+if [ "$(uname)" = "Linux" ]; then
+  echo "Running: ./avro2json --mem-stats --flatten ../tests/nested.avro"
+  ./avro2json --mem-stats --flatten ../tests/nested.avro > $tmpfile 2> "$tmpfile.stats"
+  blocks=$(grep -c '^{"mem_stats":"block","file":"../tests/nested.avro","block":[01],' "$tmpfile.stats")
+  live=$(sed -n 's/^{"mem_stats":"file",[^{]*"start_live_bytes":\([0-9]*\),"live_bytes":\([0-9]*\),.*/\1 \2/p' "$tmpfile.stats")
+  if ! diff -a $tmpfile ../tests/nested-flatten.json || [ "$blocks" != 2 ] ||
+     [ -z "$live" ] || [ "${live% *}" != "${live#* }" ]; then
+    cat "$tmpfile.stats"
+    rm -f "$tmpfile.stats"
+    exit 1
+  fi
+
+  # Lookups of formatted values are reported too, hitting for repeated ones
+  echo "Running: ./avro2json --mem-stats --logical-types ../tests/memo.avro"
+  ./avro2json --mem-stats --logical-types ../tests/memo.avro > $tmpfile 2> "$tmpfile.stats"
+  if ! diff -a $tmpfile ../tests/memo-l.json ||
+     ! grep -q '^{"memo_stats":"file","file":"../tests/memo.avro","lookups":12,"hits":8,' "$tmpfile.stats"; then
+    cat "$tmpfile.stats"
+    rm -f "$tmpfile.stats"
+    exit 1
+  fi
+  rm -f "$tmpfile.stats"
+fi
+
+# A converter generated for the schema converts its files like the generic
+# conversion, and files of other schemas, or of the same schema without its
+# logical types, are converted as usual. It's built against the Avro library
+# found by CMake, which may be a copy other than that linked into avro2json, so
+# errors it meets must still be reported like those of the generic conversion.
+# It needs a C compiler and the shared library flags of Linux or macOS.
+if command -v cc > /dev/null 2>&1 && { [ "$(uname)" = "Linux" ] || [ "$(uname)" = "Darwin" ]; }; then
+  avro_include=$(sed -n 's/^AVRO_INCLUDE_DIR:[A-Z]*=//p' CMakeCache.txt)
+  avro_libdir=$(dirname "$(sed -n 's/^AVRO_LIBRARY:[A-Z]*=//p' CMakeCache.txt)")
+  gmp_library=$(sed -n 's/^GMP_LIBRARY:[A-Z]*=//p' CMakeCache.txt)
+  echo "Running: ./avro2json --converter <generated> --logical-types ../tests/datetimes.avro"
+  ./avro2json --emit-converter --logical-types ../tests/datetimes.avro > "$tmpfile.c"
+  cc -O2 -shared -fPIC -I../src -I"$avro_include" -o "$tmpfile.so" "$tmpfile.c" ../src/binary.c \
+    ../src/format.c ../src/logical.c -L"$avro_libdir" -Wl,-rpath,"$avro_libdir" -lavro "$gmp_library"
+  ./avro2json --converter "$tmpfile.so" --logical-types ../tests/datetimes.avro > $tmpfile
+  ./avro2json --converter "$tmpfile.so" --logical-types ../tests/dates.avro > "$tmpfile.other"
+  ./avro2json --converter "$tmpfile.so" --logical-types ../tests/datetimes-plain.avro > "$tmpfile.plain"
+  if ./avro2json --converter "$tmpfile.so" --logical-types ../tests/datetimes-truncated.avro \
+       > /dev/null 2> "$tmpfile.error" ||
+     ./avro2json --logical-types ../tests/datetimes-truncated.avro > /dev/null 2> "$tmpfile.expected"; then
+    echo "Truncated record was converted"
+    rm -f "$tmpfile.c" "$tmpfile.so" "$tmpfile.other" "$tmpfile.plain" "$tmpfile.error" "$tmpfile.expected"
+    exit 1
+  fi
+  rm -f "$tmpfile.c" "$tmpfile.so"
+  if ! diff -a $tmpfile ../tests/datetimes-l.json || ! diff -a "$tmpfile.other" ../tests/dates-l.json ||
+     ! diff -a "$tmpfile.plain" ../tests/datetimes-plain.json || ! grep -q . "$tmpfile.error" ||
+     ! diff -a "$tmpfile.error" "$tmpfile.expected"; then
+    rm -f "$tmpfile.other" "$tmpfile.plain" "$tmpfile.error" "$tmpfile.expected"
+    exit 1
+  fi
+  rm -f "$tmpfile.other" "$tmpfile.plain" "$tmpfile.error" "$tmpfile.expected"
+fi
+
+# Datums outside container files convert like the records of the file, read
+# from a file or from standard input
+echo "Running: ./avro2json --datums length-prefixed --schema ../tests/file1.avsc ../tests/file1-datums.bin"
+./avro2json --datums length-prefixed --schema ../tests/file1.avsc ../tests/file1-datums.bin > $tmpfile
+if ! diff -a $tmpfile ../tests/file1.json; then
+  exit 1
+fi
+echo "Running: ./avro2json --datums single-object --schema ../tests/file1.avsc - < ../tests/file1-single-object.bin"
+./avro2json --datums single-object --schema ../tests/file1.avsc - < ../tests/file1-single-object.bin > $tmpfile
+if ! diff -a $tmpfile ../tests/file1.json; then
+  exit 1
+fi
+
+# A directory of schema files gives the schema of every single-object datum by
+# its fingerprint, so that a stream can mix schemas; datums of other schemas
+# are rejected
+echo "Running: ./avro2json --datums single-object --schema ../tests/single-object-schemas ../tests/file1-single-object.bin"
+./avro2json --datums single-object --schema ../tests/single-object-schemas ../tests/file1-single-object.bin > $tmpfile
+if ! diff -a $tmpfile ../tests/file1.json; then
+  exit 1
+fi
+echo "Running: ./avro2json --datums single-object --schema ../tests/single-object-schemas ../tests/single-object-mixed.bin"
+./avro2json --datums single-object --schema ../tests/single-object-schemas ../tests/single-object-mixed.bin > $tmpfile
+if ! diff -a $tmpfile ../tests/single-object-mixed.json; then
+  exit 1
+fi
+echo "Running: ./avro2json --datums single-object --schema ../tests/single-object-schemas ../tests/single-object-unknown.bin"
+if ./avro2json --datums single-object --schema ../tests/single-object-schemas ../tests/single-object-unknown.bin \
+     > /dev/null 2> $tmpfile ||
+   ! grep -q "No schema with fingerprint 8f014872634503c7 for datum at offset 38" $tmpfile; then
+  cat $tmpfile
+  exit 1
+fi
+
+# A malformed datum, here with union branch 5 in its first field, is reported
+# at once rather than waited on as if more of it were to come
+if command -v timeout > /dev/null 2>&1; then
+  echo "Running: ./avro2json --datums single-object --schema ../tests/file1.avsc - < <malformed datum, then open input>"
+  { head -c 10 ../tests/file1-single-object.bin; printf '\012'; sleep 10; } |
+    timeout 5 ./avro2json --datums single-object --schema ../tests/file1.avsc - > /dev/null 2> $tmpfile
+  status=$?
+  if [ $status -eq 0 ] || [ $status -eq 124 ] || ! grep -q "Truncated or malformed datum" $tmpfile; then
+    cat $tmpfile
+    exit 1
+  fi
+fi
+
+# Jobs of --serve whose schemas only differ in logical types don't share
+# their cached value interfaces, and jobs are rejected for the same
+# combinations of options as the command line
+if command -v python3 > /dev/null 2>&1; then
+  echo "Running: ./avro2json --serve $tmpfile.sock --workers 1"
+  ./avro2json --serve "$tmpfile.sock" --workers 1 &
+  server=$!
+  if python3 - "$tmpfile" <<'PYTHON'
+import json, socket, sys, time
+tmpfile = sys.argv[1]
+conn = socket.socket(socket.AF_UNIX)
+for attempt in range(100):
+    try:
+        conn.connect(tmpfile + ".sock")
+        break
+    except OSError:
+        time.sleep(0.1)
+responses = conn.makefile("r")
+for i, name in enumerate(["datetimes", "datetimes-plain", "datetimes"]):
+    job = {"id": i, "input": "../tests/%s.avro" % name, "output": "%s.%d" % (tmpfile, i),
+           "options": ["--logical-types"]}
+    conn.sendall((json.dumps(job) + "\n").encode())
+    response = json.loads(responses.readline())
+    if response.get("status") != "ok":
+        sys.exit("Job %d failed: %s" % (i, response))
+job = {"id": 3, "input": "../tests/file1.avro", "output": tmpfile + ".3",
+       "options": ["--pipeline", "--sample-rows", "1"]}
+conn.sendall((json.dumps(job) + "\n").encode())
+response = json.loads(responses.readline())
+if response.get("status") != "error" or "can't be combined" not in response.get("error", ""):
+    sys.exit("Job 3 wasn't rejected: %s" % response)
+PYTHON
+  then status=0; else status=$?; fi
+  kill $server
+  wait $server || true
+  if [ $status -ne 0 ] || ! diff -a "$tmpfile.0" ../tests/datetimes-l.json ||
+     ! diff -a "$tmpfile.1" ../tests/datetimes-plain.json || ! diff -a "$tmpfile.2" ../tests/datetimes-l.json; then
+    rm -f "$tmpfile".[0123]
+    exit 1
+  fi
+  rm -f "$tmpfile".[0123]
+fi
+
+# Blocks over --memory-limit fail the conversion, whether compressed or once
+# decompressed: the block of large-block.avro deflates over 1 MiB into 7 KiB, and
+# is rejected before any of its records is written
+echo "Running: ./avro2json --memory-limit 32K ../tests/large-block.avro"
+./avro2json --memory-limit 32K ../tests/large-block.avro > $tmpfile 2> "$tmpfile.err"
+status=$?
+if [ $status -eq 0 ] || [ -s $tmpfile ] ||
+   ! grep -q 'Block at offset [0-9]* decompresses to more than the memory limit of 32768 bytes' "$tmpfile.err"; then
+  rm -f "$tmpfile.err"
+  exit 1
+fi
+echo "Running: ./avro2json --memory-limit 4K ../tests/large-block.avro"
+./avro2json --memory-limit 4K ../tests/large-block.avro > $tmpfile 2> "$tmpfile.err"
+status=$?
+if [ $status -eq 0 ] || ! grep -q 'Block of [0-9]* bytes at offset [0-9]* exceeds memory limit' "$tmpfile.err"; then
+  rm -f "$tmpfile.err"
+  exit 1
+fi
+rm -f "$tmpfile.err"
+
+# Skipping corrupt blocks seeks back in the input, so inputs that can't seek
+# are rejected before being read
+if mkfifo "$tmpfile.fifo" 2> /dev/null; then
+  echo "Running: ./avro2json --on-error=skip-block <fifo>"
+  ./avro2json --on-error=skip-block "$tmpfile.fifo" > $tmpfile 2>&1
+  status=$?
+  rm -f "$tmpfile.fifo"
+  if [ $status -eq 0 ] || ! grep -q 'needs a seekable input' $tmpfile; then
+    exit 1
+  fi
+fi
+
+# Blocks appended to a followed file are converted once complete
+if command -v timeout > /dev/null 2>&1; then
+  echo "Running: ./avro2json --follow --flatten <growing copy of ../tests/nested.avro>"
+  head -c 527 ../tests/nested.avro > "$tmpfile.avro"
+  timeout 5 ./avro2json --follow --flatten "$tmpfile.avro" > $tmpfile &
+  follower=$!
+  sleep 1
+  # Second block in two parts, the first of them ending within its records
+  tail -c +528 ../tests/nested.avro | head -c 16 >> "$tmpfile.avro"
+  sleep 1
+  tail -c +544 ../tests/nested.avro >> "$tmpfile.avro"
+  wait $follower || true
+  rm -f "$tmpfile.avro"
+  if ! diff -a $tmpfile ../tests/nested-flatten.json; then
+    exit 1
+  fi
+fi
+
+# Outputs of --outputs can't share a file, standard output included
+for outputs in '[{"output":"-"},{"output":"-","options":["--csv"]}]' \
+               '[{"output":"'$tmpfile'.json"},{"output":"'$tmpfile'.json","options":["--csv"]}]'; do
+  echo "Running: ./avro2json --outputs '$outputs' ../tests/columns.avro"
+  if ./avro2json --outputs "$outputs" ../tests/columns.avro > $tmpfile 2>&1 ||
+     ! grep -q -e "Only one output of --outputs can be '-'" -e "Outputs 1 and 2 of --outputs both write to" $tmpfile; then
+    rm -f "$tmpfile.json"
+    exit 1
+  fi
+done
+rm -f "$tmpfile.json"
+
+# Blocks of over 1 MiB are formatted by several threads, giving the same
+# output as a single thread
+for options in "" "--where id<50" "--csv"; do
+  echo "Running: ./avro2json --format-threads 4 $options ../tests/large-block.avro"
+  ./avro2json $options ../tests/large-block.avro > "$tmpfile.single"
+  ./avro2json --format-threads 4 $options ../tests/large-block.avro > $tmpfile
+  if [ ! -s $tmpfile ] || ! cmp $tmpfile "$tmpfile.single"; then
+    rm -f "$tmpfile.single"
+    exit 1
+  fi
+done
+rm -f "$tmpfile.single"
+
+# Consumers of the avro2arrow library get record batches with the expected
+# types, buffers and null counts through the Arrow C stream interface. The
+# library isn't there when built with -DAVRO2ARROW=OFF, and the consumer needs
+# a C compiler and the linker flags of Linux or macOS.
+if { [ -f libavro2arrow.so ] || [ -f libavro2arrow.dylib ]; } && command -v cc > /dev/null 2>&1 &&
+   { [ "$(uname)" = "Linux" ] || [ "$(uname)" = "Darwin" ]; }; then
+  cc -I../src -o "$tmpfile.consumer" ../tests/arrow-consumer.c -L. -lavro2arrow -Wl,-rpath,"$(pwd)"
+  for name in file1 decimals dates; do
+    echo "Running: arrow-consumer $name ../tests/$name.avro"
+    if ! "$tmpfile.consumer" $name ../tests/$name.avro; then
+      rm -f "$tmpfile.consumer"
+      exit 1
+    fi
+  done
+  rm -f "$tmpfile.consumer"
+fi